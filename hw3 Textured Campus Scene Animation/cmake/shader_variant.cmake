@@ -0,0 +1,25 @@
+# 由 GL 的 shader 原始碼產生 Vulkan 的 variant (跟 shader_variant() 一樣換掉第一行的 #version 再加 define),
+# 再交給 glslangValidator 編成 SPIR-V.
+# 用法: cmake -DINPUT=... -DOUTPUT=... -DSTAGE=vert|frag -DDEFINES="A,B" -DGLSLANG=... -P shader_variant.cmake
+file(READ "${INPUT}" source)
+string(FIND "${source}" "\n" firstLine)
+math(EXPR bodyStart "${firstLine} + 1")
+string(SUBSTRING "${source}" ${bodyStart} -1 body)
+
+set(header "#version 450\n#extension GL_EXT_nonuniform_qualifier : require\n")
+string(REPLACE "," ";" defineList "${DEFINES}")
+foreach(define IN LISTS defineList)
+    string(APPEND header "#define ${define}\n")
+endforeach()
+
+set(variant "${OUTPUT}.glsl")
+file(WRITE "${variant}" "${header}${body}")
+execute_process(
+    COMMAND "${GLSLANG}" -V --target-env vulkan1.2 -S ${STAGE} -o "${OUTPUT}" "${variant}"
+    RESULT_VARIABLE result
+    OUTPUT_VARIABLE log
+    ERROR_VARIABLE log
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "glslangValidator failed for ${INPUT}:\n${log}")
+endif()
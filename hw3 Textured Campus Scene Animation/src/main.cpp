@@ -1,5 +1,7 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -10,6 +12,34 @@
 #include "utils/utils.h"
 #include "utils/callbacks.h"
 #include "utils/camera_path.h"
+#include "utils/mesh.h"
+#include "utils/shader.h"
+#include "utils/mdi_renderer.h"
+#include "utils/texture_array.h"
+#include "utils/occlusion_culler.h"
+#include "utils/pvs.h"
+#include "utils/impostor.h"
+#include "utils/hlod.h"
+#include "utils/instancing.h"
+#include "utils/clustered_lights.h"
+#include "utils/shadow_cascades.h"
+#include "utils/lightmap.h"
+#include "utils/vertex_ao.h"
+#include "utils/irradiance_volume.h"
+#include "utils/distance_field.h"
+#include "utils/render_graph.h"
+#include "utils/frame_sequence.h"
+#include "utils/frame_capture.h"
+#include "utils/tiled_poster.h"
+#include "utils/aov_writer.h"
+#include "utils/software_rasterizer.h"
+#include "utils/path_tracer.h"
+#include "utils/triple_buffer.h"
+#include "utils/dynamic_buffer.h"
+#include "utils/geometry_arena.h"
+#ifdef HW3_VULKAN
+#include "utils/vulkan_renderer.h"
+#endif
 
 #include <iostream>
 #include <fstream>
@@ -17,28 +47,54 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <atomic>
+#include <thread>
+#include <array>
+#include <iomanip>
 // #include <unistd.h>
-// #include <filesystem>
 
 // Window
 #define WIDTH 800
 #define HEIGHT 600
+#define NEAR_PLANE 0.001f
+#define FAR_PLANE 10.0f
 GLFWwindow *window;
 CameraPath mainPath;
 bool useManual = true;
 bool usePathCamera = !useManual; // 是否使用路徑相機
 bool manualControl = useManual;  // 手動控制模式
+bool useMdi = true;              // GL 4.3+ 時用 multi-draw indirect, 否則退回逐 mesh 繪製
+bool useTextureArrays = true;    // 貼圖打包成 GL_TEXTURE_2D_ARRAY, 材質只記 (array, layer)
+bool useOcclusionCulling = true; // CPU Hi-Z occlusion culling
+bool usePvs = true;              // 預先烘焙的 view cell 可見集合
+bool useImpostors = true;        // 遠處的建築換成 octahedral impostor
+bool useHlod = true;             // 遠處整區換成合併簡化過的代理 mesh
+bool useInstancing = true;       // 重複的幾何只存一份, 用 instanced draw 一次畫完
+bool usePersistentBuffer = true; // 每幀的動態資料用 persistent mapped ring, 否則 (或不支援時) 退回 orphaning
+bool useClusteredLights = true;  // emissive 材質與光源檔的點光源, 用 clustered forward 打光
+bool useLightmap = true;         // 預先烘焙的 lightmap, 靜態表面的漫射光只剩一次貼圖讀取
+bool useShadows = true;          // 快取的 cascaded shadow map, 只有光源變了或相機跨過格子才重畫
+bool useVertexAo = true;         // 預先烘焙的逐頂點 ambient occlusion, 乘進 ambient
+bool useProbes = true;           // 預先烘焙的 irradiance probe, 沒有 lightmap 的表面用來取代常數 ambient
+bool useSdf = true;              // 預先烘焙的稀疏距離場, 軟陰影與逐像素 AO
+bool useRenderGraph = true;      // pass 透過 render graph 排程, 畫到 transient texture 再 present
+bool useVisibilityBuffer = false; // visibility buffer 路徑 (V 鍵切換): 先只寫三角形 ID, 再全螢幕每個像素打光一次
+glm::vec3 mainLightPos(10.0f);   // 主光源 (太陽) 位置
+glm::vec3 mainLightColor(1.0f);  // 主光源顏色, 夜景調暗讓點光源看得出來
 
 // load shader
 std::string vertexCode = load_shader_source("../src/shaders/vertex.glsl");
 std::string fragmentCode = load_shader_source("../src/shaders/fragment.glsl");
-const char *vertexShaderSource = vertexCode.c_str();
-const char *fragmentShaderSource = fragmentCode.c_str();
 
-void normalize_vertices(std::vector<glm::vec3> &vertices)
+// 回傳 obj 座標到正規化後座標的轉換 (光源檔等外部資料要用)
+glm::mat4 normalize_vertices(std::vector<glm::vec3> &vertices)
 {
   if (vertices.empty())
-    return;
+    return glm::mat4(1.0f);
 
   // Find min and max values for each axis
   float minX = vertices[0].x, maxX = vertices[0].x;
@@ -76,6 +132,8 @@ void normalize_vertices(std::vector<glm::vec3> &vertices)
     vertex.y = (vertex.y - centerY) * scale;
     vertex.z = (vertex.z - centerZ) * scale;
   }
+  return glm::scale(glm::mat4(1.0f), glm::vec3(scale)) *
+         glm::translate(glm::mat4(1.0f), glm::vec3(-centerX, -centerY, -centerZ));
 }
 
 glm::vec3 read_vec3(std::vector<std::string> words, glm::mat4 preTransform, float w)
@@ -148,34 +206,18 @@ void read_face(std::vector<std::string> words,
   }
 }
 
-struct Material
-{
-  std::string name;
-  glm::vec3 Ka{0.0f};             // ambient
-  glm::vec3 Kd{0.0f};             // diffuse
-  glm::vec3 Ks{0.0f};             // specular
-  glm::vec3 Ke{0.0f};             // emissive
-  float Ns = 0.0f;                // shininess
-  float Ni = 1.0f;                // optical density (refraction)
-  float d = 1.0f;                 // dissolve
-  int illum = 0;                  // illumination model
-  std::string diffuseTexPath;     //
-  std::string normalTexPath;      //
-  std::string specularTexPath;    //
-  std::string alphaTexPath;       //
-  unsigned int diffuseTexID = 0;  //
-  unsigned int specularTexID = 0; //
-};
-
-struct Mesh
-{
-  std::vector<float> vertices;
-  Material *material;
-  unsigned int VAO, VBO;
-};
-
 std::vector<Mesh> meshes;
 std::map<std::string, Material> g_materials;
+MeshInstancer instancer;
+GeometryArena geometryArena;
+DynamicBuffer dynamicBuffer;
+ClusteredLights clusteredLights;
+ShadowCascades shadowCascades;
+Lightmapper lightmapper;
+IrradianceVolume irradianceVolume;
+DistanceField distanceField;
+RenderGraph renderGraph;
+glm::mat4 g_objToScene(1.0f); // obj 座標 -> 場景座標 (preTransform + 正規化)
 
 void load_mtl(const std::string &mtlPath, std::map<std::string, Material> &materials)
 {
@@ -404,9 +446,11 @@ bool load_obj(const std::string &objPath, glm::mat4 preTransform)
       std::string mtlFile = line.substr(7);
       load_mtl(dir + mtlFile, g_materials);
 
-      // 載入貼圖到 GPU
+      // 載入貼圖到 GPU (貼圖陣列模式在 load_obj 之後統一打包)
       for (auto &[name, mat] : g_materials)
       {
+        if (useTextureArrays)
+          break;
         if (!mat.diffuseTexPath.empty())
           mat.diffuseTexID = load_texture(mat.diffuseTexPath);
         if (!mat.specularTexPath.empty())
@@ -428,7 +472,7 @@ bool load_obj(const std::string &objPath, glm::mat4 preTransform)
   }
   file.close();
 
-  normalize_vertices(v);
+  g_objToScene = normalize_vertices(v) * preTransform;
 
   file.open(objPath);
   // 二讀 usemtl, f 建立 meshes
@@ -470,28 +514,807 @@ bool load_obj(const std::string &objPath, glm::mat4 preTransform)
   return true;
 }
 
-int main()
+// ========== shader 變體 ==========
+// 逐 mesh 版本用 330, MDI 版本用 430 + USE_MDI, 其餘功能以 #define 開關
+std::vector<std::string> shader_defines(bool mdi)
+{
+  std::vector<std::string> defines;
+  if (mdi)
+    defines.push_back("USE_MDI");
+  if (useTextureArrays)
+    defines.push_back("USE_TEXTURE_ARRAYS");
+  if (useClusteredLights)
+    defines.push_back("USE_CLUSTERED_LIGHTS");
+  if (useShadows)
+    defines.push_back("USE_SHADOWS");
+  if (useLightmap)
+    defines.push_back("USE_LIGHTMAP");
+  if (useVertexAo)
+    defines.push_back("USE_VERTEX_AO");
+  if (useProbes)
+    defines.push_back("USE_PROBES");
+  if (useSdf)
+    defines.push_back("USE_SDF");
+  return defines;
+}
+
+// ========== 每幀共用的 uniform ==========
+void set_frame_uniforms(unsigned int program, const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &viewPos)
+{
+  glUseProgram(program);
+  glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+  glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+
+  // light
+  glUniform3fv(glGetUniformLocation(program, "lightPos"), 1, glm::value_ptr(mainLightPos));
+  glUniform3fv(glGetUniformLocation(program, "viewPos"), 1, glm::value_ptr(viewPos));
+  glUniform3fv(glGetUniformLocation(program, "lightColor"), 1, glm::value_ptr(mainLightColor));
+
+  // Texture Sampler Units
+  glUniform1i(glGetUniformLocation(program, "diffuseMap"), 0);
+  glUniform1i(glGetUniformLocation(program, "specularMap"), 1);
+}
+
+// ========== 逐 mesh 繪製 (GL 3.3 fallback) ==========
+// 材質 uniform 與貼圖; bound* 記錄目前 bind 的貼圖陣列, 沒換就不重新 bind
+void bind_material(unsigned int program, const Material *mat, unsigned int whiteTexture,
+                   unsigned int &boundDiffuse, unsigned int &boundSpecular)
+{
+  // 傳遞材質屬性
+  glUniform3fv(glGetUniformLocation(program, "material_Ka"), 1, glm::value_ptr(mat->Ka));
+  glUniform3fv(glGetUniformLocation(program, "material_Kd"), 1, glm::value_ptr(mat->Kd));
+  glUniform3fv(glGetUniformLocation(program, "material_Ks"), 1, glm::value_ptr(mat->Ks));
+  glUniform3fv(glGetUniformLocation(program, "material_Ke"), 1, glm::value_ptr(mat->Ke));
+  glUniform1f(glGetUniformLocation(program, "material_Ns"), mat->Ns);
+  glUniform1f(glGetUniformLocation(program, "material_d"), mat->d);
+
+  if (useTextureArrays)
+  {
+    // 只有 array 換了才重新 bind, 同一個 array 裡的材質只改 layer uniform
+    unsigned int diffuseArray = mat->diffuseArray >= 0 ? g_textureArrays[mat->diffuseArray].id : g_whiteTextureArray;
+    unsigned int specularArray = mat->specularArray >= 0 ? g_textureArrays[mat->specularArray].id : g_whiteTextureArray;
+    if (diffuseArray != boundDiffuse)
+    {
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, diffuseArray);
+      boundDiffuse = diffuseArray;
+    }
+    if (specularArray != boundSpecular)
+    {
+      glActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, specularArray);
+      boundSpecular = specularArray;
+    }
+    glUniform1i(glGetUniformLocation(program, "hasDiffuseMap"), mat->diffuseArray >= 0);
+    glUniform1i(glGetUniformLocation(program, "hasSpecularMap"), mat->specularArray >= 0);
+    glUniform1i(glGetUniformLocation(program, "diffuseLayer"), std::max(mat->diffuseLayer, 0));
+    glUniform1i(glGetUniformLocation(program, "specularLayer"), std::max(mat->specularLayer, 0));
+  }
+  else
+  {
+    // Diffuse 紋理 (Texture Unit 0)
+    if (mat->diffuseTexID != 0)
+    {
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D, mat->diffuseTexID);
+      glUniform1i(glGetUniformLocation(program, "hasDiffuseMap"), 1);
+    }
+    else
+    {
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D, whiteTexture);
+      glUniform1i(glGetUniformLocation(program, "hasDiffuseMap"), 0);
+    }
+
+    // Specular 紋理 (Texture Unit 1)
+    if (mat->specularTexID != 0)
+    {
+      glActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_2D, mat->specularTexID);
+      glUniform1i(glGetUniformLocation(program, "hasSpecularMap"), 1);
+    }
+    else
+    {
+      glActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_2D, whiteTexture);
+      glUniform1i(glGetUniformLocation(program, "hasSpecularMap"), 0);
+    }
+  }
+}
+
+void draw_meshes(unsigned int program, const std::vector<unsigned int> &visible, unsigned int whiteTexture)
+{
+  unsigned int boundDiffuse = 0, boundSpecular = 0;
+  int boundPage = -1;
+
+  // instancing 的 mesh 依 shape 收集起來, 最後每個 shape 一次 instanced draw
+  static std::vector<unsigned int> remaining;
+  const std::vector<unsigned int> *list = &visible;
+  if (useInstancing)
+  {
+    instancer.gather(meshes, visible, remaining);
+    list = &remaining;
+  }
+
+  for (unsigned int meshIndex : *list)
+  {
+    Mesh &mesh = meshes[meshIndex];
+
+    // model 與 fade 是頂點屬性 (location 3~7), 一般 mesh 直接設目前值;
+    // lightmap UV 與 AO 在 arena 的頂點裡 (沒有的填了 -1, -1 與 1)
+    for (int c = 0; c < 4; ++c)
+      glVertexAttrib4fv(3 + c, glm::value_ptr(mesh.transform[c]));
+    glVertexAttrib1f(7, mesh.fade);
+
+    bind_material(program, mesh.material, whiteTexture, boundDiffuse, boundSpecular);
+
+    // 連續的 mesh 在同一個 page 就不用換 VAO
+    int page = geometryArena.range(mesh.geometry).page;
+    if (page != boundPage)
+    {
+      geometryArena.bind(page);
+      boundPage = page;
+    }
+    geometryArena.draw(mesh.geometry);
+  }
+
+  if (useInstancing)
+  {
+    // instancing 的 shape 沒有 lightmap
+    if (useLightmap)
+      glVertexAttrib2f(8, -1.0f, -1.0f);
+    instancer.draw(meshes, [&](const Material *mat)
+                   { bind_material(program, mat, whiteTexture, boundDiffuse, boundSpecular); });
+  }
+}
+
+// ========== draw call 數量 benchmark ==========
+// 把可見清單重複 N 次送出 (同樣的幾何, 深度測試會擋掉大部分 fragment),
+// 比較逐 mesh 與 MDI 兩條路徑的 CPU 送出時間與 GPU 時間
+void run_draw_benchmark(unsigned int legacyProgram, unsigned int mdiProgram, MdiRenderer *mdi,
+                        const std::vector<unsigned int> &visible, unsigned int whiteTexture,
+                        const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &viewPos)
+{
+  const int warmupFrames = 5;
+  const int measureFrames = 30;
+
+  unsigned int query;
+  glGenQueries(1, &query);
+
+  std::cout << "\n=== Draw count scaling benchmark ===" << std::endl;
+  std::cout << "path    draws   submit calls   cpu ms   gpu ms" << std::endl;
+
+  for (int scale = 1; scale <= 64; scale *= 2)
+  {
+    std::vector<unsigned int> list;
+    for (int k = 0; k < scale; ++k)
+      list.insert(list.end(), visible.begin(), visible.end());
+
+    for (int path = 0; path < 2; ++path)
+    {
+      bool mdiPath = path == 1;
+      if (mdiPath && !mdi)
+        continue;
+
+      unsigned int program = mdiPath ? mdiProgram : legacyProgram;
+      set_frame_uniforms(program, view, projection, viewPos);
+      if (useClusteredLights)
+      {
+        clusteredLights.update(view, projection, NEAR_PLANE, FAR_PLANE);
+        clusteredLights.bind(program);
+      }
+      if (useShadows)
+        shadowCascades.bind(program);
+      if (useLightmap)
+        lightmapper.bind(program);
+      if (useProbes)
+        irradianceVolume.bind(program);
+      if (useSdf)
+        distanceField.bind(program);
+
+      double cpuTotal = 0.0, gpuTotal = 0.0;
+      int submitCalls = list.size();
+      for (int frame = 0; frame < warmupFrames + measureFrames; ++frame)
+      {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        dynamicBuffer.begin_frame();
+        glBeginQuery(GL_TIME_ELAPSED, query);
+
+        auto begin = std::chrono::high_resolution_clock::now();
+        if (mdiPath)
+        {
+          mdi->draw(program, list, whiteTexture);
+          submitCalls = mdi->lastBatchCount;
+        }
+        else
+        {
+          draw_meshes(program, list, whiteTexture);
+          if (useInstancing)
+            submitCalls = list.size() - instancer.lastInstances + instancer.lastDrawCalls;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        glEndQuery(GL_TIME_ELAPSED);
+        dynamicBuffer.end_frame();
+        GLuint64 gpuNs = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &gpuNs);
+
+        if (frame >= warmupFrames)
+        {
+          cpuTotal += std::chrono::duration<double, std::milli>(end - begin).count();
+          gpuTotal += gpuNs / 1.0e6;
+        }
+      }
+
+      std::printf("%-6s %7zu %14d %8.3f %8.3f\n", mdiPath ? "mdi" : "legacy", list.size(), submitCalls,
+                  cpuTotal / measureFrames, gpuTotal / measureFrames);
+    }
+  }
+
+  glDeleteQueries(1, &query);
+}
+
+// ========== shadow 快取 benchmark ==========
+// 以固定的 1/60 秒沿 mainPath 走一趟, 比較快取 (只重畫跨格的 cascade) 與每幀全部重畫的 shadow pass 成本
+void run_shadow_benchmark(CameraPath path, const std::vector<unsigned int> &casters,
+                          const std::vector<unsigned int> &dynamicMeshes, const ShadowCascades::DrawFunc &draw)
+{
+  const float dt = 1.0f / 60.0f;
+  const int framesPerRow = 60;
+  path.loop = false;
+
+  GLuint query = 0;
+  glGenQueries(1, &query);
+
+  // mode 0: 快取, mode 1: 每幀全部重畫
+  std::vector<double> cpuMs[2], gpuMs[2];
+  std::vector<int> redraws[2];
+  for (int mode = 0; mode < 2; ++mode)
+  {
+    path.play();
+    shadowCascades.invalidate();
+    glm::vec3 eye = cameraPos, lookAt = cameraPos + cameraFront; // path.update 沒寫入時的預設值
+    while (path.isPlaying)
+    {
+      path.update(dt, eye, lookAt, false);
+      if (mode == 1)
+        shadowCascades.invalidate();
+
+      dynamicBuffer.begin_frame();
+      glBeginQuery(GL_TIME_ELAPSED, query);
+      auto begin = std::chrono::high_resolution_clock::now();
+      shadowCascades.update(mainLightPos, eye, meshes, casters, dynamicMeshes, draw);
+      auto end = std::chrono::high_resolution_clock::now();
+      glEndQuery(GL_TIME_ELAPSED);
+      dynamicBuffer.end_frame();
+      GLuint64 gpuNs = 0;
+      glGetQueryObjectui64v(query, GL_QUERY_RESULT, &gpuNs);
+
+      cpuMs[mode].push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+      gpuMs[mode].push_back(gpuNs / 1.0e6);
+      redraws[mode].push_back(shadowCascades.lastRendered);
+    }
+  }
+  glDeleteQueries(1, &query);
+
+  std::cout << "\n=== Shadow cache benchmark (mainPath, 60 fps) ===" << std::endl;
+  std::cout << " time   cached gpu ms   redraws   uncached gpu ms" << std::endl;
+  size_t frames = std::min(gpuMs[0].size(), gpuMs[1].size());
+  for (size_t start = 0; start < frames; start += framesPerRow)
+  {
+    size_t end = std::min(frames, start + framesPerRow);
+    double cached = 0.0, uncached = 0.0;
+    int rowRedraws = 0;
+    for (size_t f = start; f < end; ++f)
+    {
+      cached += gpuMs[0][f];
+      uncached += gpuMs[1][f];
+      rowRedraws += redraws[0][f];
+    }
+    std::printf("%4.0fs %15.3f %9d %17.3f\n", start * dt, cached / (end - start), rowRedraws, uncached / (end - start));
+  }
+
+  for (int mode = 0; mode < 2; ++mode)
+  {
+    double cpuTotal = 0.0, gpuTotal = 0.0, gpuMax = 0.0;
+    int totalRedraws = 0;
+    for (size_t f = 0; f < frames; ++f)
+    {
+      cpuTotal += cpuMs[mode][f];
+      gpuTotal += gpuMs[mode][f];
+      gpuMax = std::max(gpuMax, gpuMs[mode][f]);
+      totalRedraws += redraws[mode][f];
+    }
+    std::printf("%-8s %zu frames, %d cascade redraws, cpu %.3f ms, gpu %.3f ms avg / %.3f ms max\n",
+                mode == 0 ? "cached" : "uncached", frames, totalRedraws, cpuTotal / frames, gpuTotal / frames, gpuMax);
+  }
+}
+
+// ========== visibility buffer benchmark ==========
+// gpuMs[0]: forward, gpuMs[1]: visibility buffer; 同樣以 1/60 秒沿 mainPath 走一趟, 每幀是整個 render graph 的 GPU 時間
+void print_visibility_benchmark(const std::vector<double> gpuMs[2])
+{
+  const int framesPerRow = 60;
+  std::cout << "\n=== Visibility buffer benchmark (mainPath, 60 fps) ===" << std::endl;
+  std::cout << " time   forward gpu ms   visibility gpu ms" << std::endl;
+  size_t frames = std::min(gpuMs[0].size(), gpuMs[1].size());
+  for (size_t start = 0; start < frames; start += framesPerRow)
+  {
+    size_t end = std::min(frames, start + framesPerRow);
+    double forward = 0.0, visibility = 0.0;
+    for (size_t f = start; f < end; ++f)
+    {
+      forward += gpuMs[0][f];
+      visibility += gpuMs[1][f];
+    }
+    std::printf("%4.0fs %16.3f %19.3f\n", start / 60.0, forward / (end - start), visibility / (end - start));
+  }
+  for (int mode = 0; mode < 2; ++mode)
+  {
+    double total = 0.0, worst = 0.0;
+    for (size_t f = 0; f < frames; ++f)
+    {
+      total += gpuMs[mode][f];
+      worst = std::max(worst, gpuMs[mode][f]);
+    }
+    std::printf("%-10s %zu frames, gpu %.3f ms avg / %.3f ms max\n", mode == 0 ? "forward" : "visibility",
+                frames, frames ? total / frames : 0.0, worst);
+  }
+}
+
+// ========== geometry arena 自我測試 ==========
+// 用很小的 page 把全部 mesh 放進另一個 arena (一定會開好幾個 page), 輪流 free / 重新上傳 / defragment;
+// 每一步之後從 GPU 讀回每個 mesh, 依 index 展開成三角形跟 Mesh::vertices 比對, 並檢查同一個 page 裡的配置沒有重疊
+bool run_arena_selftest(const std::vector<Mesh> &meshes)
+{
+  GeometryArena arena;
+  arena.init(4096, 8192);
+  std::vector<int> handles(meshes.size(), -1);
+  auto upload = [&]()
+  {
+    for (size_t i = 0; i < meshes.size(); ++i)
+      if (meshes[i].instanceShape < 0 && handles[i] < 0)
+        handles[i] = arena.upload(meshes[i]);
+  };
+  auto release = [&](size_t first, size_t step)
+  {
+    for (size_t i = first; i < meshes.size(); i += step)
+      if (handles[i] >= 0)
+      {
+        arena.free(handles[i]);
+        handles[i] = -1;
+      }
+  };
+
+  bool passed = true;
+  auto check = [&](const char *step, bool expectCompact)
+  {
+    int mismatched = 0, overlapping = 0;
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    // (page, 起點, 長度): 頂點與 index 各一份
+    std::vector<std::array<size_t, 3>> vertexSpans, indexSpans;
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+      if (handles[i] < 0)
+        continue;
+      const GeometryArena::Range &range = arena.range(handles[i]);
+      arena.read_back(handles[i], vertices, indices);
+      vertexSpans.push_back({(size_t)range.page, (size_t)range.baseVertex, vertices.size() / GeometryArena::FLOATS_PER_VERTEX});
+      indexSpans.push_back({(size_t)range.page, range.firstIndex, indices.size()});
+
+      bool same = indices.size() * VERTEX_STRIDE == meshes[i].vertices.size();
+      for (size_t k = 0; same && k < indices.size(); ++k)
+      {
+        size_t v = indices[k];
+        same = v * GeometryArena::FLOATS_PER_VERTEX < vertices.size() &&
+               std::equal(meshes[i].vertices.begin() + k * VERTEX_STRIDE, meshes[i].vertices.begin() + (k + 1) * VERTEX_STRIDE,
+                          vertices.begin() + v * GeometryArena::FLOATS_PER_VERTEX);
+      }
+      mismatched += !same;
+    }
+    for (auto *spans : {&vertexSpans, &indexSpans})
+    {
+      std::sort(spans->begin(), spans->end());
+      for (size_t k = 1; k < spans->size(); ++k)
+        if ((*spans)[k][0] == (*spans)[k - 1][0] && (*spans)[k - 1][1] + (*spans)[k - 1][2] > (*spans)[k][1])
+          ++overlapping;
+    }
+    GeometryArena::Stats stats = arena.stats();
+    // 排緊之後每個 page 的頂點與 index 最多各剩尾巴一塊空閒
+    bool compact = !expectCompact || stats.freeBlocks <= 2 * stats.pages;
+
+    std::cout << std::left << std::setw(18) << step << std::right;
+    arena.print_stats();
+    if (mismatched || overlapping || !compact)
+    {
+      std::cout << "  FAILED: " << mismatched << " meshes differ, " << overlapping << " overlapping ranges"
+                << (compact ? "" : ", not compact after defragment") << std::endl;
+      passed = false;
+    }
+  };
+
+  std::cout << "\n=== Geometry arena self test ===" << std::endl;
+  upload();
+  check("upload", false);
+  release(0, 2);
+  check("free 1/2", false);
+  upload();
+  check("re-upload", false);
+  release(1, 3);
+  check("free 1/3", false);
+  arena.defragment();
+  check("defragment", true);
+  upload();
+  check("re-upload", false);
+  release(2, 5);
+  arena.defragment();
+  check("free + defragment", true);
+  arena.release();
+
+  std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+  return passed;
+}
+
+// ========== 軟體光柵化 benchmark ==========
+// mainPath 以 60 fps 走一趟, 固定 WIDTH x HEIGHT; 三角形數以通過 frustum culling、送進 setup 的為準
+void run_software_benchmark(CameraPath path, SoftwareRasterizer &rasterizer, const std::vector<unsigned int> &visible)
+{
+  const float dt = 1.0f / 60.0f;
+  const int framesPerRow = 60;
+  path.loop = false;
+  path.play();
+  glm::mat4 projection = glm::perspective(glm::radians(fov), (float)WIDTH / HEIGHT, NEAR_PLANE, FAR_PLANE);
+
+  std::vector<double> frameMs, setupMs, rasterMs;
+  std::vector<size_t> triangles, rasterized;
+  glm::vec3 eye = cameraPos, lookAt = cameraPos + cameraFront; // path.update 沒寫入時 (不到兩個 keyframe) 的預設值
+  while (path.isPlaying)
+  {
+    path.update(dt, eye, lookAt, false);
+    glm::mat4 view = glm::lookAt(eye, lookAt, cameraUp);
+    auto begin = std::chrono::high_resolution_clock::now();
+    rasterizer.render(view, projection, eye, mainLightPos, mainLightColor, visible, WIDTH, HEIGHT);
+    auto end = std::chrono::high_resolution_clock::now();
+    frameMs.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+    setupMs.push_back(rasterizer.lastSetupMs);
+    rasterMs.push_back(rasterizer.lastRasterMs);
+    triangles.push_back(rasterizer.lastTriangles);
+    rasterized.push_back(rasterizer.lastRasterized);
+  }
+
+  std::cout << "\n=== Software rasterizer benchmark (mainPath, 60 fps, " << WIDTH << "x" << HEIGHT << ", "
+            << global_thread_pool().size() << " threads) ===" << std::endl;
+  std::cout << " time   frame ms      fps   Mtri/s   setup ms   raster ms   triangles   rasterized" << std::endl;
+  size_t frames = frameMs.size();
+  double totalMs = 0.0, totalTriangles = 0.0;
+  for (size_t start = 0; start < frames; start += framesPerRow)
+  {
+    size_t end = std::min(frames, start + framesPerRow);
+    double ms = 0.0, setup = 0.0, raster = 0.0, tris = 0.0, drawn = 0.0;
+    for (size_t f = start; f < end; ++f)
+    {
+      ms += frameMs[f];
+      setup += setupMs[f];
+      raster += rasterMs[f];
+      tris += triangles[f];
+      drawn += rasterized[f];
+    }
+    totalMs += ms;
+    totalTriangles += tris;
+    size_t n = end - start;
+    std::printf("%4.0fs %10.3f %8.1f %8.1f %10.3f %11.3f %11.0f %12.0f\n", start / 60.0, ms / n, 1000.0 * n / ms,
+                tris / (ms * 1000.0), setup / n, raster / n, tris / n, drawn / n);
+  }
+  if (frames)
+    std::printf("%zu frames: %.3f ms avg, %.1f fps, %.1f Mtri/s\n", frames, totalMs / frames, 1000.0 * frames / totalMs,
+                totalTriangles / (totalMs * 1000.0));
+}
+
+// ========== path tracer benchmark ==========
+// mainPath 每秒取一個相機 (跟 60 fps 的序列同一組畫面), 每個畫面從頭累積 samples 個 sample
+void run_path_trace_benchmark(CameraPath path, PathTracer &tracer, int samples)
+{
+  const float dt = 1.0f / 60.0f;
+  const int framesPerRow = 60;
+  path.loop = false;
+  path.play();
+  glm::mat4 projection = glm::perspective(glm::radians(fov), (float)WIDTH / HEIGHT, NEAR_PLANE, FAR_PLANE);
+
+  std::cout << "\n=== Path tracer benchmark (mainPath, 1 view per second, " << WIDTH << "x" << HEIGHT << ", " << samples
+            << " spp, " << tracer.maxBounces << " bounces, " << global_thread_pool().size() << " threads) ==="
+            << std::endl;
+  std::cout << " time    frame ms   Mrays/s   rays/sample" << std::endl;
+  glm::vec3 eye = cameraPos, lookAt = cameraPos + cameraFront; // path.update 沒寫入時的預設值
+  double totalMs = 0.0, totalRays = 0.0;
+  int views = 0;
+  for (int frame = 0; path.isPlaying; ++frame)
+  {
+    path.update(frame == 0 ? 0.0f : dt, eye, lookAt, false);
+    if (frame % framesPerRow != 0)
+      continue;
+    tracer.reset();
+    tracer.render(glm::lookAt(eye, lookAt, cameraUp), projection, eye, mainLightPos, mainLightColor, WIDTH, HEIGHT,
+                  samples);
+    totalMs += tracer.lastMs;
+    totalRays += tracer.lastRays;
+    ++views;
+    std::printf("%4ds %11.1f %9.2f %13.2f\n", frame / framesPerRow, tracer.lastMs,
+                tracer.lastRays / (tracer.lastMs * 1000.0), (double)tracer.lastRays / ((double)WIDTH * HEIGHT * samples));
+  }
+  if (views)
+    std::printf("%d views: %.1f ms avg, %.2f Mrays/s\n", views, totalMs / views, totalRays / (totalMs * 1000.0));
+}
+
+// 模擬端交給繪製端的一幀: 相機與 HLOD 之後的可見集合, 發佈之後就不再改
+struct FrameSnapshot
+{
+  float time = 0.0f; // glfwGetTime
+  int framebufferWidth = 0, framebufferHeight = 0;
+  glm::mat4 view{1.0f};
+  glm::vec3 eyePos{0.0f}, eyeLookAt{0.0f}, up{0.0f, 1.0f, 0.0f};
+  float fov = 45.0f;
+  bool visibilityBuffer = false;
+  std::vector<unsigned int> visible; // HLOD 選好的 mesh (還沒過 impostor / PVS / occlusion)
+
+  // ---------- 進度顯示 ----------
+  bool pathCamera = false; // 相機正在走 mainPath
+  int keyframe = 0, keyframeCount = 0;
+  int sequenceFrame = 0;   // --render-sequence 的幀號
+  int hlodActive = 0;
+
+  bool quit = false; // 繪製執行緒收到就結束
+};
+
+int main(int argc, char **argv)
 {
   // char cwd[1024];
   // getcwd(cwd, sizeof(cwd));
   // std::cout << "Current working directory: " << cwd << std::endl;
 
+  bool runDrawBenchmark = false;
+  bool bakePvs = false;
+  bool bakeImpostors = false;
+  bool bakeHlod = false;
+  bool runShadowBenchmark = false;
+  bool bakeLightmap = false;
+  bool bakeAo = false;
+  bool bakeProbes = false;
+  bool bakeSdf = false;
+  bool printGraphStats = false;
+  bool runVisibilityBenchmark = false;
+  bool useSoftwareRasterizer = false; // --software: 場景改由 CPU 光柵化, GL 只負責顯示
+  bool runSoftwareBenchmark = false;
+  bool runArenaSelfTest = false;
+  int pathTraceSamples = 0; // --path-trace N: 場景改由 CPU path tracer 產生, 每幀 N 個 sample (相機不動就繼續累加)
+  int pathTraceBounces = 4;
+  bool runPathTraceBenchmark = false;
+  bool useVulkan = false; // --vulkan: 場景改由 Vulkan 畫在離屏 image, 讀回後交給 GL 顯示
+  bool useRenderThread = false; // --render-thread: GL 在獨立的繪製執行緒, 主執行緒只處理事件與模擬
+  bool headless = false;
+  FrameSequence sequence;
+  FrameCapture capture;
+  std::string captureDirectory; // --capture: 即時錄下互動畫面
+  bool renderAovs = false;      // --aov: 影格改成寫顏色 + 深度 + 法線 + 材質/mesh 編號 + 相機參數
+  AovWriter aovs;
+  TiledPoster poster;
+  std::string posterPath;
+  float posterTime = -1.0f; // --poster-time: 取 mainPath 上這個時間點的相機, 負的用手動相機的起始位置
+  size_t stressLights = 0;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--no-mdi")
+      useMdi = false;
+    else if (arg == "--bench-draws")
+      runDrawBenchmark = true;
+    else if (arg == "--no-texture-arrays")
+      useTextureArrays = false;
+    else if (arg == "--no-occlusion")
+      useOcclusionCulling = false;
+    else if (arg == "--no-pvs")
+      usePvs = false;
+    else if (arg == "--bake-pvs")
+      bakePvs = true;
+    else if (arg == "--no-impostors")
+      useImpostors = false;
+    else if (arg == "--bake-impostors")
+      bakeImpostors = true;
+    else if (arg == "--no-hlod")
+      useHlod = false;
+    else if (arg == "--bake-hlod")
+      bakeHlod = true;
+    else if (arg == "--no-instancing")
+      useInstancing = false;
+    else if (arg == "--no-persistent-buffer")
+      usePersistentBuffer = false;
+    else if (arg == "--no-clustered-lights")
+      useClusteredLights = false;
+    else if (arg == "--stress-lights" && i + 1 < argc)
+      stressLights = std::stoul(argv[++i]);
+    else if (arg == "--no-shadows")
+      useShadows = false;
+    else if (arg == "--bench-shadows")
+      runShadowBenchmark = true;
+    else if (arg == "--no-lightmap")
+      useLightmap = false;
+    else if (arg == "--bake-lightmap")
+      bakeLightmap = true;
+    else if (arg == "--no-ao")
+      useVertexAo = false;
+    else if (arg == "--bake-ao")
+      bakeAo = true;
+    else if (arg == "--no-probes")
+      useProbes = false;
+    else if (arg == "--bake-probes")
+      bakeProbes = true;
+    else if (arg == "--no-sdf")
+      useSdf = false;
+    else if (arg == "--bake-sdf")
+      bakeSdf = true;
+    else if (arg == "--sdf-resolution" && i + 1 < argc)
+      distanceField.resolution = std::stoi(argv[++i]);
+    else if (arg == "--sdf-budget" && i + 1 < argc)
+      distanceField.memoryBudget = std::stoul(argv[++i]) << 20;
+    else if (arg == "--no-render-graph")
+      useRenderGraph = false;
+    else if (arg == "--graph-stats")
+      printGraphStats = true;
+    else if (arg == "--visibility-buffer")
+      useVisibilityBuffer = true;
+    else if (arg == "--bench-visibility")
+      runVisibilityBenchmark = true;
+    else if (arg == "--software")
+      useSoftwareRasterizer = true;
+    else if (arg == "--bench-software")
+      runSoftwareBenchmark = true;
+    else if (arg == "--arena-selftest")
+      runArenaSelfTest = true;
+    else if (arg == "--path-trace" && i + 1 < argc)
+      pathTraceSamples = std::max(1, std::stoi(argv[++i]));
+    else if (arg == "--path-bounces" && i + 1 < argc)
+      pathTraceBounces = std::max(0, std::stoi(argv[++i]));
+    else if (arg == "--bench-path-trace")
+      runPathTraceBenchmark = true;
+    else if (arg == "--vulkan")
+      useVulkan = true;
+    else if (arg == "--render-thread")
+      useRenderThread = true;
+    else if (arg == "--headless")
+      headless = true;
+    else if (arg == "--render-sequence" && i + 1 < argc)
+      sequence.directory = argv[++i];
+    else if (arg == "--fps" && i + 1 < argc)
+      sequence.fps = std::stof(argv[++i]);
+    else if (arg == "--poster" && i + 2 < argc)
+    {
+      if (!poster.parse_size(argv[++i]))
+      {
+        std::cerr << "--poster expects WxH FILE\n";
+        return -1;
+      }
+      posterPath = argv[++i];
+    }
+    else if (arg == "--poster-tile" && i + 1 < argc)
+      poster.tileSize = std::stoi(argv[++i]);
+    else if (arg == "--poster-ss" && i + 1 < argc)
+      poster.supersample = std::stoi(argv[++i]);
+    else if (arg == "--poster-time" && i + 1 < argc)
+      posterTime = std::stof(argv[++i]);
+    else if (arg == "--capture" && i + 1 < argc)
+      captureDirectory = argv[++i];
+    else if (arg == "--aov")
+      renderAovs = true;
+    else if (arg == "--capture-format" && i + 1 < argc)
+    {
+      if (!FrameCapture::parse_format(argv[++i], capture.format))
+      {
+        std::cerr << "--capture-format expects png, ppm or y4m\n";
+        return -1;
+      }
+    }
+    else if (arg == "--frames" && i + 1 < argc)
+    {
+      if (!sequence.parse_frames(argv[++i]))
+      {
+        std::cerr << "--frames expects A-B, A- or A\n";
+        return -1;
+      }
+    }
+    else if (arg == "--shard" && i + 1 < argc)
+    {
+      if (!sequence.parse_shard(argv[++i]))
+      {
+        std::cerr << "--shard expects i/N with 0 <= i < N\n";
+        return -1;
+      }
+    }
+  }
+  // 沒有視窗可看, headless 不是畫海報就是輸出影格
+  if (headless && !sequence.enabled() && !poster.enabled())
+    sequence.directory = "frames";
+  if (sequence.fps <= 0.0f)
+  {
+    std::cerr << "--fps must be positive\n";
+    return -1;
+  }
+  if (useSoftwareRasterizer && (poster.enabled() || renderAovs))
+  {
+    std::cerr << "--software does not support --poster or --aov\n";
+    return -1;
+  }
+  bool usePathTracer = pathTraceSamples > 0;
+  if (usePathTracer && (useSoftwareRasterizer || poster.enabled() || renderAovs))
+  {
+    std::cerr << "--path-trace does not support --software, --poster or --aov\n";
+    return -1;
+  }
+#ifndef HW3_VULKAN
+  if (useVulkan)
+  {
+    std::cerr << "--vulkan needs a build configured with -DHW3_VULKAN=ON\n";
+    return -1;
+  }
+#endif
+  if (useVulkan && (useSoftwareRasterizer || usePathTracer || poster.enabled() || renderAovs))
+  {
+    std::cerr << "--vulkan does not support --software, --path-trace, --poster or --aov\n";
+    return -1;
+  }
+  if (useRenderThread && runVisibilityBenchmark)
+  {
+    std::cerr << "--bench-visibility switches modes from the render loop, drop --render-thread\n";
+    return -1;
+  }
+  if (renderAovs)
+  {
+    if (poster.enabled() || (!sequence.enabled() && captureDirectory.empty()))
+    {
+      std::cerr << "--aov goes with --render-sequence, --headless or --capture\n";
+      return -1;
+    }
+    // impostor 與 HLOD 代理不是原本的 mesh (impostor 也不寫 AOV), 資料集一律畫完整的幾何
+    useImpostors = false;
+    useHlod = false;
+    useVisibilityBuffer = false;
+  }
+
+  // headless: GLFW 的 null platform 不開視窗, context 用 EGL surfaceless (Mesa), 不行再試 OSMesa;
+  // 預設 framebuffer 是一塊 WIDTH x HEIGHT 的 pbuffer / 記憶體, render graph 照樣畫到 FBO 再 present
+  if (headless)
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+
   // load glfw
   if (!glfwInit())
   {
     std::cerr << "GLFW init fail\n";
     return -1;
   }
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  // 先試 4.3 (MDI 路徑), 不行 (例如 macOS 只到 4.1) 就退回 3.3
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
   // create window
-  window = glfwCreateWindow(WIDTH, HEIGHT, "Scene Animation", NULL, NULL);
+  const int contextApis[] = {GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API};
+  for (int api = 0; api < (headless ? 2 : 1) && !window; ++api)
+  {
+    if (headless)
+      glfwWindowHint(GLFW_CONTEXT_CREATION_API, contextApis[api]);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    window = useMdi ? glfwCreateWindow(WIDTH, HEIGHT, "Scene Animation", NULL, NULL) : NULL;
+    if (!window)
+    {
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+      window = glfwCreateWindow(WIDTH, HEIGHT, "Scene Animation", NULL, NULL);
+    }
+  }
   if (!window)
   {
-    std::cerr << "Window fail\n";
+    std::cerr << (headless ? "Headless context fail (needs EGL_MESA_platform_surfaceless or OSMesa)\n" : "Window fail\n");
     glfwTerminate();
     return -1;
   }
@@ -520,39 +1343,241 @@ int main()
   std::string obj_path = "../models/" + obj_name + "/" + obj_name + ".obj";
   load_obj(obj_path, identity);
 
-  // vertex shader
-  unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-  glCompileShader(vertexShader);
-
-  // fragment shader
-  unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-  glCompileShader(fragmentShader);
-
-  // link shader to program
-  unsigned int shaderProgram = glCreateProgram();
-  glAttachShader(shaderProgram, vertexShader);
-  glAttachShader(shaderProgram, fragmentShader);
-  glLinkProgram(shaderProgram);
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
-
-  // VBO (Vertex Buffer Object)：存「頂點資料」的緩衝區。
-  // VAO (Vertex Array Object)：存「如何讀取這些頂點資料」的設定。
+  // 重複的幾何合成 instancing shape (要在切格子之前, 切開就認不出來了)
+  if (useInstancing)
+  {
+    instancer.build(meshes);
+    useInstancing = !instancer.empty();
+  }
+
+  // 大 mesh 切成小塊, occlusion culling / PVS 才有意義; 兩個都不用時切了只會多出 draw call
+  if (useOcclusionCulling || usePvs || bakePvs)
+    split_large_meshes(meshes, 0.25f);
+
+  OcclusionCuller occlusionCuller;
+  if (useOcclusionCulling)
+    occlusionCuller.select_occluders(meshes);
+
+  // PVS 依切完之後的 mesh index 烘焙, 場景改了 load 會拒絕舊檔
+  PotentiallyVisibleSet pvs;
+  std::string pvs_path = "../models/" + obj_name + "/" + obj_name + ".pvs";
+  if (bakePvs)
+  {
+    pvs.bake(meshes);
+    pvs.save(pvs_path);
+  }
+  else if (usePvs && !pvs.load(pvs_path, meshes))
+  {
+    std::cout << "No PVS for " << obj_name << " (run with --bake-pvs to build one)" << std::endl;
+  }
+  usePvs = usePvs && !pvs.empty();
+
+  // HLOD: 代理 mesh 接在所有場景 mesh 後面 (所以要在 PVS 之後, 貼圖打包之前)
+  HlodSystem hlod;
+  if (useHlod)
+  {
+    std::string hlod_dir = "../models/" + obj_name + "/hlod";
+    if (bakeHlod || !hlod.load(hlod_dir, meshes))
+    {
+      hlod.build(meshes);
+      hlod.save(hlod_dir, meshes);
+    }
+    for (Material *mat : hlod.append_proxies(hlod_dir, meshes, g_materials))
+    {
+      if (!useTextureArrays)
+        mat->diffuseTexID = load_texture(mat->diffuseTexPath);
+    }
+    useHlod = !hlod.empty();
+  }
+
+  // 點光源: emissive 表面 + 光源檔 (+ 壓力測試用的隨機光源); 沒有任何光源就不編 clustered 變體
+  if (obj_name.find("Night") != std::string::npos)
+    mainLightColor = glm::vec3(0.15f);
+  if (useClusteredLights)
+  {
+    clusteredLights.add_emissive(meshes);
+    clusteredLights.load("../models/" + obj_name + "/" + obj_name + ".lights", g_objToScene);
+    if (stressLights > 0)
+    {
+      glm::vec3 lo(1e30f), hi(-1e30f);
+      for (const Mesh &mesh : meshes)
+      {
+        lo = glm::min(lo, mesh.boundsMin);
+        hi = glm::max(hi, mesh.boundsMax);
+      }
+      clusteredLights.add_random(stressLights, lo, hi);
+    }
+    useClusteredLights = !clusteredLights.empty();
+    if (useClusteredLights)
+      clusteredLights.upload();
+  }
+
+  // lightmap: chart 依最後的 mesh 清單產生 (第二組 UV 要在建 VAO / MDI 之前), 主光源顏色在上面已經決定
+  if (useLightmap)
+  {
+    lightmapper.build_charts(meshes);
+    std::string lightmap_dir = "../models/" + obj_name + "/lightmap";
+    if (bakeLightmap)
+    {
+      lightmapper.bake(meshes, mainLightPos, mainLightColor);
+      lightmapper.save(lightmap_dir, meshes);
+    }
+    else if (!lightmapper.load(lightmap_dir, meshes))
+    {
+      std::cout << "No lightmap for " << obj_name << " (run with --bake-lightmap to build one)" << std::endl;
+    }
+    useLightmap = !lightmapper.empty();
+    if (useLightmap)
+      lightmapper.upload();
+    else
+      lightmapper.clear_uvs(meshes);
+  }
+
+  // 逐頂點 AO: 跟 lightmap 一樣要在建 VAO / MDI 之前, 存在 mesh 旁邊
+  if (useVertexAo)
+  {
+    VertexAoBaker aoBaker;
+    std::string ao_path = "../models/" + obj_name + "/" + obj_name + ".ao";
+    if (bakeAo)
+    {
+      aoBaker.bake(meshes);
+      aoBaker.save(ao_path, meshes);
+    }
+    else if (!aoBaker.load(ao_path, meshes))
+    {
+      std::cout << "No vertex AO for " << obj_name << " (run with --bake-ao to build one)" << std::endl;
+    }
+    useVertexAo = std::any_of(meshes.begin(), meshes.end(), [](const Mesh &mesh)
+                              { return !mesh.ao.empty(); });
+  }
+
+  // irradiance probe: 跟 lightmap 一樣用上面決定的主光源烘焙
+  if (useProbes)
+  {
+    irradianceVolume.includeEmissive = !useClusteredLights;
+    std::string probe_path = "../models/" + obj_name + "/" + obj_name + ".probes";
+    if (bakeProbes)
+    {
+      irradianceVolume.bake(meshes, mainLightPos, mainLightColor);
+      irradianceVolume.save(probe_path, meshes);
+    }
+    else if (!irradianceVolume.load(probe_path, meshes))
+    {
+      std::cout << "No irradiance probes for " << obj_name << " (run with --bake-probes to build them)" << std::endl;
+    }
+    useProbes = !irradianceVolume.empty();
+    if (useProbes)
+      irradianceVolume.upload();
+  }
+
+  // 距離場: 只跟幾何有關, resolution / 記憶體上限改了要重烤
+  if (useSdf)
+  {
+    std::string sdf_path = "../models/" + obj_name + "/" + obj_name + ".sdf";
+    if (bakeSdf)
+    {
+      distanceField.bake(meshes);
+      distanceField.save(sdf_path, meshes);
+    }
+    else if (!distanceField.load(sdf_path, meshes))
+    {
+      std::cout << "No distance field for " << obj_name << " (run with --bake-sdf to build one)" << std::endl;
+    }
+    useSdf = !distanceField.empty() && distanceField.upload();
+  }
+
+  if (useTextureArrays)
+    pack_texture_arrays(g_materials);
+
+  if (useMdi && !MdiRenderer::is_supported())
+  {
+    std::cout << "GL " << GLVersion.major << "." << GLVersion.minor
+              << " has no multi-draw indirect, using per-mesh path" << std::endl;
+    useMdi = false;
+  }
+
+  // shadow map 只寫深度: vertex.glsl 的逐 mesh 版本 + 空的 fragment shader (要在決定 shader 變體之前)
+  unsigned int shadowProgram = 0;
+  if (useShadows)
+  {
+    shadowProgram = compile_program(shader_variant(vertexCode, "330 core", {}),
+                                    load_shader_source("../src/shaders/shadow_fragment.glsl"));
+    useShadows = shadowProgram != 0;
+  }
+
+  // shader: 逐 mesh 版本 (330) 與 MDI 版本 (430 + USE_MDI) 共用同一份原始碼
+  unsigned int shaderProgram = compile_program(shader_variant(vertexCode, "330 core", shader_defines(false)),
+                                               shader_variant(fragmentCode, "330 core", shader_defines(false)));
+  unsigned int mdiProgram = 0;
+  if (useMdi)
+  {
+    mdiProgram = compile_program(shader_variant(vertexCode, "430 core", shader_defines(true)),
+                                 shader_variant(fragmentCode, "430 core", shader_defines(true)));
+    if (mdiProgram == 0)
+      useMdi = false;
+  }
+
+  // 逐 mesh 路徑的幾何: 去重成 indexed 後放進少數幾個大的 page (VBO / EBO / VAO 各一組),
+  // 每個 mesh 只記 page 裡的 offset, 不再各自一組 buffer
+  geometryArena.init(1 << 18, 1 << 20);
   for (auto &mesh : meshes)
   {
-    glGenVertexArrays(1, &mesh.VAO);
-    glGenBuffers(1, &mesh.VBO);
-    glBindVertexArray(mesh.VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
-    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(float), mesh.vertices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(5 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    // instancing 的 mesh 共用 shape 的 buffer
+    if (mesh.instanceShape >= 0)
+      continue;
+    mesh.geometry = geometryArena.upload(mesh);
+  }
+  geometryArena.print_stats();
+  if (runArenaSelfTest)
+  {
+    bool passed = run_arena_selftest(meshes);
+    glfwTerminate();
+    return passed ? 0 : 1;
+  }
+  // MDI 的 command 與 instancing 的 transform 每幀都從同一個 ring 配置
+  dynamicBuffer.init(256 * 1024, usePersistentBuffer);
+  instancer.dynamic = &dynamicBuffer;
+  if (useInstancing)
+    instancer.upload(meshes);
+
+  MdiRenderer mdiRenderer;
+  mdiRenderer.dynamic = &dynamicBuffer;
+  if (useMdi)
+    mdiRenderer.build(meshes, useTextureArrays);
+
+  // visibility buffer: 頂點與材質要從 MDI 的 SSBO 讀, transient target 由 render graph 配置
+  unsigned int visibilityProgram = 0, resolveProgram = 0;
+  bool visibilityAvailable = useMdi && useRenderGraph && mdiRenderer.visibility_supported();
+  if (visibilityAvailable)
+  {
+    std::vector<std::string> resolveDefines = shader_defines(true);
+    resolveDefines.push_back("VISIBILITY_RESOLVE");
+    visibilityProgram = compile_program(load_shader_source("../src/shaders/visibility_vertex.glsl"),
+                                        load_shader_source("../src/shaders/visibility_fragment.glsl"));
+    resolveProgram = compile_program(load_shader_source("../src/shaders/fullscreen_vertex.glsl"),
+                                     shader_variant(fragmentCode, "430 core", resolveDefines));
+    visibilityAvailable = visibilityProgram != 0 && resolveProgram != 0;
+  }
+  if (!visibilityAvailable && (useVisibilityBuffer || runVisibilityBenchmark))
+    std::cout << "Visibility buffer needs the MDI path and the render graph, using forward shading" << std::endl;
+
+  // AOV: MDI 版本的 shader 多寫三個 render target (mesh 編號就是 draw ID)
+  unsigned int aovProgram = 0;
+  if (renderAovs)
+  {
+    std::vector<std::string> aovDefines = shader_defines(true);
+    aovDefines.push_back("AOV_OUTPUT");
+    if (useMdi && useRenderGraph)
+      aovProgram = compile_program(shader_variant(vertexCode, "430 core", aovDefines),
+                                   shader_variant(fragmentCode, "430 core", aovDefines));
+    if (aovProgram == 0)
+    {
+      std::cerr << "--aov needs the MDI path and the render graph" << std::endl;
+      glfwTerminate();
+      return -1;
+    }
+    if (meshes.size() >= 65535)
+      std::cout << "Warning: " << meshes.size() << " meshes do not fit the 16-bit mesh ID AOV" << std::endl;
   }
 
   glEnable(GL_DEPTH_TEST);
@@ -568,6 +1593,34 @@ int main()
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+  // impostor: 有存好的 atlas 就讀, 沒有 (或 --bake-impostors) 就用 GPU 烘焙後存檔
+  ImpostorSystem impostors;
+  unsigned int impostorProgram = 0;
+  if (useImpostors)
+  {
+    std::string impostor_dir = "../models/" + obj_name + "/impostors";
+    if (bakeImpostors || !impostors.load(impostor_dir, meshes))
+    {
+      std::vector<std::string> bakeDefines = shader_defines(false);
+      bakeDefines.push_back("IMPOSTOR_BAKE");
+      unsigned int bakeProgram = compile_program(shader_variant(vertexCode, "330 core", bakeDefines),
+                                                 shader_variant(fragmentCode, "330 core", bakeDefines));
+      impostors.build_clusters(meshes);
+      impostors.bake([&](const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eye,
+                         const std::vector<unsigned int> &clusterMeshes)
+                     {
+                       set_frame_uniforms(bakeProgram, view, projection, eye);
+                       draw_meshes(bakeProgram, clusterMeshes, whiteTexture);
+                     });
+      impostors.save(impostor_dir, meshes);
+      glDeleteProgram(bakeProgram);
+    }
+    impostors.upload();
+    impostorProgram = compile_program(load_shader_source("../src/shaders/impostor_vertex.glsl"),
+                                      load_shader_source("../src/shaders/impostor_fragment.glsl"));
+    useImpostors = impostorProgram != 0 && !impostors.empty();
+  }
+
   // 方法 1: 使用預設路徑
   // mainPath = ScenePaths::createCircularPath(glm::vec3(0, 0.5f, 0), 2.0f, 0.5f, 20);
   // mainPath.loop = true;
@@ -597,15 +1650,240 @@ int main()
   // std::cout << "Mouse: Look around (manual mode)" << std::endl;
   // std::cout << "\nPress P to start the camera path!" << std::endl;
 
+  // 沒有材質的 mesh 不畫
+  std::vector<unsigned int> visibleMeshes;
+  for (unsigned int i = 0; i < meshes.size(); ++i)
+  {
+    if (meshes[i].material && !meshes[i].proxy)
+      visibleMeshes.push_back(i);
+  }
+
+  // 快取的 shadow map: caster 是所有場景 mesh (HLOD 代理除外)
+  std::vector<unsigned int> dynamicMeshes; // 會動的物件 (目前場景全是靜態的), 每幀疊在快取的 shadow 上
+  ShadowCascades::DrawFunc drawShadowCasters = [&](const glm::mat4 &view, const glm::mat4 &projection,
+                                                   const std::vector<unsigned int> &casters)
+  {
+    glUseProgram(shadowProgram);
+    glUniformMatrix4fv(glGetUniformLocation(shadowProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(shadowProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    draw_meshes(shadowProgram, casters, whiteTexture);
+  };
+  if (useShadows)
+  {
+    glm::vec3 sceneMin(1e30f), sceneMax(-1e30f);
+    for (unsigned int meshIndex : visibleMeshes)
+    {
+      sceneMin = glm::min(sceneMin, meshes[meshIndex].boundsMin);
+      sceneMax = glm::max(sceneMax, meshes[meshIndex].boundsMax);
+    }
+    shadowCascades.init(sceneMin, sceneMax);
+    // 第一次 update 前先畫好, draw benchmark 也有 shadow 可以取樣
+    shadowCascades.update(mainLightPos, cameraPos, meshes, visibleMeshes, dynamicMeshes, drawShadowCasters);
+  }
+
+  if (runShadowBenchmark)
+  {
+    if (useShadows)
+      run_shadow_benchmark(mainPath, visibleMeshes, dynamicMeshes, drawShadowCasters);
+    glfwTerminate();
+    return 0;
+  }
+
+  // 軟體光柵化: 自己的一份 world space 頂點與解碼後的貼圖
+  SoftwareRasterizer softwareRasterizer;
+  if (useSoftwareRasterizer || runSoftwareBenchmark)
+    softwareRasterizer.build(meshes);
+  if (runSoftwareBenchmark)
+  {
+    run_software_benchmark(mainPath, softwareRasterizer, visibleMeshes);
+    glfwTerminate();
+    return 0;
+  }
+
+  // path tracer: 全部 mesh 的 BVH 與解碼後的貼圖
+  PathTracer pathTracer;
+  pathTracer.maxBounces = pathTraceBounces;
+  if (usePathTracer || runPathTraceBenchmark)
+    pathTracer.build(meshes);
+  if (runPathTraceBenchmark)
+  {
+    run_path_trace_benchmark(mainPath, pathTracer, usePathTracer ? pathTraceSamples : 4);
+    glfwTerminate();
+    return 0;
+  }
+
+#ifdef HW3_VULKAN
+  // Vulkan: 同一份 meshes / 材質, 靜態幾何的 draw 預先錄好 (SPIR-V 在建置目錄的 shaders/ 裡)
+  VulkanRenderer vulkanRenderer;
+  if (useVulkan && (!vulkanRenderer.init("shaders") || !vulkanRenderer.build(meshes, visibleMeshes)))
+  {
+    vulkanRenderer.release();
+    glfwTerminate();
+    return -1;
+  }
+#endif
+
+  if (runDrawBenchmark)
+  {
+    int framebufferWidth = 0, framebufferHeight = 0;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+    glm::mat4 projection = glm::perspective(glm::radians(fov), (float)framebufferWidth / framebufferHeight,
+                                            NEAR_PLANE, FAR_PLANE);
+    run_draw_benchmark(shaderProgram, mdiProgram, useMdi ? &mdiRenderer : nullptr,
+                       visibleMeshes, whiteTexture, view, projection, cameraPos);
+    glfwTerminate();
+    return 0;
+  }
+
+  // 載入時 (impostor 烘焙、第一次 shadow...) 配置的都在第一段, 補上 fence 再開始輪替
+  dynamicBuffer.end_frame();
   std::cout << "start rendering" << std::endl;
+  std::vector<unsigned int> nearMeshes;
+  std::vector<unsigned int> fadeChanged;
+  std::vector<unsigned int> pvsVisible;
+  std::vector<unsigned int> frameVisible;
 
-  // 控制處理循環
-  while (!glfwWindowShouldClose(window))
+  // --bench-visibility: 以固定的 1/60 秒沿 mainPath 先用 forward、再用 visibility buffer 各走一趟
+  struct
+  {
+    int mode = -1; // 0: forward, 1: visibility buffer, -1: 沒有在 benchmark
+    GLuint queries[2] = {0, 0};
+    std::vector<double> gpuMs[2];
+  } visibilityBench;
+  if (runVisibilityBenchmark && visibilityAvailable)
+  {
+    visibilityBench.mode = 0;
+    glGenQueries(2, visibilityBench.queries);
+    useVisibilityBuffer = false;
+    usePathCamera = true;
+    mainPath.loop = false;
+    mainPath.play();
+  }
+
+  // --render-sequence / --headless: 固定 fps 播一趟 mainPath, 只畫這個 shard 的幀, 畫完就結束
+  auto sequenceStart = std::chrono::high_resolution_clock::now();
+  if (sequence.enabled())
+  {
+    int totalFrames = count_path_frames(mainPath, sequence.fps);
+    if (!sequence.resolve(totalFrames))
+    {
+      std::cerr << "No frames to render (path has " << totalFrames << " frames at " << sequence.fps << " fps)" << std::endl;
+      glfwTerminate();
+      return -1;
+    }
+    std::cout << "Rendering frames " << sequence.first << "-" << sequence.last << " of " << totalFrames
+              << " (shard " << sequence.shardIndex << "/" << sequence.shardCount << ", " << sequence.fps
+              << " fps) to " << sequence.directory << std::endl;
+    usePathCamera = true;
+    manualControl = false;
+    mainPath.loop = false;
+    mainPath.play();
+    glfwSwapInterval(0);
+  }
+  // --poster: 每次迴圈畫一塊 tile (captureFrame 就是 tile 編號), 全部畫完就結束
+  auto posterStart = std::chrono::high_resolution_clock::now();
+  if (poster.enabled())
+  {
+    GLint maxTextureSize = 0, maxViewport[2] = {0, 0};
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    if (!useRenderGraph)
+    {
+      std::cerr << "--poster renders tiles through the render graph, drop --no-render-graph" << std::endl;
+      glfwTerminate();
+      return -1;
+    }
+    if (!poster.open(posterPath, std::min({maxTextureSize, maxViewport[0], maxViewport[1]})))
+    {
+      glfwTerminate();
+      return -1;
+    }
+    if (posterTime >= 0.0f)
+    {
+      CameraPath path = mainPath;
+      path.loop = false;
+      path.play();
+      glm::vec3 position, lookAt;
+      path.update(0.0f, position, lookAt, false);
+      for (float t = 0.0f; t < posterTime && path.isPlaying; t += 1.0f / 60.0f)
+        path.update(std::min(1.0f / 60.0f, posterTime - t), position, lookAt, false);
+      cameraPos = position;
+      cameraFront = glm::normalize(lookAt - position);
+    }
+    usePathCamera = false;
+    manualControl = false;
+    glfwSwapInterval(0);
+    std::cout << "Rendering " << poster.width << "x" << poster.height << " poster in " << poster.tile_count()
+              << " tiles of " << poster.tileSize << " (" << poster.supersample << "x" << poster.supersample
+              << " supersampling) to " << posterPath << std::endl;
+  }
+
+  // 離線輸出一幀都不能丟 (encoder 跟不上就等), 即時錄影則寧可丟幀也不拖慢畫面
+  int captureFrame = 0;
+  capture.fps = sequence.fps;
+  capture.dropWhenBehind = !sequence.enabled() && !poster.enabled();
+  if (poster.enabled())
+  {
+    // 佇列最多放幾塊 tile, 記憶體跟海報尺寸無關
+    capture.maxPendingBytes = (size_t)4 * poster.tileSize * poster.tileSize * poster.supersample * poster.supersample * 4;
+    capture.begin([&poster](int tile, int width, int height, std::vector<unsigned char> &pixels)
+                  { poster.write_tile(tile, width, height, pixels); });
+  }
+  else if (renderAovs)
+  {
+    if (!aovs.begin(sequence.enabled() ? sequence.directory : captureDirectory))
+    {
+      glfwTerminate();
+      return -1;
+    }
+    capture.begin([&aovs](int frame, int width, int height, std::vector<unsigned char> &pixels)
+                  { aovs.write(frame, width, height, pixels); });
+  }
+  else if (sequence.enabled() || !captureDirectory.empty())
+  {
+    if (!capture.begin(sequence.enabled() ? sequence.directory : captureDirectory))
+    {
+      glfwTerminate();
+      return -1;
+    }
+  }
+
+  // 軟體光柵化 / path tracer / Vulkan 的結果上傳到這張 texture, 再 blit 到預設 framebuffer
+  GLuint softwareTexture = 0, softwareFramebuffer = 0;
+  int softwareTextureWidth = 0, softwareTextureHeight = 0;
+  if (useSoftwareRasterizer || usePathTracer || useVulkan)
+  {
+    glGenTextures(1, &softwareTexture);
+    glGenFramebuffers(1, &softwareFramebuffer);
+  }
+
+  // ========== 模擬 (主執行緒) ==========
+  // 時間、輸入、相機路徑與 HLOD 選擇, 結果寫進 frame 交給繪製端; 回傳 false 代表這幀不畫
+  // (前面 shard 的幀、視窗最小化). 這裡不碰 GL, 可以跟上一幀的繪製同時跑
+  auto simulate = [&](FrameSnapshot &frame) -> bool
   {
     // count deltaTime for tranformation
     float currentFrame = glfwGetTime();
     deltaTime = currentFrame - lastFrame;
     lastFrame = currentFrame;
+    if (visibilityBench.mode >= 0)
+      deltaTime = 1.0f / 60.0f;
+    if (sequence.enabled())
+    {
+      deltaTime = sequence.frame_delta();
+      // 前面別的 shard 負責的幀: 只推進相機與 HLOD 的狀態, 不畫
+      if (sequence.frame < sequence.first)
+      {
+        glm::vec3 position, lookAt;
+        mainPath.update(deltaTime, position, lookAt, false);
+        if (useHlod)
+          hlod.update(position, visibleMeshes, frame.visible);
+        ++sequence.frame;
+        return false;
+      }
+      frame.sequenceFrame = sequence.frame++;
+    }
 
     // process input
     if (manualControl)
@@ -613,119 +1891,560 @@ int main()
       process_input(window);
     }
 
-    glClearColor(0.4f, 0.4f, 0.4f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // 視窗可以改大小, 每幀用目前的 framebuffer 尺寸 (最小化時是 0, 不畫)
+    glfwGetFramebufferSize(window, &frame.framebufferWidth, &frame.framebufferHeight);
+    if (frame.framebufferWidth == 0 || frame.framebufferHeight == 0)
+      return false;
 
-    glUseProgram(shaderProgram);
-
-    glm::vec3 finalCameraPos;
-    glm::vec3 finalLookAt;
-    glm::mat4 view;
-
-    if (usePathCamera && mainPath.isPlaying)
+    frame.time = currentFrame;
+    frame.eyePos = cameraPos;
+    frame.eyeLookAt = cameraPos + cameraFront;
+    frame.pathCamera = usePathCamera && mainPath.isPlaying;
+    if (frame.pathCamera)
+    {
+      mainPath.update(deltaTime, frame.eyePos, frame.eyeLookAt, false);
+      frame.keyframe = mainPath.currentKeyframe;
+      frame.keyframeCount = mainPath.keyframes.size();
+    }
+    frame.up = cameraUp;
+    frame.view = glm::lookAt(frame.eyePos, frame.eyeLookAt, cameraUp);
+    frame.fov = fov;
+    frame.visibilityBuffer = useVisibilityBuffer;
+
+    // 很遠的整區換成 HLOD 代理; 之後的 impostor / PVS / occlusion 在繪製端接著篩
+    if (useHlod)
+      hlod.update(frame.eyePos, visibleMeshes, frame.visible);
+    else
+      frame.visible = visibleMeshes;
+    frame.hlodActive = hlod.lastActive;
+    frame.quit = false;
+    return true;
+  };
+
+  // ========== 繪製 (有 --render-thread 時在繪製執行緒, GL context 在那邊) ==========
+  // 只讀 frame 與繪製端自己的狀態; 回傳 false 代表輸出完成 (影格序列、海報、benchmark), 要結束
+  auto renderFrame = [&](const FrameSnapshot &frame) -> bool
+  {
+    int framebufferWidth = frame.framebufferWidth, framebufferHeight = frame.framebufferHeight;
+    if (sequence.enabled())
+      captureFrame = frame.sequenceFrame;
+    if (poster.enabled())
+      poster.render_size(captureFrame, framebufferWidth, framebufferHeight);
+    float currentFrame = frame.time;
+    const glm::mat4 &view = frame.view;
+    const glm::vec3 &eyePos = frame.eyePos;
+    const glm::vec3 &eyeLookAt = frame.eyeLookAt;
+
+    unsigned int activeProgram = renderAovs ? aovProgram : useMdi ? mdiProgram : shaderProgram;
+    glUseProgram(activeProgram);
+
+    if (frame.pathCamera)
     {
-      mainPath.update(deltaTime, finalCameraPos, finalLookAt, false);
-      view = glm::lookAt(finalCameraPos, finalLookAt, cameraUp);
-
       // 顯示進度
       static float lastPrintTime = 0.0f;
       if (currentFrame - lastPrintTime > 0.5f)
       {
-        int totalKeyframes = mainPath.keyframes.size();
+        int totalKeyframes = frame.keyframeCount;
         if (totalKeyframes > 1)
         {
-          float progress = (float)(mainPath.currentKeyframe + 1) / (totalKeyframes - 1) * 100.0f;
+          float progress = (float)(frame.keyframe + 1) / (totalKeyframes - 1) * 100.0f;
           std::cout << "Path progress: " << (int)progress << "% "
-                    << "(Keyframe " << mainPath.currentKeyframe + 1 << "/"
-                    << totalKeyframes - 1 << ")\r" << std::flush;
+                    << "(Keyframe " << frame.keyframe + 1 << "/"
+                    << totalKeyframes - 1 << ")";
+          if (sequence.enabled())
+            std::cout << " frame " << frame.sequenceFrame << "/" << sequence.last;
+          if (useHlod)
+            std::cout << " hlod " << frame.hlodActive;
+          if (useInstancing && useMdi)
+            std::cout << " commands " << mdiRenderer.lastCommandCount << "/" << frameVisible.size();
+          else if (useInstancing)
+            std::cout << " instanced " << instancer.lastInstances << " in " << instancer.lastDrawCalls << " draws";
+          if (useImpostors)
+            std::cout << " impostors " << impostors.lastDrawn;
+          std::cout << " ring " << dynamicBuffer.lastFrameBytes / 1024 << " KB";
+          if (dynamicBuffer.fenceWaits > 0)
+            std::cout << " (" << dynamicBuffer.fenceWaits << " waits)";
+          if (useClusteredLights)
+            std::cout << " lights " << clusteredLights.lights.size() << " (" << clusteredLights.lastBinMs << " ms)";
+          if (useShadows)
+            std::cout << " shadow redraws " << shadowCascades.totalRendered;
+          if (usePvs)
+            std::cout << " pvs cell " << pvs.lastCell << " rejected " << pvs.lastRejected;
+          if (useOcclusionCulling)
+            std::cout << " occluded " << occlusionCuller.lastCulled << "/" << occlusionCuller.lastTested;
+          if (useSoftwareRasterizer)
+            std::cout << " software " << softwareRasterizer.lastSetupMs + softwareRasterizer.lastRasterMs << " ms "
+                      << softwareRasterizer.lastRasterized << "/" << softwareRasterizer.lastTriangles << " tris";
+          else if (usePathTracer)
+            std::cout << " path trace " << pathTracer.sampleCount << " spp " << pathTracer.lastMs << " ms "
+                      << pathTracer.lastRays / (pathTracer.lastMs * 1000.0f) << " Mrays/s";
+#ifdef HW3_VULKAN
+          else if (useVulkan)
+            std::cout << " vulkan " << vulkanRenderer.drawCount << " draws record " << vulkanRenderer.lastRecordMs
+                      << " ms frame " << vulkanRenderer.lastFrameMs << " ms";
+#endif
+          else if (useRenderGraph)
+          {
+            double graphGpuMs = 0.0;
+            for (const RenderGraph::PassStats &pass : renderGraph.pass_stats())
+              graphGpuMs += pass.gpuMs;
+            std::cout << " graph " << graphGpuMs << " ms " << renderGraph.pool_bytes() / (1024 * 1024) << " MB";
+            if (visibilityAvailable && frame.visibilityBuffer)
+              std::cout << " (visibility buffer)";
+          }
+          std::cout << "\r" << std::flush;
         }
         lastPrintTime = currentFrame;
       }
-
-      glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-      glUniform3fv(glGetUniformLocation(shaderProgram, "viewPos"), 1, glm::value_ptr(finalCameraPos));
-    }
-    else
-    {
-      // 使用手動相機
-      view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-      glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-      glUniform3fv(glGetUniformLocation(shaderProgram, "viewPos"), 1, glm::value_ptr(cameraPos));
     }
+    glUniformMatrix4fv(glGetUniformLocation(activeProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniform3fv(glGetUniformLocation(activeProgram, "viewPos"), 1, glm::value_ptr(eyePos));
 
     // glm 縮放與角度
-    glm::mat4 model = glm::mat4(1.0f);
-    glm::mat4 projection = glm::perspective(glm::radians(fov), (float)WIDTH / HEIGHT, 0.001f, 10.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(frame.fov), (float)framebufferWidth / framebufferHeight,
+                                            NEAR_PLANE, FAR_PLANE);
+    if (poster.enabled())
+      projection = poster.tile_projection(captureFrame, glm::radians(frame.fov), NEAR_PLANE, FAR_PLANE);
 
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-
-    // light
-    glUniform3f(glGetUniformLocation(shaderProgram, "lightPos"), 10.0f, 10.0f, 10.0f);
-    glUniform3fv(glGetUniformLocation(shaderProgram, "viewPos"), 1, glm::value_ptr(cameraPos));
-    glUniform3f(glGetUniformLocation(shaderProgram, "lightColor"), 1.0f, 1.0f, 1.0f);
+    // shadow map 是 ShadowCascades 自己的快取 (不在 graph 裡), 所以是 side effect
+    auto shadowPass = [&]()
+    {
+      shadowCascades.update(mainLightPos, eyePos, meshes, visibleMeshes, dynamicMeshes, drawShadowCasters);
+    };
+    // 打光用的 uniform 與貼圖, forward 與 visibility buffer 的 resolve 共用
+    auto bindLighting = [&](unsigned int program)
+    {
+      set_frame_uniforms(program, view, projection, eyePos);
+      if (useClusteredLights)
+      {
+        clusteredLights.update(view, projection, NEAR_PLANE, FAR_PLANE);
+        clusteredLights.bind(program);
+      }
+      if (useShadows)
+        shadowCascades.bind(program);
+      if (useLightmap)
+        lightmapper.bind(program);
+      if (useProbes)
+        irradianceVolume.bind(program);
+      if (useSdf)
+        distanceField.bind(program);
+    };
+    auto selectVisible = [&]()
+    {
+      // HLOD 之後 (模擬端已經選好) 超過切換距離的 cluster 換成 impostor (淡出中的 mesh 兩邊都畫)
+      if (useImpostors)
+      {
+        impostors.update(eyePos, meshes, frame.visible, nearMeshes, fadeChanged);
+        if (useMdi)
+        {
+          for (unsigned int meshIndex : fadeChanged)
+            mdiRenderer.set_fade(meshIndex, meshes[meshIndex].fade);
+        }
+      }
+      else
+        nearMeshes = frame.visible;
 
-    // Texture Sampler Units
-    glUniform1i(glGetUniformLocation(shaderProgram, "diffuseMap"), 0);
-    glUniform1i(glGetUniformLocation(shaderProgram, "specularMap"), 1);
+      // 先用 PVS 查這格看得到哪些, 再把被近處建築擋住的 mesh 去掉
+      if (usePvs)
+        pvs.filter(eyePos, nearMeshes, pvsVisible);
+      else
+        pvsVisible = nearMeshes;
+      if (useOcclusionCulling)
+        occlusionCuller.cull(projection * view, meshes, pvsVisible, frameVisible);
+      else
+        frameVisible = pvsVisible;
+    };
+    auto drawImpostors = [&]()
+    {
+      if (useImpostors)
+      {
+        set_frame_uniforms(impostorProgram, view, projection, eyePos);
+        impostors.draw(impostorProgram);
+      }
+    };
+    auto scenePass = [&]()
+    {
+      glClearColor(0.4f, 0.4f, 0.4f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      bindLighting(activeProgram);
+      selectVisible();
+      if (useMdi)
+        mdiRenderer.draw(activeProgram, frameVisible, whiteTexture);
+      else
+        draw_meshes(activeProgram, frameVisible, whiteTexture);
+      drawImpostors();
+    };
 
-    for (auto &mesh : meshes)
+    bool visibilityFrame = visibilityAvailable && frame.visibilityBuffer;
+    std::vector<RenderGraph::Handle> aovTargets; // color, depth, normal, ids
+    if (useSoftwareRasterizer || usePathTracer || useVulkan)
     {
-      if (!mesh.material)
-        continue;
+      const unsigned char *pixels;
+#ifdef HW3_VULKAN
+      if (useVulkan)
+      {
+        if (!vulkanRenderer.render(view, projection, eyePos, mainLightPos, mainLightColor, framebufferWidth,
+                                   framebufferHeight))
+          return false;
+        pixels = vulkanRenderer.color.data();
+      }
+      else
+#endif
+      if (usePathTracer)
+      {
+        pathTracer.render(view, projection, eyePos, mainLightPos, mainLightColor, framebufferWidth, framebufferHeight,
+                          pathTraceSamples);
+        pixels = pathTracer.color.data();
+      }
+      else
+      {
+        softwareRasterizer.render(view, projection, eyePos, mainLightPos, mainLightColor, visibleMeshes,
+                                  framebufferWidth, framebufferHeight);
+        pixels = softwareRasterizer.color.data();
+      }
+      glBindTexture(GL_TEXTURE_2D, softwareTexture);
+      if (softwareTextureWidth != framebufferWidth || softwareTextureHeight != framebufferHeight)
+      {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                     pixels);
+        glBindFramebuffer(GL_FRAMEBUFFER, softwareFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, softwareTexture, 0);
+        softwareTextureWidth = framebufferWidth;
+        softwareTextureHeight = framebufferHeight;
+      }
+      else
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, framebufferWidth, framebufferHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, softwareFramebuffer);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+      glBlitFramebuffer(0, 0, framebufferWidth, framebufferHeight, 0, 0, framebufferWidth, framebufferHeight,
+                        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      if (capture.enabled())
+        capture.capture_pixels(captureFrame, framebufferWidth, framebufferHeight, pixels);
+    }
+    else if (useRenderGraph)
+    {
+      renderGraph.begin_frame(framebufferWidth, framebufferHeight);
+      if (useShadows)
+      {
+        RenderGraph::PassDesc shadowDesc;
+        shadowDesc.sideEffect = true;
+        renderGraph.add_pass("shadow cascades", shadowDesc, [&](const RenderGraph &) { shadowPass(); });
+      }
+      RenderGraph::Handle sceneColor = renderGraph.create_texture("scene color", {GL_RGBA8});
+      RenderGraph::Handle sceneDepth = renderGraph.create_texture("scene depth", {GL_DEPTH_COMPONENT24});
+      if (visibilityFrame)
+      {
+        // 1. 只寫三角形 ID 與深度
+        RenderGraph::PassDesc visibilityDesc;
+        visibilityDesc.colors = {renderGraph.create_texture("visibility", {GL_R32UI})};
+        visibilityDesc.depth = sceneDepth;
+        renderGraph.add_pass("visibility", visibilityDesc, [&](const RenderGraph &)
+        {
+          const GLuint background[4] = {0, 0, 0, 0};
+          glClearBufferuiv(GL_COLOR, 0, background);
+          glClear(GL_DEPTH_BUFFER_BIT);
+          selectVisible();
+          set_frame_uniforms(visibilityProgram, view, projection, eyePos);
+          mdiRenderer.draw_visibility(visibilityProgram, frameVisible);
+        });
+
+        // 2. 全螢幕重建屬性並打光, 深度沿用第一個 pass 的 (impostor 要用)
+        RenderGraph::PassDesc shadeDesc;
+        shadeDesc.reads = {visibilityDesc.colors[0]};
+        shadeDesc.colors = {sceneColor};
+        shadeDesc.depth = sceneDepth;
+        RenderGraph::Handle visibility = visibilityDesc.colors[0];
+        renderGraph.add_pass("resolve", shadeDesc, [&, visibility](const RenderGraph &graph)
+        {
+          glClearColor(0.4f, 0.4f, 0.4f, 1.0f);
+          glClear(GL_COLOR_BUFFER_BIT);
+          bindLighting(resolveProgram);
+          glUniformMatrix4fv(glGetUniformLocation(resolveProgram, "inverseViewProjection"), 1, GL_FALSE,
+                             glm::value_ptr(glm::inverse(projection * view)));
+          glUniform2f(glGetUniformLocation(resolveProgram, "viewportSize"), graph.width(visibility), graph.height(visibility));
+          glUniform1i(glGetUniformLocation(resolveProgram, "visibilityBuffer"), 10);
+          glActiveTexture(GL_TEXTURE10);
+          glBindTexture(GL_TEXTURE_2D, graph.texture(visibility));
+          glActiveTexture(GL_TEXTURE0);
+          glDisable(GL_DEPTH_TEST);
+          mdiRenderer.resolve(resolveProgram, whiteTexture);
+          glEnable(GL_DEPTH_TEST);
+          drawImpostors();
+        });
+      }
+      else if (renderAovs)
+      {
+        // 同一個 geometry pass 用 MRT 寫全部通道; 整數的 target 不能用 glClear, 每張各自清
+        RenderGraph::PassDesc sceneDesc;
+        sceneDesc.colors = {sceneColor, renderGraph.create_texture("linear depth", {GL_R32F}),
+                            renderGraph.create_texture("world normal", {GL_RGBA16F}),
+                            renderGraph.create_texture("object ids", {GL_RG16UI})};
+        sceneDesc.depth = sceneDepth;
+        renderGraph.add_pass("scene aov", sceneDesc, [&](const RenderGraph &)
+        {
+          const GLfloat background[4] = {0.4f, 0.4f, 0.4f, 1.0f}, zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+          const GLuint noObject[4] = {0, 0, 0, 0};
+          glClearBufferfv(GL_COLOR, 0, background);
+          glClearBufferfv(GL_COLOR, 1, zero);
+          glClearBufferfv(GL_COLOR, 2, zero);
+          glClearBufferuiv(GL_COLOR, 3, noObject);
+          glClear(GL_DEPTH_BUFFER_BIT);
+          bindLighting(activeProgram);
+          selectVisible();
+          mdiRenderer.draw(activeProgram, frameVisible, whiteTexture);
+        });
+        aovTargets = sceneDesc.colors;
+      }
+      else
+      {
+        RenderGraph::PassDesc sceneDesc;
+        sceneDesc.colors = {sceneColor};
+        sceneDesc.depth = sceneDepth;
+        renderGraph.add_pass("scene", sceneDesc, [&](const RenderGraph &) { scenePass(); });
+      }
+      if (!poster.enabled())
+        renderGraph.add_blit_pass("present", sceneColor, RenderGraph::BACKBUFFER);
+      if (capture.enabled() && renderAovs)
+      {
+        // 四張 target 讀進同一個 PBO, 相機參數跟著幀號交給 encoder
+        RenderGraph::PassDesc readbackDesc;
+        readbackDesc.reads = aovTargets;
+        readbackDesc.sideEffect = true;
+        renderGraph.add_pass("aov readback", readbackDesc, [&](const RenderGraph &graph)
+        {
+          AovWriter::Camera camera;
+          camera.view = view;
+          camera.projection = projection;
+          camera.position = eyePos;
+          camera.lookAt = eyeLookAt;
+          camera.up = glm::normalize(frame.up);
+          camera.time = sequence.enabled() ? frame.sequenceFrame / sequence.fps : currentFrame;
+          aovs.record_camera(captureFrame, camera);
+          capture.capture_textures(captureFrame,
+                                   AovWriter::layers(graph.texture(aovTargets[0]), graph.texture(aovTargets[1]),
+                                                     graph.texture(aovTargets[2]), graph.texture(aovTargets[3])),
+                                   graph.width(sceneColor), graph.height(sceneColor));
+        });
+      }
+      else if (capture.enabled())
+      {
+        // 直接讀 scene color 進 PBO, 不經過預設 framebuffer
+        RenderGraph::PassDesc readbackDesc;
+        readbackDesc.reads = {sceneColor};
+        readbackDesc.sideEffect = true;
+        renderGraph.add_pass("readback", readbackDesc, [&, sceneColor](const RenderGraph &graph)
+        {
+          capture.capture_texture(captureFrame, graph.texture(sceneColor), graph.width(sceneColor), graph.height(sceneColor));
+        });
+      }
 
-      Material *mat = mesh.material;
+      if (visibilityBench.mode >= 0)
+        glQueryCounter(visibilityBench.queries[0], GL_TIMESTAMP);
+      renderGraph.execute();
+      if (visibilityBench.mode >= 0)
+      {
+        glQueryCounter(visibilityBench.queries[1], GL_TIMESTAMP);
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(visibilityBench.queries[0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(visibilityBench.queries[1], GL_QUERY_RESULT, &end);
+        visibilityBench.gpuMs[visibilityBench.mode].push_back((end - begin) / 1.0e6);
+      }
 
-      // 傳遞材質屬性
-      glUniform3fv(glGetUniformLocation(shaderProgram, "material_Ka"), 1, glm::value_ptr(mat->Ka));
-      glUniform3fv(glGetUniformLocation(shaderProgram, "material_Kd"), 1, glm::value_ptr(mat->Kd));
-      glUniform3fv(glGetUniformLocation(shaderProgram, "material_Ks"), 1, glm::value_ptr(mat->Ks));
-      glUniform1f(glGetUniformLocation(shaderProgram, "material_Ns"), mat->Ns);
-      glUniform1f(glGetUniformLocation(shaderProgram, "material_d"), mat->d);
+      static float lastStatsTime = 0.0f;
+      if (printGraphStats && currentFrame - lastStatsTime > 2.0f)
+      {
+        renderGraph.print_stats();
+        lastStatsTime = currentFrame;
+      }
+    }
+    else
+    {
+      glViewport(0, 0, framebufferWidth, framebufferHeight);
+      if (useShadows)
+        shadowPass();
+      scenePass();
+      if (capture.enabled())
+        capture.capture_framebuffer(captureFrame, framebufferWidth, framebufferHeight);
+    }
 
-      // Diffuse 紋理 (Texture Unit 0)
-      if (mat->diffuseTexID != 0)
+    if (capture.enabled())
+    {
+      capture.poll();
+      ++captureFrame;
+      if (poster.enabled())
       {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, mat->diffuseTexID);
-        glUniform1i(glGetUniformLocation(shaderProgram, "hasDiffuseMap"), 1);
+        std::cout << "Poster tile " << captureFrame << "/" << poster.tile_count() << "\r" << std::flush;
+        if (captureFrame == poster.tile_count())
+          return false;
       }
-      else
+      if (sequence.enabled() && frame.sequenceFrame == sequence.last)
       {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, whiteTexture);
-        glUniform1i(glGetUniformLocation(shaderProgram, "hasDiffuseMap"), 0);
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - sequenceStart).count();
+        int frames = sequence.last - sequence.first + 1;
+        std::cout << "\nRendered " << frames << " frames in " << seconds << " s (" << frames / seconds << " fps)" << std::endl;
+        return false;
       }
+    }
 
-      // Specular 紋理 (Texture Unit 1)
-      if (mat->specularTexID != 0)
+    // 走完一趟 forward 換 visibility buffer 再走一趟, 兩趟都走完就印結果
+    // (--bench-visibility 不能跟 --render-thread 一起用, 所以這裡才能直接改 useVisibilityBuffer)
+    if (visibilityBench.mode >= 0 && !mainPath.isPlaying)
+    {
+      if (++visibilityBench.mode == 2)
       {
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, mat->specularTexID);
-        glUniform1i(glGetUniformLocation(shaderProgram, "hasSpecularMap"), 1);
+        print_visibility_benchmark(visibilityBench.gpuMs);
+        return false;
       }
-      else
+      useVisibilityBuffer = true;
+      mainPath.play();
+    }
+    return true;
+  };
+
+  // 控制處理循環
+  if (!useRenderThread)
+  {
+    FrameSnapshot frame;
+    while (!glfwWindowShouldClose(window))
+    {
+      if (simulate(frame))
+      {
+        dynamicBuffer.begin_frame();
+        bool rendered = renderFrame(frame);
+        dynamicBuffer.end_frame();
+        if (!rendered)
+          break;
+        glfwSwapBuffers(window);
+      }
+      glfwPollEvents();
+    }
+  }
+  else
+  {
+    // 主執行緒只處理事件與模擬, 畫好的 snapshot 經 triple buffer 交給繪製執行緒.
+    // 繪製端一拿走第 N 幀, 主執行緒就開始模擬第 N+1 幀; 拖視窗或 cout 卡住時繪製端照樣畫
+    TripleBuffer<FrameSnapshot> frames;
+    std::atomic<bool> renderFinished{false};
+    glfwMakeContextCurrent(NULL);
+    std::thread renderThread([&]()
+    {
+      glfwMakeContextCurrent(window);
+      for (;;)
       {
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, whiteTexture);
-        glUniform1i(glGetUniformLocation(shaderProgram, "hasSpecularMap"), 0);
+        frames.wait_acquire();
+        const FrameSnapshot &frame = frames.front();
+        if (frame.quit)
+          break;
+        dynamicBuffer.begin_frame();
+        bool rendered = renderFrame(frame);
+        dynamicBuffer.end_frame();
+        if (!rendered)
+        {
+          // 輸出完成: 先標記再把等著的 snapshot 拿走, 主執行緒不會卡在 wait_consumed
+          renderFinished = true;
+          frames.acquire();
+          break;
+        }
+        glfwSwapBuffers(window);
       }
+      glfwMakeContextCurrent(NULL);
+    });
 
-      glBindVertexArray(mesh.VAO);
-      glDrawArrays(GL_TRIANGLES, 0, mesh.vertices.size() / 8);
+    while (!glfwWindowShouldClose(window) && !renderFinished)
+    {
+      glfwPollEvents();
+      if (!frames.consumed())
+      {
+        // 上一份還沒被拿走: 有視窗就繼續處理事件, headless 沒有事件可處理就直接等
+        if (headless)
+          frames.wait_consumed();
+        else
+          glfwWaitEventsTimeout(0.001);
+        continue;
+      }
+      if (simulate(frames.back()))
+        frames.publish();
     }
+    frames.back().quit = true;
+    frames.publish();
+    renderThread.join();
+    glfwMakeContextCurrent(window);
+  }
 
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+  // 剩下的 readback 與還沒編完的影格 (只有這裡會等 GPU 與磁碟)
+  if (capture.enabled())
+  {
+    auto drainStart = std::chrono::high_resolution_clock::now();
+    capture.finish();
+    std::cout << "\nCapture drained in "
+              << std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - drainStart).count() << " s"
+              << std::endl;
+    if (poster.enabled())
+    {
+      bool written = poster.close();
+      std::cout << "Poster " << (written ? "written to " : "FAILED: ") << posterPath << " in "
+                << std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - posterStart).count()
+                << " s, peak " << capture.peakPendingBytes / (1024 * 1024) << " MB queued" << std::endl;
+    }
+    else
+      capture.print_stats();
+    if (renderAovs)
+      std::cout << "AOV: " << aovs.framesWritten << " frames written" << std::endl;
+    capture.release();
   }
 
-  for (auto &mesh : meshes)
+  geometryArena.release();
+  if (useMdi)
+  {
+    mdiRenderer.release();
+    glDeleteProgram(mdiProgram);
+  }
+  if (visibilityAvailable)
+  {
+    glDeleteProgram(visibilityProgram);
+    glDeleteProgram(resolveProgram);
+  }
+  if (aovProgram)
+    glDeleteProgram(aovProgram);
+  if (useSoftwareRasterizer || usePathTracer || useVulkan)
   {
-    glDeleteVertexArrays(1, &mesh.VAO);
-    glDeleteBuffers(1, &mesh.VBO);
+    softwareRasterizer.release();
+    pathTracer.release();
+#ifdef HW3_VULKAN
+    vulkanRenderer.release();
+#endif
+    glDeleteTextures(1, &softwareTexture);
+    glDeleteFramebuffers(1, &softwareFramebuffer);
   }
+  if (visibilityBench.queries[0])
+    glDeleteQueries(2, visibilityBench.queries);
   glDeleteProgram(shaderProgram);
+  if (useImpostors)
+  {
+    impostors.release();
+    glDeleteProgram(impostorProgram);
+  }
+  if (useInstancing)
+    instancer.release();
+  dynamicBuffer.release();
+  if (useClusteredLights)
+    clusteredLights.release();
+  if (useLightmap)
+    lightmapper.release();
+  if (useProbes)
+    irradianceVolume.release();
+  if (useSdf)
+    distanceField.release();
+  if (useRenderGraph)
+    renderGraph.release();
+  if (useShadows)
+  {
+    shadowCascades.release();
+    glDeleteProgram(shadowProgram);
+  }
+  if (useTextureArrays)
+    release_texture_arrays();
   glfwTerminate();
   return 0;
 }
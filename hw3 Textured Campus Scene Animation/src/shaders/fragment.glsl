@@ -1,44 +1,507 @@
 #version 330 core
-in vec3 FragPos;
-in vec3 Normal;
-in vec2 TexCoord;
+#ifdef VULKAN
+// Vulkan (建置時編成 SPIR-V, 一定是 MDI): 變數 location 與 vertex.glsl 對應
+#define LOC(n) layout(location=n)
+#else
+#define LOC(n)
+#endif
+#ifdef VISIBILITY_RESOLVE
+// visibility buffer 的 resolve pass 是全螢幕三角形: 下面這些輸入改成全域變數, 由 reconstruct() 從 SSBO 重建
+#define VARYING
+#define FLAT_VARYING
+#else
+#define VARYING in
+#define FLAT_VARYING flat in
+#endif
+LOC(1) VARYING vec3 FragPos;
+LOC(2) VARYING vec3 Normal;
+LOC(0) VARYING vec2 TexCoord;
 
-out vec4 FragColor;
+#ifdef IMPOSTOR_BAKE
+// impostor 烘焙: 輸出不打光的顏色, 以及法線 + 深度
+layout(location=0) out vec4 FragColor;
+layout(location=1) out vec4 NormalDepth;
+#elif defined(AOV_OUTPUT)
+// AOV (資料集輸出, 只有 MDI 路徑): 顏色之外同一個 pass 寫線性深度、世界座標法線, 以及材質與 mesh 編號 (+1, 0 是背景)
+layout(location=0) out vec4 FragColor;
+layout(location=1) out float LinearDepth;
+layout(location=2) out vec4 WorldNormal;
+layout(location=3) out uvec2 ObjectId;
+flat in uint MeshIndex;
+in float ViewDepth;
+#else
+layout(location=0) out vec4 FragColor;
+#endif
 
+#ifdef VULKAN
+layout(std140, set=0, binding=2) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec3 lightPos;
+    vec3 viewPos;
+    vec3 lightColor;
+};
+#else
 uniform vec3 lightPos;
 uniform vec3 viewPos;
+#endif
 
+#if defined(VULKAN)
+// descriptor indexing: 全部材質貼圖在同一個陣列, index 由 per-draw 資料帶進來 (沒有貼圖的是白色的第 0 張)
+layout(set=0, binding=3) uniform sampler2D textures[];
+LOC(4) flat in uvec2 TextureLayers;
+#elif defined(USE_TEXTURE_ARRAYS)
+// 貼圖陣列: 同尺寸/格式的貼圖共用一個 array, layer 由 per-draw 資料 (或 uniform) 決定
+uniform sampler2DArray diffuseMap;
+uniform sampler2DArray specularMap;
+#ifdef USE_MDI
+FLAT_VARYING uvec2 TextureLayers;
+#else
+uniform int diffuseLayer;
+uniform int specularLayer;
+#endif
+#else
 uniform sampler2D diffuseMap;
 uniform sampler2D specularMap;
+#endif
+
+#ifdef USE_MDI
+// MDI 路徑: 材質從 SSBO 讀, 欄位與下面的 uniform 版本一一對應
+LOC(3) FLAT_VARYING uint MaterialIndex;
+
+struct MaterialData
+{
+    vec4 Ka;
+    vec4 Kd;
+    vec4 Ks;
+    vec4 Ke;
+    vec4 params; // x: Ns, y: d, z: hasDiffuseMap, w: hasSpecularMap
+};
+layout(std430, binding=1) readonly buffer MaterialBuffer
+{
+    MaterialData materials[];
+};
+#else
 uniform bool hasDiffuseMap;
 uniform bool hasSpecularMap;
 
 uniform vec3 material_Ka;
 uniform vec3 material_Kd;
 uniform vec3 material_Ks;
+uniform vec3 material_Ke;
 uniform float material_Ns;
 uniform float material_d;
+#endif
 
+LOC(5) FLAT_VARYING float DitherFade; // 0: 完整顯示, 1: 完全隱藏 (已換成 impostor)
+
+#ifndef VULKAN
 uniform vec3 lightColor;
+#endif
+
+#ifdef USE_LIGHTMAP
+// 烘焙好的漫射光 (irradiance / pi): 乘上 albedo 就是結果; x < 0 的 mesh 沒有 lightmap, 照常即時打光
+VARYING vec2 LightmapUV;
+uniform sampler2D lightmap;
+#endif
+
+#ifdef USE_VERTEX_AO
+// 逐頂點烘焙的 ambient occlusion, 只影響 ambient (lightmap 已經含有遮蔽)
+VARYING float AmbientOcclusion;
+#endif
+
+#ifdef USE_PROBES
+// 烘焙的 irradiance probe (L2 SH, 已經跟 cosine lobe 卷積並除以 pi): 沒有 lightmap 的表面用來取代常數 ambient
+uniform sampler3D probeVolume; // 9 個係數依序疊在 z 方向, 每段 probeDims.z 層
+uniform vec3 probeMin;         // 最外圈 probe 的位置
+uniform vec3 probeMax;
+uniform ivec3 probeDims;
+
+vec3 probe_irradiance(vec3 norm)
+{
+    vec3 dims = vec3(probeDims);
+    vec3 cell = (probeMax - probeMin) / (dims - 1.0);
+    // 沿法線推半格, 貼著牆的 fragment 才不會讀到牆裡面的 probe
+    vec3 g = clamp((FragPos + norm * 0.5 * cell - probeMin) / max(probeMax - probeMin, vec3(1e-6)), 0.0, 1.0);
+    g = g * (dims - 1.0) + 0.5; // texel 座標, 每段裡的 z 不會超出 [0.5, dims.z - 0.5]
+    vec3 c[9];
+    for (int k = 0; k < 9; ++k)
+        c[k] = texture(probeVolume, vec3(g.xy / dims.xy, (g.z + float(k) * dims.z) / (dims.z * 9.0))).rgb;
+
+    vec3 n = norm;
+    vec3 result = c[0] * 0.282095
+                + c[1] * 0.488603 * n.y + c[2] * 0.488603 * n.z + c[3] * 0.488603 * n.x
+                + c[4] * 1.092548 * n.x * n.y + c[5] * 1.092548 * n.y * n.z
+                + c[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+                + c[7] * 1.092548 * n.x * n.z + c[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+    return max(result, vec3(0.0));
+}
+#endif
+
+#ifdef USE_SHADOWS
+// 快取的 cascaded shadow map: 選包含這個 fragment 的最小一層, 3x3 PCF (每次取樣是硬體 2x2 比較)
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[4];
+uniform float shadowNormalOffset[4]; // 每層沿法線推出去的距離 (約 1.5 個 texel)
+uniform int shadowCascadeCount;
+uniform float shadowTexel;
+
+float shadow_factor(vec3 norm)
+{
+    for (int i = 0; i < shadowCascadeCount; ++i)
+    {
+        vec4 p = shadowMatrices[i] * vec4(FragPos + norm * shadowNormalOffset[i], 1.0);
+        vec3 uvz = p.xyz * 0.5 + 0.5;
+        if (any(lessThan(uvz.xy, vec2(2.0 * shadowTexel))) || any(greaterThan(uvz.xy, vec2(1.0 - 2.0 * shadowTexel))) || uvz.z > 1.0)
+            continue;
+
+        float lit = 0.0;
+        for (int y = -1; y <= 1; ++y)
+        {
+            for (int x = -1; x <= 1; ++x)
+                lit += texture(shadowMap, vec4(uvz.xy + vec2(x, y) * shadowTexel, float(i), uvz.z));
+        }
+        return lit / 9.0;
+    }
+    return 1.0;
+}
+#endif
+
+#ifdef USE_SDF
+// 稀疏 brick 距離場: sphere trace 往光源的軟陰影 + 沿法線的逐像素 AO
+uniform sampler3D sdfAtlas;       // 配置的 brick, 每塊 9^3 個取樣 (邊界重複)
+uniform sampler3D sdfIndirection; // 每個 brick: xyz = atlas 裡的 brick 座標, w = 空 brick 的距離 (x < 0)
+uniform vec3 sdfOrigin;
+uniform float sdfVoxel;
+uniform ivec3 sdfBrickDims;
+uniform vec3 sdfAtlasSize;
+uniform float sdfShadowDistance;
+uniform float sdfSoftness;
+
+// exact = false 時只是下界 (volume 外面或空 brick), 只能拿來決定步長
+float sdf_distance(vec3 p, out bool exact)
+{
+    exact = false;
+    vec3 v = (p - sdfOrigin) / sdfVoxel;
+    vec3 size = vec3(sdfBrickDims * 8);
+    // volume 外面: 到 volume 的距離當下界
+    vec3 outside = max(max(-v, v - size), vec3(0.0));
+    if (any(greaterThan(outside, vec3(0.0))))
+        return length(outside) * sdfVoxel + sdfVoxel;
+
+    ivec3 brick = min(ivec3(v / 8.0), sdfBrickDims - 1);
+    vec4 entry = texelFetch(sdfIndirection, brick, 0);
+    if (entry.x < 0.0)
+        return entry.w;
+    exact = true;
+    vec3 local = v - vec3(brick * 8);
+    return texture(sdfAtlas, (entry.xyz * 9.0 + local + 0.5) / sdfAtlasSize).r;
+}
+
+// Quilez 的 penumbra 估計: 沿途最小的 k * d / t
+float sdf_soft_shadow(vec3 norm, vec3 lightDir)
+{
+    vec3 origin = FragPos + norm * (2.0 * sdfVoxel);
+    float t = sdfVoxel;
+    float lit = 1.0;
+    for (int i = 0; i < 48 && t < sdfShadowDistance; ++i)
+    {
+        bool exact;
+        float d = sdf_distance(origin + lightDir * t, exact);
+        if (d < 0.1 * sdfVoxel)
+            return 0.0;
+        // 下界的距離會把空 brick 的邊界畫成一格一格的假半影
+        if (exact)
+            lit = min(lit, sdfSoftness * d / t);
+        t += max(d, 0.5 * sdfVoxel);
+    }
+    return clamp(lit, 0.0, 1.0);
+}
+
+// 沿法線取 5 點, 距離比預期短多少就遮蔽多少
+float sdf_ao(vec3 norm)
+{
+    float occlusion = 0.0;
+    float weight = 1.0;
+    for (int i = 1; i <= 5; ++i)
+    {
+        float h = float(i) * 1.5 * sdfVoxel;
+        bool exact;
+        occlusion += weight * max(h - sdf_distance(FragPos + norm * h, exact), 0.0) / h;
+        weight *= 0.6;
+    }
+    return clamp(1.0 - 0.45 * occlusion, 0.0, 1.0);
+}
+#endif
+
+#ifdef USE_CLUSTERED_LIGHTS
+// clustered forward: CPU 每幀把點光源分進 froxel, 這裡只算自己 cluster 裡的光源
+uniform mat4 view;
+uniform samplerBuffer lightData;     // 每盞 2 個 texel: (position, radius), (color, 0)
+uniform usamplerBuffer clusterGrid;  // 每個 cluster: (offset, count)
+uniform usamplerBuffer lightIndices; // 依 cluster 排好的光源 index
+uniform ivec3 clusterDims;           // tilesX, tilesY, slices
+uniform vec2 clusterViewport;
+uniform vec2 clusterDepth;           // x: 第 0 個切片的遠端, y: (slices - 1) / log(far / x)
+
+vec3 clustered_lighting(vec3 norm, vec3 viewDir, vec3 objectColor, vec3 specularColor, float shininess)
+{
+    ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterViewport * vec2(clusterDims.xy)), clusterDims.xy - 1);
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    int slice = depth < clusterDepth.x ? 0 : min(int(log(depth / clusterDepth.x) * clusterDepth.y) + 1, clusterDims.z - 1);
+    uvec2 cell = texelFetch(clusterGrid, (slice * clusterDims.y + tile.y) * clusterDims.x + tile.x).xy;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < cell.y; ++i)
+    {
+        int light = int(texelFetch(lightIndices, int(cell.x + i)).r);
+        vec4 positionRadius = texelFetch(lightData, light * 2);
+        vec3 color = texelFetch(lightData, light * 2 + 1).rgb;
+
+        vec3 toLight = positionRadius.xyz - FragPos;
+        float d2 = dot(toLight, toLight) / (positionRadius.w * positionRadius.w);
+        if (d2 >= 1.0)
+            continue;
+        // 半徑處平滑降到 0 的窗函數 × 反平方衰減
+        float window = (1.0 - d2) * (1.0 - d2);
+        float atten = window / (1.0 + 25.0 * d2);
+
+        vec3 lightDir = normalize(toLight);
+        float diff = max(dot(norm, lightDir), 0.0);
+        float spec = pow(max(dot(viewDir, reflect(-lightDir, norm)), 0.0), shininess);
+        result += atten * color * (diff * objectColor + spec * specularColor);
+    }
+    return result;
+}
+#endif
+
+#ifdef VISIBILITY_RESOLVE
+// 每個像素: (mesh index + 1) << triangleBits | mesh 裡的三角形編號, 0 是背景
+uniform usampler2D visibilityBuffer;
+uniform uint triangleBits;
+uniform uint resolveBatch;          // 這次只畫這個貼圖 batch 的像素
+uniform mat4 inverseViewProjection;
+uniform vec2 viewportSize;
+
+struct DrawData
+{
+    mat4 model;
+    uvec4 info;
+};
+layout(std430, binding=0) readonly buffer DrawBuffer
+{
+    DrawData draws[];
+};
+layout(std430, binding=2) readonly buffer MeshRangeBuffer
+{
+    uvec4 meshRanges[]; // x: firstIndex, y: baseVertex, z: batch
+};
+layout(std430, binding=3) readonly buffer VertexBuffer
+{
+    float vertexData[]; // pos, uv, normal
+};
+layout(std430, binding=4) readonly buffer IndexBuffer
+{
+    uint indexData[];
+};
+layout(std430, binding=5) readonly buffer LightmapUVBuffer
+{
+    vec2 lightmapData[];
+};
+layout(std430, binding=6) readonly buffer AoBuffer
+{
+    float aoData[];
+};
+
+// 貼圖取樣用的 UV 微分 (全螢幕三角形的 dFdx 在三角形邊界上是錯的)
+vec2 TexCoordDx, TexCoordDy;
+vec2 LightmapDx, LightmapDy;
+
+// 像素中心的視線跟三角形平面的交點 -> 重心座標 (不夾在三角形內, 鄰居像素也能用)
+vec3 ray_barycentrics(vec3 p0, vec3 p1, vec3 p2, vec2 pixel)
+{
+    vec2 ndc = pixel / viewportSize * 2.0 - 1.0;
+    vec4 nearPoint = inverseViewProjection * vec4(ndc, -1.0, 1.0);
+    vec4 farPoint = inverseViewProjection * vec4(ndc, 1.0, 1.0);
+    vec3 origin = nearPoint.xyz / nearPoint.w;
+    vec3 direction = farPoint.xyz / farPoint.w - origin;
+
+    vec3 e1 = p1 - p0, e2 = p2 - p0;
+    vec3 pv = cross(direction, e2);
+    float inv = 1.0 / dot(e1, pv);
+    vec3 tv = origin - p0;
+    float u = dot(tv, pv) * inv;
+    float v = dot(direction, cross(tv, e1)) * inv;
+    return vec3(1.0 - u - v, u, v);
+}
+
+vec3 vertex_position(uint i) { return vec3(vertexData[i * 8u], vertexData[i * 8u + 1u], vertexData[i * 8u + 2u]); }
+vec2 vertex_uv(uint i) { return vec2(vertexData[i * 8u + 3u], vertexData[i * 8u + 4u]); }
+vec3 vertex_normal(uint i) { return vec3(vertexData[i * 8u + 5u], vertexData[i * 8u + 6u], vertexData[i * 8u + 7u]); }
+
+// 背景或別的 batch 回傳 false
+bool reconstruct()
+{
+    uint visibility = texelFetch(visibilityBuffer, ivec2(gl_FragCoord.xy), 0).r;
+    if (visibility == 0u)
+        return false;
+    uint drawId = (visibility >> triangleBits) - 1u;
+    uvec4 range = meshRanges[drawId];
+    if (range.z != resolveBatch)
+        return false;
+    uint triangle = visibility & ((1u << triangleBits) - 1u);
+    uint base = range.x + triangle * 3u;
+    uint i0 = uint(int(indexData[base]) + int(range.y));
+    uint i1 = uint(int(indexData[base + 1u]) + int(range.y));
+    uint i2 = uint(int(indexData[base + 2u]) + int(range.y));
+
+    mat4 model = draws[drawId].model;
+    MaterialIndex = draws[drawId].info.x;
+    TextureLayers = draws[drawId].info.yz;
+    DitherFade = 0.0; // 淡出的 dither 已經在 visibility pass 做過
+
+    vec3 p0 = vec3(model * vec4(vertex_position(i0), 1.0));
+    vec3 p1 = vec3(model * vec4(vertex_position(i1), 1.0));
+    vec3 p2 = vec3(model * vec4(vertex_position(i2), 1.0));
+    vec3 b = ray_barycentrics(p0, p1, p2, gl_FragCoord.xy);
+    vec3 bx = ray_barycentrics(p0, p1, p2, gl_FragCoord.xy + vec2(1.0, 0.0)) - b;
+    vec3 by = ray_barycentrics(p0, p1, p2, gl_FragCoord.xy + vec2(0.0, 1.0)) - b;
+
+    FragPos = p0 * b.x + p1 * b.y + p2 * b.z;
+    Normal = mat3(transpose(inverse(model))) *
+             (vertex_normal(i0) * b.x + vertex_normal(i1) * b.y + vertex_normal(i2) * b.z);
+    mat3x2 uv = mat3x2(vertex_uv(i0), vertex_uv(i1), vertex_uv(i2));
+    TexCoord = uv * b;
+    TexCoordDx = uv * bx;
+    TexCoordDy = uv * by;
+#ifdef USE_LIGHTMAP
+    mat3x2 lightmapUV = mat3x2(lightmapData[i0], lightmapData[i1], lightmapData[i2]);
+    LightmapUV = lightmapUV * b;
+    LightmapDx = lightmapUV * bx;
+    LightmapDy = lightmapUV * by;
+#endif
+#ifdef USE_VERTEX_AO
+    AmbientOcclusion = dot(vec3(aoData[i0], aoData[i1], aoData[i2]), b);
+#endif
+    return true;
+}
+#endif
+
+vec4 sample_diffuse()
+{
+#if defined(VULKAN)
+    return texture(textures[nonuniformEXT(TextureLayers.x)], TexCoord);
+#elif defined(VISIBILITY_RESOLVE) && defined(USE_TEXTURE_ARRAYS)
+    return textureGrad(diffuseMap, vec3(TexCoord, float(TextureLayers.x)), TexCoordDx, TexCoordDy);
+#elif defined(VISIBILITY_RESOLVE)
+    return textureGrad(diffuseMap, TexCoord, TexCoordDx, TexCoordDy);
+#elif defined(USE_TEXTURE_ARRAYS) && defined(USE_MDI)
+    return texture(diffuseMap, vec3(TexCoord, float(TextureLayers.x)));
+#elif defined(USE_TEXTURE_ARRAYS)
+    return texture(diffuseMap, vec3(TexCoord, float(diffuseLayer)));
+#else
+    return texture(diffuseMap, TexCoord);
+#endif
+}
+
+vec4 sample_specular()
+{
+#if defined(VULKAN)
+    return texture(textures[nonuniformEXT(TextureLayers.y)], TexCoord);
+#elif defined(VISIBILITY_RESOLVE) && defined(USE_TEXTURE_ARRAYS)
+    return textureGrad(specularMap, vec3(TexCoord, float(TextureLayers.y)), TexCoordDx, TexCoordDy);
+#elif defined(VISIBILITY_RESOLVE)
+    return textureGrad(specularMap, TexCoord, TexCoordDx, TexCoordDy);
+#elif defined(USE_TEXTURE_ARRAYS) && defined(USE_MDI)
+    return texture(specularMap, vec3(TexCoord, float(TextureLayers.y)));
+#elif defined(USE_TEXTURE_ARRAYS)
+    return texture(specularMap, vec3(TexCoord, float(specularLayer)));
+#else
+    return texture(specularMap, TexCoord);
+#endif
+}
+
+// 4x4 Bayer 門檻, mesh 與 impostor 用互補的像素交叉淡出
+float dither_threshold()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0,
+                                      3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+}
 
 void main()
 {
+#ifdef VISIBILITY_RESOLVE
+    if (!reconstruct())
+        discard;
+#endif
+#ifdef USE_MDI
+    MaterialData mat = materials[MaterialIndex];
+    vec3 material_Ka = mat.Ka.rgb;
+    vec3 material_Kd = mat.Kd.rgb;
+    vec3 material_Ks = mat.Ks.rgb;
+    vec3 material_Ke = mat.Ke.rgb;
+    float material_Ns = mat.params.x;
+    float material_d = mat.params.y;
+    bool hasDiffuseMap = mat.params.z > 0.5;
+    bool hasSpecularMap = mat.params.w > 0.5;
+#endif
+    if (DitherFade > 0.0 && dither_threshold() < DitherFade)
+        discard;
+#ifdef AOV_OUTPUT
+    // 要在 lightmap 提早 return 之前寫
+    LinearDepth = ViewDepth;
+    WorldNormal = vec4(normalize(Normal), 1.0);
+    ObjectId = uvec2(MaterialIndex + 1u, MeshIndex + 1u);
+#endif
+
     // === 獲取基礎顏色 ===
     vec3 objectColor;
     if (hasDiffuseMap)
     {
-        objectColor = texture(diffuseMap, TexCoord).rgb;
+        objectColor = sample_diffuse().rgb;
     }
     else
     {
         objectColor = length(material_Kd) > 0.01 ? material_Kd : vec3(0.8, 0.8, 0.8);
     }
     
+#ifdef IMPOSTOR_BAKE
+    FragColor = vec4(objectColor, 1.0);
+    NormalDepth = vec4(normalize(Normal) * 0.5 + 0.5, gl_FragCoord.z);
+    return;
+#endif
+
+#ifdef USE_LIGHTMAP
+    if (LightmapUV.x >= 0.0)
+    {
+#ifdef VISIBILITY_RESOLVE
+        vec3 baked = textureGrad(lightmap, LightmapUV, LightmapDx, LightmapDy).rgb;
+#else
+        vec3 baked = texture(lightmap, LightmapUV).rgb;
+#endif
+        FragColor = vec4(objectColor * baked + material_Ke, material_d);
+        return;
+    }
+#endif
+
+    vec3 norm = normalize(Normal);
+
     // === 1. Ambient (降低環境光) ===
+#ifdef USE_PROBES
+    vec3 ambient = probe_irradiance(norm) * objectColor;
+#else
     vec3 ambient = 0.3 * objectColor;
+#endif
+#if defined(USE_SDF)
+    ambient *= sdf_ao(norm); // 逐像素, 取代逐頂點 AO
+#elif defined(USE_VERTEX_AO)
+    ambient *= AmbientOcclusion;
+#endif
     
     // === 2. Diffuse ===
-    vec3 norm = normalize(Normal);
     vec3 lightDir = normalize(lightPos - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
     vec3 diffuse = diff * objectColor * lightColor;
@@ -52,16 +515,32 @@ void main()
     vec3 specularColor;
     if (hasSpecularMap)
     {
-        specularColor = texture(specularMap, TexCoord).rgb;
+        specularColor = sample_specular().rgb;
     }
     else
     {
         specularColor = vec3(0.2);  // 降低高光強度
     }
     vec3 specular = spec * specularColor * lightColor;
+#if defined(USE_SHADOWS) || defined(USE_SDF)
+    float shadow = 1.0;
+#ifdef USE_SHADOWS
+    shadow = shadow_factor(norm);
+#endif
+#ifdef USE_SDF
+    // 近距離的接觸陰影交給距離場, 越近越軟; 背光面不用 trace
+    if (diff > 0.0)
+        shadow = min(shadow, sdf_soft_shadow(norm, lightDir));
+#endif
+    diffuse *= shadow;
+    specular *= shadow;
+#endif
     
     // === 4. 合成 ===
     vec3 result = ambient + diffuse + specular;
+#ifdef USE_CLUSTERED_LIGHTS
+    result += clustered_lighting(norm, viewDir, objectColor, specularColor, shininess) + material_Ke;
+#endif
     
     FragColor = vec4(result, material_d);
 }
\ No newline at end of file
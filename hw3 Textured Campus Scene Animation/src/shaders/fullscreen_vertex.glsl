@@ -0,0 +1,6 @@
+#version 330 core
+// 蓋滿整個畫面的三角形: glDrawArrays(GL_TRIANGLES, 0, 3), 不需要頂點資料
+void main(){
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
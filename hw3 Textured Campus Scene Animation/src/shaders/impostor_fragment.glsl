@@ -0,0 +1,130 @@
+#version 330 core
+in vec3 WorldPos;
+
+out vec4 FragColor;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 viewPos;
+uniform vec3 lightPos;
+uniform vec3 lightColor;
+
+uniform vec3 impostorCenter;
+uniform float impostorRadius;
+uniform int impostorLayer;
+uniform int framesPerAxis;
+uniform float ditherFade; // 0: 完全隱藏, 1: 完整顯示 (跟 mesh 的 ditherFade 互補)
+
+// octahedral atlas: rgb 不打光的顏色 + a 覆蓋率; rgb 法線 + a 深度 (正交投影, 0..4r)
+uniform sampler2DArray colorAtlas;
+uniform sampler2DArray normalAtlas;
+
+// hemi-octahedral: frame 座標 -> 上半球的方向 (與 impostor.cpp 相同)
+vec3 frame_direction(vec2 frame)
+{
+    vec2 g = (frame + 0.5) / float(framesPerAxis) * 2.0 - 1.0;
+    vec3 d = vec3(0.5 * (g.x + g.y), 0.0, 0.5 * (g.x - g.y));
+    d.y = 1.0 - abs(d.x) - abs(d.z);
+    return normalize(d);
+}
+
+// 視線打到某個 frame 的投影平面, 取出顏色與法線深度, worldPoint 是還原出來的表面位置
+vec4 sample_frame(vec2 frame, vec3 rayDir, out vec4 normalDepth, out vec3 worldPoint)
+{
+    normalDepth = vec4(0.0);
+    worldPoint = impostorCenter;
+
+    vec3 dir = frame_direction(frame);
+    float denom = dot(rayDir, dir);
+    if (denom > -1e-4)
+        return vec4(0.0);
+
+    // 與 glm::lookAt(center + dir * 2r, center, up) 相同的基底
+    vec3 f = -dir;
+    vec3 up = abs(dir.y) > 0.999 ? vec3(0.0, 0.0, -1.0) : vec3(0.0, 1.0, 0.0);
+    vec3 s = normalize(cross(f, up));
+    vec3 u = cross(s, f);
+
+    float t = dot(impostorCenter - viewPos, dir) / denom;
+    vec3 onPlane = viewPos + rayDir * t;
+    vec3 local = onPlane - impostorCenter;
+    vec2 uv = vec2(dot(local, s), dot(local, u)) / (2.0 * impostorRadius) + 0.5;
+    if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0))))
+        return vec4(0.0);
+
+    // 內縮半個 texel, 雙線性取樣才不會混到隔壁的 frame
+    float frameSize = float(textureSize(colorAtlas, 0).x) / float(framesPerAxis);
+    uv = clamp(uv, vec2(0.5 / frameSize), vec2(1.0 - 0.5 / frameSize));
+    vec3 atlasUV = vec3((frame + uv) / float(framesPerAxis), float(impostorLayer));
+
+    normalDepth = texture(normalAtlas, atlasUV);
+    worldPoint = onPlane + dir * (2.0 * impostorRadius - 4.0 * impostorRadius * normalDepth.a);
+    return texture(colorAtlas, atlasUV);
+}
+
+float dither_threshold()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0,
+                                      3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+}
+
+void main()
+{
+    if (dither_threshold() >= ditherFade)
+        discard;
+
+    // 相機方向 -> 連續的 frame 座標, 取最近的 2x2 個 frame 雙線性混合
+    vec3 toEye = normalize(viewPos - impostorCenter);
+    toEye.y = max(toEye.y, 0.0);
+    toEye /= abs(toEye.x) + abs(toEye.y) + abs(toEye.z);
+    vec2 g = vec2(toEye.x + toEye.z, toEye.x - toEye.z);
+    vec2 frameCoord = clamp((g * 0.5 + 0.5) * float(framesPerAxis) - 0.5, vec2(0.0), vec2(float(framesPerAxis - 1)));
+    vec2 base = min(floor(frameCoord), vec2(float(framesPerAxis - 2)));
+    vec2 w = frameCoord - base;
+
+    vec3 rayDir = normalize(WorldPos - viewPos);
+    vec4 color = vec4(0.0);
+    vec3 normalSum = vec3(0.0);
+    float bestWeight = 0.0;
+    vec3 surface = impostorCenter;
+    for (int i = 0; i < 4; ++i)
+    {
+        vec2 offset = vec2(i & 1, i >> 1);
+        vec2 bilinear = mix(1.0 - w, w, offset);
+        float weight = bilinear.x * bilinear.y;
+
+        vec4 normalDepth;
+        vec3 worldPoint;
+        vec4 c = sample_frame(base + offset, rayDir, normalDepth, worldPoint);
+        color += vec4(c.rgb * c.a, c.a) * weight;
+        normalSum += (normalDepth.rgb * 2.0 - 1.0) * c.a * weight;
+        if (c.a * weight > bestWeight)
+        {
+            bestWeight = c.a * weight;
+            surface = worldPoint;
+        }
+    }
+    if (color.a < 0.5)
+        discard;
+
+    vec3 objectColor = color.rgb / color.a;
+    vec3 norm = normalize(normalSum);
+
+    // 跟 fragment.glsl 一樣的 Phong (高光用預設值)
+    vec3 ambient = 0.3 * objectColor;
+    vec3 lightDir = normalize(lightPos - surface);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = diff * objectColor * lightColor;
+    vec3 viewDir = normalize(viewPos - surface);
+    vec3 reflectDir = reflect(-lightDir, norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0);
+    vec3 specular = spec * vec3(0.2) * lightColor;
+
+    FragColor = vec4(ambient + diffuse + specular, 1.0);
+
+    // 用還原的表面位置寫深度, 跟真實幾何正確互相遮擋
+    vec4 clip = projection * view * vec4(surface, 1.0);
+    gl_FragDepth = clamp(clip.z / clip.w * 0.5 + 0.5, 0.0, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+layout(location=0) in vec2 aCorner; // [-1, 1]
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 viewPos;
+uniform vec3 impostorCenter;
+uniform float impostorRadius;
+
+out vec3 WorldPos;
+
+void main(){
+    // 面向相機的四邊形, 往相機推一個半徑, 才不會被 cluster 本身的深度切掉
+    vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+    vec3 toEye = normalize(viewPos - impostorCenter);
+    WorldPos = impostorCenter + toEye * impostorRadius + (aCorner.x * right + aCorner.y * up) * impostorRadius;
+    gl_Position = projection * view * vec4(WorldPos, 1.0);
+}
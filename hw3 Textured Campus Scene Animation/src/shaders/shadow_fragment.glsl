@@ -0,0 +1,5 @@
+#version 330 core
+// shadow map: 只寫深度 (搭配 vertex.glsl 的逐 mesh 版本)
+void main()
+{
+}
@@ -1,19 +1,98 @@
 #version 330 core
+#ifdef VULKAN
+// Vulkan (建置時編成 SPIR-V): 兩個 stage 之間的變數要寫死 location, uniform 要放在 block 裡
+#define LOC(n) layout(location=n)
+#else
+#define LOC(n)
+#endif
 layout(location=0) in vec3 aPos;
 layout(location=1) in vec2 aTexCoord;
 layout(location=2) in vec3 aNormal;
 
-uniform mat4 model;
+#ifdef USE_MDI
+// MDI 路徑: draw ID 由 baseInstance 帶入, transform 與材質編號從 SSBO 讀
+layout(location=3) in uint aDrawID;
+
+struct DrawData
+{
+    mat4 model;
+    uvec4 info; // x: material index, y: diffuse layer, z: specular layer, w: fade (float bits)
+};
+layout(std430, binding=0) readonly buffer DrawBuffer
+{
+    DrawData draws[];
+};
+
+LOC(3) flat out uint MaterialIndex;
+LOC(4) flat out uvec2 TextureLayers; // 貼圖陣列模式: diffuse / specular layer; Vulkan: textures[] 的 index
+
+#ifdef AOV_OUTPUT
+flat out uint MeshIndex;
+out float ViewDepth; // 沿視線方向的距離 (正值)
+#endif
+#else
+// 逐 mesh 路徑: model 與淡出比例是頂點屬性. 一般 mesh 的 VAO 沒開這幾個 array,
+// 讀到的是 glVertexAttrib 設的目前值; instancing 的 shape 由 divisor = 1 的 instance buffer 提供
+layout(location=3) in mat4 aModel;
+layout(location=7) in float aFade;
+#endif
+LOC(5) flat out float DitherFade; // impostor 交叉淡出
+
+#ifdef USE_LIGHTMAP
+// 第二組 UV; 沒有 lightmap 的 mesh 讀到的是 (-1, -1) (MDI 填在 buffer 裡, 逐 mesh 路徑用 glVertexAttrib)
+layout(location=8) in vec2 aLightmapUV;
+out vec2 LightmapUV;
+#endif
+
+#ifdef USE_VERTEX_AO
+// 烘焙的 ambient occlusion; 沒有 AO 的 mesh 讀到的是 1 (MDI 填在 buffer 裡, 逐 mesh 路徑用 glVertexAttrib)
+layout(location=9) in float aAmbientOcclusion;
+out float AmbientOcclusion;
+#endif
+
+#ifdef VULKAN
+// 跟 fragment.glsl 同一個 block (VulkanRenderer::FrameUniforms)
+layout(std140, set=0, binding=2) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection; // 已經換成 Vulkan 的 [0, 1] 深度
+    vec3 lightPos;
+    vec3 viewPos;
+    vec3 lightColor;
+};
+#else
 uniform mat4 view;
 uniform mat4 projection;
+#endif
 
-out vec2 TexCoord;
-out vec3 FragPos;
-out vec3 Normal;
+LOC(0) out vec2 TexCoord;
+LOC(1) out vec3 FragPos;
+LOC(2) out vec3 Normal;
 
 void main(){
+#ifdef USE_MDI
+    mat4 model = draws[aDrawID].model;
+    MaterialIndex = draws[aDrawID].info.x;
+    TextureLayers = draws[aDrawID].info.yz;
+    DitherFade = uintBitsToFloat(draws[aDrawID].info.w);
+#ifdef AOV_OUTPUT
+    MeshIndex = aDrawID;
+#endif
+#else
+    mat4 model = aModel;
+    DitherFade = aFade;
+#endif
     FragPos = vec3(model * vec4(aPos,1.0));
     Normal = mat3(transpose(inverse(model))) * aNormal;
     TexCoord = aTexCoord;
+#ifdef USE_LIGHTMAP
+    LightmapUV = aLightmapUV;
+#endif
+#ifdef USE_VERTEX_AO
+    AmbientOcclusion = aAmbientOcclusion;
+#endif
+#ifdef AOV_OUTPUT
+    ViewDepth = -(view * vec4(FragPos, 1.0)).z;
+#endif
     gl_Position = projection * view * vec4(FragPos,1.0);
-}
\ No newline at end of file
+}
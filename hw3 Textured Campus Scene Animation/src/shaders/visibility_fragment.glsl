@@ -0,0 +1,24 @@
+#version 430 core
+// visibility buffer 第一個 pass: 每個像素只寫 (mesh index + 1) << triangleBits | 三角形編號
+flat in uint DrawID;
+flat in float DitherFade;
+
+uniform uint triangleBits;
+
+layout(location=0) out uint Visibility;
+
+// 跟 fragment.glsl 同一組 Bayer 門檻, 交叉淡出的像素才會一致
+float dither_threshold()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0,
+                                      3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+}
+
+void main()
+{
+    if (DitherFade > 0.0 && dither_threshold() < DitherFade)
+        discard;
+    Visibility = ((DrawID + 1u) << triangleBits) | uint(gl_PrimitiveID);
+}
@@ -0,0 +1,28 @@
+#version 430 core
+// visibility buffer 第一個 pass: 只需要位置與 draw ID (MDI 路徑)
+layout(location=0) in vec3 aPos;
+layout(location=3) in uint aDrawID;
+
+struct DrawData
+{
+    mat4 model;
+    uvec4 info; // x: material index, y: diffuse layer, z: specular layer, w: fade (float bits)
+};
+layout(std430, binding=0) readonly buffer DrawBuffer
+{
+    DrawData draws[];
+};
+
+uniform mat4 view;
+uniform mat4 projection;
+
+flat out uint DrawID;
+flat out float DitherFade;
+
+void main(){
+    DrawID = aDrawID;
+    DitherFade = uintBitsToFloat(draws[aDrawID].info.w);
+    // 跟 vertex.glsl 同樣的運算順序, 深度才會完全一樣 (impostor 接著用同一張深度)
+    vec3 fragPos = vec3(draws[aDrawID].model * vec4(aPos, 1.0));
+    gl_Position = projection * view * vec4(fragPos, 1.0);
+}
@@ -0,0 +1,182 @@
+#include "aov_writer.h"
+#include "../stb_image_write.h"
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+bool AovWriter::begin(const std::string &outputDirectory)
+{
+  std::error_code error;
+  std::filesystem::create_directories(outputDirectory, error);
+  if (error)
+  {
+    std::cerr << "Cannot create " << outputDirectory << ": " << error.message() << std::endl;
+    return false;
+  }
+  directory = outputDirectory;
+  return true;
+}
+
+std::vector<FrameCapture::Layer> AovWriter::layers(unsigned int color, unsigned int depth, unsigned int normal,
+                                                   unsigned int ids)
+{
+  // 法線讀成 RGB float, 直接就是 PFM 的像素排列
+  return {{color, GL_RGBA, GL_UNSIGNED_BYTE, 4},
+          {depth, GL_RED, GL_FLOAT, 4},
+          {normal, GL_RGB, GL_FLOAT, 12},
+          {ids, GL_RG_INTEGER, GL_UNSIGNED_SHORT, 4}};
+}
+
+void AovWriter::record_camera(int frame, const Camera &camera)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  cameras[frame] = camera;
+}
+
+std::string AovWriter::path(const char *channel, int frame, const char *extension) const
+{
+  char name[48];
+  std::snprintf(name, sizeof(name), "%s_%05d.%s", channel, frame, extension);
+  return directory + "/" + name;
+}
+
+// PFM 本來就是由下往上存, GL 讀回來的列不用翻; scale 為負代表 little endian
+static bool write_pfm(const std::string &path, int width, int height, int channels, const unsigned char *data)
+{
+  FILE *file = std::fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+  std::fprintf(file, "%s\n%d %d\n-1.0\n", channels == 3 ? "PF" : "Pf", width, height);
+  size_t bytes = (size_t)width * height * channels * sizeof(float);
+  bool written = std::fwrite(data, 1, bytes, file) == bytes;
+  std::fclose(file);
+  return written;
+}
+
+// 16-bit PGM (big endian, 由上往下); ids 是 RG16 交錯排列, component 選 R 或 G
+static bool write_pgm16(const std::string &path, int width, int height, const unsigned char *ids, int component)
+{
+  std::vector<unsigned char> rows((size_t)width * height * 2);
+  for (int y = 0; y < height; ++y)
+  {
+    const unsigned char *src = ids + (size_t)(height - 1 - y) * width * 4;
+    unsigned char *dst = &rows[(size_t)y * width * 2];
+    for (int x = 0; x < width; ++x)
+    {
+      uint16_t value;
+      std::memcpy(&value, src + x * 4 + component * 2, sizeof(value));
+      dst[x * 2] = value >> 8;
+      dst[x * 2 + 1] = value & 0xff;
+    }
+  }
+  FILE *file = std::fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+  std::fprintf(file, "P5\n%d %d\n65535\n", width, height);
+  bool written = std::fwrite(rows.data(), 1, rows.size(), file) == rows.size();
+  std::fclose(file);
+  return written;
+}
+
+void AovWriter::write(int frame, int width, int height, const std::vector<unsigned char> &pixels)
+{
+  size_t pixelCount = (size_t)width * height;
+  if (pixels.size() != pixelCount * (4 + 4 + 12 + 4))
+  {
+    std::cerr << "AOV frame " << frame << " has the wrong size" << std::endl;
+    return;
+  }
+  const unsigned char *color = pixels.data();
+  const unsigned char *depth = color + pixelCount * 4;
+  const unsigned char *normal = depth + pixelCount * 4;
+  const unsigned char *ids = normal + pixelCount * 12;
+
+  Camera camera;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cameras.find(frame);
+    if (it == cameras.end())
+    {
+      std::cerr << "AOV frame " << frame << " has no camera" << std::endl;
+      return;
+    }
+    camera = it->second;
+    cameras.erase(it);
+  }
+
+  // 顏色: GL 由下往上, PNG 由上往下, 順便去掉 alpha
+  std::vector<unsigned char> rgb(pixelCount * 3);
+  for (int y = 0; y < height; ++y)
+  {
+    const unsigned char *src = color + (size_t)(height - 1 - y) * width * 4;
+    unsigned char *dst = &rgb[(size_t)y * width * 3];
+    for (int x = 0; x < width; ++x)
+      std::memcpy(dst + x * 3, src + x * 4, 3);
+  }
+
+  bool written = stbi_write_png(path("color", frame, "png").c_str(), width, height, 3, rgb.data(), width * 3) != 0;
+  written &= write_pfm(path("depth", frame, "pfm"), width, height, 1, depth);
+  written &= write_pfm(path("normal", frame, "pfm"), width, height, 3, normal);
+  written &= write_pgm16(path("material", frame, "pgm"), width, height, ids, 0);
+  written &= write_pgm16(path("mesh", frame, "pgm"), width, height, ids, 1);
+  written &= write_camera(frame, width, height, camera);
+  if (!written)
+  {
+    std::cerr << "Cannot write AOV frame " << frame << " to " << directory << std::endl;
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  ++framesWritten;
+}
+
+bool AovWriter::write_camera(int frame, int width, int height, const Camera &camera) const
+{
+  // 像素座標 (左上角原點, y 往下) 下的針孔內參; projection 可以是 off-center 的
+  const glm::mat4 &p = camera.projection;
+  float fx = p[0][0] * width * 0.5f;
+  float fy = p[1][1] * height * 0.5f;
+  float cx = (1.0f - p[2][0]) * width * 0.5f;
+  float cy = (1.0f + p[2][1]) * height * 0.5f;
+  // OpenGL 相機看 -z、y 往上; OpenCV 相機看 +z、y 往下: 把 view 的 y、z 兩列反號
+  glm::mat4 worldToCamera = camera.view;
+  for (int c = 0; c < 4; ++c)
+  {
+    worldToCamera[c][1] = -worldToCamera[c][1];
+    worldToCamera[c][2] = -worldToCamera[c][2];
+  }
+
+  FILE *file = std::fopen(path("camera", frame, "json").c_str(), "w");
+  if (!file)
+    return false;
+  auto vector = [&](const glm::vec3 &v) { std::fprintf(file, "[%.9g, %.9g, %.9g]", v.x, v.y, v.z); };
+  // 列優先 (row-major) 輸出 rows 列
+  auto matrix = [&](const glm::mat4 &m, int rows)
+  {
+    std::fputc('[', file);
+    for (int r = 0; r < rows; ++r)
+      std::fprintf(file, "%s[%.9g, %.9g, %.9g, %.9g]", r ? ", " : "", m[0][r], m[1][r], m[2][r], m[3][r]);
+    std::fputc(']', file);
+  };
+  std::fprintf(file, "{\n  \"frame\": %d,\n  \"time\": %.9g,\n  \"width\": %d,\n  \"height\": %d,\n", frame,
+               camera.time, width, height);
+  std::fprintf(file, "  \"intrinsics\": {\"fx\": %.9g, \"fy\": %.9g, \"cx\": %.9g, \"cy\": %.9g},\n", fx, fy, cx, cy);
+  std::fprintf(file, "  \"K\": [[%.9g, 0, %.9g], [0, %.9g, %.9g], [0, 0, 1]],\n", fx, cx, fy, cy);
+  std::fputs("  \"world_to_camera_opencv\": ", file);
+  matrix(worldToCamera, 3);
+  std::fputs(",\n  \"view_matrix_opengl\": ", file);
+  matrix(camera.view, 4);
+  std::fputs(",\n  \"projection_matrix_opengl\": ", file);
+  matrix(camera.projection, 4);
+  std::fputs(",\n  \"position\": ", file);
+  vector(camera.position);
+  std::fputs(",\n  \"look_at\": ", file);
+  vector(camera.lookAt);
+  std::fputs(",\n  \"up\": ", file);
+  vector(camera.up);
+  std::fputs("\n}\n", file);
+  return std::fclose(file) == 0;
+}
@@ -0,0 +1,56 @@
+#ifndef AOV_WRITER_H
+#define AOV_WRITER_H
+
+#include <glm/glm.hpp>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "frame_capture.h"
+
+// ========== 資料集用的多通道輸出 (AOV) ==========
+// 場景 pass 用 MRT 一次寫出全部通道, 由 FrameCapture::capture_textures 讀進同一個 PBO:
+//   color  RGBA8  -> color_00042.png
+//   depth  R32F   -> depth_00042.pfm    沿視線方向的距離 (世界單位), 背景為 0
+//   normal RGBA16F-> normal_00042.pfm   世界座標單位法線, 背景為 (0, 0, 0)
+//   ids    RG16UI -> material_00042.pgm / mesh_00042.pgm  16-bit, 編號 + 1, 背景為 0
+// 每幀再加一個 camera_00042.json: 內參 (fx, fy, cx, cy, 像素座標左上角為原點) 與外參
+// (OpenGL 的 view 矩陣, 以及 OpenCV 慣例 x 右 y 下 z 前的 world-to-camera [R|t])
+class AovWriter
+{
+public:
+  // render thread 送出 readback 時記下的相機
+  struct Camera
+  {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 position;
+    glm::vec3 lookAt;
+    glm::vec3 up;
+    float time; // 秒 (序列模式是 frame / fps)
+  };
+
+  // 建立資料夾
+  bool begin(const std::string &directory);
+  // 依上面的順序排好的 layer (color, depth, normal, ids)
+  static std::vector<FrameCapture::Layer> layers(unsigned int color, unsigned int depth, unsigned int normal,
+                                                 unsigned int ids);
+
+  // render thread: 跟 capture_textures 同一幀呼叫
+  void record_camera(int frame, const Camera &camera);
+  // encoder thread (FrameCapture 的 Sink): pixels 是 layers() 依序接在一起的結果
+  void write(int frame, int width, int height, const std::vector<unsigned char> &pixels);
+
+  int framesWritten = 0;
+
+private:
+  std::string path(const char *channel, int frame, const char *extension) const;
+  bool write_camera(int frame, int width, int height, const Camera &camera) const;
+
+  std::string directory;
+  std::mutex mutex; // 保護 cameras 與 framesWritten
+  std::map<int, Camera> cameras;
+};
+
+#endif
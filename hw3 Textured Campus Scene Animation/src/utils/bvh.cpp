@@ -0,0 +1,612 @@
+#include "bvh.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const int BIN_COUNT = 12;
+static const unsigned int MAX_LEAF_SIZE = 4;
+static const int STACK_SIZE = 128;
+// 子樹小於這個三角形數就不再分給別的 thread
+static const unsigned int MIN_PARALLEL_SUBTREE = 4096;
+
+struct Aabb
+{
+  glm::vec3 lo{1e30f};
+  glm::vec3 hi{-1e30f};
+
+  void grow(const glm::vec3 &p)
+  {
+    lo = glm::min(lo, p);
+    hi = glm::max(hi, p);
+  }
+  void grow(const Aabb &b)
+  {
+    lo = glm::min(lo, b.lo);
+    hi = glm::max(hi, b.hi);
+  }
+  float area() const
+  {
+    glm::vec3 e = hi - lo;
+    return e.x < 0.0f ? 0.0f : 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+  }
+};
+
+void Bvh::build(const std::vector<Mesh> &meshes)
+{
+  std::vector<unsigned int> all(meshes.size());
+  for (unsigned int m = 0; m < meshes.size(); ++m)
+    all[m] = m;
+  build(meshes, all);
+}
+
+void Bvh::build(const std::vector<Mesh> &meshes, const std::vector<unsigned int> &subset)
+{
+  triangles.clear();
+  nodes.clear();
+
+  for (unsigned int m : subset)
+  {
+    const Mesh &mesh = meshes[m];
+    unsigned int primitive = 0;
+    for (size_t t = 0; t + 3 * VERTEX_STRIDE <= mesh.vertices.size(); t += 3 * VERTEX_STRIDE, ++primitive)
+    {
+      glm::vec3 p[3];
+      for (int k = 0; k < 3; ++k)
+      {
+        const float *v = &mesh.vertices[t + k * VERTEX_STRIDE];
+        p[k] = glm::vec3(mesh.transform * glm::vec4(v[0], v[1], v[2], 1.0f));
+      }
+      triangles.push_back({p[0], p[1], p[2], m, primitive});
+    }
+  }
+
+  if (triangles.empty())
+    return;
+
+  std::vector<glm::vec3> centroids(triangles.size());
+  for (size_t i = 0; i < triangles.size(); ++i)
+    centroids[i] = (triangles[i].p0 + triangles[i].p1 + triangles[i].p2) / 3.0f;
+
+  nodes.reserve(triangles.size() * 2);
+  nodes.push_back({glm::vec3(0.0f), 0, glm::vec3(0.0f), (unsigned int)triangles.size()});
+
+  // 上層依序切到每個 thread 大約分到 4 棵子樹, 子樹各自建在自己的 node 陣列
+  ThreadPool &pool = global_thread_pool();
+  unsigned int deferLimit = std::max<unsigned int>(MIN_PARALLEL_SUBTREE, triangles.size() / (pool.size() * 4));
+  std::vector<unsigned int> deferred;
+  subdivide(nodes, 0, centroids, pool.size() > 1 ? &deferred : nullptr, deferLimit);
+
+  std::vector<std::vector<Node>> subtrees(deferred.size());
+  pool.parallel_for(deferred.size(), 1, [&](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      subtrees[i].push_back(nodes[deferred[i]]);
+      subdivide(subtrees[i], 0, centroids, nullptr, 0);
+    }
+  });
+
+  // 接回來: 子樹的第 k 個節點 (k >= 1) 放到 base + k - 1, 根節點取代原本的位置
+  for (size_t i = 0; i < deferred.size(); ++i)
+  {
+    unsigned int base = nodes.size();
+    for (Node &node : subtrees[i])
+    {
+      if (node.count == 0)
+        node.leftOrFirst += base - 1;
+    }
+    nodes[deferred[i]] = subtrees[i][0];
+    nodes.insert(nodes.end(), subtrees[i].begin() + 1, subtrees[i].end());
+  }
+
+  sceneMin = nodes[0].boundsMin;
+  sceneMax = nodes[0].boundsMax;
+}
+
+void Bvh::subdivide(std::vector<Node> &tree, unsigned int nodeIndex, std::vector<glm::vec3> &centroids,
+                    std::vector<unsigned int> *deferred, unsigned int deferLimit)
+{
+  // 先算節點 bounds
+  Aabb bounds, centroidBounds;
+  {
+    Node &node = tree[nodeIndex];
+    for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+    {
+      bounds.grow(triangles[i].p0);
+      bounds.grow(triangles[i].p1);
+      bounds.grow(triangles[i].p2);
+      centroidBounds.grow(centroids[i]);
+    }
+    node.boundsMin = bounds.lo;
+    node.boundsMax = bounds.hi;
+    if (node.count <= MAX_LEAF_SIZE)
+      return;
+    if (deferred && node.count <= deferLimit)
+    {
+      deferred->push_back(nodeIndex);
+      return;
+    }
+  }
+
+  unsigned int first = tree[nodeIndex].leftOrFirst;
+  unsigned int count = tree[nodeIndex].count;
+
+  // binned SAH: 每個軸切 BIN_COUNT 格, 找成本最低的切面
+  int bestAxis = -1;
+  int bestSplit = 0;
+  float bestCost = bounds.area() * count;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    float lo = centroidBounds.lo[axis];
+    float hi = centroidBounds.hi[axis];
+    if (hi - lo < 1e-9f)
+      continue;
+
+    Aabb binBounds[BIN_COUNT];
+    unsigned int binCount[BIN_COUNT] = {0};
+    float scale = BIN_COUNT / (hi - lo);
+    for (unsigned int i = first; i < first + count; ++i)
+    {
+      int b = std::min(BIN_COUNT - 1, (int)((centroids[i][axis] - lo) * scale));
+      binCount[b]++;
+      binBounds[b].grow(triangles[i].p0);
+      binBounds[b].grow(triangles[i].p1);
+      binBounds[b].grow(triangles[i].p2);
+    }
+
+    // 左右掃描累積面積
+    float leftArea[BIN_COUNT - 1], rightArea[BIN_COUNT - 1];
+    unsigned int leftCount[BIN_COUNT - 1], rightCount[BIN_COUNT - 1];
+    Aabb leftBox, rightBox;
+    unsigned int leftSum = 0, rightSum = 0;
+    for (int i = 0; i < BIN_COUNT - 1; ++i)
+    {
+      leftSum += binCount[i];
+      leftCount[i] = leftSum;
+      leftBox.grow(binBounds[i]);
+      leftArea[i] = leftBox.area();
+
+      rightSum += binCount[BIN_COUNT - 1 - i];
+      rightCount[BIN_COUNT - 2 - i] = rightSum;
+      rightBox.grow(binBounds[BIN_COUNT - 1 - i]);
+      rightArea[BIN_COUNT - 2 - i] = rightBox.area();
+    }
+
+    for (int i = 0; i < BIN_COUNT - 1; ++i)
+    {
+      if (leftCount[i] == 0 || rightCount[i] == 0)
+        continue;
+      float cost = leftArea[i] * leftCount[i] + rightArea[i] * rightCount[i];
+      if (cost < bestCost)
+      {
+        bestCost = cost;
+        bestAxis = axis;
+        bestSplit = i;
+      }
+    }
+  }
+
+  // 切不下去: 三角形太多就從中間硬切, 否則當葉節點
+  unsigned int mid;
+  if (bestAxis < 0)
+  {
+    if (count <= MAX_LEAF_SIZE * 4)
+      return;
+    mid = first + count / 2;
+  }
+  else
+  {
+    float lo = centroidBounds.lo[bestAxis];
+    float scale = BIN_COUNT / (centroidBounds.hi[bestAxis] - lo);
+    unsigned int i = first, j = first + count - 1;
+    while (i <= j && j != ~0u)
+    {
+      int b = std::min(BIN_COUNT - 1, (int)((centroids[i][bestAxis] - lo) * scale));
+      if (b <= bestSplit)
+      {
+        i++;
+      }
+      else
+      {
+        std::swap(triangles[i], triangles[j]);
+        std::swap(centroids[i], centroids[j]);
+        j--;
+      }
+    }
+    mid = i;
+    if (mid == first || mid == first + count)
+      mid = first + count / 2;
+  }
+
+  unsigned int left = tree.size();
+  tree.push_back({glm::vec3(0.0f), first, glm::vec3(0.0f), mid - first});
+  tree.push_back({glm::vec3(0.0f), mid, glm::vec3(0.0f), first + count - mid});
+  tree[nodeIndex].leftOrFirst = left;
+  tree[nodeIndex].count = 0;
+
+  subdivide(tree, left, centroids, deferred, deferLimit);
+  subdivide(tree, left + 1, centroids, deferred, deferLimit);
+}
+
+// slab test, 回傳進入距離 (沒打到回傳 1e30)
+static inline float intersect_aabb(const glm::vec3 &lo, const glm::vec3 &hi, const Ray &ray,
+                                   const glm::vec3 &invDir, float tMax)
+{
+  glm::vec3 t0 = (lo - ray.origin) * invDir;
+  glm::vec3 t1 = (hi - ray.origin) * invDir;
+  glm::vec3 tNear = glm::min(t0, t1);
+  glm::vec3 tFar = glm::max(t0, t1);
+  float enter = std::max({tNear.x, tNear.y, tNear.z, ray.tMin});
+  float exit = std::min({tFar.x, tFar.y, tFar.z, tMax});
+  return enter <= exit ? enter : 1e30f;
+}
+
+// Möller–Trumbore
+static inline bool intersect_triangle(const BvhTriangle &tri, const Ray &ray, float tMax, float &t, float &u, float &v)
+{
+  glm::vec3 e1 = tri.p1 - tri.p0;
+  glm::vec3 e2 = tri.p2 - tri.p0;
+  glm::vec3 h = glm::cross(ray.direction, e2);
+  float a = glm::dot(e1, h);
+  if (std::abs(a) < 1e-12f)
+    return false;
+  float f = 1.0f / a;
+  glm::vec3 s = ray.origin - tri.p0;
+  u = f * glm::dot(s, h);
+  if (u < 0.0f || u > 1.0f)
+    return false;
+  glm::vec3 q = glm::cross(s, e1);
+  v = f * glm::dot(ray.direction, q);
+  if (v < 0.0f || u + v > 1.0f)
+    return false;
+  t = f * glm::dot(e2, q);
+  return t > ray.tMin && t < tMax;
+}
+
+bool Bvh::intersect(const Ray &ray, Hit &hit) const
+{
+  if (nodes.empty())
+    return false;
+
+  glm::vec3 invDir = 1.0f / ray.direction;
+  float tMax = std::min(ray.tMax, hit.t);
+  unsigned int stack[STACK_SIZE];
+  int stackSize = 0;
+  unsigned int nodeIndex = 0;
+  if (intersect_aabb(nodes[0].boundsMin, nodes[0].boundsMax, ray, invDir, tMax) >= 1e30f)
+    return false;
+
+  bool found = false;
+  while (true)
+  {
+    const Node &node = nodes[nodeIndex];
+    if (node.count > 0)
+    {
+      for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+      {
+        float t, u, v;
+        if (intersect_triangle(triangles[i], ray, tMax, t, u, v))
+        {
+          tMax = t;
+          hit.t = t;
+          hit.u = u;
+          hit.v = v;
+          hit.triangle = i;
+          found = true;
+        }
+      }
+    }
+    else
+    {
+      // 先走比較近的子節點
+      unsigned int a = node.leftOrFirst, b = node.leftOrFirst + 1;
+      float da = intersect_aabb(nodes[a].boundsMin, nodes[a].boundsMax, ray, invDir, tMax);
+      float db = intersect_aabb(nodes[b].boundsMin, nodes[b].boundsMax, ray, invDir, tMax);
+      if (da > db)
+      {
+        std::swap(a, b);
+        std::swap(da, db);
+      }
+      if (da < 1e30f)
+      {
+        if (db < 1e30f && stackSize < STACK_SIZE)
+          stack[stackSize++] = b;
+        nodeIndex = a;
+        continue;
+      }
+    }
+
+    // 出堆疊時再檢查一次, 可能已經有更近的交點
+    bool next = false;
+    while (stackSize > 0 && !next)
+    {
+      nodeIndex = stack[--stackSize];
+      next = intersect_aabb(nodes[nodeIndex].boundsMin, nodes[nodeIndex].boundsMax, ray, invDir, tMax) < 1e30f;
+    }
+    if (!next)
+      break;
+  }
+  return found;
+}
+
+bool Bvh::occluded(const Ray &ray) const
+{
+  if (nodes.empty())
+    return false;
+
+  glm::vec3 invDir = 1.0f / ray.direction;
+  unsigned int stack[STACK_SIZE];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+
+  while (stackSize > 0)
+  {
+    const Node &node = nodes[stack[--stackSize]];
+    if (intersect_aabb(node.boundsMin, node.boundsMax, ray, invDir, ray.tMax) >= 1e30f)
+      continue;
+
+    if (node.count > 0)
+    {
+      for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+      {
+        float t, u, v;
+        if (intersect_triangle(triangles[i], ray, ray.tMax, t, u, v))
+          return true;
+      }
+    }
+    else if (stackSize + 2 <= STACK_SIZE)
+    {
+      stack[stackSize++] = node.leftOrFirst;
+      stack[stackSize++] = node.leftOrFirst + 1;
+    }
+  }
+  return false;
+}
+
+int Bvh::occluded4(const glm::vec3 &origin, const glm::vec3 directions[4], float tMin, float tMax) const
+{
+  if (nodes.empty())
+    return 0;
+
+  // SoA: 每個 float4 是 4 條 ray 的同一個分量; 起點共用, 所以跟起點有關的量都還是 scalar
+  const float4 dx(directions[0].x, directions[1].x, directions[2].x, directions[3].x);
+  const float4 dy(directions[0].y, directions[1].y, directions[2].y, directions[3].y);
+  const float4 dz(directions[0].z, directions[1].z, directions[2].z, directions[3].z);
+  const float4 one(1.0f);
+  const float4 ix = one / dx, iy = one / dy, iz = one / dz;
+  const float4 ox(origin.x), oy(origin.y), oz(origin.z);
+  const float4 rayMin(tMin), rayMax(tMax);
+  const float4 zero(0.0f), epsilon(1e-24f);
+
+  int occluded = 0;
+  unsigned int stack[STACK_SIZE];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+
+  while (stackSize > 0)
+  {
+    const Node &node = nodes[stack[--stackSize]];
+
+    // slab test, 已經擋住的 lane 不用再管
+    float4 ax = (float4(node.boundsMin.x) - ox) * ix, bx = (float4(node.boundsMax.x) - ox) * ix;
+    float4 ay = (float4(node.boundsMin.y) - oy) * iy, by = (float4(node.boundsMax.y) - oy) * iy;
+    float4 az = (float4(node.boundsMin.z) - oz) * iz, bz = (float4(node.boundsMax.z) - oz) * iz;
+    float4 enter = max(max(min(ax, bx), min(ay, by)), max(min(az, bz), rayMin));
+    float4 exit = min(min(max(ax, bx), max(ay, by)), min(max(az, bz), rayMax));
+    int active = movemask(cmp_le(enter, exit)) & ~occluded;
+    if (active == 0)
+      continue;
+
+    if (node.count > 0)
+    {
+      for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+      {
+        // Möller–Trumbore, s = origin - p0 與 q = s x e1 對 4 條 ray 都一樣
+        const BvhTriangle &tri = triangles[i];
+        glm::vec3 e1 = tri.p1 - tri.p0;
+        glm::vec3 e2 = tri.p2 - tri.p0;
+        glm::vec3 s = origin - tri.p0;
+        glm::vec3 q = glm::cross(s, e1);
+        float4 hx = dy * float4(e2.z) - dz * float4(e2.y);
+        float4 hy = dz * float4(e2.x) - dx * float4(e2.z);
+        float4 hz = dx * float4(e2.y) - dy * float4(e2.x);
+        float4 a = float4(e1.x) * hx + float4(e1.y) * hy + float4(e1.z) * hz;
+        float4 f = one / a;
+        float4 u = f * (float4(s.x) * hx + float4(s.y) * hy + float4(s.z) * hz);
+        float4 v = f * (dx * float4(q.x) + dy * float4(q.y) + dz * float4(q.z));
+        float4 t = f * float4(glm::dot(e2, q));
+        float4 hit = mask_and(cmp_gt(a * a, epsilon),
+                              mask_and(mask_and(cmp_ge(u, zero), cmp_ge(v, zero)),
+                                       mask_and(cmp_le(u + v, one), mask_and(cmp_gt(t, rayMin), cmp_lt(t, rayMax)))));
+        occluded |= movemask(hit) & active;
+        if (occluded == 0xF)
+          return occluded;
+      }
+    }
+    else if (stackSize + 2 <= STACK_SIZE)
+    {
+      stack[stackSize++] = node.leftOrFirst;
+      stack[stackSize++] = node.leftOrFirst + 1;
+    }
+  }
+  return occluded;
+}
+
+void Bvh::intersect4(const glm::vec3 &origin, const glm::vec3 directions[4], float tMin, Hit hits[4]) const
+{
+  if (nodes.empty())
+    return;
+
+  // 跟 occluded4 一樣是 SoA, 但每個 lane 有自己的 tMax (目前最近的交點)
+  const float4 dx(directions[0].x, directions[1].x, directions[2].x, directions[3].x);
+  const float4 dy(directions[0].y, directions[1].y, directions[2].y, directions[3].y);
+  const float4 dz(directions[0].z, directions[1].z, directions[2].z, directions[3].z);
+  const float4 one(1.0f);
+  const float4 ix = one / dx, iy = one / dy, iz = one / dz;
+  const float4 ox(origin.x), oy(origin.y), oz(origin.z);
+  const float4 rayMin(tMin);
+  const float4 zero(0.0f), epsilon(1e-24f);
+  float4 rayMax(hits[0].t, hits[1].t, hits[2].t, hits[3].t);
+  // 子節點的順序用 4 條 ray 的平均方向決定
+  const glm::vec3 order = directions[0] + directions[1] + directions[2] + directions[3];
+
+  unsigned int stack[STACK_SIZE];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+
+  while (stackSize > 0)
+  {
+    const Node &node = nodes[stack[--stackSize]];
+
+    float4 ax = (float4(node.boundsMin.x) - ox) * ix, bx = (float4(node.boundsMax.x) - ox) * ix;
+    float4 ay = (float4(node.boundsMin.y) - oy) * iy, by = (float4(node.boundsMax.y) - oy) * iy;
+    float4 az = (float4(node.boundsMin.z) - oz) * iz, bz = (float4(node.boundsMax.z) - oz) * iz;
+    float4 enter = max(max(min(ax, bx), min(ay, by)), max(min(az, bz), rayMin));
+    float4 exit = min(min(max(ax, bx), max(ay, by)), min(max(az, bz), rayMax));
+    int active = movemask(cmp_le(enter, exit));
+    if (active == 0)
+      continue;
+
+    if (node.count > 0)
+    {
+      for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+      {
+        const BvhTriangle &tri = triangles[i];
+        glm::vec3 e1 = tri.p1 - tri.p0;
+        glm::vec3 e2 = tri.p2 - tri.p0;
+        glm::vec3 s = origin - tri.p0;
+        glm::vec3 q = glm::cross(s, e1);
+        float4 hx = dy * float4(e2.z) - dz * float4(e2.y);
+        float4 hy = dz * float4(e2.x) - dx * float4(e2.z);
+        float4 hz = dx * float4(e2.y) - dy * float4(e2.x);
+        float4 a = float4(e1.x) * hx + float4(e1.y) * hy + float4(e1.z) * hz;
+        float4 f = one / a;
+        float4 u = f * (float4(s.x) * hx + float4(s.y) * hy + float4(s.z) * hz);
+        float4 v = f * (dx * float4(q.x) + dy * float4(q.y) + dz * float4(q.z));
+        float4 t = f * float4(glm::dot(e2, q));
+        float4 hit = mask_and(cmp_gt(a * a, epsilon),
+                              mask_and(mask_and(cmp_ge(u, zero), cmp_ge(v, zero)),
+                                       mask_and(cmp_le(u + v, one), mask_and(cmp_gt(t, rayMin), cmp_lt(t, rayMax)))));
+        int lanes = movemask(hit) & active;
+        if (lanes == 0)
+          continue;
+        float tValues[4], uValues[4], vValues[4];
+        t.store(tValues);
+        u.store(uValues);
+        v.store(vValues);
+        for (int lane = 0; lane < 4; ++lane)
+        {
+          if (lanes & (1 << lane))
+            hits[lane] = {tValues[lane], i, uValues[lane], vValues[lane]};
+        }
+        rayMax = float4(hits[0].t, hits[1].t, hits[2].t, hits[3].t);
+      }
+    }
+    else if (stackSize + 2 <= STACK_SIZE)
+    {
+      // 遠的先推, 近的先處理, tMax 才會早點縮小
+      unsigned int a = node.leftOrFirst, b = node.leftOrFirst + 1;
+      glm::vec3 centerA = nodes[a].boundsMin + nodes[a].boundsMax;
+      glm::vec3 centerB = nodes[b].boundsMin + nodes[b].boundsMax;
+      if (glm::dot(centerA - centerB, order) < 0.0f)
+        std::swap(a, b);
+      stack[stackSize++] = a;
+      stack[stackSize++] = b;
+    }
+  }
+}
+
+// 三角形上離 p 最近的點 (Ericson, Real-Time Collision Detection 5.1.5)
+static glm::vec3 closest_point_on_triangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+  glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+  float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+  if (d1 <= 0.0f && d2 <= 0.0f)
+    return a;
+  glm::vec3 bp = p - b;
+  float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+  if (d3 >= 0.0f && d4 <= d3)
+    return b;
+  float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+    return a + ab * (d1 / (d1 - d3));
+  glm::vec3 cp = p - c;
+  float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+  if (d6 >= 0.0f && d5 <= d6)
+    return c;
+  float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+    return a + ac * (d2 / (d2 - d6));
+  float va = d3 * d6 - d5 * d4;
+  if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+    return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+  float denom = 1.0f / (va + vb + vc);
+  return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// p 到 AABB 的距離平方 (在裡面是 0)
+static inline float distance2_aabb(const glm::vec3 &p, const glm::vec3 &lo, const glm::vec3 &hi)
+{
+  glm::vec3 d = glm::max(glm::max(lo - p, p - hi), glm::vec3(0.0f));
+  return glm::dot(d, d);
+}
+
+bool Bvh::closest(const glm::vec3 &p, float maxDistance, glm::vec3 &point, unsigned int &triangle) const
+{
+  if (nodes.empty())
+    return false;
+
+  float best2 = maxDistance * maxDistance;
+  float bestAlign = -1.0f;
+  bool found = false;
+  // 共用邊 / 頂點的三角形距離只差浮點誤差, 當成同一個距離
+  auto tolerance = [](float d2)
+  { return d2 * 1e-5f + 1e-12f; };
+
+  unsigned int stack[STACK_SIZE];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0)
+  {
+    const Node &node = nodes[stack[--stackSize]];
+    if (distance2_aabb(p, node.boundsMin, node.boundsMax) > best2 + tolerance(best2))
+      continue;
+
+    if (node.count > 0)
+    {
+      for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+      {
+        const BvhTriangle &tri = triangles[i];
+        glm::vec3 q = closest_point_on_triangle(p, tri.p0, tri.p1, tri.p2);
+        glm::vec3 offset = p - q;
+        float d2 = glm::dot(offset, offset);
+        if (d2 > best2 + tolerance(best2))
+          continue;
+        glm::vec3 n = glm::cross(tri.p1 - tri.p0, tri.p2 - tri.p0);
+        float lengths = std::sqrt(glm::dot(n, n) * d2);
+        float align = lengths > 1e-20f ? std::abs(glm::dot(n, offset)) / lengths : 0.0f;
+        if (d2 < best2 - tolerance(best2) || align > bestAlign)
+        {
+          best2 = std::min(best2, d2);
+          bestAlign = align;
+          point = q;
+          triangle = i;
+          found = true;
+        }
+      }
+    }
+    else if (stackSize + 2 <= STACK_SIZE)
+    {
+      // 近的子節點後推, 先處理
+      unsigned int a = node.leftOrFirst, b = node.leftOrFirst + 1;
+      if (distance2_aabb(p, nodes[a].boundsMin, nodes[a].boundsMax) >
+          distance2_aabb(p, nodes[b].boundsMin, nodes[b].boundsMax))
+        std::swap(a, b);
+      stack[stackSize++] = b;
+      stack[stackSize++] = a;
+    }
+  }
+  return found;
+}
@@ -0,0 +1,74 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "mesh.h"
+
+// ========== 三角形 BVH (binned SAH) ==========
+// 給離線烘焙 (PVS、lightmap、AO...) 與 CPU path tracer 做 ray casting 用.
+// 建樹時上層在呼叫端依序切, 切到夠小的子樹丟給 thread pool 各自建 (三角形範圍不重疊), 最後再接回來
+
+struct Ray
+{
+  glm::vec3 origin;
+  glm::vec3 direction;
+  float tMin = 1e-5f;
+  float tMax = 1e30f;
+};
+
+struct Hit
+{
+  float t = 1e30f;
+  unsigned int triangle = ~0u; // BVH 內部排序後的三角形 index
+  float u = 0.0f, v = 0.0f;    // barycentric (相對於 p1, p2)
+  bool valid() const { return triangle != ~0u; }
+};
+
+struct BvhTriangle
+{
+  glm::vec3 p0, p1, p2;
+  unsigned int mesh;     // 所屬 mesh index
+  unsigned int primitive; // mesh 裡的第幾個三角形
+};
+
+class Bvh
+{
+public:
+  struct Node
+  {
+    glm::vec3 boundsMin;
+    unsigned int leftOrFirst; // 內部節點: 左子節點 index; 葉節點: 第一個三角形
+    glm::vec3 boundsMax;
+    unsigned int count; // 0: 內部節點 (右子節點 = left + 1)
+  };
+
+  // 把所有 mesh 的三角形 (套上 transform) 建成一棵 BVH
+  void build(const std::vector<Mesh> &meshes);
+  // 只用 subset 裡的 mesh (BvhTriangle::mesh 仍是 meshes 的 index)
+  void build(const std::vector<Mesh> &meshes, const std::vector<unsigned int> &subset);
+
+  bool intersect(const Ray &ray, Hit &hit) const;
+  // 只要有擋到就回傳 (shadow / visibility ray)
+  bool occluded(const Ray &ray) const;
+  // 同一個起點的 4 條 ray 一起走 (4-wide SIMD, 見 simd.h), 回傳被擋住的 lane bitmask.
+  // AO 這種從同一點往半球發散的 ray, 上層節點幾乎都是一起命中, 一次測 4 條比一條一條走快
+  int occluded4(const glm::vec3 &origin, const glm::vec3 directions[4], float tMin, float tMax) const;
+  // 同一個起點的 4 條 ray 找最近交點 (針孔相機 2x2 像素的 primary ray); hits[i].t 進來時是該 lane 的 tMax
+  void intersect4(const glm::vec3 &origin, const glm::vec3 directions[4], float tMin, Hit hits[4]) const;
+  // 離 p 最近的三角形 (只找 maxDistance 以內), 找不到回傳 false. 距離相同 (最近點在共用的邊或頂點上) 時
+  // 選面最正對 p 的那個, 呼叫端用它的法線判斷內外才不會在凸角外面判斷錯
+  bool closest(const glm::vec3 &p, float maxDistance, glm::vec3 &point, unsigned int &triangle) const;
+
+  std::vector<BvhTriangle> triangles;
+  std::vector<Node> nodes;
+  glm::vec3 sceneMin{0.0f}, sceneMax{0.0f};
+
+private:
+  // deferred 不是 null 時, 三角形數 <= deferLimit 的節點先記下來不往下切
+  void subdivide(std::vector<Node> &tree, unsigned int nodeIndex, std::vector<glm::vec3> &centroids,
+                 std::vector<unsigned int> *deferred, unsigned int deferLimit);
+};
+
+#endif
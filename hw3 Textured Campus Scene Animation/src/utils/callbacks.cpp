@@ -163,4 +163,9 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 {
   if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
     glfwSetWindowShouldClose(window, true);
+  if (key == GLFW_KEY_V && action == GLFW_PRESS)
+  {
+    useVisibilityBuffer = !useVisibilityBuffer;
+    std::cout << (useVisibilityBuffer ? "Visibility buffer" : "Forward shading") << std::endl;
+  }
 }
\ No newline at end of file
@@ -23,6 +23,8 @@ extern float lastFrame;
 
 extern float fov;
 
+extern bool useVisibilityBuffer; // V 鍵切換 forward / visibility buffer
+
 void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
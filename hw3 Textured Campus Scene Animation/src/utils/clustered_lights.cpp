@@ -0,0 +1,351 @@
+#include "clustered_lights.h"
+#include "simd.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <tuple>
+
+void ClusteredLights::add_emissive(const std::vector<Mesh> &meshes)
+{
+  struct Accum
+  {
+    glm::vec3 weightedPosition{0.0f};
+    glm::vec3 normal{0.0f};
+    float area = 0.0f;
+  };
+  // 同一個材質、同一格的三角形 (可能來自切開的不同 mesh) 合成一盞燈
+  std::map<std::tuple<const Material *, int, int, int>, Accum> cells;
+  for (const Mesh &mesh : meshes)
+  {
+    const Material *mat = mesh.material;
+    if (!mat || mesh.proxy || std::max({mat->Ke.r, mat->Ke.g, mat->Ke.b}) < 0.01f)
+      continue;
+    for (size_t t = 0; t + 3 * VERTEX_STRIDE <= mesh.vertices.size(); t += 3 * VERTEX_STRIDE)
+    {
+      glm::vec3 p[3];
+      for (int k = 0; k < 3; ++k)
+      {
+        const float *v = &mesh.vertices[t + k * VERTEX_STRIDE];
+        p[k] = glm::vec3(mesh.transform * glm::vec4(v[0], v[1], v[2], 1.0f));
+      }
+      glm::vec3 cross = glm::cross(p[1] - p[0], p[2] - p[0]);
+      float area = 0.5f * glm::length(cross);
+      if (area <= 0.0f)
+        continue;
+      glm::vec3 centroid = (p[0] + p[1] + p[2]) / 3.0f;
+      glm::ivec3 c = glm::ivec3(glm::floor(centroid / emissiveCellSize));
+      Accum &cell = cells[{mat, c.x, c.y, c.z}];
+      cell.weightedPosition += centroid * area;
+      cell.normal += cross * 0.5f; // 面積加權的法線
+      cell.area += area;
+    }
+  }
+
+  size_t before = lights.size();
+  for (const auto &[key, cell] : cells)
+  {
+    PointLight light;
+    light.position = cell.weightedPosition / cell.area;
+    // 推到表面外面一點, 發光面本身也照得到
+    if (glm::length(cell.normal) > 1e-12f)
+      light.position += glm::normalize(cell.normal) * emissiveCellSize * 0.25f;
+    light.radius = emissiveRadius;
+    light.color = std::get<0>(key)->Ke * emissiveIntensity;
+    lights.push_back(light);
+  }
+  std::cout << "Clustered lights: " << lights.size() - before << " lights from emissive materials" << std::endl;
+}
+
+bool ClusteredLights::load(const std::string &path, const glm::mat4 &toScene)
+{
+  std::ifstream file(path);
+  if (!file.is_open())
+    return false;
+
+  // 正規化是等比例縮放, 半徑跟著乘同一個倍數
+  float scale = glm::length(glm::vec3(toScene[0]));
+  size_t before = lights.size();
+  std::string line;
+  while (std::getline(file, line))
+  {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream iss(line);
+    glm::vec3 position, color;
+    float radius;
+    if (!(iss >> position.x >> position.y >> position.z >> color.r >> color.g >> color.b >> radius))
+    {
+      std::cerr << "Bad light line in " << path << ": " << line << std::endl;
+      continue;
+    }
+    PointLight light;
+    light.position = glm::vec3(toScene * glm::vec4(position, 1.0f));
+    light.color = color;
+    light.radius = radius * scale;
+    lights.push_back(light);
+  }
+  std::cout << "Clustered lights: " << lights.size() - before << " lights from " << path << std::endl;
+  return true;
+}
+
+void ClusteredLights::add_random(size_t count, const glm::vec3 &lo, const glm::vec3 &hi)
+{
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  for (size_t i = 0; i < count; ++i)
+  {
+    PointLight light;
+    light.position = lo + (hi - lo) * glm::vec3(unit(rng), unit(rng), unit(rng));
+    light.color = glm::vec3(0.2f) + 0.8f * glm::vec3(unit(rng), unit(rng), unit(rng));
+    light.radius = emissiveRadius;
+    lights.push_back(light);
+  }
+}
+
+void ClusteredLights::upload()
+{
+  // 每盞燈 2 個 texel: (position, radius), (color, 0)
+  std::vector<glm::vec4> data;
+  data.reserve(lights.size() * 2);
+  for (const PointLight &light : lights)
+  {
+    data.push_back(glm::vec4(light.position, light.radius));
+    data.push_back(glm::vec4(light.color, 0.0f));
+  }
+  if (data.empty())
+    data.push_back(glm::vec4(0.0f));
+
+  if (!lightBuffer)
+  {
+    glGenBuffers(1, &lightBuffer);
+    glGenBuffers(1, &gridBuffer);
+    glGenBuffers(1, &indexBuffer);
+    glGenTextures(1, &lightTexture);
+    glGenTextures(1, &gridTexture);
+    glGenTextures(1, &indexTexture);
+  }
+  glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+  glBufferData(GL_TEXTURE_BUFFER, data.size() * sizeof(glm::vec4), data.data(), GL_STATIC_DRAW);
+  glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, lightBuffer);
+
+  unsigned int zero[2] = {0, 0};
+  glBindBuffer(GL_TEXTURE_BUFFER, gridBuffer);
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(zero), zero, GL_STREAM_DRAW);
+  glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, gridBuffer);
+
+  glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(zero), zero, GL_STREAM_DRAW);
+  glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, indexBuffer);
+
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+int ClusteredLights::slice_of(float depth) const
+{
+  if (depth < clusterNear)
+    return 0;
+  return std::min(slices - 1, 1 + (int)std::floor(std::log(depth / clusterNear) * sliceScale));
+}
+
+void ClusteredLights::build_cluster_bounds(const glm::mat4 &projection, float nearPlane, float farPlane)
+{
+  this->farPlane = farPlane;
+  sliceScale = (slices - 1) / std::log(farPlane / clusterNear);
+  rowStride = (tilesX + 3) & ~3;
+  size_t count = (size_t)slices * tilesY * rowStride;
+  for (int a = 0; a < 3; ++a)
+  {
+    // 補位的 lane 是空盒子, 永遠測不過
+    boundsMin[a].assign(count, 1e30f);
+    boundsMax[a].assign(count, -1e30f);
+  }
+
+  // NDC 上的 tile 邊界在深度 d 對應 view space 的 x = (ndc + P20) * d / P00
+  // (對稱的透視投影 P20 = 0; 海報分塊的 off-center frustum 不是)
+  float p00 = projection[0][0], p11 = projection[1][1], p20 = projection[2][0], p21 = projection[2][1];
+  for (int s = 0; s < slices; ++s)
+  {
+    float d0 = s == 0 ? nearPlane : clusterNear * std::exp((s - 1) / sliceScale);
+    float d1 = s == slices - 1 ? farPlane : clusterNear * std::exp(s / sliceScale);
+    for (int ty = 0; ty < tilesY; ++ty)
+    {
+      float y0 = -1.0f + 2.0f * ty / tilesY + p21, y1 = -1.0f + 2.0f * (ty + 1) / tilesY + p21;
+      for (int tx = 0; tx < tilesX; ++tx)
+      {
+        float x0 = -1.0f + 2.0f * tx / tilesX + p20, x1 = -1.0f + 2.0f * (tx + 1) / tilesX + p20;
+        size_t i = ((size_t)s * tilesY + ty) * rowStride + tx;
+        boundsMin[0][i] = std::min({x0 * d0, x0 * d1, x1 * d0, x1 * d1}) / p00;
+        boundsMax[0][i] = std::max({x0 * d0, x0 * d1, x1 * d0, x1 * d1}) / p00;
+        boundsMin[1][i] = std::min({y0 * d0, y0 * d1, y1 * d0, y1 * d1}) / p11;
+        boundsMax[1][i] = std::max({y0 * d0, y0 * d1, y1 * d0, y1 * d1}) / p11;
+        boundsMin[2][i] = -d1;
+        boundsMax[2][i] = -d0;
+      }
+    }
+  }
+  cachedProjection = glm::vec4(p00, p11, p20, p21);
+  cachedPlanes = glm::vec2(nearPlane, farPlane);
+}
+
+void ClusteredLights::update(const glm::mat4 &view, const glm::mat4 &projection, float nearPlane, float farPlane)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  if (cachedProjection != glm::vec4(projection[0][0], projection[1][1], projection[2][0], projection[2][1]) ||
+      cachedPlanes != glm::vec2(nearPlane, farPlane))
+    build_cluster_bounds(projection, nearPlane, farPlane);
+
+  // ---------- 1. 光源轉到 view space, 一次 4 盞 ----------
+  size_t n = lights.size();
+  size_t padded = (n + 3) & ~(size_t)3;
+  viewX.resize(padded);
+  viewY.resize(padded);
+  viewZ.resize(padded);
+  viewR.resize(padded);
+  auto lane = [&](size_t i, int axis)
+  { return i < n ? lights[i].position[axis] : 0.0f; };
+  for (size_t i = 0; i < padded; i += 4)
+  {
+    float4 x(lane(i, 0), lane(i + 1, 0), lane(i + 2, 0), lane(i + 3, 0));
+    float4 y(lane(i, 1), lane(i + 1, 1), lane(i + 2, 1), lane(i + 3, 1));
+    float4 z(lane(i, 2), lane(i + 1, 2), lane(i + 2, 2), lane(i + 3, 2));
+    for (int r = 0; r < 3; ++r)
+    {
+      float4 out = float4(view[0][r]) * x + float4(view[1][r]) * y + float4(view[2][r]) * z + float4(view[3][r]);
+      out.store(&(r == 0 ? viewX : r == 1 ? viewY : viewZ)[i]);
+    }
+    for (size_t k = i; k < i + 4; ++k)
+      viewR[k] = k < n ? lights[k].radius : 0.0f;
+  }
+
+  // ---------- 2. 每盞燈: 先算涵蓋的 tile / slice 範圍, 再一次測 4 個 cluster 的 AABB ----------
+  pairCluster.clear();
+  pairLight.clear();
+  float p00 = projection[0][0], p11 = projection[1][1], p20 = projection[2][0], p21 = projection[2][1];
+  for (size_t i = 0; i < n; ++i)
+  {
+    float cx = viewX[i], cy = viewY[i], depth = -viewZ[i], r = viewR[i];
+    if (depth + r < nearPlane || depth - r > farPlane)
+      continue;
+    int s0 = slice_of(std::max(depth - r, nearPlane)), s1 = slice_of(std::min(depth + r, farPlane));
+    int x0 = 0, x1 = tilesX - 1, y0 = 0, y1 = tilesY - 1;
+    if (depth - r > nearPlane)
+    {
+      // 球的 view AABB 投影到螢幕: x (或 y) 的兩個極值各配最近、最遠的深度
+      float zn = depth - r, zf = depth + r;
+      float nx[4] = {(cx - r) / zn, (cx - r) / zf, (cx + r) / zn, (cx + r) / zf};
+      float ny[4] = {(cy - r) / zn, (cy - r) / zf, (cy + r) / zn, (cy + r) / zf};
+      float minX = *std::min_element(nx, nx + 4) * p00 - p20, maxX = *std::max_element(nx, nx + 4) * p00 - p20;
+      float minY = *std::min_element(ny, ny + 4) * p11 - p21, maxY = *std::max_element(ny, ny + 4) * p11 - p21;
+      if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+        continue;
+      x0 = std::clamp((int)std::floor((minX * 0.5f + 0.5f) * tilesX), 0, tilesX - 1);
+      x1 = std::clamp((int)std::floor((maxX * 0.5f + 0.5f) * tilesX), 0, tilesX - 1);
+      y0 = std::clamp((int)std::floor((minY * 0.5f + 0.5f) * tilesY), 0, tilesY - 1);
+      y1 = std::clamp((int)std::floor((maxY * 0.5f + 0.5f) * tilesY), 0, tilesY - 1);
+    }
+
+    float4 lx(cx), ly(cy), lz(viewZ[i]), radius2(r * r);
+    for (int s = s0; s <= s1; ++s)
+    {
+      for (int ty = y0; ty <= y1; ++ty)
+      {
+        size_t row = ((size_t)s * tilesY + ty) * rowStride;
+        for (int tx = x0 & ~3; tx <= x1; tx += 4)
+        {
+          size_t b = row + tx;
+          float4 dx = lx - min(max(lx, float4::load(&boundsMin[0][b])), float4::load(&boundsMax[0][b]));
+          float4 dy = ly - min(max(ly, float4::load(&boundsMin[1][b])), float4::load(&boundsMax[1][b]));
+          float4 dz = lz - min(max(lz, float4::load(&boundsMin[2][b])), float4::load(&boundsMax[2][b]));
+          int bits = movemask(cmp_le(dx * dx + dy * dy + dz * dz, radius2));
+          for (int k = 0; k < 4; ++k)
+          {
+            if (tx + k < x0 || tx + k > x1)
+              bits &= ~(1 << k);
+          }
+          while (bits)
+          {
+            int k = std::countr_zero((unsigned int)bits);
+            bits &= bits - 1;
+            pairCluster.push_back(((unsigned int)s * tilesY + ty) * tilesX + tx + k);
+            pairLight.push_back(i);
+          }
+        }
+      }
+    }
+  }
+
+  // ---------- 3. counting sort 成 (offset, count) + index 清單 ----------
+  size_t clusterCount = (size_t)tilesX * tilesY * slices;
+  grid.assign(clusterCount * 2, 0);
+  for (unsigned int c : pairCluster)
+    grid[c * 2 + 1]++;
+  unsigned int offset = 0;
+  for (size_t c = 0; c < clusterCount; ++c)
+  {
+    grid[c * 2] = offset;
+    offset += grid[c * 2 + 1];
+  }
+  indices.resize(std::max<size_t>(pairLight.size(), 1));
+  std::vector<unsigned int> cursor(clusterCount);
+  for (size_t c = 0; c < clusterCount; ++c)
+    cursor[c] = grid[c * 2];
+  for (size_t p = 0; p < pairLight.size(); ++p)
+    indices[cursor[pairCluster[p]]++] = pairLight[p];
+
+  lastReferences = pairLight.size();
+  lastBinMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+  // 每幀整塊重傳 (orphan)
+  glBindBuffer(GL_TEXTURE_BUFFER, gridBuffer);
+  glBufferData(GL_TEXTURE_BUFFER, grid.size() * sizeof(unsigned int), NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_TEXTURE_BUFFER, 0, grid.size() * sizeof(unsigned int), grid.data());
+  glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+  glBufferData(GL_TEXTURE_BUFFER, indices.size() * sizeof(unsigned int), NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_TEXTURE_BUFFER, 0, indices.size() * sizeof(unsigned int), indices.data());
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLights::bind(unsigned int program)
+{
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+
+  glUseProgram(program);
+  glUniform3i(glGetUniformLocation(program, "clusterDims"), tilesX, tilesY, slices);
+  glUniform2f(glGetUniformLocation(program, "clusterViewport"), (float)viewport[2], (float)viewport[3]);
+  glUniform2f(glGetUniformLocation(program, "clusterDepth"), clusterNear, sliceScale);
+  glUniform1i(glGetUniformLocation(program, "lightData"), 2);
+  glUniform1i(glGetUniformLocation(program, "clusterGrid"), 3);
+  glUniform1i(glGetUniformLocation(program, "lightIndices"), 4);
+
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+  glActiveTexture(GL_TEXTURE3);
+  glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+  glActiveTexture(GL_TEXTURE4);
+  glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void ClusteredLights::release()
+{
+  glDeleteBuffers(1, &lightBuffer);
+  glDeleteBuffers(1, &gridBuffer);
+  glDeleteBuffers(1, &indexBuffer);
+  glDeleteTextures(1, &lightTexture);
+  glDeleteTextures(1, &gridTexture);
+  glDeleteTextures(1, &indexTexture);
+  lightBuffer = gridBuffer = indexBuffer = lightTexture = gridTexture = indexTexture = 0;
+}
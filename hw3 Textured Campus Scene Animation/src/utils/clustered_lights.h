@@ -0,0 +1,74 @@
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+// ========== Clustered forward lighting ==========
+// 點光源來自 emissive 材質 (Ke) 的表面, 以及選用的光源檔 (models/<場景>/<場景>.lights).
+// 每幀在 CPU 上把光源分進 view space 的 froxel 格子: 螢幕切 tilesX x tilesY 個 tile,
+// 深度方向切 slices 個指數切片, 用 SIMD 一次測 4 個 cluster 的 sphere-AABB.
+// 結果 (每個 cluster 的 offset/count + 光源 index 清單) 放進 texture buffer,
+// fragment shader (USE_CLUSTERED_LIGHTS) 只算自己 cluster 裡的光源.
+struct PointLight
+{
+  glm::vec3 position{0.0f}; // world space
+  float radius = 0.1f;      // 影響範圍, 超過就完全沒有貢獻
+  glm::vec3 color{1.0f};    // 已經乘上強度
+};
+
+class ClusteredLights
+{
+public:
+  int tilesX = 16, tilesY = 9, slices = 24;
+  float clusterNear = 0.02f;      // 第 0 個切片涵蓋 [near, clusterNear], 之後指數切到 far
+  float emissiveCellSize = 0.05f; // emissive 表面每一格合成一個點光源
+  float emissiveRadius = 0.1f;
+  float emissiveIntensity = 0.5f; // 光源顏色 = Ke * intensity
+
+  // 每個 emissive 材質的表面依格子合成點光源 (位置 = 面積加權重心, 往平均法線方向推一點)
+  void add_emissive(const std::vector<Mesh> &meshes);
+  // 光源檔: 每行 "x y z r g b radius" (obj 座標, # 開頭是註解); toScene 是 load_obj 的正規化
+  bool load(const std::string &path, const glm::mat4 &toScene);
+  // 壓力測試: 在 [lo, hi] 裡隨機放 count 個光源
+  void add_random(size_t count, const glm::vec3 &lo, const glm::vec3 &hi);
+
+  // 光源資料 (world space) 上傳成 texture buffer, 光源改了要重新呼叫
+  void upload();
+  // 每幀: 光源轉到 view space, 分進 cluster, 上傳格子與 index 清單
+  void update(const glm::mat4 &view, const glm::mat4 &projection, float nearPlane, float farPlane);
+  // 設定 cluster uniform, texture buffer bind 在 unit 2~4
+  void bind(unsigned int program);
+  void release();
+  bool empty() const { return lights.empty(); }
+
+  std::vector<PointLight> lights;
+  float lastBinMs = 0.0f;     // 上一幀分 cluster 的 CPU 時間
+  size_t lastReferences = 0;  // 上一幀所有 cluster 的光源參照總數
+
+private:
+  void build_cluster_bounds(const glm::mat4 &projection, float nearPlane, float farPlane);
+  int slice_of(float depth) const;
+
+  // cluster 的 view space AABB, SoA, 每列 (同 slice 同 tile y) 補到 4 的倍數
+  int rowStride = 0;
+  std::vector<float> boundsMin[3], boundsMax[3];
+  glm::vec4 cachedProjection{0.0f}; // P00, P11, P20, P21 (off-center 的偏移): 跟 near / far 一起變了才重算 AABB
+  glm::vec2 cachedPlanes{0.0f};
+  float farPlane = 10.0f;
+  float sliceScale = 1.0f; // (slices - 1) / log(far / clusterNear)
+
+  // 每幀暫存
+  std::vector<float> viewX, viewY, viewZ, viewR;
+  std::vector<unsigned int> pairCluster, pairLight;
+  std::vector<unsigned int> grid;    // 每個 cluster 的 (offset, count)
+  std::vector<unsigned int> indices; // 依 cluster 排好的光源 index
+
+  unsigned int lightBuffer = 0, gridBuffer = 0, indexBuffer = 0;
+  unsigned int lightTexture = 0, gridTexture = 0, indexTexture = 0;
+};
+
+#endif
@@ -0,0 +1,299 @@
+#include "distance_field.h"
+#include "bvh.h"
+#include "thread_pool.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static const char SDF_MAGIC[4] = {'S', 'D', 'F', '1'};
+static const int BRICK_SAMPLES = DistanceField::BRICK + 1;
+static const int BRICK_VOLUME = BRICK_SAMPLES * BRICK_SAMPLES * BRICK_SAMPLES;
+
+// maxDistance 內找不到表面就回傳 +maxDistance (當成在外面)
+static float signed_distance(const Bvh &bvh, const std::vector<Mesh> &meshes, const glm::vec3 &p, float maxDistance)
+{
+  glm::vec3 q;
+  unsigned int t;
+  if (!bvh.closest(p, maxDistance, q, t))
+    return maxDistance;
+  const BvhTriangle &tri = bvh.triangles[t];
+  glm::vec3 n = glm::cross(tri.p1 - tri.p0, tri.p2 - tri.p0);
+  // obj 的繞序不一定可靠, 正面以頂點法線為準
+  const Mesh &mesh = meshes[tri.mesh];
+  const float *v = &mesh.vertices[(size_t)tri.primitive * 3 * VERTEX_STRIDE];
+  glm::vec3 shading = glm::mat3(mesh.transform) *
+                      (glm::vec3(v[5], v[6], v[7]) + glm::vec3(v[VERTEX_STRIDE + 5], v[VERTEX_STRIDE + 6], v[VERTEX_STRIDE + 7]) +
+                       glm::vec3(v[2 * VERTEX_STRIDE + 5], v[2 * VERTEX_STRIDE + 6], v[2 * VERTEX_STRIDE + 7]));
+  if (glm::dot(n, shading) < 0.0f)
+    n = -n;
+  float d = glm::length(p - q);
+  return glm::dot(p - q, n) < 0.0f ? -d : d;
+}
+
+void DistanceField::bake(const std::vector<Mesh> &meshes)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  bricks.clear();
+  samples.clear();
+  bakedResolution = resolution;
+  bakedBudget = memoryBudget;
+
+  std::vector<unsigned int> subset;
+  for (unsigned int m = 0; m < meshes.size(); ++m)
+  {
+    if (meshes[m].material && !meshes[m].proxy)
+      subset.push_back(m);
+  }
+  Bvh bvh;
+  bvh.build(meshes, subset);
+  if (bvh.nodes.empty())
+    return;
+
+  // ---------- 1. brick 中心的距離決定哪些要配置; 超過記憶體上限就放大 voxel 重來 ----------
+  glm::vec3 extent = bvh.sceneMax - bvh.sceneMin;
+  float voxel = std::max({extent.x, extent.y, extent.z}) / std::max(resolution, BRICK);
+  std::vector<float> centerDistance;
+  std::vector<unsigned int> allocated;
+  while (true)
+  {
+    // 外圍多留 band, 邊界上的表面兩側才都有取樣
+    origin = bvh.sceneMin - glm::vec3(band * voxel);
+    glm::vec3 size = extent + glm::vec3(2.0f * band * voxel);
+    brickDims = glm::max(glm::ivec3(glm::ceil(size / (voxel * BRICK))), glm::ivec3(1));
+    size_t brickCount = (size_t)brickDims.x * brickDims.y * brickDims.z;
+    float halfDiagonal = 0.5f * std::sqrt(3.0f) * BRICK * voxel;
+
+    centerDistance.assign(brickCount, 0.0f);
+    global_thread_pool().parallel_for(brickCount, 64, [&](size_t begin, size_t end)
+    {
+      for (size_t b = begin; b < end; ++b)
+      {
+        glm::ivec3 brick(b % brickDims.x, (b / brickDims.x) % brickDims.y, b / ((size_t)brickDims.x * brickDims.y));
+        glm::vec3 center = origin + (glm::vec3(brick) + 0.5f) * (voxel * BRICK);
+        centerDistance[b] = signed_distance(bvh, meshes, center, 1e30f);
+      }
+    });
+
+    allocated.clear();
+    for (size_t b = 0; b < brickCount; ++b)
+    {
+      if (std::abs(centerDistance[b]) < halfDiagonal + band * voxel)
+        allocated.push_back(b);
+    }
+    size_t bytes = allocated.size() * BRICK_VOLUME * 2 + brickCount * sizeof(glm::vec4);
+    if (bytes <= memoryBudget || brickCount == 1)
+      break;
+    voxel *= 1.25f;
+  }
+  voxelSize = voxel;
+
+  // ---------- 2. 配置的 brick 每個取樣點都查一次 ----------
+  int side = std::max(1, (int)std::ceil(std::cbrt((double)allocated.size())));
+  atlasBricks = glm::ivec3(side, side, std::max<size_t>(1, (allocated.size() + side * side - 1) / (side * side)));
+  float halfDiagonal = 0.5f * std::sqrt(3.0f) * BRICK * voxel;
+  bricks.resize(centerDistance.size());
+  for (size_t b = 0; b < bricks.size(); ++b)
+  {
+    // 空的 brick: 裡面任何一點離表面至少 |中心距離| - 半對角線
+    float d = centerDistance[b];
+    bricks[b] = glm::vec4(-1.0f, -1.0f, -1.0f, d < 0.0f ? std::min(d + halfDiagonal, 0.0f) : std::max(d - halfDiagonal, 0.0f));
+  }
+  samples.assign(allocated.size() * BRICK_VOLUME, 0.0f);
+  global_thread_pool().parallel_for(allocated.size(), 4, [&](size_t begin, size_t end)
+  {
+    for (size_t k = begin; k < end; ++k)
+    {
+      size_t b = allocated[k];
+      glm::ivec3 brick(b % brickDims.x, (b / brickDims.x) % brickDims.y, b / ((size_t)brickDims.x * brickDims.y));
+      bricks[b] = glm::vec4(k % atlasBricks.x, (k / atlasBricks.x) % atlasBricks.y, k / ((size_t)atlasBricks.x * atlasBricks.y), 0.0f);
+      // 取樣點離中心最多半對角線, 最近的表面一定在這個範圍內
+      float maxDistance = std::abs(centerDistance[b]) + halfDiagonal + voxel;
+      float *out = &samples[k * BRICK_VOLUME];
+      for (int z = 0; z < BRICK_SAMPLES; ++z)
+      {
+        for (int y = 0; y < BRICK_SAMPLES; ++y)
+        {
+          for (int x = 0; x < BRICK_SAMPLES; ++x)
+          {
+            glm::vec3 p = origin + glm::vec3(brick * BRICK + glm::ivec3(x, y, z)) * voxel;
+            *out++ = signed_distance(bvh, meshes, p, maxDistance);
+          }
+        }
+      }
+    }
+  });
+
+  float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+  std::cout << "Distance field baked: voxel " << voxelSize << ", " << brickDims.x * BRICK << "x" << brickDims.y * BRICK
+            << "x" << brickDims.z * BRICK << ", " << allocated.size() << "/" << bricks.size() << " bricks, "
+            << gpu_bytes() / (1024.0f * 1024.0f) << " MB, " << seconds << " s on " << global_thread_pool().size()
+            << " threads" << std::endl;
+}
+
+size_t DistanceField::gpu_bytes() const
+{
+  // atlas 是 R16F, indirection 是 RGBA32F
+  glm::ivec3 atlas = atlasBricks * BRICK_SAMPLES;
+  return (size_t)atlas.x * atlas.y * atlas.z * 2 + bricks.size() * sizeof(glm::vec4);
+}
+
+bool DistanceField::save(const std::string &path, const std::vector<Mesh> &meshes) const
+{
+  std::ofstream file(path, std::ios::binary);
+  if (!file)
+  {
+    std::cerr << "Failed to write distance field: " << path << std::endl;
+    return false;
+  }
+  uint32_t meshCount = meshes.size();
+  uint64_t checksum = mesh_checksum(meshes);
+  int32_t savedResolution = bakedResolution;
+  uint64_t savedBudget = bakedBudget;
+  uint32_t brickCount = bricks.size();
+  uint32_t allocatedCount = samples.size() / BRICK_VOLUME;
+  file.write(SDF_MAGIC, sizeof(SDF_MAGIC));
+  file.write((const char *)&meshCount, sizeof(meshCount));
+  file.write((const char *)&checksum, sizeof(checksum));
+  file.write((const char *)&savedResolution, sizeof(savedResolution));
+  file.write((const char *)&savedBudget, sizeof(savedBudget));
+  file.write((const char *)&voxelSize, sizeof(voxelSize));
+  file.write((const char *)&origin, sizeof(origin));
+  file.write((const char *)&brickDims, sizeof(brickDims));
+  file.write((const char *)&atlasBricks, sizeof(atlasBricks));
+  file.write((const char *)&brickCount, sizeof(brickCount));
+  file.write((const char *)&allocatedCount, sizeof(allocatedCount));
+  file.write((const char *)bricks.data(), bricks.size() * sizeof(glm::vec4));
+  file.write((const char *)samples.data(), samples.size() * sizeof(float));
+  std::cout << "Distance field saved: " << path << std::endl;
+  return (bool)file;
+}
+
+bool DistanceField::load(const std::string &path, const std::vector<Mesh> &meshes)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+
+  char magic[4];
+  uint32_t meshCount = 0, brickCount = 0, allocatedCount = 0;
+  uint64_t checksum = 0, savedBudget = 0;
+  int32_t savedResolution = 0;
+  file.read(magic, sizeof(magic));
+  file.read((char *)&meshCount, sizeof(meshCount));
+  file.read((char *)&checksum, sizeof(checksum));
+  file.read((char *)&savedResolution, sizeof(savedResolution));
+  file.read((char *)&savedBudget, sizeof(savedBudget));
+  file.read((char *)&voxelSize, sizeof(voxelSize));
+  file.read((char *)&origin, sizeof(origin));
+  file.read((char *)&brickDims, sizeof(brickDims));
+  file.read((char *)&atlasBricks, sizeof(atlasBricks));
+  file.read((char *)&brickCount, sizeof(brickCount));
+  file.read((char *)&allocatedCount, sizeof(allocatedCount));
+  if (!file || std::memcmp(magic, SDF_MAGIC, sizeof(magic)) != 0 || meshCount != meshes.size() ||
+      checksum != mesh_checksum(meshes) || savedResolution != resolution || savedBudget != memoryBudget ||
+      brickCount != (size_t)brickDims.x * brickDims.y * brickDims.z ||
+      allocatedCount > (size_t)atlasBricks.x * atlasBricks.y * atlasBricks.z)
+  {
+    std::cout << "Distance field out of date, ignoring: " << path << std::endl;
+    return false;
+  }
+
+  bricks.resize(brickCount);
+  samples.resize((size_t)allocatedCount * BRICK_VOLUME);
+  file.read((char *)bricks.data(), bricks.size() * sizeof(glm::vec4));
+  file.read((char *)samples.data(), samples.size() * sizeof(float));
+  if (!file)
+  {
+    std::cerr << "Distance field file truncated: " << path << std::endl;
+    bricks.clear();
+    samples.clear();
+    return false;
+  }
+  bakedResolution = savedResolution;
+  bakedBudget = savedBudget;
+  std::cout << "Distance field loaded: " << allocatedCount << "/" << brickCount << " bricks, "
+            << gpu_bytes() / (1024.0f * 1024.0f) << " MB" << std::endl;
+  return true;
+}
+
+bool DistanceField::upload()
+{
+  glm::ivec3 atlas = atlasBricks * BRICK_SAMPLES;
+  GLint maxSize = 0;
+  glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxSize);
+  if (std::max({atlas.x, atlas.y, atlas.z, brickDims.x, brickDims.y, brickDims.z}) > maxSize)
+  {
+    std::cout << "Distance field atlas " << atlas.x << "x" << atlas.y << "x" << atlas.z
+              << " exceeds GL_MAX_3D_TEXTURE_SIZE " << maxSize << std::endl;
+    return false;
+  }
+
+  // brick 依序搬進 atlas 的格子
+  std::vector<float> texels((size_t)atlas.x * atlas.y * atlas.z, 0.0f);
+  size_t allocatedCount = samples.size() / BRICK_VOLUME;
+  for (size_t k = 0; k < allocatedCount; ++k)
+  {
+    glm::ivec3 slot(k % atlasBricks.x, (k / atlasBricks.x) % atlasBricks.y, k / ((size_t)atlasBricks.x * atlasBricks.y));
+    const float *src = &samples[k * BRICK_VOLUME];
+    for (int z = 0; z < BRICK_SAMPLES; ++z)
+    {
+      for (int y = 0; y < BRICK_SAMPLES; ++y)
+      {
+        glm::ivec3 p = slot * BRICK_SAMPLES + glm::ivec3(0, y, z);
+        std::memcpy(&texels[((size_t)p.z * atlas.y + p.y) * atlas.x + p.x], src, BRICK_SAMPLES * sizeof(float));
+        src += BRICK_SAMPLES;
+      }
+    }
+  }
+
+  glGenTextures(1, &atlasTexture);
+  glBindTexture(GL_TEXTURE_3D, atlasTexture);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_R16F, atlas.x, atlas.y, atlas.z, 0, GL_RED, GL_FLOAT, texels.data());
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+  // indirection 只用 texelFetch
+  glGenTextures(1, &indirectionTexture);
+  glBindTexture(GL_TEXTURE_3D, indirectionTexture);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, brickDims.x, brickDims.y, brickDims.z, 0, GL_RGBA, GL_FLOAT, bricks.data());
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_3D, 0);
+  return true;
+}
+
+void DistanceField::bind(unsigned int program)
+{
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "sdfAtlas"), 8);
+  glUniform1i(glGetUniformLocation(program, "sdfIndirection"), 9);
+  glUniform3fv(glGetUniformLocation(program, "sdfOrigin"), 1, glm::value_ptr(origin));
+  glUniform1f(glGetUniformLocation(program, "sdfVoxel"), voxelSize);
+  glUniform3iv(glGetUniformLocation(program, "sdfBrickDims"), 1, glm::value_ptr(brickDims));
+  glUniform3fv(glGetUniformLocation(program, "sdfAtlasSize"), 1,
+               glm::value_ptr(glm::vec3(atlasBricks * BRICK_SAMPLES)));
+  glUniform1f(glGetUniformLocation(program, "sdfShadowDistance"), shadowDistance);
+  glUniform1f(glGetUniformLocation(program, "sdfSoftness"), softness);
+
+  glActiveTexture(GL_TEXTURE8);
+  glBindTexture(GL_TEXTURE_3D, atlasTexture);
+  glActiveTexture(GL_TEXTURE9);
+  glBindTexture(GL_TEXTURE_3D, indirectionTexture);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void DistanceField::release()
+{
+  glDeleteTextures(1, &atlasTexture);
+  glDeleteTextures(1, &indirectionTexture);
+  atlasTexture = indirectionTexture = 0;
+}
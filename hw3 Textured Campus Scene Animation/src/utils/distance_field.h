@@ -0,0 +1,58 @@
+#ifndef DISTANCE_FIELD_H
+#define DISTANCE_FIELD_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+// ========== 稀疏 (brick) signed distance field ==========
+// 靜態場景的距離場, 給 fragment shader (USE_SDF) 做 sphere / cone trace 的軟陰影與逐像素 AO,
+// 不用每幀多畫 shadow pass:
+// - 場景 bounds 切成 BRICK^3 voxel 一塊的 brick; 先用 BVH 最近點查詢算每塊中心的距離,
+//   表面附近的 brick 才配置 (BRICK + 1)^3 個取樣點 (邊界跟隔壁重複, trilinear 才不會有縫),
+//   其他的 brick 只記一個保守的距離 (中心距離 - 半對角線), sphere trace 照樣能用
+// - 符號看最近三角形的法線 (距離相同時選最正對的那個); 單面的地板、看板下方會是負的, 只是不會用到
+// - thread pool 平行; 配置的 brick 超過 memoryBudget 就降 resolution 重來
+// - GPU 上是一張 R16F 的 brick atlas + 每個 brick 一個 RGBA32F 的 indirection (atlas 位置或空 brick 的距離)
+// - 存成 models/<場景>/<場景>.sdf
+class DistanceField
+{
+public:
+  static constexpr int BRICK = 8;      // 每個 brick 的 voxel 數 (每軸)
+  int resolution = 256;            // 最長軸的 voxel 數
+  size_t memoryBudget = 64u << 20; // GPU 記憶體上限 (bytes), 超過就降低解析度
+  float band = 2.0f;               // 離表面幾個 voxel 內的 brick 要配置
+  float shadowDistance = 0.3f;     // 軟陰影往光源 trace 的最遠距離 (更遠的交給 shadow map)
+  float softness = 8.0f;           // 軟陰影的 k, 越大越硬
+
+  // 多執行緒烘焙 (不需要 GL context)
+  void bake(const std::vector<Mesh> &meshes);
+
+  bool save(const std::string &path, const std::vector<Mesh> &meshes) const;
+  // 場景、resolution 或 memoryBudget 跟烘焙時不同就回傳 false
+  bool load(const std::string &path, const std::vector<Mesh> &meshes);
+
+  // 超過 GL_MAX_3D_TEXTURE_SIZE 時回傳 false
+  bool upload();
+  // atlas bind 在 unit 8, indirection 在 unit 9
+  void bind(unsigned int program);
+  void release();
+  bool empty() const { return bricks.empty(); }
+
+  size_t gpu_bytes() const;
+
+private:
+  float voxelSize = 0.0f;
+  glm::vec3 origin{0.0f};        // 第 0 個取樣點的位置
+  glm::ivec3 brickDims{0};       // brick 格子的大小
+  glm::ivec3 atlasBricks{0};     // atlas 每軸放幾個 brick
+  std::vector<glm::vec4> bricks; // 每個 brick: xyz = atlas 裡的 brick 座標, w = 空 brick 的距離 (x < 0 代表空的)
+  std::vector<float> samples;    // 配置的 brick 依序, 每塊 (BRICK + 1)^3 個 (x 最快)
+  int bakedResolution = 0;       // 烘焙時的設定 (存檔比對用)
+  size_t bakedBudget = 0;
+  unsigned int atlasTexture = 0, indirectionTexture = 0;
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include "dynamic_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+bool DynamicBuffer::init(size_t bytesPerFrame, bool usePersistent)
+{
+  release();
+  bool ok = usePersistent && GLAD_GL_ARB_buffer_storage ? create(bytesPerFrame) : false;
+  if (!ok)
+  {
+    // orphaning: 一段就夠, 每幀換新的 storage
+    regionSize = bytesPerFrame;
+    staging.resize(regionSize);
+    glGenBuffers(1, &id);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+    glBufferData(GL_COPY_WRITE_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+  frame = 0;
+  frameStart = cursor = flushed = 0;
+  limit = regionSize;
+  std::cout << "Dynamic buffer: " << (persistent() ? "persistent mapped " : "orphaning ")
+            << (persistent() ? FRAMES : 1) << " x " << regionSize / 1024 << " KB" << std::endl;
+  return true;
+}
+
+// persistent + coherent, 整個生命週期只 map 一次
+bool DynamicBuffer::create(size_t regionBytes)
+{
+  const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  GLuint buffer = 0;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferStorage(GL_COPY_WRITE_BUFFER, regionBytes * FRAMES, NULL, flags);
+  void *pointer = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, regionBytes * FRAMES, flags);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  if (!pointer)
+  {
+    glDeleteBuffers(1, &buffer);
+    return false;
+  }
+  id = buffer;
+  mapped = (unsigned char *)pointer;
+  regionSize = regionBytes;
+  return true;
+}
+
+void DynamicBuffer::release()
+{
+  for (GLsync &fence : fences)
+  {
+    if (fence)
+      glDeleteSync(fence);
+    fence = 0;
+  }
+  if (id)
+    glDeleteBuffers(1, &id); // persistent 的 mapping 跟著 buffer 一起沒了
+  id = 0;
+  mapped = nullptr;
+  staging.clear();
+  staging.shrink_to_fit();
+}
+
+void DynamicBuffer::begin_frame()
+{
+  lastFrameBytes = cursor - frameStart;
+  if (persistent())
+  {
+    frame = (frame + 1) % FRAMES;
+    GLsync &fence = fences[frame];
+    if (fence)
+    {
+      // 通常 FRAMES 幀前的指令早就做完了; 沒做完才真的等
+      GLenum status = glClientWaitSync(fence, 0, 0);
+      if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+      {
+        ++fenceWaits;
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+      }
+      glDeleteSync(fence);
+      fence = 0;
+    }
+    frameStart = cursor = frame * regionSize;
+    limit = frameStart + regionSize;
+  }
+  else
+  {
+    // orphan: 上一幀的 draw 還拿著舊的 storage, 這裡拿到的是新的
+    glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+    glBufferData(GL_COPY_WRITE_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    frameStart = cursor = flushed = 0;
+    limit = regionSize;
+  }
+}
+
+void DynamicBuffer::end_frame()
+{
+  if (!persistent())
+    return;
+  GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  if (grewThisFrame)
+  {
+    // 剛放大過, 這幀的資料不在原本的那一段裡: 每一段都要等這幀做完才能重用
+    for (GLsync &other : fences)
+    {
+      if (other)
+        glDeleteSync(other);
+      other = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    glDeleteSync(fence);
+    grewThisFrame = false;
+    return;
+  }
+  if (fences[frame])
+    glDeleteSync(fences[frame]);
+  fences[frame] = fence;
+}
+
+DynamicBuffer::Allocation DynamicBuffer::allocate(size_t bytes, size_t alignment)
+{
+  size_t offset = (cursor + alignment - 1) / alignment * alignment;
+  if (offset + bytes > limit)
+  {
+    grow(offset + bytes - frameStart);
+    offset = (cursor + alignment - 1) / alignment * alignment;
+  }
+  cursor = offset + bytes;
+  Allocation allocation;
+  allocation.offset = offset;
+  allocation.data = persistent() ? mapped + offset : staging.data() + offset;
+  return allocation;
+}
+
+void DynamicBuffer::flush()
+{
+  if (persistent() || flushed >= cursor)
+    return;
+  glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, flushed, cursor - flushed, staging.data() + flushed);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  flushed = cursor;
+}
+
+// 這幀已經配置的 offset 都還要能用 (attribute pointer、indirect offset 指的是同一個 buffer name),
+// 所以新的 buffer 裡同一個位置要有同樣的資料
+void DynamicBuffer::grow(size_t needed)
+{
+  size_t newRegion = std::max(regionSize * 2, needed);
+  ++grows;
+  if (persistent())
+  {
+    GLuint oldId = id;
+    unsigned char *oldMapped = mapped;
+    std::vector<unsigned char> used(oldMapped + frameStart, oldMapped + cursor);
+    glDeleteBuffers(1, &oldId);
+    id = 0;
+    mapped = nullptr;
+    for (GLsync &fence : fences)
+    {
+      if (fence)
+        glDeleteSync(fence);
+      fence = 0;
+    }
+    if (create(newRegion))
+    {
+      std::memcpy(mapped + frameStart, used.data(), used.size());
+      // 新的 buffer 沒有 GPU 在讀: 這幀可以一直用到尾巴
+      limit = regionSize * FRAMES;
+      grewThisFrame = true;
+      std::cout << "Dynamic buffer: grew to " << regionSize / 1024 << " KB per frame" << std::endl;
+      return;
+    }
+    // 配置不到這麼大的 persistent buffer: 改用 orphaning, 這幀的資料放回暫存 (offset 不變)
+    std::cerr << "Dynamic buffer: persistent buffer of " << newRegion * FRAMES / 1024
+              << " KB failed, falling back to orphaning" << std::endl;
+    glGenBuffers(1, &id);
+    staging.assign(frameStart, 0);
+    staging.insert(staging.end(), used.begin(), used.end());
+    newRegion += frameStart;
+  }
+  regionSize = newRegion;
+  staging.resize(regionSize);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+  glBufferData(GL_COPY_WRITE_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  flushed = 0; // 新的 storage 是空的, 下次 flush 連前面的一起傳
+  limit = regionSize;
+  std::cout << "Dynamic buffer: grew to " << regionSize / 1024 << " KB per frame" << std::endl;
+}
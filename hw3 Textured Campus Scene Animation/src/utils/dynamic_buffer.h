@@ -0,0 +1,62 @@
+#ifndef DYNAMIC_BUFFER_H
+#define DYNAMIC_BUFFER_H
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+// ========== 每幀動態資料的 upload ring ==========
+// 每幀重寫的資料 (MDI 的 draw ID 與 indirect command、instancing 的 transform...) 都從這裡 bump 配置,
+// 不再對各自的 buffer glBufferData + glBufferSubData (GPU 還在讀上一幀時會隱性同步):
+// - 有 ARB_buffer_storage: 一個 GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT 的 buffer 切成 FRAMES 段,
+//   每幀用一段, 開始用之前等那段上次的 glFenceSync; 配置直接拿到 mapped 指標, 不用 map / unmap
+// - GL 3.3 沒有的話退回 orphaning: 每幀開頭 glBufferData(NULL) 換一塊新的, 配置寫在 CPU 的暫存,
+//   flush() 時 glBufferSubData 上傳
+// 一幀用量超過一段就整個 buffer 放大 (這幀已經配置的 offset 不變), 之後不會再縮
+class DynamicBuffer
+{
+public:
+  static constexpr int FRAMES = 3;
+
+  struct Allocation
+  {
+    void *data = nullptr; // 寫入的位置, 下一次 allocate 之前有效
+    GLintptr offset = 0;  // 在 buffer() 裡的 offset
+  };
+
+  // persistent 為 false (或不支援) 時用 orphaning
+  bool init(size_t bytesPerFrame, bool persistent);
+  void release();
+
+  // 換到下一段 (等它上次的 fence); end_frame 在這幀最後一個用到它的 GL 指令之後呼叫
+  void begin_frame();
+  void end_frame();
+
+  Allocation allocate(size_t bytes, size_t alignment = 16);
+  // 配置後寫入的資料在 GL 指令用到之前要 flush (persistent 的是 coherent, 什麼都不用做)
+  void flush();
+
+  GLuint buffer() const { return id; }
+  bool persistent() const { return mapped != nullptr; }
+
+  // ---------- 統計 ----------
+  size_t lastFrameBytes = 0; // 上一幀配置的量
+  int fenceWaits = 0;        // begin_frame 時 GPU 還沒用完那一段的次數
+  int grows = 0;
+
+private:
+  bool create(size_t regionBytes);
+  void grow(size_t needed);
+
+  GLuint id = 0;
+  unsigned char *mapped = nullptr;    // persistent: 整個 buffer 的 mapped 指標
+  std::vector<unsigned char> staging; // orphaning: 這幀的資料, flush 時上傳
+  size_t regionSize = 0;
+  int frame = 0;                      // 目前用哪一段
+  size_t frameStart = 0, cursor = 0, limit = 0;
+  size_t flushed = 0;                 // orphaning: [0, flushed) 已經上傳
+  GLsync fences[FRAMES] = {};
+  bool grewThisFrame = false;
+};
+
+#endif
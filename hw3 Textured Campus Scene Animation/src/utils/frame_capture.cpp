@@ -0,0 +1,399 @@
+#include "frame_capture.h"
+#include "../stb_image_write.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+bool FrameCapture::parse_format(const std::string &text, Format &format)
+{
+  if (text == "png")
+    format = Format::PNG;
+  else if (text == "ppm")
+    format = Format::PPM;
+  else if (text == "y4m")
+    format = Format::Y4M;
+  else
+    return false;
+  return true;
+}
+
+bool FrameCapture::begin(const std::string &outputDirectory)
+{
+  std::error_code error;
+  std::filesystem::create_directories(outputDirectory, error);
+  if (error)
+  {
+    std::cerr << "Cannot create " << outputDirectory << ": " << error.message() << std::endl;
+    return false;
+  }
+  directory = outputDirectory;
+  // 至少兩條, 單核心時 render thread 也不會自己去壓縮
+  encoders = std::make_unique<ThreadPool>(std::max(2u, std::thread::hardware_concurrency() / 2));
+  active = true;
+  return true;
+}
+
+void FrameCapture::begin(Sink frameSink)
+{
+  sink = std::move(frameSink);
+  format = Format::PNG; // 不走 Y4M 的排序
+  encoders = std::make_unique<ThreadPool>(std::max(2u, std::thread::hardware_concurrency() / 2));
+  active = true;
+}
+
+std::string FrameCapture::frame_path(int frame) const
+{
+  char name[32];
+  std::snprintf(name, sizeof(name), "frame_%05d.%s", frame, format == Format::PNG ? "png" : "ppm");
+  return directory + "/" + name;
+}
+
+FrameCapture::Slot &FrameCapture::begin_slot(int frame, int width, int height, size_t bytes)
+{
+  Slot &slot = slots[nextSlot];
+  nextSlot = (nextSlot + 1) % LATENCY;
+  if (slot.frame >= 0)
+    retire(slot, true);
+
+  if (!slot.pbo)
+    glGenBuffers(1, &slot.pbo);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  if (slot.capacity < bytes)
+  {
+    glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+    slot.capacity = bytes;
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  slot.bytes = bytes;
+  slot.frame = frame;
+  slot.width = width;
+  slot.height = height;
+  return slot;
+}
+
+void FrameCapture::end_slot(Slot &slot)
+{
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void FrameCapture::capture_framebuffer(int frame, int width, int height)
+{
+  Slot &slot = begin_slot(frame, width, height, (size_t)width * height * 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  end_slot(slot);
+}
+
+void FrameCapture::capture_texture(int frame, unsigned int texture, int width, int height)
+{
+  Slot &slot = begin_slot(frame, width, height, (size_t)width * height * 4);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  end_slot(slot);
+}
+
+void FrameCapture::capture_textures(int frame, const std::vector<Layer> &layers, int width, int height)
+{
+  size_t bytes = 0;
+  for (const Layer &layer : layers)
+    bytes += (size_t)width * height * layer.bytesPerPixel;
+  Slot &slot = begin_slot(frame, width, height, bytes);
+  size_t offset = 0;
+  for (const Layer &layer : layers)
+  {
+    glBindTexture(GL_TEXTURE_2D, layer.texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, layer.format, layer.type, (void *)offset);
+    offset += (size_t)width * height * layer.bytesPerPixel;
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  end_slot(slot);
+}
+
+void FrameCapture::poll()
+{
+  // 由舊到新, 遇到還沒好的就停 (後面的一定也還沒好)
+  for (int i = 0; i < LATENCY; ++i)
+  {
+    Slot &slot = slots[(nextSlot + i) % LATENCY];
+    if (slot.frame >= 0 && !retire(slot, false))
+      break;
+  }
+}
+
+bool FrameCapture::retire(Slot &slot, bool wait)
+{
+  GLsync fence = (GLsync)slot.fence;
+  GLenum status = glClientWaitSync(fence, 0, 0);
+  if (status == GL_TIMEOUT_EXPIRED)
+  {
+    if (!wait)
+      return false;
+    ++gpuStalls;
+    do
+      status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+    while (status == GL_TIMEOUT_EXPIRED);
+  }
+  glDeleteSync(fence);
+  slot.fence = nullptr;
+  int frame = slot.frame;
+  slot.frame = -1;
+
+  std::vector<unsigned char> pixels;
+  if (!reserve(slot.width, slot.height, slot.bytes, pixels))
+    return true;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.bytes, GL_MAP_READ_BIT);
+  if (!mapped)
+  {
+    // 讀不到就丟掉這幀, 不要把沒寫過的 buffer 當成畫面存出去
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    std::cerr << "Capture: cannot map readback buffer for frame " << frame << " (GL error 0x" << std::hex
+              << glGetError() << std::dec << ")" << std::endl;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pendingBytes -= pixels.size();
+      freeBuffers.push_back(std::move(pixels));
+    }
+    drained.notify_all();
+    ++dropped;
+    return true;
+  }
+  std::memcpy(pixels.data(), mapped, slot.bytes);
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  submit(frame, slot.width, slot.height, pixels);
+  return true;
+}
+
+void FrameCapture::capture_pixels(int frame, int width, int height, const unsigned char *rgba)
+{
+  size_t bytes = (size_t)width * height * 4;
+  std::vector<unsigned char> pixels;
+  if (!reserve(width, height, bytes, pixels))
+    return;
+  std::memcpy(pixels.data(), rgba, bytes);
+  submit(frame, width, height, pixels);
+}
+
+bool FrameCapture::reserve(int width, int height, size_t bytes, std::vector<unsigned char> &pixels)
+{
+  if (format == Format::Y4M)
+  {
+    // Y4M 整段同一個尺寸, 中途改視窗大小的幀丟掉
+    if (videoSubmitted == 0)
+      videoWidth = width, videoHeight = height;
+    if (width != videoWidth || height != videoHeight)
+    {
+      ++dropped;
+      return false;
+    }
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (pendingBytes + bytes > maxPendingBytes && pendingBytes > 0)
+    {
+      if (dropWhenBehind)
+      {
+        ++dropped;
+        return false;
+      }
+      ++encoderStalls;
+      drained.wait(lock, [&] { return pendingBytes + bytes <= maxPendingBytes || pendingBytes == 0; });
+    }
+    pendingBytes += bytes;
+    peakPendingBytes = std::max(peakPendingBytes, pendingBytes);
+    if (!freeBuffers.empty())
+    {
+      pixels = std::move(freeBuffers.back());
+      freeBuffers.pop_back();
+    }
+  }
+  pixels.resize(bytes);
+  return true;
+}
+
+void FrameCapture::submit(int frame, int width, int height, std::vector<unsigned char> &pixels)
+{
+  int videoFrame = format == Format::Y4M ? videoSubmitted++ : -1;
+  ++captured;
+  auto buffer = std::make_shared<std::vector<unsigned char>>(std::move(pixels));
+  encoders->submit([this, frame, videoFrame, width, height, buffer]
+                   { encode(frame, videoFrame, width, height, *buffer); });
+}
+
+// GL 讀回來是由下往上, 檔案都是由上往下; RGBA -> RGB 順便做
+static void flip_to_rgb(const std::vector<unsigned char> &rgba, int width, int height, std::vector<unsigned char> &rgb)
+{
+  rgb.resize((size_t)width * height * 3);
+  for (int y = 0; y < height; ++y)
+  {
+    const unsigned char *src = &rgba[(size_t)(height - 1 - y) * width * 4];
+    unsigned char *dst = &rgb[(size_t)y * width * 3];
+    for (int x = 0; x < width; ++x)
+    {
+      dst[x * 3 + 0] = src[x * 4 + 0];
+      dst[x * 3 + 1] = src[x * 4 + 1];
+      dst[x * 3 + 2] = src[x * 4 + 2];
+    }
+  }
+}
+
+// BT.601 full range (Y4M 的 C420jpeg), chroma 取 2x2 平均
+static void rgba_to_i420(const std::vector<unsigned char> &rgba, int width, int height, std::vector<unsigned char> &yuv)
+{
+  int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+  yuv.resize((size_t)width * height + 2 * (size_t)chromaWidth * chromaHeight);
+  unsigned char *planeY = yuv.data();
+  unsigned char *planeU = planeY + (size_t)width * height;
+  unsigned char *planeV = planeU + (size_t)chromaWidth * chromaHeight;
+  auto pixel = [&](int x, int y) { return &rgba[((size_t)(height - 1 - y) * width + x) * 4]; };
+
+  for (int y = 0; y < height; ++y)
+  {
+    for (int x = 0; x < width; ++x)
+    {
+      const unsigned char *p = pixel(x, y);
+      planeY[(size_t)y * width + x] = (unsigned char)std::clamp(0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2] + 0.5f, 0.0f, 255.0f);
+    }
+  }
+  for (int cy = 0; cy < chromaHeight; ++cy)
+  {
+    for (int cx = 0; cx < chromaWidth; ++cx)
+    {
+      float r = 0.0f, g = 0.0f, b = 0.0f;
+      int count = 0;
+      for (int y = cy * 2; y < std::min(height, cy * 2 + 2); ++y)
+      {
+        for (int x = cx * 2; x < std::min(width, cx * 2 + 2); ++x)
+        {
+          const unsigned char *p = pixel(x, y);
+          r += p[0], g += p[1], b += p[2];
+          ++count;
+        }
+      }
+      r /= count, g /= count, b /= count;
+      planeU[(size_t)cy * chromaWidth + cx] = (unsigned char)std::clamp(-0.168736f * r - 0.331264f * g + 0.5f * b + 128.5f, 0.0f, 255.0f);
+      planeV[(size_t)cy * chromaWidth + cx] = (unsigned char)std::clamp(0.5f * r - 0.418688f * g - 0.081312f * b + 128.5f, 0.0f, 255.0f);
+    }
+  }
+}
+
+void FrameCapture::encode(int frame, int videoFrame, int width, int height, std::vector<unsigned char> &pixels)
+{
+  auto begin = std::chrono::high_resolution_clock::now();
+  std::vector<unsigned char> converted;
+  if (sink)
+    sink(frame, width, height, pixels);
+  else if (format == Format::Y4M)
+  {
+    rgba_to_i420(pixels, width, height, converted);
+    write_video_frame(videoFrame, converted);
+  }
+  else
+  {
+    flip_to_rgb(pixels, width, height, converted);
+    std::string path = frame_path(frame);
+    bool written = false;
+    if (format == Format::PNG)
+      written = stbi_write_png(path.c_str(), width, height, 3, converted.data(), width * 3) != 0;
+    else if (FILE *file = std::fopen(path.c_str(), "wb"))
+    {
+      std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+      written = std::fwrite(converted.data(), 1, converted.size(), file) == converted.size();
+      std::fclose(file);
+    }
+    if (!written)
+      std::cerr << "Cannot write " << path << std::endl;
+  }
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pendingBytes -= pixels.size();
+    encodeMs += ms;
+    freeBuffers.push_back(std::move(pixels));
+  }
+  drained.notify_all();
+}
+
+void FrameCapture::write_video_frame(int videoFrame, std::vector<unsigned char> &yuv)
+{
+  std::lock_guard<std::mutex> lock(videoMutex);
+  if (!video)
+  {
+    std::string path = directory + "/capture.y4m";
+    video = std::fopen(path.c_str(), "wb");
+    if (!video)
+    {
+      std::cerr << "Cannot write " << path << std::endl;
+      return;
+    }
+    // fps 寫成有理數 (例如 29.97 -> 29970:1000)
+    std::fprintf(video, "YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 C420jpeg\n", videoWidth, videoHeight,
+                 (int)(fps * 1000.0f + 0.5f));
+  }
+  videoQueue[videoFrame] = std::move(yuv);
+  for (auto it = videoQueue.find(videoWritten); it != videoQueue.end(); it = videoQueue.find(videoWritten))
+  {
+    std::fputs("FRAME\n", video);
+    std::fwrite(it->second.data(), 1, it->second.size(), video);
+    videoQueue.erase(it);
+    ++videoWritten;
+  }
+}
+
+void FrameCapture::finish()
+{
+  if (!active)
+    return;
+  for (int i = 0; i < LATENCY; ++i)
+  {
+    Slot &slot = slots[nextSlot];
+    nextSlot = (nextSlot + 1) % LATENCY;
+    if (slot.frame >= 0)
+      retire(slot, true);
+  }
+  encoders->wait_idle();
+  std::lock_guard<std::mutex> lock(videoMutex);
+  if (video)
+  {
+    std::fclose(video);
+    video = nullptr;
+  }
+}
+
+void FrameCapture::release()
+{
+  finish();
+  for (Slot &slot : slots)
+  {
+    if (slot.pbo)
+      glDeleteBuffers(1, &slot.pbo);
+    slot = Slot();
+  }
+  encoders.reset();
+  sink = nullptr;
+  freeBuffers.clear();
+  active = false;
+}
+
+void FrameCapture::print_stats() const
+{
+  static const char *names[] = {"png", "ppm", "y4m"};
+  std::cout << "Capture: " << captured << " frames";
+  if (sink)
+    std::cout << " (sink)";
+  else
+    std::cout << " (" << names[(int)format] << ") to " << directory;
+  std::cout << ", " << dropped << " dropped, " << gpuStalls << " readback waits, " << encoderStalls << " encoder waits, peak "
+            << peakPendingBytes / (1024 * 1024) << " MB queued, encode "
+            << (captured ? encodeMs / captured : 0.0) << " ms/frame" << std::endl;
+}
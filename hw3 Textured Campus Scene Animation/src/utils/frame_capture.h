@@ -0,0 +1,124 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+// ========== 非同步的影格擷取 ==========
+// 每幀把畫面讀進 LATENCY 個 PBO 輪流用的其中一個, 後面放一個 fence, 不等 GPU:
+// - poll() 只把 fence 已經 signal 的 PBO map 出來 (通常是 2 ~ 3 幀前的), 複製一份交給 encoder
+// - ring 滿了 (GPU 落後 LATENCY 幀) 才會等最舊的 fence, 次數記在 gpuStalls
+// - encoder 是自己的 thread pool (不跟 culling 共用, 單核心也不會在 render thread 上壓縮),
+//   PNG / PPM 每幀一個檔案, Y4M 是一個串流檔 (I420), 依送出的順序寫入
+// - 還沒編完的影格超過 maxPendingBytes 時: dropWhenBehind (即時錄影) 直接丟掉那幀,
+//   否則 (離線輸出, 一幀都不能少) 等 encoder 消化, 次數記在 encoderStalls
+// - 也可以不寫檔, 改成在 encoder thread 上把讀回來的像素交給自訂的 Sink (海報分塊、AOV)
+// - capture_textures 一次讀好幾張 texture 到同一個 PBO (依序接在一起), 共用一個 fence, 只能配合 Sink
+class FrameCapture
+{
+public:
+  enum class Format
+  {
+    PNG,
+    PPM,
+    Y4M
+  };
+  static constexpr int LATENCY = 3;
+  // capture_textures 的一張 texture: glGetTexImage 的 format / type, 以及讀回來每個像素幾 bytes (4 的倍數)
+  struct Layer
+  {
+    unsigned int texture;
+    unsigned int format;
+    unsigned int type;
+    int bytesPerPixel;
+  };
+  // encoder thread 上呼叫; pixels 是 RGBA (或 capture_textures 的各層依序接在一起), 由下往上
+  using Sink = std::function<void(int frame, int width, int height, std::vector<unsigned char> &pixels)>;
+
+  Format format = Format::PNG;
+  float fps = 30.0f;                // 只寫進 Y4M header
+  bool dropWhenBehind = false;
+  size_t maxPendingBytes = 256u << 20;
+
+  // "png"、"ppm" 或 "y4m"
+  static bool parse_format(const std::string &text, Format &format);
+
+  // 建立資料夾與 encoder thread
+  bool begin(const std::string &directory);
+  void begin(Sink sink);
+  bool enabled() const { return active; }
+
+  // 從目前綁定的 GL_READ_FRAMEBUFFER 讀左下角 width x height
+  void capture_framebuffer(int frame, int width, int height);
+  // 讀一張 RGBA8 texture 的 level 0
+  void capture_texture(int frame, unsigned int texture, int width, int height);
+  // 同尺寸的多張 texture 一起讀 (level 0)
+  void capture_textures(int frame, const std::vector<Layer> &layers, int width, int height);
+  // 已經在 CPU 上的 RGBA (由下往上, 例如軟體光柵化): 複製一份直接交給 encoder
+  void capture_pixels(int frame, int width, int height, const unsigned char *rgba);
+  // 每幀呼叫一次: 已經完成的 readback 交給 encoder
+  void poll();
+  // 等 GPU 與 encoder 全部做完並關檔 (結束時呼叫, 會 block)
+  void finish();
+  void release();
+  void print_stats() const;
+
+  // ---------- 統計 ----------
+  int captured = 0;       // 交給 encoder 的幀數
+  int dropped = 0;        // encoder 跟不上 (或 Y4M 途中改了尺寸) 丟掉的幀數
+  int gpuStalls = 0;      // ring 滿了等 fence 的次數
+  int encoderStalls = 0;  // 等 encoder 消化的次數
+  size_t peakPendingBytes = 0;
+
+private:
+  struct Slot
+  {
+    unsigned int pbo = 0;
+    void *fence = nullptr; // GLsync
+    size_t capacity = 0;
+    size_t bytes = 0;      // 這次 readback 的大小
+    int frame = -1;        // -1: 沒有在等的 readback
+    int width = 0, height = 0;
+  };
+
+  Slot &begin_slot(int frame, int width, int height, size_t bytes);
+  void end_slot(Slot &slot);
+  // 把 slot 的結果 map 出來交給 encoder; wait 為 false 時 fence 還沒好就回傳 false
+  bool retire(Slot &slot, bool wait);
+  // 等 (或丟掉) 到佇列放得下, 拿一個 bytes 大小的 buffer; 回傳 false 代表這幀丟掉了
+  bool reserve(int width, int height, size_t bytes, std::vector<unsigned char> &pixels);
+  void submit(int frame, int width, int height, std::vector<unsigned char> &pixels);
+  void encode(int frame, int videoFrame, int width, int height, std::vector<unsigned char> &pixels);
+  void write_video_frame(int videoFrame, std::vector<unsigned char> &yuv);
+  std::string frame_path(int frame) const;
+
+  bool active = false;
+  std::string directory;
+  Sink sink;
+  Slot slots[LATENCY];
+  int nextSlot = 0; // 下一個要用的 slot, 也就是 ring 裡最舊的那個
+  std::unique_ptr<ThreadPool> encoders;
+
+  std::mutex mutex; // 保護以下 (encoder thread 也會改)
+  std::condition_variable drained;
+  size_t pendingBytes = 0;
+  std::vector<std::vector<unsigned char>> freeBuffers;
+  double encodeMs = 0.0;
+
+  // Y4M: 影格可能不按順序編完, 先放 videoQueue, 輪到了才寫
+  std::mutex videoMutex;
+  FILE *video = nullptr;
+  int videoWidth = 0, videoHeight = 0;
+  int videoSubmitted = 0, videoWritten = 0;
+  std::map<int, std::vector<unsigned char>> videoQueue;
+};
+
+#endif
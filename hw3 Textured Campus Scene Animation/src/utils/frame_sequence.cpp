@@ -0,0 +1,62 @@
+#include "frame_sequence.h"
+
+#include <algorithm>
+#include <cstdio>
+
+bool FrameSequence::parse_frames(const std::string &text)
+{
+  int a = 0, b = 0;
+  char dash = 0;
+  int matched = std::sscanf(text.c_str(), "%d%c%d", &a, &dash, &b);
+  if (matched == 1 && a >= 0)
+    rangeFirst = rangeLast = a;
+  else if (matched == 2 && dash == '-' && a >= 0)
+    rangeFirst = a, rangeLast = -1;
+  else if (matched == 3 && dash == '-' && a >= 0 && b >= a)
+    rangeFirst = a, rangeLast = b;
+  else
+    return false;
+  return true;
+}
+
+bool FrameSequence::parse_shard(const std::string &text)
+{
+  int i = 0, n = 0;
+  if (std::sscanf(text.c_str(), "%d/%d", &i, &n) != 2 || n < 1 || i < 0 || i >= n)
+    return false;
+  shardIndex = i;
+  shardCount = n;
+  return true;
+}
+
+bool FrameSequence::resolve(int totalFrames)
+{
+  int rangeEnd = rangeLast < 0 ? totalFrames - 1 : std::min(rangeLast, totalFrames - 1);
+  int count = rangeEnd - rangeFirst + 1;
+  if (count <= 0)
+    return false;
+
+  // 連續的區塊 (shadow cache、HLOD 狀態在相鄰幀之間比較能沿用), 前 count % N 塊多分一幀
+  int base = count / shardCount, extra = count % shardCount;
+  first = rangeFirst + shardIndex * base + std::min(shardIndex, extra);
+  last = first + base + (shardIndex < extra ? 1 : 0) - 1;
+  frame = 0;
+  return last >= first;
+}
+
+int count_path_frames(CameraPath path, float fps)
+{
+  if (path.keyframes.size() < 2)
+    return 1;
+  path.loop = false;
+  path.play();
+  glm::vec3 position, lookAt;
+  path.update(0.0f, position, lookAt, false);
+  int frames = 1;
+  while (path.isPlaying)
+  {
+    path.update(1.0f / fps, position, lookAt, false);
+    ++frames;
+  }
+  return frames;
+}
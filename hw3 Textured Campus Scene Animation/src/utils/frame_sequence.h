@@ -0,0 +1,37 @@
+#ifndef FRAME_SEQUENCE_H
+#define FRAME_SEQUENCE_H
+
+#include <string>
+
+#include "camera_path.h"
+
+// ========== 離線輸出 camera path 的影格序列 ==========
+// 不看 glfwGetTime: 第 0 幀 update(0), 之後每幀固定 update(1 / fps), 能畫多快就畫多快
+// - --frames A-B 只輸出這段 (含 B), --shard i/N 再把這段切成 N 塊連續的區間, 第 i 塊歸這個 process
+// - 相機與 HLOD 的遲滯有跨幀狀態, 所以 first 之前的幀還是要一幀一幀推進 (只跑 CPU 的部分, 不畫),
+//   每個 shard 的輸出都跟單一 process 從頭畫到尾的一樣
+// - 影像交給 FrameCapture 寫, 檔名用全域的幀號 (<directory>/frame_00042.png), 各 shard 寫到同一個資料夾也不會撞名
+struct FrameSequence
+{
+  std::string directory;             // 空字串: 互動模式
+  float fps = 30.0f;
+  int rangeFirst = 0, rangeLast = -1; // --frames, -1 代表到路徑結束
+  int shardIndex = 0, shardCount = 1; // --shard
+  int first = 0, last = -1;           // resolve 後這個 process 要畫的幀 [first, last]
+  int frame = 0;                      // 目前推進到第幾幀
+
+  bool enabled() const { return !directory.empty(); }
+  float frame_delta() const { return frame == 0 ? 0.0f : 1.0f / fps; }
+
+  // "A-B"、"A-" 或單一個 "A"
+  bool parse_frames(const std::string &text);
+  // "i/N", 0 <= i < N
+  bool parse_shard(const std::string &text);
+  // 依路徑總幀數算出 first / last; 這個 shard 沒有幀要畫時回傳 false
+  bool resolve(int totalFrames);
+};
+
+// 以固定 fps 從頭播到結束 (不 loop) 會有幾幀, 包含第 0 幀與停在終點的那一幀
+int count_path_frames(CameraPath path, float fps);
+
+#endif
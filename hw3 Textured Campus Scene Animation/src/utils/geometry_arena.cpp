@@ -0,0 +1,472 @@
+#include "geometry_arena.h"
+
+#include <algorithm>
+#include <bit>
+#include <iostream>
+
+// ========== TlsfAllocator ==========
+
+void TlsfAllocator::init(uint32_t capacity)
+{
+  blocks.clear();
+  unusedBlocks.clear();
+  for (auto &row : heads)
+    std::fill(std::begin(row), std::end(row), NONE);
+  flBitmap = 0;
+  std::fill(std::begin(slBitmap), std::end(slBitmap), 0u);
+  total = capacity;
+  usedSize = freeCount = 0;
+  if (capacity == 0)
+    return;
+  uint32_t block = new_block();
+  blocks[block].size = capacity;
+  insert_free(block);
+}
+
+// 小於 SL_COUNT 的大小一個 sl 一種; 其他的 fl = 最高位, sl = 接下來的 SL_BITS 位
+void TlsfAllocator::mapping(uint32_t size, int &fl, int &sl)
+{
+  if (size < (uint32_t)SL_COUNT)
+  {
+    fl = 0;
+    sl = size;
+    return;
+  }
+  int top = std::bit_width(size) - 1;
+  fl = top - SL_BITS + 1;
+  sl = (size >> (top - SL_BITS)) - SL_COUNT;
+}
+
+uint32_t TlsfAllocator::new_block()
+{
+  if (!unusedBlocks.empty())
+  {
+    uint32_t block = unusedBlocks.back();
+    unusedBlocks.pop_back();
+    blocks[block] = Block();
+    return block;
+  }
+  blocks.emplace_back();
+  return blocks.size() - 1;
+}
+
+void TlsfAllocator::insert_free(uint32_t block)
+{
+  int fl, sl;
+  mapping(blocks[block].size, fl, sl);
+  Block &b = blocks[block];
+  b.free = true;
+  b.prevFree = NONE;
+  b.nextFree = heads[fl][sl];
+  if (b.nextFree != NONE)
+    blocks[b.nextFree].prevFree = block;
+  heads[fl][sl] = block;
+  flBitmap |= 1u << fl;
+  slBitmap[fl] |= 1u << sl;
+  ++freeCount;
+}
+
+void TlsfAllocator::remove_free(uint32_t block)
+{
+  int fl, sl;
+  mapping(blocks[block].size, fl, sl);
+  Block &b = blocks[block];
+  if (b.prevFree != NONE)
+    blocks[b.prevFree].nextFree = b.nextFree;
+  else
+    heads[fl][sl] = b.nextFree;
+  if (b.nextFree != NONE)
+    blocks[b.nextFree].prevFree = b.prevFree;
+  if (heads[fl][sl] == NONE)
+  {
+    slBitmap[fl] &= ~(1u << sl);
+    if (!slBitmap[fl])
+      flBitmap &= ~(1u << fl);
+  }
+  b.free = false;
+  b.prevFree = b.nextFree = NONE;
+  --freeCount;
+}
+
+uint32_t TlsfAllocator::allocate(uint32_t size)
+{
+  size = std::max(size, 1u);
+  if (size > total - usedSize)
+    return NONE;
+
+  // 先把大小進位到下一個串列的下限, 那個串列以上的任何區塊都一定夠大
+  uint64_t rounded = size;
+  if (size >= (uint32_t)SL_COUNT)
+    rounded += (1ull << (std::bit_width(size) - 1 - SL_BITS)) - 1;
+  uint32_t found = NONE;
+  if (rounded <= 0xffffffffull)
+  {
+    int fl, sl;
+    mapping((uint32_t)rounded, fl, sl);
+    uint32_t slBits = slBitmap[fl] & (~0u << sl);
+    if (!slBits)
+    {
+      uint32_t flBits = fl + 1 < FL_COUNT ? flBitmap & (~0u << (fl + 1)) : 0;
+      if (flBits)
+      {
+        fl = std::countr_zero(flBits);
+        slBits = slBitmap[fl];
+      }
+    }
+    if (slBits)
+      found = heads[fl][std::countr_zero(slBits)];
+  }
+  if (found == NONE)
+  {
+    // 進位後找不到: 同一個串列裡可能還有剛好夠大的 (例如重新排緊時的最後一塊)
+    int fl, sl;
+    mapping(size, fl, sl);
+    for (uint32_t block = heads[fl][sl]; block != NONE; block = blocks[block].nextFree)
+      if (blocks[block].size >= size)
+      {
+        found = block;
+        break;
+      }
+    if (found == NONE)
+      return NONE;
+  }
+
+  remove_free(found);
+  if (blocks[found].size > size)
+  {
+    // 剩下的切成新的空閒區塊接在後面
+    uint32_t rest = new_block();
+    Block &b = blocks[found];
+    Block &r = blocks[rest];
+    r.offset = b.offset + size;
+    r.size = b.size - size;
+    r.prevPhysical = found;
+    r.nextPhysical = b.nextPhysical;
+    if (b.nextPhysical != NONE)
+      blocks[b.nextPhysical].prevPhysical = rest;
+    b.nextPhysical = rest;
+    b.size = size;
+    insert_free(rest);
+  }
+  usedSize += blocks[found].size;
+  return found;
+}
+
+void TlsfAllocator::free(uint32_t block)
+{
+  usedSize -= blocks[block].size;
+
+  uint32_t prev = blocks[block].prevPhysical;
+  if (prev != NONE && blocks[prev].free)
+  {
+    remove_free(prev);
+    blocks[prev].size += blocks[block].size;
+    blocks[prev].nextPhysical = blocks[block].nextPhysical;
+    if (blocks[block].nextPhysical != NONE)
+      blocks[blocks[block].nextPhysical].prevPhysical = prev;
+    unusedBlocks.push_back(block);
+    block = prev;
+  }
+  uint32_t next = blocks[block].nextPhysical;
+  if (next != NONE && blocks[next].free)
+  {
+    remove_free(next);
+    blocks[block].size += blocks[next].size;
+    blocks[block].nextPhysical = blocks[next].nextPhysical;
+    if (blocks[next].nextPhysical != NONE)
+      blocks[blocks[next].nextPhysical].prevPhysical = block;
+    unusedBlocks.push_back(next);
+  }
+  insert_free(block);
+}
+
+uint32_t TlsfAllocator::largest_free() const
+{
+  if (!flBitmap)
+    return 0;
+  int fl = std::bit_width(flBitmap) - 1;
+  int sl = std::bit_width(slBitmap[fl]) - 1;
+  uint32_t largest = 0;
+  for (uint32_t block = heads[fl][sl]; block != NONE; block = blocks[block].nextFree)
+    largest = std::max(largest, blocks[block].size);
+  return largest;
+}
+
+bool TlsfAllocator::compact() const
+{
+  if (freeCount != 1)
+    return freeCount == 0;
+  int fl = std::countr_zero(flBitmap);
+  const Block &block = blocks[heads[fl][std::countr_zero(slBitmap[fl])]];
+  return block.offset + block.size == total;
+}
+
+// ========== GeometryArena ==========
+
+void GeometryArena::init(uint32_t pageVertices, uint32_t pageIndices)
+{
+  release();
+  defaultVertices = pageVertices;
+  defaultIndices = pageIndices;
+}
+
+void GeometryArena::release()
+{
+  for (Page &page : pages)
+  {
+    glDeleteVertexArrays(1, &page.VAO);
+    glDeleteBuffers(1, &page.VBO);
+    glDeleteBuffers(1, &page.EBO);
+  }
+  pages.clear();
+  ranges.clear();
+  freeHandles.clear();
+}
+
+void GeometryArena::setup_vao(Page &page)
+{
+  const GLsizei stride = FLOATS_PER_VERTEX * sizeof(float);
+  glBindVertexArray(page.VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, page.VBO);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void *)(5 * sizeof(float)));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(8, 2, GL_FLOAT, GL_FALSE, stride, (void *)(VERTEX_STRIDE * sizeof(float)));
+  glEnableVertexAttribArray(8);
+  glVertexAttribPointer(9, 1, GL_FLOAT, GL_FALSE, stride, (void *)((VERTEX_STRIDE + 2) * sizeof(float)));
+  glEnableVertexAttribArray(9);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.EBO);
+  glBindVertexArray(0);
+}
+
+int GeometryArena::create_page(uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+  Page page;
+  page.vertices.init(vertexCapacity);
+  page.indices.init(indexCapacity);
+  glGenVertexArrays(1, &page.VAO);
+  glGenBuffers(1, &page.VBO);
+  glGenBuffers(1, &page.EBO);
+  glBindBuffer(GL_ARRAY_BUFFER, page.VBO);
+  glBufferData(GL_ARRAY_BUFFER, (size_t)vertexCapacity * FLOATS_PER_VERTEX * sizeof(float), NULL, GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  // EBO 要在 VAO 綁著時才會記進去, 這裡先用 copy target 配置
+  glBindBuffer(GL_COPY_WRITE_BUFFER, page.EBO);
+  glBufferData(GL_COPY_WRITE_BUFFER, (size_t)indexCapacity * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  setup_vao(page);
+  pages.push_back(std::move(page));
+  return pages.size() - 1;
+}
+
+int GeometryArena::upload(const Mesh &mesh)
+{
+  std::vector<float> indexed, lightmap, ao;
+  std::vector<unsigned int> indices;
+  index_vertices(mesh.vertices, indexed, indices, &mesh.lightmapUV, &lightmap, &mesh.ao, &ao);
+
+  size_t count = indexed.size() / VERTEX_STRIDE;
+  std::vector<float> interleaved;
+  interleaved.reserve(count * FLOATS_PER_VERTEX);
+  for (size_t i = 0; i < count; ++i)
+  {
+    interleaved.insert(interleaved.end(), indexed.begin() + i * VERTEX_STRIDE, indexed.begin() + (i + 1) * VERTEX_STRIDE);
+    interleaved.insert(interleaved.end(), {lightmap[i * 2], lightmap[i * 2 + 1], ao[i]});
+  }
+  return allocate(interleaved, indices);
+}
+
+int GeometryArena::allocate(const std::vector<float> &vertices, const std::vector<unsigned int> &indices)
+{
+  uint32_t vertexCount = vertices.size() / FLOATS_PER_VERTEX;
+  uint32_t indexCount = indices.size();
+
+  // 依序找第一個兩邊都放得下的 page, 都不行就開新的
+  Range range;
+  for (size_t p = 0; p < pages.size() && range.page < 0; ++p)
+  {
+    uint32_t vertexBlock = pages[p].vertices.allocate(vertexCount);
+    if (vertexBlock == TlsfAllocator::NONE)
+      continue;
+    uint32_t indexBlock = pages[p].indices.allocate(indexCount);
+    if (indexBlock == TlsfAllocator::NONE)
+    {
+      pages[p].vertices.free(vertexBlock);
+      continue;
+    }
+    range.page = p;
+    range.vertexBlock = vertexBlock;
+    range.indexBlock = indexBlock;
+  }
+  if (range.page < 0)
+  {
+    range.page = create_page(std::max(defaultVertices, vertexCount), std::max(defaultIndices, indexCount));
+    range.vertexBlock = pages[range.page].vertices.allocate(vertexCount);
+    range.indexBlock = pages[range.page].indices.allocate(indexCount);
+  }
+
+  const Page &page = pages[range.page];
+  range.baseVertex = page.vertices.offset(range.vertexBlock);
+  range.firstIndex = page.indices.offset(range.indexBlock);
+  range.indexCount = indexCount;
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, page.VBO);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, (size_t)range.baseVertex * FLOATS_PER_VERTEX * sizeof(float),
+                  vertices.size() * sizeof(float), vertices.data());
+  glBindBuffer(GL_COPY_WRITE_BUFFER, page.EBO);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, (size_t)range.firstIndex * sizeof(unsigned int),
+                  indices.size() * sizeof(unsigned int), indices.data());
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  int handle;
+  if (!freeHandles.empty())
+  {
+    handle = freeHandles.back();
+    freeHandles.pop_back();
+    ranges[handle] = range;
+  }
+  else
+  {
+    handle = ranges.size();
+    ranges.push_back(range);
+  }
+  return handle;
+}
+
+void GeometryArena::free(int handle)
+{
+  Range &range = ranges[handle];
+  if (range.page < 0)
+    return;
+  pages[range.page].vertices.free(range.vertexBlock);
+  pages[range.page].indices.free(range.indexBlock);
+  range = Range();
+  freeHandles.push_back(handle);
+}
+
+void GeometryArena::defragment()
+{
+  for (size_t p = 0; p < pages.size(); ++p)
+  {
+    Page &page = pages[p];
+    if (page.vertices.compact() && page.indices.compact())
+      continue;
+    std::vector<int> live;
+    for (size_t handle = 0; handle < ranges.size(); ++handle)
+      if (ranges[handle].page == (int)p)
+        live.push_back(handle);
+
+    // 新的 buffer 一樣大, 存活的配置依原本的順序接在一起; 同一個 buffer 內 copy 範圍不能重疊, 所以另開一組
+    GLuint vbo = 0, ebo = 0;
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ebo);
+    const size_t vertexBytes = FLOATS_PER_VERTEX * sizeof(float);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+    glBufferData(GL_COPY_WRITE_BUFFER, (size_t)page.vertices.capacity() * vertexBytes, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+    glBufferData(GL_COPY_WRITE_BUFFER, (size_t)page.indices.capacity() * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+
+    TlsfAllocator vertices, indices;
+    vertices.init(page.vertices.capacity());
+    indices.init(page.indices.capacity());
+
+    std::sort(live.begin(), live.end(), [&](int a, int b)
+              { return ranges[a].baseVertex < ranges[b].baseVertex; });
+    glBindBuffer(GL_COPY_READ_BUFFER, page.VBO);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+    for (int handle : live)
+    {
+      Range &range = ranges[handle];
+      uint32_t count = page.vertices.size(range.vertexBlock);
+      range.vertexBlock = vertices.allocate(count);
+      int baseVertex = vertices.offset(range.vertexBlock);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (size_t)range.baseVertex * vertexBytes,
+                          (size_t)baseVertex * vertexBytes, (size_t)count * vertexBytes);
+      range.baseVertex = baseVertex;
+    }
+
+    std::sort(live.begin(), live.end(), [&](int a, int b)
+              { return ranges[a].firstIndex < ranges[b].firstIndex; });
+    glBindBuffer(GL_COPY_READ_BUFFER, page.EBO);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+    for (int handle : live)
+    {
+      Range &range = ranges[handle];
+      uint32_t count = page.indices.size(range.indexBlock);
+      range.indexBlock = indices.allocate(count);
+      unsigned int firstIndex = indices.offset(range.indexBlock);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (size_t)range.firstIndex * sizeof(unsigned int),
+                          (size_t)firstIndex * sizeof(unsigned int), (size_t)count * sizeof(unsigned int));
+      range.firstIndex = firstIndex;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glDeleteBuffers(1, &page.VBO);
+    glDeleteBuffers(1, &page.EBO);
+    page.VBO = vbo;
+    page.EBO = ebo;
+    page.vertices = std::move(vertices);
+    page.indices = std::move(indices);
+    setup_vao(page);
+  }
+}
+
+void GeometryArena::draw(int handle) const
+{
+  const Range &range = ranges[handle];
+  glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+                           (void *)((size_t)range.firstIndex * sizeof(unsigned int)), range.baseVertex);
+}
+
+void GeometryArena::read_back(int handle, std::vector<float> &vertices, std::vector<unsigned int> &indices) const
+{
+  const Range &range = ranges[handle];
+  const Page &page = pages[range.page];
+  vertices.resize((size_t)vertex_count(handle) * FLOATS_PER_VERTEX);
+  indices.resize(range.indexCount);
+  glBindBuffer(GL_COPY_READ_BUFFER, page.VBO);
+  glGetBufferSubData(GL_COPY_READ_BUFFER, (size_t)range.baseVertex * FLOATS_PER_VERTEX * sizeof(float),
+                     vertices.size() * sizeof(float), vertices.data());
+  glBindBuffer(GL_COPY_READ_BUFFER, page.EBO);
+  glGetBufferSubData(GL_COPY_READ_BUFFER, (size_t)range.firstIndex * sizeof(unsigned int),
+                     indices.size() * sizeof(unsigned int), indices.data());
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+GeometryArena::Stats GeometryArena::stats() const
+{
+  Stats s;
+  s.pages = pages.size();
+  s.allocations = ranges.size() - freeHandles.size();
+  for (const Page &page : pages)
+  {
+    s.vertexCapacity += page.vertices.capacity();
+    s.vertexUsed += page.vertices.used();
+    s.vertexLargestFree = std::max<size_t>(s.vertexLargestFree, page.vertices.largest_free());
+    s.indexCapacity += page.indices.capacity();
+    s.indexUsed += page.indices.used();
+    s.indexLargestFree = std::max<size_t>(s.indexLargestFree, page.indices.largest_free());
+    s.freeBlocks += page.vertices.free_blocks() + page.indices.free_blocks();
+  }
+  size_t vertexFree = s.vertexCapacity - s.vertexUsed, indexFree = s.indexCapacity - s.indexUsed;
+  s.vertexFragmentation = vertexFree ? 1.0f - (float)s.vertexLargestFree / vertexFree : 0.0f;
+  s.indexFragmentation = indexFree ? 1.0f - (float)s.indexLargestFree / indexFree : 0.0f;
+  return s;
+}
+
+void GeometryArena::print_stats() const
+{
+  Stats s = stats();
+  const size_t vertexBytes = FLOATS_PER_VERTEX * sizeof(float);
+  std::cout << "Geometry arena: " << s.allocations << " meshes in " << s.pages << " pages, vertices "
+            << s.vertexUsed * vertexBytes / 1024 << "/" << s.vertexCapacity * vertexBytes / 1024 << " KB ("
+            << (s.vertexCapacity ? 100.0 * s.vertexUsed / s.vertexCapacity : 0.0) << "%), indices "
+            << s.indexUsed * sizeof(unsigned int) / 1024 << "/" << s.indexCapacity * sizeof(unsigned int) / 1024
+            << " KB (" << (s.indexCapacity ? 100.0 * s.indexUsed / s.indexCapacity : 0.0) << "%), "
+            << s.freeBlocks << " free blocks, fragmentation " << s.vertexFragmentation << " / "
+            << s.indexFragmentation << std::endl;
+}
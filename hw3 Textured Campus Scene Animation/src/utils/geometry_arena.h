@@ -0,0 +1,128 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+
+#include "mesh.h"
+
+// ========== TLSF (two-level segregated fit) 配置器 ==========
+// 只管理 [0, capacity) 的 offset, 不碰實際的記憶體; 單位由呼叫端決定 (頂點數、index 數...).
+// 空閒區塊依大小分到 FL (2 的次方) x SL (再切 16 份) 個串列, 兩層 bitmap 找第一個夠大的串列,
+// 配置與釋放都是 O(1); 釋放時跟實體相鄰的空閒區塊合併
+class TlsfAllocator
+{
+public:
+  static constexpr uint32_t NONE = 0xffffffffu;
+
+  void init(uint32_t capacity);
+  // 回傳區塊 handle, 放不下回傳 NONE
+  uint32_t allocate(uint32_t size);
+  void free(uint32_t block);
+
+  uint32_t offset(uint32_t block) const { return blocks[block].offset; }
+  uint32_t size(uint32_t block) const { return blocks[block].size; }
+
+  uint32_t capacity() const { return total; }
+  uint32_t used() const { return usedSize; }
+  uint32_t largest_free() const;
+  uint32_t free_blocks() const { return freeCount; }
+  // 空閒空間只剩尾巴的一塊 (或沒有)
+  bool compact() const;
+
+private:
+  static constexpr int SL_BITS = 4;
+  static constexpr int SL_COUNT = 1 << SL_BITS;
+  static constexpr int FL_COUNT = 32;
+
+  struct Block
+  {
+    uint32_t offset = 0, size = 0;
+    uint32_t prevPhysical = NONE, nextPhysical = NONE; // 位址上相鄰的區塊
+    uint32_t prevFree = NONE, nextFree = NONE;         // 同一個大小串列
+    bool free = false;
+  };
+
+  static void mapping(uint32_t size, int &fl, int &sl);
+  uint32_t new_block();
+  void insert_free(uint32_t block);
+  void remove_free(uint32_t block);
+
+  std::vector<Block> blocks;
+  std::vector<uint32_t> unusedBlocks; // 合併掉的 Block 重複利用
+  uint32_t heads[FL_COUNT][SL_COUNT];
+  uint32_t flBitmap = 0;
+  uint32_t slBitmap[FL_COUNT] = {};
+  uint32_t total = 0, usedSize = 0, freeCount = 0;
+};
+
+// ========== 逐 mesh 路徑的幾何 arena ==========
+// 不再每個 Mesh 各自 glGenBuffers + glBufferData: 頂點與 index 放在少數幾個大的 page 裡
+// (每個 page 一組 VBO / EBO / VAO), page 內用 TlsfAllocator 配置 offset,
+// 畫的時候 glDrawElementsBaseVertex 帶 base vertex, 連續的 mesh 在同一個 page 就不用換 VAO.
+// 頂點交錯存放: x y z | u v | nx ny nz | lightmap u v | ao, 沒有 lightmap / AO 的 mesh 填 -1, -1 與 1
+class GeometryArena
+{
+public:
+  static constexpr int FLOATS_PER_VERTEX = VERTEX_STRIDE + 3;
+
+  struct Range
+  {
+    int page = -1;
+    unsigned int firstIndex = 0;
+    unsigned int indexCount = 0;
+    int baseVertex = 0;
+    uint32_t vertexBlock = TlsfAllocator::NONE, indexBlock = TlsfAllocator::NONE;
+  };
+
+  struct Stats
+  {
+    size_t pages = 0;
+    size_t allocations = 0;
+    size_t vertexCapacity = 0, vertexUsed = 0, vertexLargestFree = 0;
+    size_t indexCapacity = 0, indexUsed = 0, indexLargestFree = 0;
+    size_t freeBlocks = 0;
+    // 1 - 最大空閒區塊 / 全部空閒: 0 代表空閒空間都連在一起 (有好幾個 page 時, 排緊之後也還是各自一塊)
+    float vertexFragmentation = 0.0f, indexFragmentation = 0.0f;
+  };
+
+  // 新 page 的預設大小 (單一 mesh 比這個大時, 那個 page 就開到剛好放得下)
+  void init(uint32_t pageVertices, uint32_t pageIndices);
+  void release();
+
+  // mesh 的三角形 soup 去重成 indexed geometry 後放進 arena, 回傳 handle (Mesh::geometry)
+  int upload(const Mesh &mesh);
+  // vertices 是 FLOATS_PER_VERTEX 交錯的頂點, indices 從 0 開始
+  int allocate(const std::vector<float> &vertices, const std::vector<unsigned int> &indices);
+  void free(int handle);
+  // 把每個 page 的存活配置往前搬緊 (GPU 上 copy, 不經過 CPU), handle 不變、Range 的 offset 會更新
+  void defragment();
+
+  const Range &range(int handle) const { return ranges[handle]; }
+  uint32_t vertex_count(int handle) const { return pages[ranges[handle].page].vertices.size(ranges[handle].vertexBlock); }
+  // 從 GPU 讀回這個配置目前的頂點與 index (--arena-selftest 用來比對搬移後的內容)
+  void read_back(int handle, std::vector<float> &vertices, std::vector<unsigned int> &indices) const;
+  void bind(int page) const { glBindVertexArray(pages[page].VAO); }
+  void draw(int handle) const;
+
+  Stats stats() const;
+  void print_stats() const;
+
+private:
+  struct Page
+  {
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    TlsfAllocator vertices, indices;
+  };
+
+  int create_page(uint32_t vertexCapacity, uint32_t indexCapacity);
+  void setup_vao(Page &page);
+
+  uint32_t defaultVertices = 1 << 18, defaultIndices = 1 << 20;
+  std::vector<Page> pages;
+  std::vector<Range> ranges;
+  std::vector<int> freeHandles;
+};
+
+#endif
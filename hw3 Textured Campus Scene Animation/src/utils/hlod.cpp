@@ -0,0 +1,380 @@
+#include "hlod.h"
+#include "bvh.h"
+#include "thread_pool.h"
+#include "../stb_image_write.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <tuple>
+
+static const char HLOD_MAGIC[4] = {'H', 'L', 'D', '1'};
+
+static std::string atlas_path(const std::string &directory, size_t cluster)
+{
+  return directory + "/cluster_" + std::to_string(cluster) + "_atlas.png";
+}
+
+// 跟 fragment.glsl 一樣: 有貼圖用貼圖, 沒有就用 Kd (太暗時用灰色)
+static glm::vec3 material_color(const Material *mat, const std::map<std::string, Image> &images, glm::vec2 uv)
+{
+  if (!mat)
+    return glm::vec3(0.8f);
+  auto it = images.find(mat->diffuseTexPath);
+  if (it != images.end())
+    return glm::vec3(sample_image(it->second, uv));
+  return glm::length(mat->Kd) > 0.01f ? mat->Kd : glm::vec3(0.8f);
+}
+
+void HlodSystem::build(const std::vector<Mesh> &meshes)
+{
+  auto start = std::chrono::steady_clock::now();
+  clusters.clear();
+
+  // ---------- 依 mesh bounds 中心分格 ----------
+  std::map<std::tuple<int, int, int>, std::vector<unsigned int>> cells;
+  for (unsigned int i = 0; i < meshes.size(); ++i)
+  {
+    if (!meshes[i].material || meshes[i].proxy || meshes[i].vertices.empty())
+      continue;
+    glm::ivec3 c = glm::ivec3(glm::floor((meshes[i].boundsMin + meshes[i].boundsMax) * 0.5f / clusterCellSize));
+    cells[{c.x, c.y, c.z}].push_back(i);
+  }
+  for (auto &[key, members] : cells)
+  {
+    if (members.size() < minClusterMeshes)
+      continue;
+    Cluster cluster;
+    cluster.meshes = std::move(members);
+    clusters.push_back(std::move(cluster));
+  }
+
+  // 原始貼圖先讀進來, 平行烘焙時只讀不寫
+  std::map<std::string, Image> images;
+  for (const Cluster &cluster : clusters)
+  {
+    for (unsigned int m : cluster.meshes)
+    {
+      const std::string &path = meshes[m].material->diffuseTexPath;
+      if (path.empty() || images.count(path))
+        continue;
+      Image image;
+      if (load_image(path, image))
+        images.emplace(path, std::move(image));
+    }
+  }
+
+  global_thread_pool().parallel_for(clusters.size(), 1, [&](size_t begin, size_t end)
+  {
+    for (size_t c = begin; c < end; ++c)
+      build_cluster(meshes, images, clusters[c]);
+  });
+
+  size_t sourceTriangles = 0, proxyTriangles = 0;
+  for (const Cluster &cluster : clusters)
+  {
+    for (unsigned int m : cluster.meshes)
+      sourceTriangles += meshes[m].vertices.size() / (3 * VERTEX_STRIDE);
+    proxyTriangles += cluster.vertices.size() / (3 * VERTEX_STRIDE);
+  }
+  float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "HLOD: " << clusters.size() << " clusters, " << sourceTriangles << " -> " << proxyTriangles
+            << " triangles, " << seconds << " s on " << global_thread_pool().size() << " threads" << std::endl;
+}
+
+void HlodSystem::build_cluster(const std::vector<Mesh> &meshes, const std::map<std::string, Image> &images,
+                               Cluster &cluster) const
+{
+  // ---------- 1. 合併: 所有成員的三角形 (world space) ----------
+  std::vector<glm::vec3> positions;
+  glm::vec3 lo(1e30f), hi(-1e30f);
+  for (unsigned int m : cluster.meshes)
+  {
+    const Mesh &mesh = meshes[m];
+    for (size_t i = 0; i + VERTEX_STRIDE <= mesh.vertices.size(); i += VERTEX_STRIDE)
+    {
+      glm::vec3 p = glm::vec3(mesh.transform * glm::vec4(mesh.vertices[i], mesh.vertices[i + 1], mesh.vertices[i + 2], 1.0f));
+      positions.push_back(p);
+      lo = glm::min(lo, p);
+      hi = glm::max(hi, p);
+    }
+  }
+  cluster.center = (lo + hi) * 0.5f;
+  cluster.radius = std::max(glm::length(hi - lo) * 0.5f, 1e-4f);
+  cluster.switchDistance = cluster.radius * switchDistanceScale;
+
+  // ---------- 2. vertex clustering: 同一格的頂點合成一個 (取平均) ----------
+  float cell = std::max({hi.x - lo.x, hi.y - lo.y, hi.z - lo.z, 1e-4f}) / simplifyGrid;
+  std::map<std::tuple<int, int, int>, unsigned int> cellIndex;
+  std::vector<glm::vec3> representative;
+  std::vector<int> representativeCount;
+  std::vector<unsigned int> remap(positions.size());
+  for (size_t i = 0; i < positions.size(); ++i)
+  {
+    glm::ivec3 c = glm::ivec3(glm::floor((positions[i] - lo) / cell));
+    auto [it, inserted] = cellIndex.emplace(std::make_tuple(c.x, c.y, c.z), (unsigned int)representative.size());
+    if (inserted)
+    {
+      representative.push_back(glm::vec3(0.0f));
+      representativeCount.push_back(0);
+    }
+    representative[it->second] += positions[i];
+    representativeCount[it->second]++;
+    remap[i] = it->second;
+  }
+  for (size_t i = 0; i < representative.size(); ++i)
+    representative[i] /= (float)representativeCount[i];
+
+  // 退化 (兩個頂點同格) 與重複的三角形丟掉
+  std::vector<std::array<unsigned int, 3>> triangles;
+  std::set<std::array<unsigned int, 3>> seen;
+  for (size_t i = 0; i + 2 < remap.size(); i += 3)
+  {
+    std::array<unsigned int, 3> tri = {remap[i], remap[i + 1], remap[i + 2]};
+    if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+      continue;
+    glm::vec3 n = glm::cross(representative[tri[1]] - representative[tri[0]], representative[tri[2]] - representative[tri[0]]);
+    if (glm::dot(n, n) < 1e-20f)
+      continue;
+    std::array<unsigned int, 3> key = tri;
+    std::sort(key.begin(), key.end());
+    if (seen.insert(key).second)
+      triangles.push_back(tri);
+  }
+
+  // ---------- 3. atlas: 每兩個三角形共用一個方格, 各佔對角線的一半 ----------
+  size_t tiles = (triangles.size() + 1) / 2;
+  int perRow = std::max(1, (int)std::ceil(std::sqrt((double)tiles)));
+  int tile = std::max(1, atlasSize / perRow);
+  float pad = tile >= 4 ? 1.0f : 0.0f;
+
+  Bvh bvh;
+  bvh.build(meshes, cluster.meshes);
+
+  glm::vec3 fallback = material_color(meshes[cluster.meshes[0]].material, images, glm::vec2(0.5f));
+  float searchDistance = cell * 2.0f;
+  auto trace = [&](const glm::vec3 &p, const glm::vec3 &n) -> glm::vec3
+  {
+    // 從代理表面兩側沿法線找最近的原始表面
+    Ray ray;
+    ray.origin = p + n * searchDistance;
+    ray.direction = -n;
+    ray.tMin = 0.0f;
+    ray.tMax = 2.0f * searchDistance;
+    Hit hit;
+    if (!bvh.intersect(ray, hit))
+      return fallback;
+    const BvhTriangle &tri = bvh.triangles[hit.triangle];
+    const Mesh &mesh = meshes[tri.mesh];
+    const float *v = &mesh.vertices[(size_t)tri.primitive * 3 * VERTEX_STRIDE];
+    glm::vec2 uv = (1.0f - hit.u - hit.v) * glm::vec2(v[3], v[4]) +
+                   hit.u * glm::vec2(v[VERTEX_STRIDE + 3], v[VERTEX_STRIDE + 4]) +
+                   hit.v * glm::vec2(v[2 * VERTEX_STRIDE + 3], v[2 * VERTEX_STRIDE + 4]);
+    return material_color(mesh.material, images, uv);
+  };
+
+  cluster.atlas.assign((size_t)atlasSize * atlasSize * 3, 0);
+  cluster.vertices.clear();
+  cluster.vertices.reserve(triangles.size() * 3 * VERTEX_STRIDE);
+  for (size_t t = 0; t < triangles.size(); ++t)
+  {
+    int tileIndex = t / 2;
+    bool upper = t & 1;
+    float x0 = (tileIndex % perRow) * tile, y0 = (tileIndex / perRow) * tile;
+    float a = pad, b = tile - pad;
+    // 方格內的像素座標: 下半 (0,0)(1,0)(0,1), 上半 (1,1)(0,1)(1,0)
+    glm::vec2 corner[3];
+    if (!upper)
+    {
+      corner[0] = {x0 + a, y0 + a};
+      corner[1] = {x0 + b, y0 + a};
+      corner[2] = {x0 + a, y0 + b};
+    }
+    else
+    {
+      corner[0] = {x0 + b, y0 + b};
+      corner[1] = {x0 + a, y0 + b};
+      corner[2] = {x0 + b, y0 + a};
+    }
+
+    glm::vec3 p[3] = {representative[triangles[t][0]], representative[triangles[t][1]], representative[triangles[t][2]]};
+    glm::vec3 normal = glm::normalize(glm::cross(p[1] - p[0], p[2] - p[0]));
+    for (int k = 0; k < 3; ++k)
+    {
+      glm::vec2 uv = corner[k] / (float)atlasSize;
+      cluster.vertices.insert(cluster.vertices.end(), {p[k].x, p[k].y, p[k].z, uv.x, uv.y, normal.x, normal.y, normal.z});
+    }
+
+    // 方格裡屬於這一半的像素 (含 padding, 當作 gutter)
+    glm::vec2 e1 = corner[1] - corner[0], e2 = corner[2] - corner[0];
+    float det = e1.x * e2.y - e1.y * e2.x;
+    for (int py = (int)y0; py < (int)y0 + tile && py < atlasSize; ++py)
+    {
+      for (int px = (int)x0; px < (int)x0 + tile && px < atlasSize; ++px)
+      {
+        float fx = px + 0.5f - x0, fy = py + 0.5f - y0;
+        if ((fx + fy <= tile) == upper)
+          continue;
+        glm::vec2 d = glm::vec2(px + 0.5f, py + 0.5f) - corner[0];
+        float w1 = (d.x * e2.y - d.y * e2.x) / det;
+        float w2 = (e1.x * d.y - e1.y * d.x) / det;
+        w1 = std::clamp(w1, 0.0f, 1.0f);
+        w2 = std::clamp(w2, 0.0f, 1.0f - w1);
+        glm::vec3 surface = p[0] + w1 * (p[1] - p[0]) + w2 * (p[2] - p[0]);
+        glm::vec3 color = glm::clamp(trace(surface, normal), 0.0f, 1.0f);
+        unsigned char *out = &cluster.atlas[((size_t)py * atlasSize + px) * 3];
+        for (int c = 0; c < 3; ++c)
+          out[c] = (unsigned char)(color[c] * 255.0f + 0.5f);
+      }
+    }
+  }
+}
+
+bool HlodSystem::save(const std::string &directory, const std::vector<Mesh> &meshes) const
+{
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  std::ofstream file(directory + "/hlod.bin", std::ios::binary);
+  if (!file)
+  {
+    std::cerr << "Failed to write HLOD: " << directory << std::endl;
+    return false;
+  }
+
+  uint64_t checksum = mesh_checksum(meshes);
+  uint32_t clusterCount = clusters.size();
+  file.write(HLOD_MAGIC, sizeof(HLOD_MAGIC));
+  file.write((const char *)&checksum, sizeof(checksum));
+  file.write((const char *)&atlasSize, sizeof(atlasSize));
+  file.write((const char *)&clusterCount, sizeof(clusterCount));
+  for (const Cluster &cluster : clusters)
+  {
+    uint32_t memberCount = cluster.meshes.size();
+    uint32_t floatCount = cluster.vertices.size();
+    file.write((const char *)&cluster.center, sizeof(cluster.center));
+    file.write((const char *)&cluster.radius, sizeof(cluster.radius));
+    file.write((const char *)&cluster.switchDistance, sizeof(cluster.switchDistance));
+    file.write((const char *)&memberCount, sizeof(memberCount));
+    file.write((const char *)cluster.meshes.data(), memberCount * sizeof(unsigned int));
+    file.write((const char *)&floatCount, sizeof(floatCount));
+    file.write((const char *)cluster.vertices.data(), floatCount * sizeof(float));
+  }
+
+  for (size_t c = 0; c < clusters.size(); ++c)
+    stbi_write_png(atlas_path(directory, c).c_str(), atlasSize, atlasSize, 3, clusters[c].atlas.data(), atlasSize * 3);
+  std::cout << "HLOD saved: " << directory << std::endl;
+  return (bool)file;
+}
+
+bool HlodSystem::load(const std::string &directory, const std::vector<Mesh> &meshes)
+{
+  std::ifstream file(directory + "/hlod.bin", std::ios::binary);
+  if (!file)
+    return false;
+
+  char magic[4];
+  uint64_t checksum = 0;
+  uint32_t clusterCount = 0;
+  file.read(magic, sizeof(magic));
+  file.read((char *)&checksum, sizeof(checksum));
+  file.read((char *)&atlasSize, sizeof(atlasSize));
+  file.read((char *)&clusterCount, sizeof(clusterCount));
+  if (!file || std::memcmp(magic, HLOD_MAGIC, sizeof(magic)) != 0 || checksum != mesh_checksum(meshes))
+  {
+    std::cout << "HLOD out of date, ignoring: " << directory << std::endl;
+    return false;
+  }
+
+  clusters.assign(clusterCount, {});
+  for (Cluster &cluster : clusters)
+  {
+    uint32_t memberCount = 0, floatCount = 0;
+    file.read((char *)&cluster.center, sizeof(cluster.center));
+    file.read((char *)&cluster.radius, sizeof(cluster.radius));
+    file.read((char *)&cluster.switchDistance, sizeof(cluster.switchDistance));
+    file.read((char *)&memberCount, sizeof(memberCount));
+    if (!file || memberCount > meshes.size())
+      break;
+    cluster.meshes.resize(memberCount);
+    file.read((char *)cluster.meshes.data(), memberCount * sizeof(unsigned int));
+    file.read((char *)&floatCount, sizeof(floatCount));
+    if (!file || floatCount % (3 * VERTEX_STRIDE) != 0)
+      break;
+    cluster.vertices.resize(floatCount);
+    file.read((char *)cluster.vertices.data(), floatCount * sizeof(float));
+  }
+
+  bool valid = (bool)file;
+  for (size_t c = 0; c < clusters.size() && valid; ++c)
+  {
+    valid = std::filesystem::exists(atlas_path(directory, c));
+    for (unsigned int m : clusters[c].meshes)
+      valid = valid && m < meshes.size();
+  }
+  if (!valid)
+  {
+    std::cerr << "HLOD file truncated: " << directory << std::endl;
+    clusters.clear();
+    return false;
+  }
+  std::cout << "HLOD loaded: " << clusters.size() << " clusters" << std::endl;
+  return true;
+}
+
+std::vector<Material *> HlodSystem::append_proxies(const std::string &directory, std::vector<Mesh> &meshes,
+                                                   std::map<std::string, Material> &materials)
+{
+  std::vector<Material *> added;
+  for (size_t c = 0; c < clusters.size(); ++c)
+  {
+    Material mat;
+    mat.name = "__hlod_" + std::to_string(c);
+    mat.Kd = glm::vec3(1.0f);
+    mat.diffuseTexPath = atlas_path(directory, c);
+    Material *stored = &(materials[mat.name] = mat);
+    added.push_back(stored);
+
+    Mesh proxy;
+    proxy.vertices = clusters[c].vertices;
+    proxy.material = stored;
+    proxy.proxy = true;
+    compute_mesh_bounds(proxy);
+    clusters[c].proxyMesh = meshes.size();
+    clusters[c].atlas.clear();
+    clusters[c].atlas.shrink_to_fit();
+    meshes.push_back(std::move(proxy));
+  }
+  hidden.assign(meshes.size(), 0);
+  return added;
+}
+
+void HlodSystem::update(const glm::vec3 &eye, const std::vector<unsigned int> &candidates, std::vector<unsigned int> &visible)
+{
+  lastActive = 0;
+  for (Cluster &cluster : clusters)
+  {
+    float distance = glm::length(eye - cluster.center);
+    cluster.active = distance > cluster.switchDistance * (cluster.active ? 1.0f - hysteresis : 1.0f);
+    for (unsigned int m : cluster.meshes)
+      hidden[m] = cluster.active;
+    lastActive += cluster.active;
+  }
+
+  visible.clear();
+  for (unsigned int m : candidates)
+  {
+    if (m >= hidden.size() || !hidden[m])
+      visible.push_back(m);
+  }
+  for (const Cluster &cluster : clusters)
+  {
+    if (cluster.active && cluster.proxyMesh >= 0)
+      visible.push_back(cluster.proxyMesh);
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef HLOD_H
+#define HLOD_H
+
+#include <glm/glm.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+#include "texture_array.h"
+
+// ========== 階層式 LOD (HLOD) 代理 mesh ==========
+// 離線 (thread pool 平行) 把相鄰的 mesh 分成 cluster, 每個 cluster:
+// 1. 合併所有三角形, 用 vertex clustering 簡化成一個代理 mesh
+// 2. 每個代理三角形在 atlas 裡分到半個方格, 從代理表面沿法線打 ray 回原始幾何取貼圖顏色
+// 執行時整個 cluster 超過切換距離就只畫一個代理 mesh (一個材質, 一次 draw)
+// 結果 (hlod.bin + 每個 cluster 一張 atlas png) 存在 models/<場景>/hlod/
+class HlodSystem
+{
+public:
+  float clusterCellSize = 1.0f;     // 分 cluster 用的格子大小
+  size_t minClusterMeshes = 4;      // mesh 太少的 cluster 省不了 draw call
+  int simplifyGrid = 24;            // vertex clustering: cluster 最長邊切幾格
+  int atlasSize = 512;              // 每個 cluster 的 atlas 解析度
+  float switchDistanceScale = 6.0f; // 切換距離 = cluster 半徑 * scale
+  float hysteresis = 0.05f;         // 切回原始 mesh 時多留的距離比例, 避免在門檻上閃爍
+
+  struct Cluster
+  {
+    glm::vec3 center{0.0f};
+    float radius = 0.0f;
+    float switchDistance = 0.0f;
+    std::vector<unsigned int> meshes;
+    std::vector<float> vertices; // 代理 mesh, 格式同 Mesh::vertices
+    std::vector<unsigned char> atlas; // RGB8, atlasSize x atlasSize
+    int proxyMesh = -1;               // append_proxies 之後在 meshes 裡的 index
+    bool active = false;
+  };
+
+  // 在 thread pool 上建所有 cluster (不需要 GL context)
+  void build(const std::vector<Mesh> &meshes);
+
+  bool save(const std::string &directory, const std::vector<Mesh> &meshes) const;
+  bool load(const std::string &directory, const std::vector<Mesh> &meshes);
+
+  // 代理 mesh 接到 meshes 後面, 材質 (atlas 當 diffuse 貼圖) 加進 materials; 回傳新增的材質
+  std::vector<Material *> append_proxies(const std::string &directory, std::vector<Mesh> &meshes,
+                                         std::map<std::string, Material> &materials);
+
+  // 依相機距離決定哪些 cluster 換成代理: candidates 去掉那些 cluster 的成員, 加上代理 mesh
+  void update(const glm::vec3 &eye, const std::vector<unsigned int> &candidates, std::vector<unsigned int> &visible);
+
+  bool empty() const { return clusters.empty(); }
+
+  std::vector<Cluster> clusters;
+  int lastActive = 0; // 上一幀用代理的 cluster 數
+
+private:
+  void build_cluster(const std::vector<Mesh> &meshes, const std::map<std::string, Image> &images, Cluster &cluster) const;
+  std::vector<char> hidden; // update 用: 每個 mesh 是否被代理取代
+};
+
+#endif
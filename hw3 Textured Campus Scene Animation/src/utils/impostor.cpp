@@ -0,0 +1,383 @@
+#include "impostor.h"
+#include "texture_array.h"
+#include "../stb_image_write.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <tuple>
+
+// hemi-octahedral: frame 座標 -> 上半球的方向 (與 impostor_fragment.glsl 相同)
+static glm::vec3 frame_direction(int i, int j, int framesPerAxis)
+{
+  glm::vec2 g = (glm::vec2(i, j) + 0.5f) / (float)framesPerAxis * 2.0f - 1.0f;
+  glm::vec3 d(0.5f * (g.x + g.y), 0.0f, 0.5f * (g.x - g.y));
+  d.y = 1.0f - std::abs(d.x) - std::abs(d.z);
+  return glm::normalize(d);
+}
+
+static std::string atlas_path(const std::string &directory, size_t cluster, const char *kind)
+{
+  return directory + "/cluster_" + std::to_string(cluster) + "_" + kind + ".png";
+}
+
+// GL 讀回來是由下往上, png 存成一般的由上往下
+static void flip_rows(std::vector<unsigned char> &pixels, int width, int height)
+{
+  size_t stride = (size_t)width * 4;
+  std::vector<unsigned char> row(stride);
+  for (int y = 0; y < height / 2; ++y)
+  {
+    unsigned char *a = &pixels[y * stride];
+    unsigned char *b = &pixels[(height - 1 - y) * stride];
+    std::memcpy(row.data(), a, stride);
+    std::memcpy(a, b, stride);
+    std::memcpy(b, row.data(), stride);
+  }
+}
+
+void ImpostorSystem::build_clusters(const std::vector<Mesh> &meshes)
+{
+  clusters.clear();
+
+  // 依 mesh bounds 中心分格, 同一格的 mesh 合成一個 cluster
+  std::map<std::tuple<int, int, int>, std::vector<unsigned int>> cells;
+  for (unsigned int i = 0; i < meshes.size(); ++i)
+  {
+    if (!meshes[i].material || meshes[i].proxy || meshes[i].vertices.empty())
+      continue;
+    glm::ivec3 c = glm::ivec3(glm::floor((meshes[i].boundsMin + meshes[i].boundsMax) * 0.5f / clusterCellSize));
+    cells[{c.x, c.y, c.z}].push_back(i);
+  }
+
+  for (auto &[key, members] : cells)
+  {
+    size_t triangles = 0;
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (unsigned int m : members)
+    {
+      triangles += meshes[m].vertices.size() / (3 * VERTEX_STRIDE);
+      lo = glm::min(lo, meshes[m].boundsMin);
+      hi = glm::max(hi, meshes[m].boundsMax);
+    }
+    if (triangles < minClusterTriangles)
+      continue;
+
+    Cluster cluster;
+    cluster.center = (lo + hi) * 0.5f;
+    cluster.radius = std::max(glm::length(hi - lo) * 0.5f, 1e-4f);
+    cluster.switchDistance = cluster.radius * switchDistanceScale;
+    cluster.meshes = std::move(members);
+    clusters.push_back(std::move(cluster));
+  }
+  std::cout << "Impostor: " << clusters.size() << " clusters" << std::endl;
+}
+
+void ImpostorSystem::bake(const DrawFunc &draw)
+{
+  int size = atlas_size();
+  colorAtlases.assign(clusters.size(), {});
+  normalAtlases.assign(clusters.size(), {});
+  if (clusters.empty())
+    return;
+
+  // 之後要還原的狀態
+  GLint previousFramebuffer = 0;
+  GLint previousViewport[4];
+  GLfloat previousClearColor[4];
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  glGetIntegerv(GL_VIEWPORT, previousViewport);
+  glGetFloatv(GL_COLOR_CLEAR_VALUE, previousClearColor);
+
+  // FBO: 顏色 + 法線深度 兩個 RGBA8, 加一個深度 buffer
+  unsigned int fbo, targets[2], depthBuffer;
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glGenTextures(2, targets);
+  for (int t = 0; t < 2; ++t)
+  {
+    glBindTexture(GL_TEXTURE_2D, targets[t]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + t, GL_TEXTURE_2D, targets[t], 0);
+  }
+  glGenRenderbuffers(1, &depthBuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+  GLenum drawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, drawBuffers);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+  {
+    std::cerr << "Impostor FBO incomplete, skipping bake" << std::endl;
+    clusters.clear();
+  }
+
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  for (size_t c = 0; c < clusters.size(); ++c)
+  {
+    const Cluster &cluster = clusters[c];
+    float r = cluster.radius;
+    glViewport(0, 0, size, size);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // 正交相機放在 2r 外, near 0 / far 4r, 深度 buffer 的值就是線性深度
+    glm::mat4 projection = glm::ortho(-r, r, -r, r, 0.0f, 4.0f * r);
+    for (int j = 0; j < framesPerAxis; ++j)
+    {
+      for (int i = 0; i < framesPerAxis; ++i)
+      {
+        glm::vec3 dir = frame_direction(i, j, framesPerAxis);
+        glm::vec3 up = std::abs(dir.y) > 0.999f ? glm::vec3(0.0f, 0.0f, -1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::vec3 eye = cluster.center + dir * 2.0f * r;
+        glm::mat4 view = glm::lookAt(eye, cluster.center, up);
+        glViewport(i * frameSize, j * frameSize, frameSize, frameSize);
+        draw(view, projection, eye, cluster.meshes);
+      }
+    }
+
+    colorAtlases[c].resize((size_t)size * size * 4);
+    normalAtlases[c].resize((size_t)size * size * 4);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, colorAtlases[c].data());
+    glReadBuffer(GL_COLOR_ATTACHMENT1);
+    glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, normalAtlases[c].data());
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+  glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+  glClearColor(previousClearColor[0], previousClearColor[1], previousClearColor[2], previousClearColor[3]);
+  glDeleteFramebuffers(1, &fbo);
+  glDeleteTextures(2, targets);
+  glDeleteRenderbuffers(1, &depthBuffer);
+
+  std::cout << "Impostor: baked " << clusters.size() << " atlases (" << size << "x" << size << ", "
+            << framesPerAxis * framesPerAxis << " views)" << std::endl;
+}
+
+bool ImpostorSystem::save(const std::string &directory, const std::vector<Mesh> &meshes) const
+{
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+
+  std::ofstream file(directory + "/impostors.txt");
+  if (!file)
+  {
+    std::cerr << "Failed to write impostors: " << directory << std::endl;
+    return false;
+  }
+  // 切換距離可以直接改這個檔案調整
+  file << "# impostor atlas: cluster cx cy cz radius switchDistance meshCount meshIndices...\n";
+  file << "checksum " << mesh_checksum(meshes) << "\n";
+  file << "frames " << framesPerAxis << " " << frameSize << "\n";
+  for (const Cluster &cluster : clusters)
+  {
+    file << "cluster " << cluster.center.x << " " << cluster.center.y << " " << cluster.center.z << " "
+         << cluster.radius << " " << cluster.switchDistance << " " << cluster.meshes.size();
+    for (unsigned int m : cluster.meshes)
+      file << " " << m;
+    file << "\n";
+  }
+
+  int size = atlas_size();
+  stbi_flip_vertically_on_write(1);
+  for (size_t c = 0; c < clusters.size() && c < colorAtlases.size(); ++c)
+  {
+    stbi_write_png(atlas_path(directory, c, "color").c_str(), size, size, 4, colorAtlases[c].data(), size * 4);
+    stbi_write_png(atlas_path(directory, c, "normal").c_str(), size, size, 4, normalAtlases[c].data(), size * 4);
+  }
+  stbi_flip_vertically_on_write(0);
+  std::cout << "Impostors saved: " << directory << std::endl;
+  return true;
+}
+
+bool ImpostorSystem::load(const std::string &directory, const std::vector<Mesh> &meshes)
+{
+  std::ifstream file(directory + "/impostors.txt");
+  if (!file)
+    return false;
+
+  clusters.clear();
+  uint64_t checksum = 0;
+  std::string line;
+  while (std::getline(file, line))
+  {
+    std::istringstream iss(line);
+    std::string token;
+    iss >> token;
+    if (token == "checksum")
+      iss >> checksum;
+    else if (token == "frames")
+      iss >> framesPerAxis >> frameSize;
+    else if (token == "cluster")
+    {
+      Cluster cluster;
+      size_t count = 0;
+      iss >> cluster.center.x >> cluster.center.y >> cluster.center.z >> cluster.radius >> cluster.switchDistance >> count;
+      cluster.meshes.resize(count);
+      for (auto &m : cluster.meshes)
+        iss >> m;
+      clusters.push_back(std::move(cluster));
+    }
+  }
+
+  bool valid = checksum == mesh_checksum(meshes) && framesPerAxis >= 2 && frameSize > 0;
+  for (const Cluster &cluster : clusters)
+  {
+    for (unsigned int m : cluster.meshes)
+      valid = valid && m < meshes.size();
+  }
+  if (!valid)
+  {
+    std::cout << "Impostors out of date, ignoring: " << directory << std::endl;
+    clusters.clear();
+    return false;
+  }
+
+  int size = atlas_size();
+  colorAtlases.assign(clusters.size(), {});
+  normalAtlases.assign(clusters.size(), {});
+  for (size_t c = 0; c < clusters.size(); ++c)
+  {
+    Image color, normal;
+    if (!load_image(atlas_path(directory, c, "color"), color) || !load_image(atlas_path(directory, c, "normal"), normal) ||
+        color.width != size || color.height != size || color.channels != 4 ||
+        normal.width != size || normal.height != size || normal.channels != 4)
+    {
+      std::cout << "Impostor atlas missing or wrong size, ignoring: " << directory << std::endl;
+      clusters.clear();
+      return false;
+    }
+    flip_rows(color.pixels, size, size);
+    flip_rows(normal.pixels, size, size);
+    colorAtlases[c] = std::move(color.pixels);
+    normalAtlases[c] = std::move(normal.pixels);
+  }
+  std::cout << "Impostors loaded: " << clusters.size() << " clusters" << std::endl;
+  return true;
+}
+
+void ImpostorSystem::upload()
+{
+  release();
+  clusterFade.assign(clusters.size(), 0.0f);
+  clusterShown.assign(clusters.size(), 0);
+  if (clusters.empty())
+    return;
+
+  int size = atlas_size();
+  auto create = [&](unsigned int &id, const std::vector<std::vector<unsigned char>> &atlases)
+  {
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, size, size, atlases.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    for (size_t layer = 0; layer < atlases.size(); ++layer)
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE, atlases[layer].data());
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  };
+  create(colorArray, colorAtlases);
+  create(normalArray, normalAtlases);
+
+  float corners[8] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+  glGenVertexArrays(1, &quadVAO);
+  glGenBuffers(1, &quadVBO);
+  glBindVertexArray(quadVAO);
+  glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+  glEnableVertexAttribArray(0);
+  glBindVertexArray(0);
+}
+
+void ImpostorSystem::release()
+{
+  glDeleteTextures(1, &colorArray);
+  glDeleteTextures(1, &normalArray);
+  glDeleteVertexArrays(1, &quadVAO);
+  glDeleteBuffers(1, &quadVBO);
+  colorArray = normalArray = quadVAO = quadVBO = 0;
+}
+
+void ImpostorSystem::update(const glm::vec3 &eye, std::vector<Mesh> &meshes, const std::vector<unsigned int> &candidates,
+                            std::vector<unsigned int> &remaining, std::vector<unsigned int> &fadeChanged)
+{
+  fadeChanged.clear();
+  for (size_t c = 0; c < clusters.size(); ++c)
+  {
+    const Cluster &cluster = clusters[c];
+    float fadeRange = std::max(cluster.switchDistance * fadeFraction, 1e-4f);
+    float fade = glm::clamp((glm::length(eye - cluster.center) - cluster.switchDistance) / fadeRange, 0.0f, 1.0f);
+    if (fade == clusterFade[c])
+      continue;
+    clusterFade[c] = fade;
+    for (unsigned int m : cluster.meshes)
+    {
+      meshes[m].fade = fade;
+      fadeChanged.push_back(m);
+    }
+  }
+
+  remaining.clear();
+  present.assign(meshes.size(), 0);
+  for (unsigned int m : candidates)
+  {
+    present[m] = 1;
+    if (meshes[m].fade < 1.0f)
+      remaining.push_back(m);
+  }
+
+  // 成員都不在 candidates 裡 (例如已經換成 HLOD 代理) 的 cluster 不畫 impostor
+  clusterShown.assign(clusters.size(), 0);
+  for (size_t c = 0; c < clusters.size(); ++c)
+  {
+    for (unsigned int m : clusters[c].meshes)
+      clusterShown[c] = clusterShown[c] || present[m];
+  }
+}
+
+void ImpostorSystem::draw(unsigned int program)
+{
+  lastDrawn = 0;
+  if (clusters.empty())
+    return;
+
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "colorAtlas"), 0);
+  glUniform1i(glGetUniformLocation(program, "normalAtlas"), 1);
+  glUniform1i(glGetUniformLocation(program, "framesPerAxis"), framesPerAxis);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, colorArray);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, normalArray);
+  glBindVertexArray(quadVAO);
+
+  GLint centerLoc = glGetUniformLocation(program, "impostorCenter");
+  GLint radiusLoc = glGetUniformLocation(program, "impostorRadius");
+  GLint layerLoc = glGetUniformLocation(program, "impostorLayer");
+  GLint fadeLoc = glGetUniformLocation(program, "ditherFade");
+  for (size_t c = 0; c < clusters.size(); ++c)
+  {
+    if (clusterFade[c] <= 0.0f || !clusterShown[c])
+      continue;
+    glUniform3fv(centerLoc, 1, glm::value_ptr(clusters[c].center));
+    glUniform1f(radiusLoc, clusters[c].radius);
+    glUniform1i(layerLoc, (int)c);
+    glUniform1f(fadeLoc, clusterFade[c]);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    lastDrawn++;
+  }
+  glBindVertexArray(0);
+}
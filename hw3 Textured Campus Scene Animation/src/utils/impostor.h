@@ -0,0 +1,74 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include <glm/glm.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+// ========== 遠處建築的 impostor ==========
+// 烘焙: 相鄰的 mesh 依格子分成 cluster, 每個 cluster 從上半球 framesPerAxis^2 個方向
+//       (hemi-octahedral 排列) 正交投影畫進 atlas: 顏色 (不打光) 與 法線 + 深度
+// 執行: 超過切換距離的 cluster 只畫一個面向相機的四邊形, 在 shader 裡混合最近的 4 個視角並重新打光;
+//       切換區間內 mesh 與 impostor 用互補的 dither 交叉淡出
+// atlas (png) 與切換距離 (impostors.txt) 存在 models/<場景>/impostors/
+class ImpostorSystem
+{
+public:
+  int framesPerAxis = 8;             // 每邊幾個視角
+  int frameSize = 64;                // 每個視角的解析度
+  float clusterCellSize = 0.5f;      // 分 cluster 用的格子大小
+  size_t minClusterTriangles = 64;   // 太小的 cluster 不做 impostor
+  float switchDistanceScale = 8.0f;  // 切換距離 = cluster 半徑 * scale
+  float fadeFraction = 0.2f;         // 淡入淡出區間佔切換距離的比例
+
+  struct Cluster
+  {
+    glm::vec3 center{0.0f};
+    float radius = 0.0f;
+    float switchDistance = 0.0f;
+    std::vector<unsigned int> meshes;
+  };
+
+  // 在 bake 時畫出 meshes (呼叫端負責 shader 與材質)
+  using DrawFunc = std::function<void(const glm::mat4 &view, const glm::mat4 &projection,
+                                      const glm::vec3 &eye, const std::vector<unsigned int> &meshes)>;
+
+  void build_clusters(const std::vector<Mesh> &meshes);
+  // 需要 GL context, draw 要輸出 fragment.glsl 的 IMPOSTOR_BAKE 版本
+  void bake(const DrawFunc &draw);
+
+  bool save(const std::string &directory, const std::vector<Mesh> &meshes) const;
+  // 場景改了 (checksum 不同) 或檔案不完整就回傳 false
+  bool load(const std::string &directory, const std::vector<Mesh> &meshes);
+
+  // CPU 上的 atlas 上傳成兩個 GL_TEXTURE_2D_ARRAY (每個 cluster 一層)
+  void upload();
+  void release();
+  bool empty() const { return clusters.empty(); }
+
+  // 依相機距離更新每個 mesh 的 Mesh::fade; 完全換成 impostor 的 mesh 不放進 remaining,
+  // fade 有變的 mesh 寫進 fadeChanged (MDI 要更新 SSBO)
+  void update(const glm::vec3 &eye, std::vector<Mesh> &meshes, const std::vector<unsigned int> &candidates,
+              std::vector<unsigned int> &remaining, std::vector<unsigned int> &fadeChanged);
+  // 畫出 fade > 0 的 impostor (program 的 view / projection / 光源已經設好)
+  void draw(unsigned int program);
+
+  std::vector<Cluster> clusters;
+  int lastDrawn = 0; // 上一幀畫了幾個 impostor
+
+private:
+  int atlas_size() const { return framesPerAxis * frameSize; }
+
+  std::vector<float> clusterFade;                      // 0: 只畫 mesh, 1: 只畫 impostor
+  std::vector<char> clusterShown;                      // 這一幀還有成員在 candidates 裡
+  std::vector<char> present;
+  std::vector<std::vector<unsigned char>> colorAtlases; // RGBA8, GL 的列順序 (由下往上)
+  std::vector<std::vector<unsigned char>> normalAtlases;
+  unsigned int colorArray = 0, normalArray = 0;
+  unsigned int quadVAO = 0, quadVBO = 0;
+};
+
+#endif
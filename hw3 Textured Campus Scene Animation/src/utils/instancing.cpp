@@ -0,0 +1,535 @@
+#include "instancing.h"
+#include "dynamic_buffer.h"
+#include "thread_pool.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <unordered_map>
+
+// 一個連通部件, 轉到自己的 canonical 座標系
+struct InstancePart
+{
+  unsigned int mesh = 0;               // 來源 mesh
+  std::vector<unsigned int> triangles; // 來源 mesh 裡的三角形編號
+  std::vector<float> local;            // canonical 頂點, 格式同 Mesh::vertices
+  glm::mat4 frame{1.0f};               // local -> mesh space 的剛體變換
+  uint64_t key = 0;                    // canonical hash
+};
+
+static unsigned int find_root(std::vector<unsigned int> &parent, unsigned int x)
+{
+  while (parent[x] != x)
+  {
+    parent[x] = parent[parent[x]];
+    x = parent[x];
+  }
+  return x;
+}
+
+// 對稱 3x3 矩陣的 Jacobi 特徵分解: vectors 的第 i 個 column 對應 values[i]
+static void symmetric_eigen(double a[3][3], double values[3], double vectors[3][3])
+{
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+      vectors[i][j] = i == j ? 1.0 : 0.0;
+
+  for (int sweep = 0; sweep < 32; ++sweep)
+  {
+    double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+    if (off < 1e-40)
+      break;
+    for (int p = 0; p < 2; ++p)
+    {
+      for (int q = p + 1; q < 3; ++q)
+      {
+        if (std::abs(a[p][q]) < 1e-40)
+          continue;
+        double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+        double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+        double c = 1.0 / std::sqrt(t * t + 1.0), s = t * c;
+        for (int k = 0; k < 3; ++k)
+        {
+          double akp = a[k][p], akq = a[k][q];
+          a[k][p] = c * akp - s * akq;
+          a[k][q] = s * akp + c * akq;
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+          double apk = a[p][k], aqk = a[q][k];
+          a[p][k] = c * apk - s * aqk;
+          a[q][k] = s * apk + c * aqk;
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+          double vkp = vectors[k][p], vkq = vectors[k][q];
+          vectors[k][p] = c * vkp - s * vkq;
+          vectors[k][q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+  for (int i = 0; i < 3; ++i)
+    values[i] = a[i][i];
+}
+
+// 部件的 canonical 座標系: 原點在頂點重心, 軸是共變異矩陣的主軸 (由大到小),
+// 軸的正負號取三階動差為正的方向. 主軸不唯一 (特徵值太接近, 例如正方體、球)
+// 或正負號分不出來 (對稱的形狀) 時退回世界座標軸, 這時只認得平移過的複製品.
+static void canonical_frame(const Mesh &mesh, InstancePart &part, double sigma[3])
+{
+  const float *v = mesh.vertices.data();
+  size_t corners = part.triangles.size() * 3;
+  auto corner = [&](size_t i) -> glm::dvec3
+  {
+    const float *p = v + ((size_t)part.triangles[i / 3] * 3 + i % 3) * VERTEX_STRIDE;
+    return glm::dvec3(p[0], p[1], p[2]);
+  };
+
+  glm::dvec3 center(0.0);
+  for (size_t i = 0; i < corners; ++i)
+    center += corner(i);
+  center /= (double)corners;
+
+  double cov[3][3] = {};
+  for (size_t i = 0; i < corners; ++i)
+  {
+    glm::dvec3 d = corner(i) - center;
+    for (int r = 0; r < 3; ++r)
+      for (int c = 0; c < 3; ++c)
+        cov[r][c] += d[r] * d[c] / (double)corners;
+  }
+  double values[3], vectors[3][3];
+  symmetric_eigen(cov, values, vectors);
+
+  int order[3] = {0, 1, 2};
+  std::sort(order, order + 3, [&](int x, int y)
+            { return values[x] > values[y]; });
+  glm::dvec3 axis[3];
+  for (int k = 0; k < 3; ++k)
+  {
+    axis[k] = glm::dvec3(vectors[0][order[k]], vectors[1][order[k]], vectors[2][order[k]]);
+    sigma[k] = std::sqrt(std::max(values[order[k]], 0.0));
+  }
+
+  const double gapEpsilon = 1e-3, skewEpsilon = 1e-3;
+  double largest = std::max(values[order[0]], 1e-30);
+  bool unique = values[order[0]] - values[order[1]] > gapEpsilon * largest &&
+                values[order[1]] - values[order[2]] > gapEpsilon * largest;
+  for (int k = 0; k < 2 && unique; ++k)
+  {
+    double skew = 0.0;
+    for (size_t i = 0; i < corners; ++i)
+    {
+      double t = glm::dot(corner(i) - center, axis[k]);
+      skew += t * t * t / (double)corners;
+    }
+    if (std::abs(skew) < skewEpsilon * largest * std::sqrt(largest))
+      unique = false;
+    else if (skew < 0.0)
+      axis[k] = -axis[k];
+  }
+  if (unique)
+    axis[2] = glm::cross(axis[0], axis[1]);
+  else
+    axis[0] = glm::dvec3(1, 0, 0), axis[1] = glm::dvec3(0, 1, 0), axis[2] = glm::dvec3(0, 0, 1);
+
+  // 世界座標軸時 sigma 改成沿世界軸的標準差, hash 才跟這個座標系一致
+  if (!unique)
+  {
+    for (int k = 0; k < 3; ++k)
+      sigma[k] = std::sqrt(std::max(cov[k][k], 0.0));
+  }
+
+  glm::mat3 rotation{glm::vec3(axis[0]), glm::vec3(axis[1]), glm::vec3(axis[2])};
+  glm::mat3 inverse = glm::transpose(rotation);
+  part.frame = glm::translate(glm::mat4(1.0f), glm::vec3(center)) * glm::mat4(rotation);
+
+  part.local.resize(corners * VERTEX_STRIDE);
+  for (size_t i = 0; i < corners; ++i)
+  {
+    const float *p = v + ((size_t)part.triangles[i / 3] * 3 + i % 3) * VERTEX_STRIDE;
+    float *out = &part.local[i * VERTEX_STRIDE];
+    glm::vec3 pos = inverse * glm::vec3(corner(i) - center);
+    glm::vec3 normal = inverse * glm::vec3(p[5], p[6], p[7]);
+    out[0] = pos.x, out[1] = pos.y, out[2] = pos.z;
+    out[3] = p[3], out[4] = p[4];
+    out[5] = normal.x, out[6] = normal.y, out[7] = normal.z;
+  }
+}
+
+// 把一個 mesh 拆成共用頂點位置的連通部件
+static std::vector<InstancePart> extract_parts(const Mesh &mesh, unsigned int meshIndex, size_t minTriangles,
+                                               const Material *material)
+{
+  const float weld = 1e-6f;
+  size_t triangleCount = mesh.vertices.size() / (3 * VERTEX_STRIDE);
+
+  // 位置相同 (焊接) 的頂點給同一個 id
+  struct WeldKey
+  {
+    long long x, y, z;
+    bool operator==(const WeldKey &other) const { return x == other.x && y == other.y && z == other.z; }
+  };
+  struct WeldKeyHash
+  {
+    size_t operator()(const WeldKey &k) const
+    {
+      return (size_t)(k.x * 73856093ll) ^ (size_t)(k.y * 19349663ll) ^ (size_t)(k.z * 83492791ll);
+    }
+  };
+  std::unordered_map<WeldKey, unsigned int, WeldKeyHash> ids;
+  std::vector<unsigned int> cornerId(triangleCount * 3);
+  for (size_t i = 0; i < cornerId.size(); ++i)
+  {
+    const float *p = &mesh.vertices[i * VERTEX_STRIDE];
+    WeldKey key{std::llround(p[0] / weld), std::llround(p[1] / weld), std::llround(p[2] / weld)};
+    cornerId[i] = ids.emplace(key, (unsigned int)ids.size()).first->second;
+  }
+
+  std::vector<unsigned int> parent(ids.size());
+  for (unsigned int i = 0; i < parent.size(); ++i)
+    parent[i] = i;
+  for (size_t t = 0; t < triangleCount; ++t)
+  {
+    unsigned int a = find_root(parent, cornerId[t * 3]);
+    parent[find_root(parent, cornerId[t * 3 + 1])] = a;
+    parent[find_root(parent, cornerId[t * 3 + 2])] = a;
+  }
+
+  std::unordered_map<unsigned int, size_t> partIndex;
+  std::vector<InstancePart> parts;
+  for (size_t t = 0; t < triangleCount; ++t)
+  {
+    unsigned int root = find_root(parent, cornerId[t * 3]);
+    auto [it, inserted] = partIndex.emplace(root, parts.size());
+    if (inserted)
+    {
+      parts.emplace_back();
+      parts.back().mesh = meshIndex;
+    }
+    parts[it->second].triangles.push_back(t);
+  }
+  // 整個 mesh 只有一個部件時也照樣處理: 依 usemtl 切的 mesh 本身就可能是重複的物件
+  parts.erase(std::remove_if(parts.begin(), parts.end(), [&](const InstancePart &part)
+                             { return part.triangles.size() < minTriangles; }),
+              parts.end());
+
+  for (InstancePart &part : parts)
+  {
+    double sigma[3];
+    canonical_frame(mesh, part, sigma);
+
+    // hash 只用不受頂點順序與浮點誤差影響的量 (材質、三角形數、主軸方向的標準差粗略量化),
+    // 碰撞的候選在 build 裡逐頂點確認
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](uint64_t value)
+    {
+      hash ^= value;
+      hash *= 1099511628211ull;
+    };
+    mix((uint64_t)(uintptr_t)material);
+    mix(part.triangles.size());
+    for (int k = 0; k < 3; ++k)
+      mix((uint64_t)std::llround(sigma[k] / 1e-4));
+    part.key = hash;
+  }
+  return parts;
+}
+
+// canonical 頂點逐一比對 (位置用 tolerance, uv 與法線各自的容許值)
+static bool same_shape(const std::vector<float> &a, const std::vector<float> &b, float tolerance)
+{
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i += VERTEX_STRIDE)
+  {
+    for (int k = 0; k < VERTEX_STRIDE; ++k)
+    {
+      float limit = k < 3 ? tolerance : k < 5 ? 1e-4f : 1e-2f;
+      if (std::abs(a[i + k] - b[i + k]) > limit)
+        return false;
+    }
+  }
+  return true;
+}
+
+void MeshInstancer::build(std::vector<Mesh> &meshes)
+{
+  auto start = std::chrono::steady_clock::now();
+  shapes.clear();
+
+  // ---------- 1. 每個 mesh 各自拆部件、算 canonical frame (平行) ----------
+  std::vector<std::vector<InstancePart>> meshParts(meshes.size());
+  global_thread_pool().parallel_for(meshes.size(), 1, [&](size_t begin, size_t end)
+  {
+    for (size_t m = begin; m < end; ++m)
+    {
+      const Mesh &mesh = meshes[m];
+      if (!mesh.material || mesh.proxy || mesh.instanceShape >= 0)
+        continue;
+      meshParts[m] = extract_parts(mesh, m, minTriangles, mesh.material);
+    }
+  });
+
+  // ---------- 2. 依 hash 分組, 同組的逐頂點確認 ----------
+  struct Group
+  {
+    std::vector<InstancePart *> parts; // parts[0] 是代表
+  };
+  std::vector<Group> groups;
+  std::unordered_map<uint64_t, std::vector<size_t>> candidates;
+  for (auto &parts : meshParts)
+  {
+    for (InstancePart &part : parts)
+    {
+      std::vector<size_t> &bucket = candidates[part.key];
+      bool matched = false;
+      for (size_t g : bucket)
+      {
+        const InstancePart &reference = *groups[g].parts[0];
+        if (meshes[reference.mesh].material == meshes[part.mesh].material &&
+            same_shape(reference.local, part.local, tolerance))
+        {
+          groups[g].parts.push_back(&part);
+          matched = true;
+          break;
+        }
+      }
+      if (!matched)
+      {
+        bucket.push_back(groups.size());
+        groups.push_back({{&part}});
+      }
+    }
+  }
+
+  // ---------- 3. 重複夠多次的部件拿出來變成 instance ----------
+  std::vector<std::vector<char>> removed(meshes.size());
+  std::vector<const Group *> accepted;
+  for (const Group &group : groups)
+  {
+    if (group.parts.size() < minInstances)
+      continue;
+    accepted.push_back(&group);
+    for (const InstancePart *part : group.parts)
+    {
+      std::vector<char> &flags = removed[part->mesh];
+      flags.resize(meshes[part->mesh].vertices.size() / (3 * VERTEX_STRIDE), 0);
+      for (unsigned int t : part->triangles)
+        flags[t] = 1;
+    }
+  }
+  if (accepted.empty())
+  {
+    std::cout << "Instancing: no repeated geometry found" << std::endl;
+    return;
+  }
+
+  std::vector<Mesh> result;
+  for (size_t m = 0; m < meshes.size(); ++m)
+  {
+    if (removed[m].empty())
+    {
+      result.push_back(std::move(meshes[m]));
+      continue;
+    }
+    Mesh rest;
+    rest.material = meshes[m].material;
+    rest.transform = meshes[m].transform;
+    for (size_t t = 0; t < removed[m].size(); ++t)
+    {
+      if (!removed[m][t])
+      {
+        const float *v = &meshes[m].vertices[t * 3 * VERTEX_STRIDE];
+        rest.vertices.insert(rest.vertices.end(), v, v + 3 * VERTEX_STRIDE);
+      }
+    }
+    if (!rest.vertices.empty())
+    {
+      compute_mesh_bounds(rest);
+      result.push_back(std::move(rest));
+    }
+  }
+
+  size_t instanceCount = 0, triangleCount = 0, soupBytes = 0, sharedBytes = 0;
+  for (const Group *group : accepted)
+  {
+    const InstancePart &reference = *group->parts[0];
+    Shape shape;
+    shape.material = meshes[reference.mesh].material;
+    shape.triangleCount = reference.triangles.size();
+    for (const InstancePart *part : group->parts)
+    {
+      Mesh instance;
+      instance.vertices = reference.local;
+      instance.material = meshes[part->mesh].material;
+      instance.transform = meshes[part->mesh].transform * part->frame;
+      instance.instanceShape = shapes.size();
+      compute_mesh_bounds(instance);
+      shape.meshes.push_back(result.size());
+      result.push_back(std::move(instance));
+    }
+
+    std::vector<float> indexedVertices;
+    std::vector<unsigned int> indices;
+    index_vertices(reference.local, indexedVertices, indices);
+    instanceCount += shape.meshes.size();
+    triangleCount += shape.meshes.size() * shape.triangleCount;
+    soupBytes += shape.meshes.size() * reference.local.size() * sizeof(float);
+    sharedBytes += indexedVertices.size() * sizeof(float) + indices.size() * sizeof(unsigned int) +
+                   shape.meshes.size() * sizeof(InstanceData);
+    shapes.push_back(std::move(shape));
+  }
+  meshes = std::move(result);
+
+  float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "Instancing: " << shapes.size() << " shapes, " << instanceCount << " instances (" << triangleCount
+            << " triangles), geometry " << soupBytes / 1024 << " KB -> " << sharedBytes / 1024 << " KB, draws "
+            << instanceCount << " -> " << shapes.size() << ", " << seconds << " s" << std::endl;
+}
+
+void MeshInstancer::upload(const std::vector<Mesh> &meshes)
+{
+  // split_large_meshes 之後 mesh 的 index 會變, 依 Mesh::instanceShape 重新收集
+  for (Shape &shape : shapes)
+    shape.meshes.clear();
+  for (unsigned int i = 0; i < meshes.size(); ++i)
+  {
+    if (meshes[i].instanceShape >= 0)
+      shapes[meshes[i].instanceShape].meshes.push_back(i);
+  }
+
+  for (Shape &shape : shapes)
+  {
+    const Mesh &reference = meshes[shape.meshes[0]];
+    std::vector<float> vertices, ao;
+    std::vector<unsigned int> indices;
+    index_vertices(reference.vertices, vertices, indices, nullptr, nullptr, &reference.ao, &ao);
+    shape.indexCount = indices.size();
+
+    glGenVertexArrays(1, &shape.VAO);
+    glBindVertexArray(shape.VAO);
+
+    glGenBuffers(1, &shape.VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, shape.VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_STRIDE * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, VERTEX_STRIDE * sizeof(float), (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, VERTEX_STRIDE * sizeof(float), (void *)(5 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    // 烘焙的 AO 每個 instance 都一樣 (只算 shape 自己的遮蔽), 跟著頂點走
+    if (!reference.ao.empty())
+    {
+      glGenBuffers(1, &shape.aoVBO);
+      glBindBuffer(GL_ARRAY_BUFFER, shape.aoVBO);
+      glBufferData(GL_ARRAY_BUFFER, ao.size() * sizeof(float), ao.data(), GL_STATIC_DRAW);
+      glVertexAttribPointer(9, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void *)0);
+      glEnableVertexAttribArray(9);
+    }
+
+    glGenBuffers(1, &shape.EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, shape.EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+    // per-instance: model (location 3~6, 一個 column 一個 location) + fade (location 7)
+    glGenBuffers(1, &shape.instanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, shape.instanceVBO);
+    for (int c = 0; c < 4; ++c)
+    {
+      glVertexAttribPointer(3 + c, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)(c * sizeof(glm::vec4)));
+      glVertexAttribDivisor(3 + c, 1);
+      glEnableVertexAttribArray(3 + c);
+    }
+    glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)sizeof(glm::mat4));
+    glVertexAttribDivisor(7, 1);
+    glEnableVertexAttribArray(7);
+  }
+  glBindVertexArray(0);
+}
+
+void MeshInstancer::release()
+{
+  for (Shape &shape : shapes)
+  {
+    glDeleteVertexArrays(1, &shape.VAO);
+    glDeleteBuffers(1, &shape.VBO);
+    glDeleteBuffers(1, &shape.EBO);
+    glDeleteBuffers(1, &shape.instanceVBO);
+    glDeleteBuffers(1, &shape.aoVBO);
+    shape.VAO = shape.VBO = shape.EBO = shape.instanceVBO = shape.aoVBO = 0;
+  }
+}
+
+void MeshInstancer::gather(const std::vector<Mesh> &meshes, const std::vector<unsigned int> &visible,
+                           std::vector<unsigned int> &remaining)
+{
+  for (Shape &shape : shapes)
+    shape.queued.clear();
+  remaining.clear();
+  for (unsigned int meshIndex : visible)
+  {
+    int s = meshes[meshIndex].instanceShape;
+    if (s >= 0)
+      shapes[s].queued.push_back(meshIndex);
+    else
+      remaining.push_back(meshIndex);
+  }
+}
+
+void MeshInstancer::draw(const std::vector<Mesh> &meshes, const std::function<void(const Material *)> &bindMaterial)
+{
+  lastDrawCalls = 0;
+  lastInstances = 0;
+  for (Shape &shape : shapes)
+  {
+    if (shape.queued.empty())
+      continue;
+
+    if (dynamic)
+    {
+      // 直接寫進 ring, VAO 的 per-instance 屬性改指到這次配置的位置
+      DynamicBuffer::Allocation allocation = dynamic->allocate(shape.queued.size() * sizeof(InstanceData));
+      InstanceData *data = (InstanceData *)allocation.data;
+      for (size_t i = 0; i < shape.queued.size(); ++i)
+      {
+        const Mesh &mesh = meshes[shape.queued[i]];
+        data[i] = {mesh.transform, mesh.fade};
+      }
+      dynamic->flush();
+      glBindVertexArray(shape.VAO);
+      glBindBuffer(GL_ARRAY_BUFFER, dynamic->buffer());
+      for (int c = 0; c < 4; ++c)
+        glVertexAttribPointer(3 + c, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void *)(allocation.offset + c * sizeof(glm::vec4)));
+      glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                            (void *)(allocation.offset + sizeof(glm::mat4)));
+    }
+    else
+    {
+      instanceData.resize(shape.queued.size());
+      for (size_t i = 0; i < shape.queued.size(); ++i)
+      {
+        const Mesh &mesh = meshes[shape.queued[i]];
+        instanceData[i] = {mesh.transform, mesh.fade};
+      }
+      // 每幀整塊重傳 (orphan)
+      glBindBuffer(GL_ARRAY_BUFFER, shape.instanceVBO);
+      glBufferData(GL_ARRAY_BUFFER, instanceData.size() * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+      glBufferSubData(GL_ARRAY_BUFFER, 0, instanceData.size() * sizeof(InstanceData), instanceData.data());
+    }
+
+    bindMaterial(shape.material);
+    glBindVertexArray(shape.VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, shape.indexCount, GL_UNSIGNED_INT, (void *)0, shape.queued.size());
+
+    lastDrawCalls++;
+    lastInstances += shape.queued.size();
+  }
+  glBindVertexArray(0);
+}
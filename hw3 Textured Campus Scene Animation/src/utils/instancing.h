@@ -0,0 +1,69 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <glm/glm.hpp>
+#include <functional>
+#include <vector>
+
+#include "mesh.h"
+
+class DynamicBuffer;
+
+// ========== 重複幾何的自動 instancing ==========
+// 校園裡的樹、長椅、路燈、窗框常常是同一份幾何複製很多次, 但 obj 依 usemtl 把它們全部攤平成頂點.
+// 載入後把每個 mesh 拆成連通的部件, 在部件自己的座標系 (重心 + PCA 主軸) 下算 canonical hash,
+// 剛體變換 (旋轉 + 平移) 後相同的部件合成一個 shape:
+// - 每個 instance 變成一個 Mesh: vertices 是 shape 的 local 頂點, transform 是它的剛體變換,
+//   所以 culling / PVS / 烘焙照舊逐 mesh 處理
+// - GPU 上幾何只存一份; 逐 mesh 路徑每個 shape 一次 glDrawElementsInstanced,
+//   MDI 路徑共用同一段 index 並合成一個 command
+class MeshInstancer
+{
+public:
+  size_t minInstances = 4; // 至少出現幾次才值得 instancing
+  size_t minTriangles = 8; // 太小的部件 (單一四邊形...) 拆出來反而多了 per-mesh 的 culling 成本
+  float tolerance = 1e-4f; // 比對 canonical 頂點位置的容許誤差 (場景已正規化到 [-1, 1])
+
+  struct Shape
+  {
+    const Material *material = nullptr;
+    std::vector<unsigned int> meshes; // 這個 shape 的 instance (meshes 裡的 index)
+    size_t triangleCount = 0;
+
+    unsigned int VAO = 0, VBO = 0, EBO = 0, instanceVBO = 0, aoVBO = 0;
+    unsigned int indexCount = 0;
+    std::vector<unsigned int> queued; // gather 收集到的可見 instance
+  };
+
+  // 要在 split_large_meshes 之前呼叫 (切格子會把重複的部件切開)
+  void build(std::vector<Mesh> &meshes);
+  // 每個 shape 一組 indexed VBO/EBO, 加上每幀重寫的 per-instance buffer (model + fade);
+  // 也會依 Mesh::instanceShape 更新 Shape::meshes (build 之後 mesh 的順序可能變了)
+  void upload(const std::vector<Mesh> &meshes);
+  void release();
+  bool empty() const { return shapes.empty(); }
+
+  // visible 裡屬於 shape 的 mesh 依 shape 收集起來, 其他的放進 remaining
+  void gather(const std::vector<Mesh> &meshes, const std::vector<unsigned int> &visible,
+              std::vector<unsigned int> &remaining);
+  // 畫出 gather 收集的 shape: bindMaterial 負責材質 uniform 與貼圖, 每個 shape 一次 draw
+  void draw(const std::vector<Mesh> &meshes, const std::function<void(const Material *)> &bindMaterial);
+
+  std::vector<Shape> shapes;
+  // 有設定的話 per-instance 資料寫進這個 ring (attribute 3~7 每次 draw 改指到那一段), 不用 instanceVBO
+  DynamicBuffer *dynamic = nullptr;
+
+  // 上一幀的統計
+  int lastDrawCalls = 0;
+  int lastInstances = 0;
+
+private:
+  struct InstanceData
+  {
+    glm::mat4 model;
+    float fade;
+  };
+  std::vector<InstanceData> instanceData;
+};
+
+#endif
@@ -0,0 +1,307 @@
+#include "irradiance_volume.h"
+#include "bvh.h"
+#include "texture_array.h"
+#include "thread_pool.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+static const char PROBE_MAGIC[4] = {'I', 'R', 'V', '1'};
+static const int SH_COUNT = 9;
+
+// 實數 SH 基底 L0 ~ L2 (順序跟 fragment.glsl 的 probe_irradiance 一樣)
+static void sh_basis(const glm::vec3 &d, float out[SH_COUNT])
+{
+  out[0] = 0.282095f;
+  out[1] = 0.488603f * d.y;
+  out[2] = 0.488603f * d.z;
+  out[3] = 0.488603f * d.x;
+  out[4] = 1.092548f * d.x * d.y;
+  out[5] = 1.092548f * d.y * d.z;
+  out[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+  out[7] = 1.092548f * d.x * d.z;
+  out[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+}
+
+void IrradianceVolume::bake(const std::vector<Mesh> &meshes, const glm::vec3 &lightPos, const glm::vec3 &lightColor)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  coefficients.clear();
+
+  std::vector<unsigned int> subset;
+  for (unsigned int m = 0; m < meshes.size(); ++m)
+  {
+    if (meshes[m].material && !meshes[m].proxy)
+      subset.push_back(m);
+  }
+  Bvh bvh;
+  bvh.build(meshes, subset);
+  if (bvh.nodes.empty())
+    return;
+
+  std::unordered_map<const Material *, glm::vec3> albedo;
+  std::vector<glm::mat3> normalMatrices(meshes.size(), glm::mat3(1.0f));
+  for (unsigned int m : subset)
+  {
+    const Material *mat = meshes[m].material;
+    if (!albedo.count(mat))
+      albedo[mat] = average_albedo(mat);
+    normalMatrices[m] = glm::transpose(glm::inverse(glm::mat3(meshes[m].transform)));
+  }
+
+  // 格子: 最外圈的 probe 剛好在場景 bounds 上, 太密就放大間距
+  boundsMin = bvh.sceneMin;
+  boundsMax = bvh.sceneMax;
+  glm::vec3 extent = boundsMax - boundsMin;
+  float step = spacing;
+  while (std::max({extent.x, extent.y, extent.z}) / step + 1.0f > maxProbesPerAxis)
+    step *= 1.25f;
+  dims = glm::max(glm::ivec3(glm::ceil(extent / step)) + 1, glm::ivec3(2));
+  size_t probeCount = (size_t)dims.x * dims.y * dims.z;
+
+  // 整個球面上均勻的 Fibonacci 方向
+  std::vector<glm::vec3> directions(raysPerProbe);
+  for (int i = 0; i < raysPerProbe; ++i)
+  {
+    float z = 1.0f - (2.0f * i + 1.0f) / raysPerProbe;
+    float r = std::sqrt(std::max(0.0f, 1.0f - z * z)), phi = 2.3999632f * i;
+    directions[i] = glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+  }
+
+  const float offset = 1e-4f;
+  auto direct = [&](const glm::vec3 &p, const glm::vec3 &n)
+  {
+    glm::vec3 toLight = lightPos - p;
+    float distance = glm::length(toLight);
+    glm::vec3 l = toLight / distance;
+    float ndl = glm::dot(n, l);
+    if (ndl <= 0.0f)
+      return glm::vec3(0.0f);
+    Ray ray;
+    ray.origin = p + n * offset;
+    ray.direction = l;
+    ray.tMax = distance;
+    return bvh.occluded(ray) ? glm::vec3(0.0f) : lightColor * ndl;
+  };
+
+  // 投影到 SH 的權重 (均勻球面取樣 4pi / N) x cosine lobe 卷積後除以 pi (A0 = pi, A1 = 2pi/3, A2 = pi/4)
+  const float sampleWeight = 4.0f * 3.14159265f / raysPerProbe;
+  const float band[SH_COUNT] = {1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f};
+
+  std::vector<glm::vec3> result(probeCount * SH_COUNT, glm::vec3(0.0f));
+  std::vector<char> valid(probeCount, 0);
+  global_thread_pool().parallel_for(probeCount, 4, [&](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      glm::ivec3 cell(i % dims.x, (i / dims.x) % dims.y, i / ((size_t)dims.x * dims.y));
+      glm::vec3 origin = boundsMin + extent * glm::vec3(cell) / glm::vec3(dims - 1);
+      glm::vec3 sh[SH_COUNT];
+      std::fill(sh, sh + SH_COUNT, glm::vec3(0.0f));
+      int backfaces = 0;
+      for (const glm::vec3 &d : directions)
+      {
+        Ray ray;
+        ray.origin = origin;
+        ray.direction = d;
+        Hit hit;
+        glm::vec3 radiance = skyColor;
+        if (bvh.intersect(ray, hit))
+        {
+          const BvhTriangle &tri = bvh.triangles[hit.triangle];
+          const Mesh &mesh = meshes[tri.mesh];
+          // 背面用頂點法線判斷 (obj 的繞序不一定可靠)
+          const float *v = &mesh.vertices[(size_t)tri.primitive * 3 * VERTEX_STRIDE];
+          glm::vec3 shading = normalMatrices[tri.mesh] * (glm::vec3(v[5], v[6], v[7]) +
+                                                          glm::vec3(v[VERTEX_STRIDE + 5], v[VERTEX_STRIDE + 6], v[VERTEX_STRIDE + 7]) +
+                                                          glm::vec3(v[2 * VERTEX_STRIDE + 5], v[2 * VERTEX_STRIDE + 6], v[2 * VERTEX_STRIDE + 7]));
+          if (glm::dot(shading, d) > 0.0f)
+          {
+            ++backfaces;
+            radiance = glm::vec3(0.0f);
+          }
+          else
+          {
+            glm::vec3 n = glm::cross(tri.p1 - tri.p0, tri.p2 - tri.p0);
+            n = glm::length(n) > 1e-12f ? glm::normalize(n) : -d;
+            if (glm::dot(n, d) > 0.0f)
+              n = -n;
+            radiance = albedo.at(mesh.material) * direct(origin + d * hit.t, n);
+            if (includeEmissive)
+              radiance += mesh.material->Ke;
+          }
+        }
+        float basis[SH_COUNT];
+        sh_basis(d, basis);
+        for (int k = 0; k < SH_COUNT; ++k)
+          sh[k] += radiance * basis[k];
+      }
+      for (int k = 0; k < SH_COUNT; ++k)
+        result[i * SH_COUNT + k] = sh[k] * (sampleWeight * band[k]);
+      valid[i] = backfaces <= invalidBackfaceRatio * raysPerProbe;
+    }
+  });
+
+  // 在幾何裡面的 probe 一圈一圈用相鄰的有效 probe 平均補起來
+  size_t invalidCount = std::count(valid.begin(), valid.end(), 0);
+  size_t remaining = invalidCount;
+  while (remaining > 0 && remaining < probeCount)
+  {
+    std::vector<char> next = valid;
+    for (size_t i = 0; i < probeCount; ++i)
+    {
+      if (valid[i])
+        continue;
+      glm::ivec3 cell(i % dims.x, (i / dims.x) % dims.y, i / ((size_t)dims.x * dims.y));
+      glm::vec3 sum[SH_COUNT];
+      std::fill(sum, sum + SH_COUNT, glm::vec3(0.0f));
+      int count = 0;
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        for (int side = -1; side <= 1; side += 2)
+        {
+          glm::ivec3 n = cell;
+          n[axis] += side;
+          if (n[axis] < 0 || n[axis] >= dims[axis])
+            continue;
+          size_t j = ((size_t)n.z * dims.y + n.y) * dims.x + n.x;
+          if (!valid[j])
+            continue;
+          for (int k = 0; k < SH_COUNT; ++k)
+            sum[k] += result[j * SH_COUNT + k];
+          ++count;
+        }
+      }
+      if (count == 0)
+        continue;
+      for (int k = 0; k < SH_COUNT; ++k)
+        result[i * SH_COUNT + k] = sum[k] / (float)count;
+      next[i] = 1;
+      --remaining;
+    }
+    valid.swap(next);
+  }
+  // 全部都無效 (不太可能): 退回只有天空光
+  if (remaining == probeCount)
+  {
+    for (size_t i = 0; i < probeCount; ++i)
+    {
+      std::fill(result.begin() + i * SH_COUNT, result.begin() + (i + 1) * SH_COUNT, glm::vec3(0.0f));
+      result[i * SH_COUNT] = skyColor / 0.282095f;
+    }
+  }
+  coefficients.swap(result);
+
+  float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+  std::cout << "Irradiance volume baked: " << dims.x << "x" << dims.y << "x" << dims.z << " probes (" << invalidCount
+            << " inside geometry) x " << raysPerProbe << " rays, " << seconds << " s on "
+            << global_thread_pool().size() << " threads" << std::endl;
+}
+
+bool IrradianceVolume::save(const std::string &path, const std::vector<Mesh> &meshes) const
+{
+  std::ofstream file(path, std::ios::binary);
+  if (!file)
+  {
+    std::cerr << "Failed to write irradiance volume: " << path << std::endl;
+    return false;
+  }
+  uint32_t meshCount = meshes.size();
+  uint64_t checksum = mesh_checksum(meshes);
+  file.write(PROBE_MAGIC, sizeof(PROBE_MAGIC));
+  file.write((const char *)&meshCount, sizeof(meshCount));
+  file.write((const char *)&checksum, sizeof(checksum));
+  file.write((const char *)&boundsMin, sizeof(boundsMin));
+  file.write((const char *)&boundsMax, sizeof(boundsMax));
+  file.write((const char *)&dims, sizeof(dims));
+  uint8_t emissive = includeEmissive;
+  file.write((const char *)&emissive, sizeof(emissive));
+  file.write((const char *)coefficients.data(), coefficients.size() * sizeof(glm::vec3));
+  std::cout << "Irradiance volume saved: " << path << std::endl;
+  return (bool)file;
+}
+
+bool IrradianceVolume::load(const std::string &path, const std::vector<Mesh> &meshes)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+
+  char magic[4];
+  uint32_t meshCount = 0;
+  uint64_t checksum = 0;
+  file.read(magic, sizeof(magic));
+  file.read((char *)&meshCount, sizeof(meshCount));
+  file.read((char *)&checksum, sizeof(checksum));
+  file.read((char *)&boundsMin, sizeof(boundsMin));
+  file.read((char *)&boundsMax, sizeof(boundsMax));
+  file.read((char *)&dims, sizeof(dims));
+  uint8_t emissive = 0;
+  file.read((char *)&emissive, sizeof(emissive));
+  if (!file || std::memcmp(magic, PROBE_MAGIC, sizeof(magic)) != 0 || meshCount != meshes.size() ||
+      checksum != mesh_checksum(meshes) || (bool)emissive != includeEmissive || glm::any(glm::lessThan(dims, glm::ivec3(2))) ||
+      glm::any(glm::greaterThan(dims, glm::ivec3(1024))))
+  {
+    std::cout << "Irradiance volume out of date, ignoring: " << path << std::endl;
+    return false;
+  }
+
+  coefficients.resize((size_t)dims.x * dims.y * dims.z * SH_COUNT);
+  file.read((char *)coefficients.data(), coefficients.size() * sizeof(glm::vec3));
+  if (!file)
+  {
+    std::cerr << "Irradiance volume file truncated: " << path << std::endl;
+    coefficients.clear();
+    return false;
+  }
+  std::cout << "Irradiance volume loaded: " << dims.x << "x" << dims.y << "x" << dims.z << " probes" << std::endl;
+  return true;
+}
+
+void IrradianceVolume::upload()
+{
+  // 第 k 個係數放在 z = [k * dims.z, (k + 1) * dims.z), shader 取樣時把 z 夾在自己那段裡
+  std::vector<glm::vec3> texels(coefficients.size());
+  size_t probeCount = coefficients.size() / SH_COUNT;
+  for (size_t i = 0; i < probeCount; ++i)
+  {
+    for (int k = 0; k < SH_COUNT; ++k)
+      texels[k * probeCount + i] = coefficients[i * SH_COUNT + k];
+  }
+
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_3D, texture);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, dims.x, dims.y, dims.z * SH_COUNT, 0, GL_RGB, GL_FLOAT, texels.data());
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void IrradianceVolume::bind(unsigned int program)
+{
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "probeVolume"), 7);
+  glUniform3fv(glGetUniformLocation(program, "probeMin"), 1, glm::value_ptr(boundsMin));
+  glUniform3fv(glGetUniformLocation(program, "probeMax"), 1, glm::value_ptr(boundsMax));
+  glUniform3iv(glGetUniformLocation(program, "probeDims"), 1, glm::value_ptr(dims));
+
+  glActiveTexture(GL_TEXTURE7);
+  glBindTexture(GL_TEXTURE_3D, texture);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void IrradianceVolume::release()
+{
+  glDeleteTextures(1, &texture);
+  texture = 0;
+}
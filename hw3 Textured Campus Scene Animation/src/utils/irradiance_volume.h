@@ -0,0 +1,51 @@
+#ifndef IRRADIANCE_VOLUME_H
+#define IRRADIANCE_VOLUME_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+// ========== 烘焙的 irradiance probe volume ==========
+// 沒有 lightmap 的表面 (之後加進校園會動的物件、instancing 的 shape、HLOD 代理) 原本只有常數 ambient.
+// 在場景 bounds 上放一個 3D 格子的 probe, 離線算好每個 probe 的 L2 球諧 (9 個 RGB 係數) 間接光:
+// - 每個 probe 往整個球面射 raysPerProbe 條 ray (thread pool 平行), 打到的表面算主光源直接光 (含陰影)
+//   x albedo + emissive, 沒打到就是 skyColor; 投影到 SH 後先跟 cosine lobe 卷積並除以 pi,
+//   shader 用法線算出來的值乘上 albedo 就是 ambient (跟 lightmap 同一個尺度)
+// - 太多 ray 打到背面的 probe 在牆裡或物件裡面, 丟掉後用相鄰的 probe 補
+// - 存成 models/<場景>/<場景>.probes; 9 個係數依序疊在一張 RGB16F 3D texture 的 z 方向
+// shader (USE_PROBES) 每個 fragment 9 次 trilinear 取樣, 不用每幀更新
+class IrradianceVolume
+{
+public:
+  float spacing = 0.1f;               // probe 間距 (場景正規化到 [-1, 1])
+  int maxProbesPerAxis = 48;          // 超過就加大間距
+  int raysPerProbe = 256;
+  float invalidBackfaceRatio = 0.25f; // 打到背面的 ray 超過這個比例就當成在幾何裡面
+  glm::vec3 skyColor{0.3f};           // 跟 lightmap 一樣對應即時打光的 0.3 ambient
+  bool includeEmissive = true;        // clustered lights 已經把 emissive 表面當點光源打光時要關掉, 不然會算兩次
+
+  // 多執行緒烘焙 (不需要 GL context); lightPos / lightColor 是主光源
+  void bake(const std::vector<Mesh> &meshes, const glm::vec3 &lightPos, const glm::vec3 &lightColor);
+
+  bool save(const std::string &path, const std::vector<Mesh> &meshes) const;
+  // 場景不同 (checksum 對不上) 或 includeEmissive 跟烘焙時不同就回傳 false
+  bool load(const std::string &path, const std::vector<Mesh> &meshes);
+
+  void upload();
+  // probe volume bind 在 unit 7
+  void bind(unsigned int program);
+  void release();
+  bool empty() const { return coefficients.empty(); }
+
+  glm::vec3 boundsMin{0.0f}, boundsMax{0.0f}; // 最外圈 probe 的位置
+  glm::ivec3 dims{0};
+
+private:
+  // probe 依 x, y, z (x 最快) 排, 每個 9 個係數
+  std::vector<glm::vec3> coefficients;
+  unsigned int texture = 0;
+};
+
+#endif
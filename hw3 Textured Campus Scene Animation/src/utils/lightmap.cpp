@@ -0,0 +1,506 @@
+#include "lightmap.h"
+#include "bvh.h"
+#include "texture_array.h"
+#include "thread_pool.h"
+#include "../stb_image.h"
+#include "../stb_image_write.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+namespace
+{
+// 焊接頂點用的量化座標 (建 chart 的相鄰關係)
+struct WeldKey
+{
+  int64_t x, y, z;
+  bool operator==(const WeldKey &other) const { return x == other.x && y == other.y && z == other.z; }
+};
+
+struct WeldKeyHash
+{
+  size_t operator()(const WeldKey &key) const
+  {
+    return std::hash<int64_t>()(key.x * 73856093 ^ key.y * 19349663 ^ key.z * 83492791);
+  }
+};
+}
+
+// 跟 n 垂直的兩個軸
+static void orthonormal_basis(const glm::vec3 &n, glm::vec3 &t, glm::vec3 &b)
+{
+  glm::vec3 up = std::abs(n.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+  t = glm::normalize(glm::cross(up, n));
+  b = glm::cross(n, t);
+}
+
+bool Lightmapper::pack(const std::vector<Mesh> &meshes)
+{
+  charts.clear();
+  const size_t triangleFloats = 3 * VERTEX_STRIDE;
+
+  for (unsigned int m = 0; m < meshes.size(); ++m)
+  {
+    const Mesh &mesh = meshes[m];
+    if (!mesh.material || mesh.proxy || mesh.instanceShape >= 0)
+      continue;
+    size_t triangleCount = mesh.vertices.size() / triangleFloats;
+
+    // 世界座標 + 焊接後的頂點編號
+    std::vector<glm::vec3> positions(triangleCount * 3);
+    std::vector<unsigned int> weldIds(triangleCount * 3);
+    std::unordered_map<WeldKey, unsigned int, WeldKeyHash> weld;
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+    {
+      const float *v = &mesh.vertices[i * VERTEX_STRIDE];
+      positions[i] = glm::vec3(mesh.transform * glm::vec4(v[0], v[1], v[2], 1.0f));
+      WeldKey key{(int64_t)std::llround(positions[i].x * 1e5), (int64_t)std::llround(positions[i].y * 1e5),
+                  (int64_t)std::llround(positions[i].z * 1e5)};
+      weldIds[i] = weld.emplace(key, (unsigned int)weld.size()).first->second;
+    }
+
+    // 邊 -> 共用這條邊的三角形
+    std::vector<glm::vec3> normals(triangleCount);
+    std::unordered_map<uint64_t, std::vector<unsigned int>> edges;
+    auto edge_key = [&](size_t t, int k)
+    {
+      uint64_t a = weldIds[t * 3 + k], b = weldIds[t * 3 + (k + 1) % 3];
+      return (std::min(a, b) << 32) | std::max(a, b);
+    };
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+      glm::vec3 cross = glm::cross(positions[t * 3 + 1] - positions[t * 3], positions[t * 3 + 2] - positions[t * 3]);
+      normals[t] = glm::length(cross) > 1e-12f ? glm::normalize(cross) : glm::vec3(0.0f);
+      for (int k = 0; k < 3; ++k)
+        edges[edge_key(t, k)].push_back(t);
+    }
+
+    // flood fill: 法線跟種子夠接近的相鄰三角形併成一個 chart, 投影到種子的平面
+    std::vector<char> assigned(triangleCount, 0);
+    std::vector<unsigned int> stack;
+    for (size_t seed = 0; seed < triangleCount; ++seed)
+    {
+      if (assigned[seed])
+        continue;
+      glm::vec3 chartNormal = normals[seed] != glm::vec3(0.0f) ? normals[seed] : glm::vec3(0.0f, 1.0f, 0.0f);
+      Chart chart;
+      chart.mesh = m;
+      assigned[seed] = 1;
+      stack.assign(1, seed);
+      while (!stack.empty())
+      {
+        unsigned int t = stack.back();
+        stack.pop_back();
+        chart.triangles.push_back(t);
+        for (int k = 0; k < 3; ++k)
+        {
+          for (unsigned int neighbor : edges[edge_key(t, k)])
+          {
+            if (!assigned[neighbor] && (normals[neighbor] == glm::vec3(0.0f) ||
+                                        glm::dot(normals[neighbor], chartNormal) > chartNormalCos))
+            {
+              assigned[neighbor] = 1;
+              stack.push_back(neighbor);
+            }
+          }
+        }
+      }
+      std::sort(chart.triangles.begin(), chart.triangles.end());
+
+      glm::vec3 axisT, axisB;
+      orthonormal_basis(chartNormal, axisT, axisB);
+      glm::vec2 lo(1e30f), hi(-1e30f);
+      for (unsigned int t : chart.triangles)
+      {
+        for (int k = 0; k < 3; ++k)
+        {
+          const glm::vec3 &p = positions[t * 3 + k];
+          glm::vec2 q = glm::vec2(glm::dot(p, axisT), glm::dot(p, axisB)) * texelsPerUnit;
+          chart.local.push_back(q);
+          lo = glm::min(lo, q);
+          hi = glm::max(hi, q);
+        }
+      }
+      for (glm::vec2 &q : chart.local)
+        q = q - lo + glm::vec2((float)padding);
+      chart.width = (int)std::ceil(hi.x - lo.x) + 2 * padding + 1;
+      chart.height = (int)std::ceil(hi.y - lo.y) + 2 * padding + 1;
+      charts.push_back(std::move(chart));
+    }
+  }
+
+  // shelf packing: 由高到矮排, 一列一列放
+  std::vector<unsigned int> order(charts.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b)
+                   { return charts[a].height > charts[b].height; });
+  int x = 0, y = 0, shelfHeight = 0;
+  for (unsigned int c : order)
+  {
+    Chart &chart = charts[c];
+    if (chart.width > atlasWidth)
+      return false;
+    if (x + chart.width > atlasWidth)
+    {
+      y += shelfHeight;
+      x = 0;
+      shelfHeight = 0;
+    }
+    chart.x = x;
+    chart.y = y;
+    x += chart.width;
+    shelfHeight = std::max(shelfHeight, chart.height);
+  }
+  atlasHeight = (y + shelfHeight + 3) & ~3;
+  return atlasHeight <= atlasWidth;
+}
+
+void Lightmapper::build_charts(std::vector<Mesh> &meshes)
+{
+  while (!pack(meshes))
+    texelsPerUnit *= 0.8f;
+
+  for (Mesh &mesh : meshes)
+    mesh.lightmapUV.clear();
+  glm::vec2 atlasScale(1.0f / atlasWidth, 1.0f / std::max(atlasHeight, 1));
+  for (const Chart &chart : charts)
+  {
+    Mesh &mesh = meshes[chart.mesh];
+    mesh.lightmapUV.resize(mesh.vertices.size() / VERTEX_STRIDE * 2, 0.0f);
+    for (size_t i = 0; i < chart.triangles.size(); ++i)
+    {
+      for (int k = 0; k < 3; ++k)
+      {
+        glm::vec2 uv = (glm::vec2(chart.x, chart.y) + chart.local[i * 3 + k]) * atlasScale;
+        size_t vertex = chart.triangles[i] * 3 + k;
+        mesh.lightmapUV[vertex * 2] = uv.x;
+        mesh.lightmapUV[vertex * 2 + 1] = uv.y;
+      }
+    }
+  }
+  std::cout << "Lightmap charts: " << charts.size() << " charts, " << atlasWidth << "x" << atlasHeight
+            << " atlas, " << texelsPerUnit << " texels per unit" << std::endl;
+}
+
+void Lightmapper::clear_uvs(std::vector<Mesh> &meshes)
+{
+  for (Mesh &mesh : meshes)
+    std::vector<float>().swap(mesh.lightmapUV);
+}
+
+void Lightmapper::bake(const std::vector<Mesh> &meshes, const glm::vec3 &lightPos, const glm::vec3 &lightColor)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+
+  std::vector<unsigned int> subset;
+  for (unsigned int m = 0; m < meshes.size(); ++m)
+  {
+    if (meshes[m].material && !meshes[m].proxy)
+      subset.push_back(m);
+  }
+  Bvh bvh;
+  bvh.build(meshes, subset);
+
+  // 反彈用的 albedo
+  std::unordered_map<const Material *, glm::vec3> albedo;
+  for (unsigned int m : subset)
+  {
+    const Material *mat = meshes[m].material;
+    if (!albedo.count(mat))
+      albedo[mat] = average_albedo(mat);
+  }
+
+  // ---------- 1. chart 三角形光柵化到 texel: 世界座標 + 法線 ----------
+  // 中心在三角形裡的 texel 優先; 邊緣 0.75 texel 內的也算 (bilinear 會讀到), 用夾到三角形上的點
+  struct Texel
+  {
+    glm::vec3 position{0.0f};
+    glm::vec3 normal{0.0f};
+    int coverage = 0; // 0: 空, 1: 邊緣, 2: 中心在三角形裡
+  };
+  std::vector<Texel> texels((size_t)atlasWidth * atlasHeight);
+  for (const Chart &chart : charts)
+  {
+    const Mesh &mesh = meshes[chart.mesh];
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(mesh.transform)));
+    for (size_t i = 0; i < chart.triangles.size(); ++i)
+    {
+      glm::vec2 a[3];
+      glm::vec3 p[3], n[3];
+      for (int k = 0; k < 3; ++k)
+      {
+        a[k] = glm::vec2(chart.x, chart.y) + chart.local[i * 3 + k];
+        const float *v = &mesh.vertices[(chart.triangles[i] * 3 + k) * VERTEX_STRIDE];
+        p[k] = glm::vec3(mesh.transform * glm::vec4(v[0], v[1], v[2], 1.0f));
+        n[k] = normalMatrix * glm::vec3(v[5], v[6], v[7]);
+      }
+      float area = (a[1].x - a[0].x) * (a[2].y - a[0].y) - (a[2].x - a[0].x) * (a[1].y - a[0].y);
+      if (std::abs(area) < 1e-8f)
+        continue;
+
+      glm::vec2 lo = glm::min(a[0], glm::min(a[1], a[2])), hi = glm::max(a[0], glm::max(a[1], a[2]));
+      int x0 = std::max(0, (int)std::floor(lo.x) - 1), x1 = std::min(atlasWidth - 1, (int)std::ceil(hi.x) + 1);
+      int y0 = std::max(0, (int)std::floor(lo.y) - 1), y1 = std::min(atlasHeight - 1, (int)std::ceil(hi.y) + 1);
+      for (int y = y0; y <= y1; ++y)
+      {
+        for (int x = x0; x <= x1; ++x)
+        {
+          glm::vec2 c(x + 0.5f, y + 0.5f);
+          float w1 = ((c.x - a[0].x) * (a[2].y - a[0].y) - (a[2].x - a[0].x) * (c.y - a[0].y)) / area;
+          float w2 = ((a[1].x - a[0].x) * (c.y - a[0].y) - (c.x - a[0].x) * (a[1].y - a[0].y)) / area;
+          glm::vec3 w(1.0f - w1 - w2, w1, w2);
+          int coverage = 2;
+          if (w.x < -1e-4f || w.y < -1e-4f || w.z < -1e-4f)
+          {
+            w = glm::max(w, glm::vec3(0.0f));
+            w /= w.x + w.y + w.z;
+            glm::vec2 q = a[0] * w.x + a[1] * w.y + a[2] * w.z;
+            if (glm::length(q - c) > 0.75f)
+              continue;
+            coverage = 1;
+          }
+          Texel &texel = texels[(size_t)y * atlasWidth + x];
+          if (coverage <= texel.coverage)
+            continue;
+          texel.coverage = coverage;
+          texel.position = p[0] * w.x + p[1] * w.y + p[2] * w.z;
+          glm::vec3 normal = n[0] * w.x + n[1] * w.y + n[2] * w.z;
+          texel.normal = glm::length(normal) > 1e-12f ? glm::normalize(normal) : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+      }
+    }
+  }
+  std::vector<unsigned int> work;
+  for (size_t i = 0; i < texels.size(); ++i)
+  {
+    if (texels[i].coverage > 0)
+      work.push_back(i);
+  }
+
+  // ---------- 2. path trace ----------
+  const float offset = 1e-4f;
+  auto direct = [&](const glm::vec3 &p, const glm::vec3 &n)
+  {
+    glm::vec3 toLight = lightPos - p;
+    float distance = glm::length(toLight);
+    glm::vec3 l = toLight / distance;
+    float ndl = glm::dot(n, l);
+    if (ndl <= 0.0f)
+      return glm::vec3(0.0f);
+    Ray ray;
+    ray.origin = p + n * offset;
+    ray.direction = l;
+    ray.tMax = distance;
+    return bvh.occluded(ray) ? glm::vec3(0.0f) : lightColor * ndl;
+  };
+  auto cosine_sample = [](const glm::vec3 &n, std::mt19937 &rng)
+  {
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    float u1 = unit(rng), u2 = unit(rng);
+    float r = std::sqrt(u1), phi = 6.2831853f * u2;
+    glm::vec3 t, b;
+    orthonormal_basis(n, t, b);
+    return glm::normalize(t * (r * std::cos(phi)) + b * (r * std::sin(phi)) + n * std::sqrt(std::max(0.0f, 1.0f - u1)));
+  };
+  // 沿 direction 看到的 radiance (已經除掉 pi, 跟 irradiance 同尺度)
+  std::function<glm::vec3(const glm::vec3 &, const glm::vec3 &, int, std::mt19937 &)> trace =
+      [&](const glm::vec3 &origin, const glm::vec3 &direction, int depth, std::mt19937 &rng)
+  {
+    Ray ray;
+    ray.origin = origin;
+    ray.direction = direction;
+    Hit hit;
+    if (!bvh.intersect(ray, hit))
+      return skyColor;
+    const BvhTriangle &tri = bvh.triangles[hit.triangle];
+    glm::vec3 n = glm::cross(tri.p1 - tri.p0, tri.p2 - tri.p0);
+    n = glm::length(n) > 1e-12f ? glm::normalize(n) : -direction;
+    if (glm::dot(n, direction) > 0.0f)
+      n = -n;
+    glm::vec3 p = origin + direction * hit.t;
+    const Material *mat = meshes[tri.mesh].material;
+
+    glm::vec3 light = direct(p, n);
+    if (depth < bounces)
+      light += trace(p + n * offset, cosine_sample(n, rng), depth + 1, rng);
+    return albedo.at(mat) * light + mat->Ke;
+  };
+
+  std::vector<glm::vec3> result(texels.size(), glm::vec3(0.0f));
+  global_thread_pool().parallel_for(work.size(), 64, [&](size_t begin, size_t end)
+  {
+    for (size_t w = begin; w < end; ++w)
+    {
+      const Texel &texel = texels[work[w]];
+      std::mt19937 rng(work[w] * 2654435761u + 1);
+      glm::vec3 origin = texel.position + texel.normal * offset;
+      glm::vec3 indirect(0.0f);
+      for (int s = 0; s < samplesPerTexel; ++s)
+        indirect += trace(origin, cosine_sample(texel.normal, rng), 1, rng);
+      result[work[w]] = direct(texel.position, texel.normal) + indirect / (float)samplesPerTexel;
+    }
+  });
+
+  // ---------- 3. 往外擴兩圈, 避免 bilinear 在 chart 邊緣讀到黑色 ----------
+  std::vector<char> filled(texels.size());
+  for (size_t i = 0; i < texels.size(); ++i)
+    filled[i] = texels[i].coverage > 0;
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    std::vector<char> next = filled;
+    for (int y = 0; y < atlasHeight; ++y)
+    {
+      for (int x = 0; x < atlasWidth; ++x)
+      {
+        size_t i = (size_t)y * atlasWidth + x;
+        if (filled[i])
+          continue;
+        glm::vec3 sum(0.0f);
+        int count = 0;
+        for (int dy = -1; dy <= 1; ++dy)
+        {
+          for (int dx = -1; dx <= 1; ++dx)
+          {
+            int nx = x + dx, ny = y + dy;
+            if (nx < 0 || ny < 0 || nx >= atlasWidth || ny >= atlasHeight || !filled[(size_t)ny * atlasWidth + nx])
+              continue;
+            sum += result[(size_t)ny * atlasWidth + nx];
+            ++count;
+          }
+        }
+        if (count > 0)
+        {
+          result[i] = sum / (float)count;
+          next[i] = 1;
+        }
+      }
+    }
+    filled.swap(next);
+  }
+  irradiance.swap(result);
+
+  float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+  std::cout << "Lightmap baked: " << work.size() << " texels x " << samplesPerTexel << " samples, " << bounces
+            << " bounces, " << seconds << " s on " << global_thread_pool().size() << " threads" << std::endl;
+}
+
+bool Lightmapper::save(const std::string &directory, const std::vector<Mesh> &meshes) const
+{
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+
+  std::ofstream file(directory + "/lightmap.txt");
+  if (!file)
+  {
+    std::cerr << "Failed to write lightmap: " << directory << std::endl;
+    return false;
+  }
+  file << "# lightmap atlas (lightmap.hdr): irradiance / pi, chart 配置由 texelsPerUnit 與 atlas 尺寸決定\n";
+  file << "checksum " << mesh_checksum(meshes) << "\n";
+  file << "texelsPerUnit " << texelsPerUnit << "\n";
+  file << "atlas " << atlasWidth << " " << atlasHeight << " " << charts.size() << "\n";
+  file << "samples " << samplesPerTexel << " " << bounces << "\n";
+
+  stbi_flip_vertically_on_write(1);
+  bool written = stbi_write_hdr((directory + "/lightmap.hdr").c_str(), atlasWidth, atlasHeight, 3,
+                                &irradiance[0].x) != 0;
+  stbi_flip_vertically_on_write(0);
+  if (!written)
+  {
+    std::cerr << "Failed to write lightmap: " << directory << std::endl;
+    return false;
+  }
+  std::cout << "Lightmap saved: " << directory << std::endl;
+  return true;
+}
+
+bool Lightmapper::load(const std::string &directory, const std::vector<Mesh> &meshes)
+{
+  std::ifstream file(directory + "/lightmap.txt");
+  if (!file)
+    return false;
+
+  uint64_t checksum = 0;
+  float fileTexelsPerUnit = 0.0f;
+  int width = 0, height = 0;
+  size_t chartCount = 0;
+  std::string line;
+  while (std::getline(file, line))
+  {
+    std::istringstream iss(line);
+    std::string token;
+    iss >> token;
+    if (token == "checksum")
+      iss >> checksum;
+    else if (token == "texelsPerUnit")
+      iss >> fileTexelsPerUnit;
+    else if (token == "atlas")
+      iss >> width >> height >> chartCount;
+  }
+  // chart 是依目前設定重新算的, 配置要跟烘焙時一模一樣
+  if (checksum != mesh_checksum(meshes) || std::abs(fileTexelsPerUnit - texelsPerUnit) > 1e-3f * texelsPerUnit ||
+      width != atlasWidth || height != atlasHeight || chartCount != charts.size())
+  {
+    std::cout << "Lightmap out of date, ignoring: " << directory << std::endl;
+    return false;
+  }
+
+  int w = 0, h = 0, channels = 0;
+  float *data = stbi_loadf((directory + "/lightmap.hdr").c_str(), &w, &h, &channels, 3);
+  if (!data || w != atlasWidth || h != atlasHeight)
+  {
+    std::cout << "Lightmap image missing or wrong size, ignoring: " << directory << std::endl;
+    stbi_image_free(data);
+    return false;
+  }
+  // 檔案由上往下, GL 由下往上
+  irradiance.resize((size_t)w * h);
+  for (int y = 0; y < h; ++y)
+  {
+    const float *row = data + (size_t)(h - 1 - y) * w * 3;
+    for (int x = 0; x < w; ++x)
+      irradiance[(size_t)y * w + x] = glm::vec3(row[x * 3], row[x * 3 + 1], row[x * 3 + 2]);
+  }
+  stbi_image_free(data);
+  std::cout << "Lightmap loaded: " << directory << std::endl;
+  return true;
+}
+
+void Lightmapper::upload()
+{
+  if (!texture)
+    glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, atlasWidth, atlasHeight, 0, GL_RGB, GL_FLOAT, irradiance.data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Lightmapper::bind(unsigned int program)
+{
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "lightmap"), 6);
+  glActiveTexture(GL_TEXTURE6);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void Lightmapper::release()
+{
+  glDeleteTextures(1, &texture);
+  texture = 0;
+}
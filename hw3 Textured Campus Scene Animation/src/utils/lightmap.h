@@ -0,0 +1,66 @@
+#ifndef LIGHTMAP_H
+#define LIGHTMAP_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+// ========== 靜態場景的 lightmap ==========
+// 三個 SchoolScene 都不會動, 漫射光可以離線烘好, 執行時只剩一次貼圖讀取:
+// 1. chart: 每個 mesh 相鄰且法線相近的三角形併成一個 chart, 投影到 chart 平面,
+//    shelf packing 進同一張 atlas, 得到第二組不重疊的 UV (Mesh::lightmapUV)
+// 2. 烘焙: 場景建 BVH, 每個 texel 用 thread pool 平行 path trace 直接光 (主光源 + 陰影)
+//    與間接光 (cosine 取樣, bounces 次反彈, 打到 emissive 表面也算)
+// 3. 存成 models/<場景>/lightmap/ 的 lightmap.hdr + lightmap.txt, 每個場景各自一份
+// 存的是 "乘上 albedo 就是漫射顏色" 的 irradiance / pi, 跟即時打光的 0.3 ambient + N.L 同一個尺度.
+// instancing 的 mesh 共用幾何 (UV 沒辦法每個 instance 不同) 與 HLOD 代理不做, 繼續即時打光
+class Lightmapper
+{
+public:
+  float texelsPerUnit = 128.0f; // 場景座標每單位幾個 texel (場景正規化到 [-1, 1]); atlas 放不下會自動降低
+  int atlasWidth = 1024;        // atlas 寬度, 高度依 packing 結果決定 (最多跟寬度一樣)
+  int padding = 2;              // chart 四周留的 texel, bilinear 取樣才不會滲到隔壁
+  float chartNormalCos = 0.9f;  // 相鄰三角形法線夾角的 cos 超過這個值才併進同一個 chart
+  int samplesPerTexel = 64;
+  int bounces = 2;
+  glm::vec3 skyColor{0.3f}; // 沒打到東西的光線 (對應即時打光的 0.3 ambient)
+
+  // 產生 Mesh::lightmapUV (要在 mesh 清單定案之後、建立 VAO / MDI 之前)
+  void build_charts(std::vector<Mesh> &meshes);
+  // 多執行緒烘焙 (不需要 GL context); lightPos / lightColor 是主光源
+  void bake(const std::vector<Mesh> &meshes, const glm::vec3 &lightPos, const glm::vec3 &lightColor);
+
+  bool save(const std::string &directory, const std::vector<Mesh> &meshes) const;
+  // 場景或 chart 配置不同 (checksum / 尺寸對不上) 就回傳 false
+  bool load(const std::string &directory, const std::vector<Mesh> &meshes);
+  // 不用 lightmap 時把 Mesh::lightmapUV 清掉, 省下 VBO
+  void clear_uvs(std::vector<Mesh> &meshes);
+
+  void upload();
+  // lightmap bind 在 unit 6
+  void bind(unsigned int program);
+  void release();
+  bool empty() const { return irradiance.empty(); }
+
+private:
+  struct Chart
+  {
+    unsigned int mesh;
+    std::vector<unsigned int> triangles; // mesh 裡的第幾個三角形
+    std::vector<glm::vec2> local;        // 每個三角形 3 個頂點在 chart 裡的 texel 座標 (含 padding)
+    int width = 0, height = 0;
+    int x = 0, y = 0; // packing 後在 atlas 裡的位置
+  };
+
+  // 依目前的 texelsPerUnit 切 chart + packing, 放不下回傳 false
+  bool pack(const std::vector<Mesh> &meshes);
+
+  std::vector<Chart> charts;
+  int atlasHeight = 0;
+  std::vector<glm::vec3> irradiance; // atlasWidth x atlasHeight, GL 的列順序 (由下往上)
+  unsigned int texture = 0;
+};
+
+#endif
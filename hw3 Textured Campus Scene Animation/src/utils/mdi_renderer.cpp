@@ -0,0 +1,372 @@
+#include "mdi_renderer.h"
+#include "dynamic_buffer.h"
+#include "texture_array.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+bool MdiRenderer::is_supported()
+{
+  return GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_shader_storage_buffer_object &&
+         GLAD_GL_ARB_base_instance && GLAD_GL_ARB_draw_indirect;
+}
+
+bool MdiRenderer::build(const std::vector<Mesh> &meshes, bool useTextureArrays)
+{
+  textureArrays = useTextureArrays;
+
+  std::vector<float> allVertices;
+  std::vector<float> allLightmapUV; // 跟 allVertices 對齊, 沒有 lightmap 的頂點是 (-1, -1)
+  std::vector<float> allAo;         // 同上, 沒有烘焙 AO 的頂點是 1
+  std::vector<unsigned int> allIndices;
+  std::vector<GpuDrawData> drawData;
+  std::vector<GpuMaterial> materials;
+  std::unordered_map<const Material *, unsigned int> materialIndex;
+
+  ranges.clear();
+  batches.clear();
+
+  // obj 讀進來是沒有 index 的三角形, 每個 mesh 各自去重成 indexed geometry;
+  // 同一個 instancing shape 的 mesh 共用第一個 instance 的那一段
+  std::unordered_map<int, MeshRange> shapeRanges;
+  for (const auto &mesh : meshes)
+  {
+    MeshRange range;
+    auto shared = mesh.instanceShape >= 0 ? shapeRanges.find(mesh.instanceShape) : shapeRanges.end();
+    if (shared != shapeRanges.end())
+    {
+      range = shared->second;
+    }
+    else
+    {
+      range.firstIndex = allIndices.size();
+      range.baseVertex = allVertices.size() / VERTEX_STRIDE;
+      index_vertices(mesh.vertices, allVertices, allIndices, &mesh.lightmapUV, &allLightmapUV, &mesh.ao, &allAo);
+      range.count = allIndices.size() - range.firstIndex;
+      if (mesh.instanceShape >= 0)
+        shapeRanges.emplace(mesh.instanceShape, range);
+    }
+    range.shape = mesh.instanceShape;
+
+    // 材質表
+    const Material *mat = mesh.material;
+    unsigned int matIdx = 0;
+    if (mat)
+    {
+      auto it = materialIndex.find(mat);
+      if (it == materialIndex.end())
+      {
+        matIdx = materials.size();
+        materialIndex.emplace(mat, matIdx);
+        GpuMaterial gm;
+        gm.Ka = glm::vec4(mat->Ka, 0.0f);
+        gm.Kd = glm::vec4(mat->Kd, 0.0f);
+        gm.Ks = glm::vec4(mat->Ks, 0.0f);
+        gm.Ke = glm::vec4(mat->Ke, 0.0f);
+        bool hasDiffuse = textureArrays ? mat->diffuseArray >= 0 : mat->diffuseTexID != 0;
+        bool hasSpecular = textureArrays ? mat->specularArray >= 0 : mat->specularTexID != 0;
+        gm.params = glm::vec4(mat->Ns, mat->d, hasDiffuse ? 1.0f : 0.0f, hasSpecular ? 1.0f : 0.0f);
+        materials.push_back(gm);
+      }
+      else
+      {
+        matIdx = it->second;
+      }
+    }
+
+    // 貼圖組合 -> batch
+    unsigned int diffuseTex = mat ? mat->diffuseTexID : 0;
+    unsigned int specularTex = mat ? mat->specularTexID : 0;
+    glm::uvec2 layers(0);
+    if (textureArrays)
+    {
+      // 沒有貼圖的材質不會取樣, 隨便掛在第 0 個 array 上, 讓它跟有貼圖的 mesh 併成同一批
+      int diffuseArray = mat && mat->diffuseArray >= 0 ? mat->diffuseArray : 0;
+      int specularArray = mat && mat->specularArray >= 0 ? mat->specularArray : 0;
+      diffuseTex = g_textureArrays.empty() ? g_whiteTextureArray : g_textureArrays[diffuseArray].id;
+      specularTex = g_textureArrays.empty() ? g_whiteTextureArray : g_textureArrays[specularArray].id;
+      layers = glm::uvec2(mat ? std::max(mat->diffuseLayer, 0) : 0, mat ? std::max(mat->specularLayer, 0) : 0);
+    }
+    range.batch = -1;
+    for (size_t b = 0; b < batches.size(); ++b)
+    {
+      if (batches[b].diffuseTexID == diffuseTex && batches[b].specularTexID == specularTex)
+      {
+        range.batch = b;
+        break;
+      }
+    }
+    if (range.batch < 0)
+    {
+      range.batch = batches.size();
+      batches.push_back({diffuseTex, specularTex});
+    }
+
+    ranges.push_back(range);
+    drawData.push_back({mesh.transform, glm::uvec4(matIdx, layers.x, layers.y, 0)});
+  }
+
+  if (materials.empty())
+    materials.push_back(GpuMaterial{});
+
+  // visibility buffer 的 bit 分配: 低位是 mesh 裡的三角形編號, 高位是 mesh index + 1 (0 代表背景)
+  unsigned int maxTriangles = 1;
+  std::vector<GpuMeshRange> meshRanges;
+  for (const MeshRange &range : ranges)
+  {
+    maxTriangles = std::max(maxTriangles, range.count / 3);
+    meshRanges.push_back({range.firstIndex, range.baseVertex, (unsigned int)range.batch, 0});
+  }
+  triangleBits = 1;
+  while (triangleBits < 32 && (1ull << triangleBits) < maxTriangles)
+    ++triangleBits;
+  if (triangleBits >= 32 || ranges.size() + 1 > (1ull << (32 - triangleBits)) - 1)
+  {
+    std::cout << "MDI: " << ranges.size() << " meshes x " << maxTriangles
+              << " triangles do not fit a 32-bit visibility buffer" << std::endl;
+    triangleBits = 0;
+  }
+
+  vertexCount = allVertices.size() / VERTEX_STRIDE;
+  indexCount = allIndices.size();
+
+  glGenVertexArrays(1, &VAO);
+  glBindVertexArray(VAO);
+
+  glGenBuffers(1, &VBO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, allVertices.size() * sizeof(float), allVertices.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_STRIDE * sizeof(float), (void *)0);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, VERTEX_STRIDE * sizeof(float), (void *)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, VERTEX_STRIDE * sizeof(float), (void *)(5 * sizeof(float)));
+  glEnableVertexAttribArray(2);
+
+  glGenBuffers(1, &lightmapVBO);
+  glBindBuffer(GL_ARRAY_BUFFER, lightmapVBO);
+  glBufferData(GL_ARRAY_BUFFER, allLightmapUV.size() * sizeof(float), allLightmapUV.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(8, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+  glEnableVertexAttribArray(8);
+
+  glGenBuffers(1, &aoVBO);
+  glBindBuffer(GL_ARRAY_BUFFER, aoVBO);
+  glBufferData(GL_ARRAY_BUFFER, allAo.size() * sizeof(float), allAo.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(9, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void *)0);
+  glEnableVertexAttribArray(9);
+
+  // draw ID 每幀依 command 順序重寫 (見 draw)
+  glGenBuffers(1, &drawIdVBO);
+  glBindBuffer(GL_ARRAY_BUFFER, drawIdVBO);
+  glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void *)0);
+  glVertexAttribDivisor(3, 1);
+  glEnableVertexAttribArray(3);
+
+  glGenBuffers(1, &EBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, allIndices.size() * sizeof(unsigned int), allIndices.data(), GL_STATIC_DRAW);
+
+  glBindVertexArray(0);
+
+  glGenBuffers(1, &drawDataSSBO);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataSSBO);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, drawData.size() * sizeof(GpuDrawData), drawData.data(), GL_STATIC_DRAW);
+
+  glGenBuffers(1, &materialSSBO);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialSSBO);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(GpuMaterial), materials.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  glGenBuffers(1, &meshRangeSSBO);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshRangeSSBO);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, meshRanges.size() * sizeof(GpuMeshRange), meshRanges.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  glGenBuffers(1, &indirectBuffer);
+  glGenVertexArrays(1, &emptyVAO);
+
+  std::cout << "MDI: " << meshes.size() << " meshes, " << vertexCount << " unique vertices, "
+            << indexCount << " indices, " << batches.size() << " texture batches" << std::endl;
+  return true;
+}
+
+void MdiRenderer::build_commands(const std::vector<unsigned int> &visible)
+{
+  // counting sort: 依 batch 排好, 同一 batch 連續存放
+  batchOffsets.assign(batches.size() + 1, 0);
+  for (unsigned int meshIndex : visible)
+    batchOffsets[ranges[meshIndex].batch + 1]++;
+  for (size_t b = 1; b < batchOffsets.size(); ++b)
+    batchOffsets[b] += batchOffsets[b - 1];
+
+  drawIds.resize(visible.size());
+  std::vector<unsigned int> cursor(batchOffsets.begin(), batchOffsets.end() - 1);
+  for (unsigned int meshIndex : visible)
+    drawIds[cursor[ranges[meshIndex].batch]++] = meshIndex;
+
+  // batch 內同一個 shape 的 mesh 排在一起, 合成一個 instanceCount = n 的 command;
+  // baseInstance 指向 drawIds 裡的位置, shader 用它讀到各自的 mesh index
+  commands.clear();
+  commandOffsets.assign(batches.size() + 1, 0);
+  for (size_t b = 0; b < batches.size(); ++b)
+  {
+    auto first = drawIds.begin() + batchOffsets[b], last = drawIds.begin() + batchOffsets[b + 1];
+    std::sort(first, last, [&](unsigned int x, unsigned int y)
+              { return ranges[x].shape < ranges[y].shape; });
+    for (unsigned int i = batchOffsets[b]; i < batchOffsets[b + 1]; ++i)
+    {
+      const MeshRange &range = ranges[drawIds[i]];
+      if (range.shape >= 0 && commands.size() > commandOffsets[b] && ranges[drawIds[i - 1]].shape == range.shape)
+        commands.back().instanceCount++;
+      else
+        commands.push_back({range.count, 1, range.firstIndex, range.baseVertex, i});
+    }
+    commandOffsets[b + 1] = commands.size();
+  }
+  lastCommandCount = commands.size();
+
+  if (dynamic)
+  {
+    // 寫進 ring 這幀的那一段, attribute 與 indirect buffer 改指到它
+    DynamicBuffer::Allocation ids = dynamic->allocate(drawIds.size() * sizeof(unsigned int), sizeof(unsigned int));
+    std::memcpy(ids.data, drawIds.data(), drawIds.size() * sizeof(unsigned int));
+    DynamicBuffer::Allocation cmds = dynamic->allocate(commands.size() * sizeof(DrawElementsIndirectCommand), 4);
+    std::memcpy(cmds.data, commands.data(), commands.size() * sizeof(DrawElementsIndirectCommand));
+    dynamic->flush();
+    commandBase = cmds.offset;
+
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, dynamic->buffer());
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void *)ids.offset);
+    glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, dynamic->buffer());
+    return;
+  }
+
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, drawIdVBO);
+  glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void *)0);
+  glBindVertexArray(0);
+  glBufferData(GL_ARRAY_BUFFER, drawIds.size() * sizeof(unsigned int), NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, drawIds.size() * sizeof(unsigned int), drawIds.data());
+
+  // 每幀整塊重傳 (orphan), 避免跟上一幀的 GPU 讀取同步
+  commandBase = 0;
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+}
+
+void MdiRenderer::bind_batch_textures(size_t batch, unsigned int whiteTexture)
+{
+  if (textureArrays)
+  {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, batches[batch].diffuseTexID);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, batches[batch].specularTexID);
+  }
+  else
+  {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, batches[batch].diffuseTexID != 0 ? batches[batch].diffuseTexID : whiteTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, batches[batch].specularTexID != 0 ? batches[batch].specularTexID : whiteTexture);
+  }
+}
+
+void MdiRenderer::draw(unsigned int program, const std::vector<unsigned int> &visible, unsigned int whiteTexture)
+{
+  build_commands(visible);
+
+  glUseProgram(program);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, drawDataSSBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, materialSSBO);
+  glBindVertexArray(VAO);
+
+  lastBatchCount = 0;
+  for (size_t b = 0; b < batches.size(); ++b)
+  {
+    unsigned int first = commandOffsets[b];
+    unsigned int count = commandOffsets[b + 1] - first;
+    if (count == 0)
+      continue;
+
+    bind_batch_textures(b, whiteTexture);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                (void *)(commandBase + first * sizeof(DrawElementsIndirectCommand)), count, 0);
+    lastBatchCount++;
+  }
+
+  glBindVertexArray(0);
+}
+
+void MdiRenderer::draw_visibility(unsigned int program, const std::vector<unsigned int> &visible)
+{
+  build_commands(visible);
+
+  glUseProgram(program);
+  glUniform1ui(glGetUniformLocation(program, "triangleBits"), triangleBits);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, drawDataSSBO);
+  glBindVertexArray(VAO);
+  if (!commands.empty())
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void *)commandBase, commands.size(), 0);
+  lastBatchCount = commands.empty() ? 0 : 1;
+  glBindVertexArray(0);
+}
+
+void MdiRenderer::resolve(unsigned int program, unsigned int whiteTexture)
+{
+  glUseProgram(program);
+  glUniform1ui(glGetUniformLocation(program, "triangleBits"), triangleBits);
+  GLint batchLocation = glGetUniformLocation(program, "resolveBatch");
+  // 頂點資料直接把 VBO / EBO 當 SSBO 讀
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, drawDataSSBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, materialSSBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, meshRangeSSBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, VBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, EBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, lightmapVBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, aoVBO);
+  glBindVertexArray(emptyVAO);
+
+  for (size_t b = 0; b < batches.size(); ++b)
+  {
+    if (commandOffsets[b + 1] == commandOffsets[b])
+      continue;
+    bind_batch_textures(b, whiteTexture);
+    glUniform1ui(batchLocation, b);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+  }
+  glBindVertexArray(0);
+}
+
+void MdiRenderer::set_fade(unsigned int meshIndex, float fade)
+{
+  unsigned int bits;
+  std::memcpy(&bits, &fade, sizeof(bits));
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataSSBO);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, meshIndex * sizeof(GpuDrawData) + sizeof(glm::mat4) + 3 * sizeof(unsigned int),
+                  sizeof(bits), &bits);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void MdiRenderer::release()
+{
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &EBO);
+  glDeleteBuffers(1, &drawIdVBO);
+  glDeleteBuffers(1, &lightmapVBO);
+  glDeleteBuffers(1, &aoVBO);
+  glDeleteBuffers(1, &drawDataSSBO);
+  glDeleteBuffers(1, &materialSSBO);
+  glDeleteBuffers(1, &indirectBuffer);
+  glDeleteBuffers(1, &meshRangeSSBO);
+  glDeleteVertexArrays(1, &emptyVAO);
+  VAO = VBO = EBO = drawIdVBO = lightmapVBO = aoVBO = drawDataSSBO = materialSSBO = indirectBuffer = 0;
+  meshRangeSSBO = emptyVAO = 0;
+}
@@ -0,0 +1,120 @@
+#ifndef MDI_RENDERER_H
+#define MDI_RENDERER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "mesh.h"
+
+class DynamicBuffer;
+
+// ========== Multi-Draw Indirect 繪製路徑 (GL 4.3+) ==========
+// 全部靜態幾何放在同一組 VBO/EBO, 每個 mesh 的 transform 與材質編號放在 SSBO,
+// 每幀把可見的 mesh 寫成 indirect command, 用 glMultiDrawElementsIndirect 一次送出.
+// draw ID 靠 baseInstance + 一個 divisor = 1 的頂點屬性 (location 3) 傳進 shader:
+// 屬性 buffer 每幀依 command 順序寫入 mesh index, 同一個 instancing shape 的 mesh 因此能合成一個 command.
+
+// 與 GL 規格相同的 indirect command 排列
+struct DrawElementsIndirectCommand
+{
+  unsigned int count;
+  unsigned int instanceCount;
+  unsigned int firstIndex;
+  int baseVertex;
+  unsigned int baseInstance;
+};
+
+// std430: 對應 shader 裡的 DrawData
+struct GpuDrawData
+{
+  glm::mat4 model;
+  glm::uvec4 info; // x: material index, y: diffuse layer, z: specular layer, w: fade (float bits)
+};
+
+// std430: 對應 visibility buffer resolve 的 MeshRangeData
+struct GpuMeshRange
+{
+  unsigned int firstIndex;
+  int baseVertex;
+  unsigned int batch; // resolve 一次畫一個 batch, 其他 batch 的像素 discard
+  unsigned int pad;
+};
+
+// std430: 對應 shader 裡的 MaterialData
+struct GpuMaterial
+{
+  glm::vec4 Ka;
+  glm::vec4 Kd;
+  glm::vec4 Ks;
+  glm::vec4 Ke; // emissive
+  glm::vec4 params; // x: Ns, y: d, z: hasDiffuseMap, w: hasSpecularMap
+};
+
+class MdiRenderer
+{
+public:
+  // 檢查 context 是否支援 MDI + SSBO + baseInstance
+  static bool is_supported();
+
+  // useTextureArrays: 材質貼圖已經打包成 g_textureArrays, batch 改以 array 分組
+  bool build(const std::vector<Mesh> &meshes, bool useTextureArrays = false);
+  void draw(unsigned int program, const std::vector<unsigned int> &visible, unsigned int whiteTexture);
+  // 更新單一 mesh 的淡出比例 (Mesh::fade), 只有交叉淡出中的 mesh 會呼叫
+  void set_fade(unsigned int meshIndex, float fade);
+  void release();
+
+  // ---------- visibility buffer ----------
+  // 第一個 pass: 全部 command 一次送出 (不用換貼圖), shader 只寫 (mesh index + 1) << triangleBits | gl_PrimitiveID
+  void draw_visibility(unsigned int program, const std::vector<unsigned int> &visible);
+  // 第二個 pass: 每個有可見 mesh 的 batch 畫一個全螢幕三角形, shader 從 SSBO 讀頂點重建屬性後打光;
+  // 用的是上一次 draw_visibility 的 command (batch 清單)
+  void resolve(unsigned int program, unsigned int whiteTexture);
+  // mesh 數與每個 mesh 的最大三角形數塞得進 32 bit 才能用
+  bool visibility_supported() const { return triangleBits > 0; }
+  unsigned int triangleBits = 0;
+
+  size_t vertexCount = 0;
+  size_t indexCount = 0;
+  int lastBatchCount = 0;   // 上一幀 glMultiDrawElementsIndirect 呼叫次數
+  int lastCommandCount = 0; // 上一幀的 indirect command 數 (instancing 合併之後)
+
+  // 有設定的話 draw ID 與 indirect command 從這個 ring 配置, 沒有就用自己的 buffer 每幀 orphan
+  DynamicBuffer *dynamic = nullptr;
+
+private:
+  struct MeshRange
+  {
+    unsigned int firstIndex;
+    unsigned int count;
+    int baseVertex;
+    int batch; // 同一組貼圖的 mesh 屬於同一個 batch
+    int shape; // Mesh::instanceShape, 同 shape 的 range 指向同一段 index
+  };
+
+  // 同一組 diffuse/specular 貼圖 (或貼圖陣列) 共用一次 bind
+  struct Batch
+  {
+    unsigned int diffuseTexID;
+    unsigned int specularTexID;
+  };
+
+  // 依 batch 排好可見 mesh, 產生 indirect command 並上傳
+  void build_commands(const std::vector<unsigned int> &visible);
+  void bind_batch_textures(size_t batch, unsigned int whiteTexture);
+
+  bool textureArrays = false;
+
+  std::vector<MeshRange> ranges;
+  std::vector<Batch> batches;
+  std::vector<DrawElementsIndirectCommand> commands;
+  std::vector<unsigned int> batchOffsets;
+  std::vector<unsigned int> commandOffsets;
+  std::vector<unsigned int> drawIds; // 依 command 順序排好的 mesh index
+
+  unsigned int VAO = 0, VBO = 0, EBO = 0, drawIdVBO = 0, lightmapVBO = 0, aoVBO = 0;
+  unsigned int drawDataSSBO = 0, materialSSBO = 0, indirectBuffer = 0;
+  unsigned int meshRangeSSBO = 0, emptyVAO = 0;
+  size_t commandBase = 0; // 這幀的 command 在 GL_DRAW_INDIRECT_BUFFER 裡的 offset
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+// ========== 頂點去重用的 key ==========
+struct VertexKey
+{
+  float v[VERTEX_STRIDE + 3]; // 頂點 + lightmap UV (沒有就是 -1, -1) + AO (沒有就是 1)
+
+  bool operator==(const VertexKey &other) const
+  {
+    return std::memcmp(v, other.v, sizeof(v)) == 0;
+  }
+};
+
+struct VertexKeyHash
+{
+  size_t operator()(const VertexKey &key) const
+  {
+    // FNV-1a
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(key.v);
+    size_t hash = 1469598103934665603ull;
+    for (size_t i = 0; i < sizeof(key.v); ++i)
+    {
+      hash ^= bytes[i];
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+};
+
+void compute_mesh_bounds(Mesh &mesh)
+{
+  glm::vec3 lo(1e30f), hi(-1e30f);
+  for (size_t i = 0; i + VERTEX_STRIDE <= mesh.vertices.size(); i += VERTEX_STRIDE)
+  {
+    glm::vec3 p = glm::vec3(mesh.transform * glm::vec4(mesh.vertices[i], mesh.vertices[i + 1], mesh.vertices[i + 2], 1.0f));
+    lo = glm::min(lo, p);
+    hi = glm::max(hi, p);
+  }
+  if (mesh.vertices.empty())
+    lo = hi = glm::vec3(0.0f);
+  mesh.boundsMin = lo;
+  mesh.boundsMax = hi;
+}
+
+void split_large_meshes(std::vector<Mesh> &meshes, float cellSize)
+{
+  std::vector<Mesh> result;
+  const size_t triangleFloats = 3 * VERTEX_STRIDE;
+
+  for (auto &mesh : meshes)
+  {
+    compute_mesh_bounds(mesh);
+    glm::vec3 extent = mesh.boundsMax - mesh.boundsMin;
+    // instancing 的 mesh 本來就只是一個物件, 切開就不能共用幾何了
+    if (std::max({extent.x, extent.y, extent.z}) <= cellSize || mesh.instanceShape >= 0)
+    {
+      result.push_back(std::move(mesh));
+      continue;
+    }
+
+    // 依三角形重心分格
+    std::map<std::tuple<int, int, int>, Mesh> cells;
+    for (size_t t = 0; t + triangleFloats <= mesh.vertices.size(); t += triangleFloats)
+    {
+      const float *v = &mesh.vertices[t];
+      glm::vec3 centroid = (glm::vec3(v[0], v[1], v[2]) +
+                            glm::vec3(v[VERTEX_STRIDE], v[VERTEX_STRIDE + 1], v[VERTEX_STRIDE + 2]) +
+                            glm::vec3(v[2 * VERTEX_STRIDE], v[2 * VERTEX_STRIDE + 1], v[2 * VERTEX_STRIDE + 2])) /
+                           3.0f;
+      auto key = std::make_tuple((int)std::floor(centroid.x / cellSize),
+                                 (int)std::floor(centroid.y / cellSize),
+                                 (int)std::floor(centroid.z / cellSize));
+      Mesh &cell = cells[key];
+      cell.vertices.insert(cell.vertices.end(), v, v + triangleFloats);
+    }
+
+    for (auto &[key, cell] : cells)
+    {
+      cell.material = mesh.material;
+      cell.transform = mesh.transform;
+      compute_mesh_bounds(cell);
+      result.push_back(std::move(cell));
+    }
+  }
+
+  meshes = std::move(result);
+}
+
+uint64_t mesh_checksum(const std::vector<Mesh> &meshes)
+{
+  uint64_t hash = 14695981039346656037ull;
+  auto mix = [&hash](const void *data, size_t size)
+  {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+      hash ^= bytes[i];
+      hash *= 1099511628211ull;
+    }
+  };
+  // HLOD 代理是烘焙出來的, 不算在場景裡
+  size_t count = std::count_if(meshes.begin(), meshes.end(), [](const Mesh &mesh)
+                               { return !mesh.proxy; });
+  mix(&count, sizeof(count));
+  for (const Mesh &mesh : meshes)
+  {
+    if (mesh.proxy)
+      continue;
+    size_t vertexCount = mesh.vertices.size();
+    mix(&vertexCount, sizeof(vertexCount));
+    mix(&mesh.boundsMin, sizeof(mesh.boundsMin));
+    mix(&mesh.boundsMax, sizeof(mesh.boundsMax));
+  }
+  return hash;
+}
+
+void index_vertices(const std::vector<float> &soup, std::vector<float> &vertices, std::vector<unsigned int> &indices,
+                    const std::vector<float> *lightmapUV, std::vector<float> *lightmapOut,
+                    const std::vector<float> *ao, std::vector<float> *aoOut)
+{
+  std::unordered_map<VertexKey, unsigned int, VertexKeyHash> unique;
+  size_t count = soup.size() / VERTEX_STRIDE;
+  bool hasLightmap = lightmapUV && !lightmapUV->empty();
+  bool hasAo = ao && !ao->empty();
+  for (size_t i = 0; i < count; ++i)
+  {
+    VertexKey key;
+    std::memcpy(key.v, &soup[i * VERTEX_STRIDE], VERTEX_STRIDE * sizeof(float));
+    key.v[VERTEX_STRIDE] = hasLightmap ? (*lightmapUV)[i * 2] : -1.0f;
+    key.v[VERTEX_STRIDE + 1] = hasLightmap ? (*lightmapUV)[i * 2 + 1] : -1.0f;
+    key.v[VERTEX_STRIDE + 2] = hasAo ? (*ao)[i] : 1.0f;
+    auto [it, inserted] = unique.emplace(key, (unsigned int)unique.size());
+    if (inserted)
+    {
+      vertices.insert(vertices.end(), key.v, key.v + VERTEX_STRIDE);
+      if (lightmapOut)
+        lightmapOut->insert(lightmapOut->end(), key.v + VERTEX_STRIDE, key.v + VERTEX_STRIDE + 2);
+      if (aoOut)
+        aoOut->push_back(key.v[VERTEX_STRIDE + 2]);
+    }
+    indices.push_back(it->second);
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+
+// 每個頂點 8 個 float: x y z | u v | nx ny nz
+#define VERTEX_STRIDE 8
+
+struct Material
+{
+  std::string name;
+  glm::vec3 Ka{0.0f};             // ambient
+  glm::vec3 Kd{0.0f};             // diffuse
+  glm::vec3 Ks{0.0f};             // specular
+  glm::vec3 Ke{0.0f};             // emissive
+  float Ns = 0.0f;                // shininess
+  float Ni = 1.0f;                // optical density (refraction)
+  float d = 1.0f;                 // dissolve
+  int illum = 0;                  // illumination model
+  std::string diffuseTexPath;     //
+  std::string normalTexPath;      //
+  std::string specularTexPath;    //
+  std::string alphaTexPath;       //
+  unsigned int diffuseTexID = 0;  //
+  unsigned int specularTexID = 0; //
+  int diffuseArray = -1;          // 貼圖陣列模式: g_textureArrays 的 index
+  int diffuseLayer = -1;          //               array 裡的 layer
+  int specularArray = -1;         //
+  int specularLayer = -1;         //
+};
+
+struct Mesh
+{
+  std::vector<float> vertices;
+  Material *material = nullptr;
+  int geometry = -1; // 逐 mesh 路徑: GeometryArena 的 handle (instancing 的 mesh 用 shape 的 buffer, 沒有)
+  glm::mat4 transform{1.0f}; // per-draw model matrix (目前場景都是 identity)
+  glm::vec3 boundsMin{0.0f}; // world space AABB (含 transform)
+  glm::vec3 boundsMax{0.0f};
+  float fade = 0.0f; // 切換到 impostor 時的淡出比例 (0: 完整顯示, 1: 完全隱藏)
+  bool proxy = false; // HLOD 代理 mesh: 平常不畫, 整個 cluster 夠遠時取代成員
+  int instanceShape = -1; // 自動 instancing: 屬於哪個 shape (vertices 是 shape 的 local 頂點, transform 是剛體變換)
+  std::vector<float> lightmapUV; // lightmap 的第二組 UV (每個頂點 2 個 float), 空的代表這個 mesh 沒有 lightmap
+  std::vector<float> ao; // 烘焙的 ambient occlusion (每個頂點 1 個 float, 1 = 沒被遮), 空的代表沒有
+};
+
+// 這些 extern 代表 main.cpp 定義的全域變數
+extern std::vector<Mesh> meshes;
+extern std::map<std::string, Material> g_materials;
+
+// 重新計算 boundsMin / boundsMax
+void compute_mesh_bounds(Mesh &mesh);
+
+// obj 依 usemtl 切出來的 mesh 常常橫跨整個校園, culling 時幾乎永遠可見.
+// 超過 cellSize 的 mesh 依三角形重心切到格子裡 (材質不變), 讓 culling 有意義
+void split_large_meshes(std::vector<Mesh> &meshes, float cellSize);
+
+// 用 mesh 數量、頂點數與 bounds 算 hash, 判斷烘焙結果 (.pvs、impostor...) 是不是同一份場景烘出來的
+uint64_t mesh_checksum(const std::vector<Mesh> &meshes);
+
+// 沒有 index 的三角形頂點 (每個頂點 VERTEX_STRIDE 個 float) 去重成 indexed geometry,
+// 結果接在 vertices / indices 後面, index 從 0 開始 (呼叫端自己加 base vertex).
+// 有給 lightmapOut 時, lightmap UV 也算進去重的 key, 每個輸出頂點的 UV 接在 lightmapOut 後面
+// (lightmapUV 是空的或 nullptr 就填 -1, -1). aoOut 同理, 沒有 AO 的頂點填 1
+void index_vertices(const std::vector<float> &soup, std::vector<float> &vertices, std::vector<unsigned int> &indices,
+                    const std::vector<float> *lightmapUV = nullptr, std::vector<float> *lightmapOut = nullptr,
+                    const std::vector<float> *ao = nullptr, std::vector<float> *aoOut = nullptr);
+
+#endif
@@ -0,0 +1,312 @@
+#include "occlusion_culler.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+void OcclusionCuller::select_occluders(const std::vector<Mesh> &meshes)
+{
+  struct Candidate
+  {
+    float area;
+    glm::vec3 p[3];
+  };
+  std::vector<Candidate> candidates;
+
+  for (const auto &mesh : meshes)
+  {
+    // 半透明的東西擋不住後面
+    if (!mesh.material || mesh.material->d < 0.99f || !mesh.material->alphaTexPath.empty())
+      continue;
+
+    for (size_t t = 0; t + 3 * VERTEX_STRIDE <= mesh.vertices.size(); t += 3 * VERTEX_STRIDE)
+    {
+      Candidate c;
+      for (int k = 0; k < 3; ++k)
+      {
+        const float *v = &mesh.vertices[t + k * VERTEX_STRIDE];
+        c.p[k] = glm::vec3(mesh.transform * glm::vec4(v[0], v[1], v[2], 1.0f));
+      }
+      c.area = 0.5f * glm::length(glm::cross(c.p[1] - c.p[0], c.p[2] - c.p[0]));
+      if (c.area > minOccluderArea)
+        candidates.push_back(c);
+    }
+  }
+
+  size_t count = std::min(candidates.size(), occluderTriangleBudget);
+  std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+                    [](const Candidate &a, const Candidate &b)
+                    { return a.area > b.area; });
+
+  occluders.clear();
+  for (size_t i = 0; i < count; ++i)
+    occluders.insert(occluders.end(), candidates[i].p, candidates[i].p + 3);
+
+  screenTriangles.resize(count * 2); // near plane 裁切後最多變成 2 個三角形
+
+  // Hi-Z 各層大小
+  levels.clear();
+  levelSizes.clear();
+  int w = width, h = height;
+  while (true)
+  {
+    levelSizes.push_back(glm::ivec2(w, h));
+    levels.push_back(std::vector<float>((size_t)w * h, 0.0f));
+    if (w == 1 && h == 1)
+      break;
+    w = std::max(1, w / 2);
+    h = std::max(1, h / 2);
+  }
+
+  std::cout << "Occlusion culling: " << count << " occluder triangles (of " << candidates.size()
+            << " candidates), " << width << "x" << height << " depth buffer" << std::endl;
+}
+
+void OcclusionCuller::setup_triangles(const glm::mat4 &viewProjection)
+{
+  size_t triangleCount = occluders.size() / 3;
+
+  global_thread_pool().parallel_for(triangleCount, 256, [&](size_t begin, size_t end)
+                                    {
+    for (size_t t = begin; t < end; ++t)
+    {
+      ScreenTriangle &out0 = screenTriangles[t * 2];
+      ScreenTriangle &out1 = screenTriangles[t * 2 + 1];
+      out0.minX = out1.minX = 1;
+      out0.maxX = out1.maxX = 0; // 預設為空
+
+      glm::vec4 clip[3];
+      for (int k = 0; k < 3; ++k)
+        clip[k] = viewProjection * glm::vec4(occluders[t * 3 + k], 1.0f);
+
+      // 對 near plane (z + w >= 0) 裁切, 最多剩 4 個頂點
+      glm::vec4 poly[4];
+      int n = 0;
+      for (int k = 0; k < 3; ++k)
+      {
+        const glm::vec4 &a = clip[k];
+        const glm::vec4 &b = clip[(k + 1) % 3];
+        float da = a.z + a.w;
+        float db = b.z + b.w;
+        if (da >= 0.0f)
+          poly[n++] = a;
+        if ((da >= 0.0f) != (db >= 0.0f))
+          poly[n++] = a + (b - a) * (da / (da - db));
+      }
+      if (n < 3)
+        continue;
+
+      glm::vec3 screen[4];
+      for (int k = 0; k < n; ++k)
+      {
+        float invW = 1.0f / std::max(poly[k].w, 1e-6f);
+        screen[k] = glm::vec3((poly[k].x * invW * 0.5f + 0.5f) * width,
+                              (poly[k].y * invW * 0.5f + 0.5f) * height,
+                              invW);
+      }
+
+      for (int f = 0; f + 2 < n; ++f)
+      {
+        ScreenTriangle &tri = f == 0 ? out0 : out1;
+        glm::vec3 v0 = screen[0], v1 = screen[f + 1], v2 = screen[f + 2];
+
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+        if (std::abs(area) < 1e-8f)
+          continue;
+        if (area < 0.0f)
+        {
+          std::swap(v1, v2); // 兩面都當 occluder, 統一成逆時針
+          area = -area;
+        }
+
+        tri.minX = std::max(0, (int)std::floor(std::min({v0.x, v1.x, v2.x})));
+        tri.maxX = std::min(width - 1, (int)std::ceil(std::max({v0.x, v1.x, v2.x})));
+        tri.minY = std::max(0, (int)std::floor(std::min({v0.y, v1.y, v2.y})));
+        tri.maxY = std::min(height - 1, (int)std::ceil(std::max({v0.y, v1.y, v2.y})));
+
+        const glm::vec3 *v[3] = {&v0, &v1, &v2};
+        for (int e = 0; e < 3; ++e)
+        {
+          const glm::vec3 &a = *v[e];
+          const glm::vec3 &b = *v[(e + 1) % 3];
+          tri.edgeA[e] = a.y - b.y;
+          tri.edgeB[e] = b.x - a.x;
+          tri.edgeC[e] = a.x * b.y - a.y * b.x;
+        }
+
+        // 1/w 在螢幕空間是線性的, 解平面方程式
+        tri.depthA = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+        tri.depthB = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+        tri.depthC = v0.z - tri.depthA * v0.x - tri.depthB * v0.y;
+      }
+    } });
+}
+
+void OcclusionCuller::rasterize_rows(int rowBegin, int rowEnd)
+{
+  float *depth = levels[0].data();
+  const float4 laneOffset(0.5f, 1.5f, 2.5f, 3.5f);
+  const float4 zero(0.0f);
+
+  for (const auto &tri : screenTriangles)
+  {
+    if (tri.minX > tri.maxX)
+      continue;
+    int y0 = std::max(tri.minY, rowBegin);
+    int y1 = std::min(tri.maxY, rowEnd - 1);
+    if (y0 > y1)
+      continue;
+
+    int x0 = tri.minX & ~3;
+    float4 A0(tri.edgeA[0]), A1(tri.edgeA[1]), A2(tri.edgeA[2]);
+    float4 dA(tri.depthA);
+
+    for (int y = y0; y <= y1; ++y)
+    {
+      float py = y + 0.5f;
+      float4 rowE0(tri.edgeB[0] * py + tri.edgeC[0]);
+      float4 rowE1(tri.edgeB[1] * py + tri.edgeC[1]);
+      float4 rowE2(tri.edgeB[2] * py + tri.edgeC[2]);
+      float4 rowZ(tri.depthB * py + tri.depthC);
+      float *row = depth + (size_t)y * width;
+
+      for (int x = x0; x <= tri.maxX; x += 4)
+      {
+        float4 px = float4((float)x) + laneOffset;
+        float4 e0 = A0 * px + rowE0;
+        float4 e1 = A1 * px + rowE1;
+        float4 e2 = A2 * px + rowE2;
+        float4 inside = mask_and(mask_and(cmp_ge(e0, zero), cmp_ge(e1, zero)), cmp_ge(e2, zero));
+        if (movemask(inside) == 0)
+          continue;
+
+        float4 z = dA * px + rowZ;
+        float4 stored = float4::load(row + x);
+        select(inside, max(stored, z), stored).store(row + x);
+      }
+    }
+  }
+}
+
+void OcclusionCuller::build_hiz()
+{
+  for (size_t l = 1; l < levels.size(); ++l)
+  {
+    const std::vector<float> &src = levels[l - 1];
+    std::vector<float> &dst = levels[l];
+    glm::ivec2 srcSize = levelSizes[l - 1];
+    glm::ivec2 dstSize = levelSizes[l];
+
+    for (int y = 0; y < dstSize.y; ++y)
+    {
+      int sy0 = std::min(y * 2, srcSize.y - 1);
+      int sy1 = std::min(y * 2 + 1, srcSize.y - 1);
+      for (int x = 0; x < dstSize.x; ++x)
+      {
+        int sx0 = std::min(x * 2, srcSize.x - 1);
+        int sx1 = std::min(x * 2 + 1, srcSize.x - 1);
+        // 存最遠 (1/w 最小) 的值: 保守
+        dst[(size_t)y * dstSize.x + x] = std::min({src[(size_t)sy0 * srcSize.x + sx0], src[(size_t)sy0 * srcSize.x + sx1],
+                                                   src[(size_t)sy1 * srcSize.x + sx0], src[(size_t)sy1 * srcSize.x + sx1]});
+      }
+    }
+  }
+}
+
+bool OcclusionCuller::is_visible(const glm::mat4 &viewProjection, const Mesh &mesh) const
+{
+  float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+  float nearestInvW = 0.0f;
+
+  for (int i = 0; i < 8; ++i)
+  {
+    glm::vec3 corner((i & 1) ? mesh.boundsMax.x : mesh.boundsMin.x,
+                     (i & 2) ? mesh.boundsMax.y : mesh.boundsMin.y,
+                     (i & 4) ? mesh.boundsMax.z : mesh.boundsMin.z);
+    glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+    // 有角落在 near plane 後面: 相機在 box 裡或緊貼, 直接當可見
+    if (clip.z + clip.w < 0.0f || clip.w <= 1e-6f)
+      return true;
+
+    float invW = 1.0f / clip.w;
+    float sx = (clip.x * invW * 0.5f + 0.5f) * width;
+    float sy = (clip.y * invW * 0.5f + 0.5f) * height;
+    minX = std::min(minX, sx);
+    maxX = std::max(maxX, sx);
+    minY = std::min(minY, sy);
+    maxY = std::max(maxY, sy);
+    nearestInvW = std::max(nearestInvW, invW);
+  }
+
+  // 完全在畫面外 (順便做 frustum culling)
+  if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+    return false;
+
+  int x0 = std::max(0, (int)std::floor(minX));
+  int x1 = std::min(width - 1, (int)std::floor(maxX));
+  int y0 = std::max(0, (int)std::floor(minY));
+  int y1 = std::min(height - 1, (int)std::floor(maxY));
+
+  // 選一層讓 rect 最多覆蓋 4x4 個 texel
+  int extent = std::max(x1 - x0 + 1, y1 - y0 + 1);
+  int level = 0;
+  while ((extent >> level) > 4 && level + 1 < (int)levels.size())
+    level++;
+
+  const std::vector<float> &hiz = levels[level];
+  int levelWidth = levelSizes[level].x;
+  for (int y = y0 >> level; y <= (y1 >> level); ++y)
+  {
+    for (int x = x0 >> level; x <= (x1 >> level); ++x)
+    {
+      // occluder 最遠的深度還比 box 最近的點遠 -> 可能看得到
+      if (hiz[(size_t)y * levelWidth + x] <= nearestInvW)
+        return true;
+    }
+  }
+  return false;
+}
+
+void OcclusionCuller::cull(const glm::mat4 &viewProjection, const std::vector<Mesh> &meshes,
+                           const std::vector<unsigned int> &candidates, std::vector<unsigned int> &visible)
+{
+  auto t0 = std::chrono::high_resolution_clock::now();
+
+  ThreadPool &pool = global_thread_pool();
+  setup_triangles(viewProjection);
+
+  // 畫面切成橫條, 每個 worker 負責自己的列, 不需要同步
+  std::fill(levels[0].begin(), levels[0].end(), 0.0f);
+  int bands = std::max(1, std::min((int)pool.size() * 2, height / 4));
+  int rowsPerBand = (height + bands - 1) / bands;
+  pool.parallel_for(bands, 1, [&](size_t begin, size_t end)
+                    {
+    for (size_t b = begin; b < end; ++b)
+      rasterize_rows(b * rowsPerBand, std::min(height, (int)(b + 1) * rowsPerBand)); });
+  build_hiz();
+
+  auto t1 = std::chrono::high_resolution_clock::now();
+
+  // occludee 測試也分給 worker, 結果先寫到 flag 再依原順序收集
+  std::vector<unsigned char> flags(candidates.size());
+  pool.parallel_for(candidates.size(), 64, [&](size_t begin, size_t end)
+                    {
+    for (size_t i = begin; i < end; ++i)
+      flags[i] = is_visible(viewProjection, meshes[candidates[i]]); });
+
+  visible.clear();
+  for (size_t i = 0; i < candidates.size(); ++i)
+  {
+    if (flags[i])
+      visible.push_back(candidates[i]);
+  }
+
+  auto t2 = std::chrono::high_resolution_clock::now();
+  lastTested = candidates.size();
+  lastCulled = candidates.size() - visible.size();
+  lastRasterMs = std::chrono::duration<float, std::milli>(t1 - t0).count();
+  lastTestMs = std::chrono::duration<float, std::milli>(t2 - t1).count();
+}
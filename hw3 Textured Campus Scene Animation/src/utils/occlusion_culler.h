@@ -0,0 +1,55 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "mesh.h"
+
+// ========== CPU 階層式 Z (Hi-Z) occlusion culling ==========
+// 1. 載入時挑出一小組大的 occluder 三角形
+// 2. 每幀用 SIMD 把 occluder 光柵化到低解析度深度緩衝 (分帶給 worker thread)
+// 3. 建 Hi-Z 金字塔 (每層存 2x2 裡最遠的深度)
+// 4. 每個 mesh 的 AABB 投影到螢幕, 在對應的 mip 層比較, 全被擋住就不送出
+// 深度存的是 1/w (螢幕空間線性, 越大越近), 0 代表沒有東西
+class OcclusionCuller
+{
+public:
+  int width = 256;  // 必須是 4 的倍數 (SIMD 一次處理 4 個像素)
+  int height = 128;
+  size_t occluderTriangleBudget = 4096;
+  float minOccluderArea = 0.0f; // 小於這個面積的三角形不當 occluder (0: 自動)
+
+  // 依面積挑 occluder: 只用不透明材質的三角形, 取面積最大的前 occluderTriangleBudget 個
+  void select_occluders(const std::vector<Mesh> &meshes);
+
+  // candidates 裡沒被擋住的 mesh 寫進 visible
+  void cull(const glm::mat4 &viewProjection, const std::vector<Mesh> &meshes,
+            const std::vector<unsigned int> &candidates, std::vector<unsigned int> &visible);
+
+  // 上一幀的統計
+  int lastTested = 0;
+  int lastCulled = 0;
+  float lastRasterMs = 0.0f;
+  float lastTestMs = 0.0f;
+
+private:
+  struct ScreenTriangle
+  {
+    int minX, maxX, minY, maxY;
+    float edgeA[3], edgeB[3], edgeC[3]; // E(x, y) = A x + B y + C, 內部 >= 0
+    float depthA, depthB, depthC;       // 1/w = A x + B y + C
+  };
+
+  void setup_triangles(const glm::mat4 &viewProjection);
+  void rasterize_rows(int rowBegin, int rowEnd);
+  void build_hiz();
+  bool is_visible(const glm::mat4 &viewProjection, const Mesh &mesh) const;
+
+  std::vector<glm::vec3> occluders; // 每 3 個一個三角形
+  std::vector<ScreenTriangle> screenTriangles;
+  std::vector<std::vector<float>> levels; // levels[0] 就是深度緩衝
+  std::vector<glm::ivec2> levelSizes;
+};
+
+#endif
@@ -0,0 +1,387 @@
+#include "path_tracer.h"
+#include "thread_pool.h"
+#include "../stb_image.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+
+static const float PI = 3.14159265f;
+// 反彈 / shadow ray 起點沿幾何法線推出去的距離 (跟 lightmap 一樣)
+static const float RAY_OFFSET = 1e-4f;
+// d < 1 的表面最多連續穿透幾次
+static const int MAX_TRANSPARENT_HOPS = 16;
+
+// PCG (O'Neill), 只取高 24 bit 轉成 [0, 1)
+float PathTracer::Random::next()
+{
+  state = state * 747796405u + 2891336453u;
+  uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  word = (word >> 22u) ^ word;
+  return (word >> 8) * (1.0f / 16777216.0f);
+}
+
+static uint32_t hash(uint32_t x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+// 跟 n 垂直的兩個軸
+static void orthonormal_basis(const glm::vec3 &n, glm::vec3 &t, glm::vec3 &b)
+{
+  glm::vec3 up = std::abs(n.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+  t = glm::normalize(glm::cross(up, n));
+  b = glm::cross(n, t);
+}
+
+// 以 axis 為中心, 機率密度正比於 cos^exponent 的方向 (exponent = 1 就是 cosine-weighted 半球)
+static glm::vec3 sample_lobe(const glm::vec3 &axis, float exponent, float u1, float u2)
+{
+  float cosTheta = std::pow(u1, 1.0f / (exponent + 1.0f));
+  float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+  float phi = 2.0f * PI * u2;
+  glm::vec3 t, b;
+  orthonormal_basis(axis, t, b);
+  return glm::normalize(t * (sinTheta * std::cos(phi)) + b * (sinTheta * std::sin(phi)) + axis * cosTheta);
+}
+
+static float luminance(const glm::vec3 &c)
+{
+  return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+}
+
+int PathTracer::load_texture(const std::string &path)
+{
+  int w, h, channels;
+  unsigned char *data = stbi_load(path.c_str(), &w, &h, &channels, 0);
+  if (!data)
+  {
+    std::cerr << "Path tracer: failed to load texture " << path << std::endl;
+    return -1;
+  }
+
+  // 跟 GL 一樣: 單通道是 (r, 0, 0), 沒有 alpha 就補 1
+  Texture texture;
+  texture.width = w;
+  texture.height = h;
+  texture.pixels.resize((size_t)w * h * 4);
+  for (size_t i = 0; i < (size_t)w * h; ++i)
+  {
+    const unsigned char *src = data + i * channels;
+    unsigned char *dst = &texture.pixels[i * 4];
+    dst[0] = src[0];
+    dst[1] = channels >= 2 ? src[1] : 0;
+    dst[2] = channels >= 3 ? src[2] : 0;
+    dst[3] = channels == 4 ? src[3] : 255;
+  }
+  stbi_image_free(data);
+  textures.push_back(std::move(texture));
+  return textures.size() - 1;
+}
+
+void PathTracer::build(const std::vector<Mesh> &meshes)
+{
+  release();
+  auto start = std::chrono::high_resolution_clock::now();
+
+  std::vector<unsigned int> subset;
+  for (unsigned int m = 0; m < meshes.size(); ++m)
+  {
+    if (meshes[m].material && !meshes[m].proxy)
+      subset.push_back(m);
+  }
+  bvh.build(meshes, subset);
+
+  std::map<std::string, int> loaded;
+  std::map<const Material *, int> materialIndex;
+  for (unsigned int m : subset)
+  {
+    const Material *source = meshes[m].material;
+    if (materialIndex.count(source))
+      continue;
+    MaterialData material;
+    material.Kd = source->Kd;
+    material.Ks = source->Ks;
+    material.Ke = source->Ke;
+    material.Ns = source->Ns > 1.0f ? source->Ns : 32.0f; // 跟 fragment.glsl 的 shininess 一樣
+    material.d = source->d;
+    if (!source->diffuseTexPath.empty())
+    {
+      auto it = loaded.find(source->diffuseTexPath);
+      if (it == loaded.end())
+        it = loaded.emplace(source->diffuseTexPath, load_texture(source->diffuseTexPath)).first;
+      material.diffuse = it->second;
+    }
+    materials.push_back(material);
+    materialIndex[source] = materials.size() - 1;
+  }
+
+  // BVH 排序後的順序存頂點法線與 uv; 法線乘 model 的 inverse transpose
+  std::map<unsigned int, glm::mat3> normalMatrices;
+  shading.resize(bvh.triangles.size());
+  for (size_t i = 0; i < bvh.triangles.size(); ++i)
+  {
+    const BvhTriangle &tri = bvh.triangles[i];
+    const Mesh &mesh = meshes[tri.mesh];
+    auto it = normalMatrices.find(tri.mesh);
+    if (it == normalMatrices.end())
+      it = normalMatrices.emplace(tri.mesh, glm::transpose(glm::inverse(glm::mat3(mesh.transform)))).first;
+    const float *v = &mesh.vertices[(size_t)tri.primitive * 3 * VERTEX_STRIDE];
+    Shading &s = shading[i];
+    s.n0 = it->second * glm::vec3(v[5], v[6], v[7]);
+    s.n1 = it->second * glm::vec3(v[VERTEX_STRIDE + 5], v[VERTEX_STRIDE + 6], v[VERTEX_STRIDE + 7]);
+    s.n2 = it->second * glm::vec3(v[2 * VERTEX_STRIDE + 5], v[2 * VERTEX_STRIDE + 6], v[2 * VERTEX_STRIDE + 7]);
+    s.uv0 = glm::vec2(v[3], v[4]);
+    s.uv1 = glm::vec2(v[VERTEX_STRIDE + 3], v[VERTEX_STRIDE + 4]);
+    s.uv2 = glm::vec2(v[2 * VERTEX_STRIDE + 3], v[2 * VERTEX_STRIDE + 4]);
+    s.material = materialIndex[mesh.material];
+  }
+
+  buildMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+  std::cout << "Path tracer: " << bvh.triangles.size() << " triangles, " << bvh.nodes.size() << " BVH nodes, "
+            << materials.size() << " materials, " << textures.size() << " textures, built in " << buildMs << " ms on "
+            << global_thread_pool().size() << " threads" << std::endl;
+}
+
+void PathTracer::release()
+{
+  bvh = Bvh();
+  shading.clear();
+  materials.clear();
+  textures.clear();
+  accumulation.clear();
+  color.clear();
+  width = height = 0;
+  sampleCount = 0;
+}
+
+// 貼圖是 bilinear + GL_REPEAT (不用 mipmap: 每個像素本來就有很多 sample 平均)
+glm::vec3 PathTracer::albedo(const MaterialData &material, const glm::vec2 &uv) const
+{
+  if (material.diffuse < 0)
+    return glm::length(material.Kd) > 0.01f ? material.Kd : glm::vec3(0.8f);
+
+  const Texture &texture = textures[material.diffuse];
+  float x = uv.x * texture.width - 0.5f, y = uv.y * texture.height - 0.5f;
+  float fx = std::floor(x), fy = std::floor(y);
+  float tx = x - fx, ty = y - fy;
+  auto wrap = [](int i, int size) { return ((i % size) + size) % size; };
+  int x0 = wrap((int)fx, texture.width), x1 = wrap((int)fx + 1, texture.width);
+  int y0 = wrap((int)fy, texture.height), y1 = wrap((int)fy + 1, texture.height);
+  auto texel = [&](int px, int py)
+  {
+    const unsigned char *p = &texture.pixels[((size_t)py * texture.width + px) * 4];
+    return glm::vec3(p[0], p[1], p[2]);
+  };
+  glm::vec3 top = glm::mix(texel(x0, y0), texel(x1, y0), tx);
+  glm::vec3 bottom = glm::mix(texel(x0, y1), texel(x1, y1), tx);
+  return glm::mix(top, bottom, ty) / 255.0f;
+}
+
+glm::vec3 PathTracer::trace(glm::vec3 origin, glm::vec3 direction, Hit hit, Random &random, uint64_t &rays) const
+{
+  glm::vec3 radiance(0.0f), throughput(1.0f);
+  int bounce = 0, hops = 0;
+  while (true)
+  {
+    if (!hit.valid())
+    {
+      radiance += throughput * (bounce == 0 ? backgroundColor : skyColor);
+      break;
+    }
+
+    const BvhTriangle &tri = bvh.triangles[hit.triangle];
+    const Shading &s = shading[hit.triangle];
+    const MaterialData &material = materials[s.material];
+    glm::vec3 p = origin + direction * hit.t;
+
+    // 半透明: 依 d 的機率決定停在這裡還是直接穿過去
+    if (material.d < 1.0f && random.next() >= material.d && hops < MAX_TRANSPARENT_HOPS)
+    {
+      ++hops;
+      Ray ray;
+      ray.origin = p + direction * RAY_OFFSET;
+      ray.direction = direction;
+      origin = ray.origin;
+      hit = Hit();
+      bvh.intersect(ray, hit);
+      ++rays;
+      continue;
+    }
+
+    // 幾何法線朝向來的方向, 內插法線放到同一側
+    glm::vec3 ng = glm::cross(tri.p1 - tri.p0, tri.p2 - tri.p0);
+    ng = glm::length(ng) > 1e-12f ? glm::normalize(ng) : -direction;
+    if (glm::dot(ng, direction) > 0.0f)
+      ng = -ng;
+    float w = 1.0f - hit.u - hit.v;
+    glm::vec3 n = s.n0 * w + s.n1 * hit.u + s.n2 * hit.v;
+    n = glm::length(n) > 1e-12f ? glm::normalize(n) : ng;
+    if (glm::dot(n, ng) < 0.0f)
+      n = -n;
+    glm::vec2 uv = s.uv0 * w + s.uv1 * hit.u + s.uv2 * hit.v;
+    glm::vec3 kd = albedo(material, uv);
+    glm::vec3 view = -direction;
+    glm::vec3 start = p + ng * RAY_OFFSET;
+
+    radiance += throughput * material.Ke;
+
+    // 主光源 (點光源, 沒有衰減): radiance = BRDF x pi x lightColor x cos
+    glm::vec3 toLight = frameLightPos - p;
+    float distance = glm::length(toLight);
+    glm::vec3 l = toLight / distance;
+    float ndl = glm::dot(n, l);
+    if (ndl > 0.0f && glm::dot(ng, l) > 0.0f)
+    {
+      Ray shadow;
+      shadow.origin = start;
+      shadow.direction = l;
+      shadow.tMax = distance;
+      ++rays;
+      if (!bvh.occluded(shadow))
+      {
+        float spec = std::pow(std::max(glm::dot(glm::reflect(-l, n), view), 0.0f), material.Ns);
+        glm::vec3 brdf = kd + material.Ks * ((material.Ns + 2.0f) * 0.5f * spec);
+        radiance += throughput * brdf * frameLightColor * ndl;
+      }
+    }
+
+    if (bounce >= maxBounces)
+      break;
+
+    // 下一個方向: 依 diffuse / specular 的亮度比例選一個 lobe 取樣, pdf 用兩個 lobe 的混合
+    float diffuseWeight = luminance(kd), specularWeight = luminance(material.Ks);
+    float pSpecular = specularWeight > 0.0f ? specularWeight / (diffuseWeight + specularWeight) : 0.0f;
+    glm::vec3 mirror = glm::reflect(direction, n);
+    float u1 = random.next(), u2 = random.next();
+    glm::vec3 next = random.next() < pSpecular ? sample_lobe(mirror, material.Ns, u1, u2) : sample_lobe(n, 1.0f, u1, u2);
+    float cosTheta = glm::dot(n, next);
+    if (cosTheta <= 0.0f || glm::dot(ng, next) <= 0.0f)
+      break;
+    float lobe = std::pow(std::max(glm::dot(mirror, next), 0.0f), material.Ns);
+    float pdf = (1.0f - pSpecular) * cosTheta / PI + pSpecular * (material.Ns + 1.0f) / (2.0f * PI) * lobe;
+    if (pdf <= 0.0f)
+      break;
+    glm::vec3 brdf = kd / PI + material.Ks * ((material.Ns + 2.0f) / (2.0f * PI) * lobe);
+    throughput *= brdf * (cosTheta / pdf);
+
+    // 3 次反彈以後 Russian roulette
+    if (++bounce >= 3)
+    {
+      float survive = std::min(0.95f, std::max({throughput.r, throughput.g, throughput.b}));
+      if (random.next() >= survive)
+        break;
+      throughput /= survive;
+    }
+
+    Ray ray;
+    ray.origin = start;
+    ray.direction = next;
+    origin = start;
+    direction = next;
+    hit = Hit();
+    bvh.intersect(ray, hit);
+    ++rays;
+  }
+  return radiance;
+}
+
+void PathTracer::render_tile(int tile, int samples, uint64_t &rays)
+{
+  int tilesX = (width + TILE - 1) / TILE;
+  int x0 = (tile % tilesX) * TILE, y0 = (tile / tilesX) * TILE;
+  int x1 = std::min(width, x0 + TILE), y1 = std::min(height, y0 + TILE);
+
+  for (int s = 0; s < samples; ++s)
+  {
+    uint32_t sampleSeed = hash(sampleCount + s + 1);
+    for (int y = y0; y < y1; y += 2)
+    {
+      for (int x = x0; x < x1; x += 2)
+      {
+        // 2x2 像素一組; 超出畫面的 lane 還是照算 (用夾住的座標), 結果丟掉
+        Random random[4];
+        glm::vec3 directions[4];
+        int pixels[4];
+        for (int lane = 0; lane < 4; ++lane)
+        {
+          int px = std::min(x + (lane & 1), width - 1), py = std::min(y + (lane >> 1), height - 1);
+          pixels[lane] = (x + (lane & 1) < width && y + (lane >> 1) < height) ? py * width + px : -1;
+          random[lane].state = hash((uint32_t)(py * width + px) ^ sampleSeed);
+          float jx = random[lane].next(), jy = random[lane].next();
+          glm::vec4 target = inverseViewProjection * glm::vec4((px + jx) / width * 2.0f - 1.0f,
+                                                               (py + jy) / height * 2.0f - 1.0f, 1.0f, 1.0f);
+          directions[lane] = glm::normalize(glm::vec3(target) / target.w - frameViewPos);
+        }
+        Hit hits[4];
+        bvh.intersect4(frameViewPos, directions, 1e-5f, hits);
+        for (int lane = 0; lane < 4; ++lane)
+        {
+          if (pixels[lane] < 0)
+            continue;
+          ++rays;
+          accumulation[pixels[lane]] += trace(frameViewPos, directions[lane], hits[lane], random[lane], rays);
+        }
+      }
+    }
+  }
+
+  // 平均後直接夾到 [0, 1] (跟即時打光一樣沒有 tone mapping)
+  float scale = 1.0f / (sampleCount + samples);
+  for (int y = y0; y < y1; ++y)
+  {
+    for (int x = x0; x < x1; ++x)
+    {
+      glm::vec3 c = glm::clamp(accumulation[(size_t)y * width + x] * scale, 0.0f, 1.0f);
+      unsigned char *dst = &color[((size_t)y * width + x) * 4];
+      dst[0] = (unsigned char)(c.r * 255.0f + 0.5f);
+      dst[1] = (unsigned char)(c.g * 255.0f + 0.5f);
+      dst[2] = (unsigned char)(c.b * 255.0f + 0.5f);
+      dst[3] = 255;
+    }
+  }
+}
+
+void PathTracer::render(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &viewPos,
+                        const glm::vec3 &lightPos, const glm::vec3 &lightColor, int w, int h, int samples)
+{
+  if (w != width || h != height || view != frameView || projection != frameProjection || lightPos != frameLightPos ||
+      lightColor != frameLightColor)
+  {
+    width = w;
+    height = h;
+    frameView = view;
+    frameProjection = projection;
+    frameViewPos = viewPos;
+    frameLightPos = lightPos;
+    frameLightColor = lightColor;
+    inverseViewProjection = glm::inverse(projection * view);
+    accumulation.assign((size_t)width * height, glm::vec3(0.0f));
+    color.resize((size_t)width * height * 4);
+    sampleCount = 0;
+  }
+  else if (sampleCount == 0)
+    std::fill(accumulation.begin(), accumulation.end(), glm::vec3(0.0f));
+
+  auto start = std::chrono::high_resolution_clock::now();
+  int tileCount = ((width + TILE - 1) / TILE) * ((height + TILE - 1) / TILE);
+  std::atomic<uint64_t> totalRays{0};
+  global_thread_pool().parallel_for(tileCount, 1, [&](size_t begin, size_t end)
+  {
+    uint64_t rays = 0;
+    for (size_t tile = begin; tile < end; ++tile)
+      render_tile(tile, samples, rays);
+    totalRays += rays;
+  });
+  sampleCount += samples;
+  lastRays = totalRays;
+  lastMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
@@ -0,0 +1,92 @@
+#ifndef PATH_TRACER_H
+#define PATH_TRACER_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bvh.h"
+#include "mesh.h"
+
+// ========== CPU path tracer (對照用的參考影像) ==========
+// 用來檢查即時打光的改動, 以及輸出各個 SchoolScene 版本的 ground truth:
+// - 全部 mesh 的三角形建一棵 binned SAH BVH (Bvh::build, 子樹平行建)
+// - primary ray 以 2x2 像素為一組, 同一個相機原點, 用 Bvh::intersect4 一次走 4 條; 之後的反彈各走各的
+// - 材質: 貼圖或 Kd 的 Lambert + Ks / Ns 的 normalized Phong, 打到 Ke 就加上自發光, d < 1 的隨機穿透
+// - 光源: 主光源 (跟即時打光一樣沒有距離衰減, next event estimation + shadow ray), 反彈後沒打到東西是 skyColor;
+//   亮度的尺度跟 lightmap 一樣 (radiance 已經除掉 pi), 沒有遮蔽的平面就等於即時打光的 0.3 ambient + diffuse
+// - 畫面切成 TILE x TILE 的 tile 分給 thread pool; 相機不動就繼續累加, 每次 render 多 samples 個 sample
+// 亂數只跟 (像素, sample 編號) 有關, 結果不受 thread 數影響
+class PathTracer
+{
+public:
+  static constexpr int TILE = 16;
+
+  void build(const std::vector<Mesh> &meshes);
+  // 相機或大小變了就重新累積
+  void render(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &viewPos, const glm::vec3 &lightPos,
+              const glm::vec3 &lightColor, int width, int height, int samples);
+  void reset() { sampleCount = 0; }
+  void release();
+
+  int maxBounces = 4;              // 第幾次反彈後停止 (3 次以後開始 Russian roulette)
+  glm::vec3 skyColor{0.3f};        // 跟 lightmap 一樣對應即時打光的 0.3 ambient
+  glm::vec3 backgroundColor{0.4f}; // 還沒反彈就沒打到東西 (跟 glClearColor 一樣)
+
+  std::vector<unsigned char> color; // width * height * 4, 由下往上 (跟 glReadPixels 一樣)
+  int width = 0, height = 0;
+  int sampleCount = 0;              // 目前每個像素累積的 sample 數
+
+  // ---------- 上一次 render 的統計 ----------
+  uint64_t lastRays = 0; // primary + 反彈 + shadow ray
+  float lastMs = 0.0f;
+  float buildMs = 0.0f;
+
+private:
+  struct Texture
+  {
+    std::vector<unsigned char> pixels; // RGBA8, 第 0 列是 uv 的 v = 0
+    int width = 0, height = 0;
+  };
+
+  struct MaterialData
+  {
+    glm::vec3 Kd, Ks, Ke;
+    float Ns, d;
+    int diffuse = -1; // textures 的 index
+  };
+
+  // 依 BVH 排序後的三角形順序存的頂點屬性
+  struct Shading
+  {
+    glm::vec3 n0, n1, n2;
+    glm::vec2 uv0, uv1, uv2;
+    int material;
+  };
+
+  struct Random
+  {
+    uint32_t state;
+    float next();
+  };
+
+  int load_texture(const std::string &path);
+  glm::vec3 albedo(const MaterialData &material, const glm::vec2 &uv) const;
+  // 從 primary hit 開始走完一條 path, 回傳 radiance; rays 累加這條 path 用掉的 ray 數
+  glm::vec3 trace(glm::vec3 origin, glm::vec3 direction, Hit hit, Random &random, uint64_t &rays) const;
+  void render_tile(int tile, int samples, uint64_t &rays);
+
+  Bvh bvh;
+  std::vector<Shading> shading;
+  std::vector<MaterialData> materials;
+  std::vector<Texture> textures;
+  std::vector<glm::vec3> accumulation; // 每個像素的 radiance 總和
+
+  // 這次累積用的相機與光源
+  glm::mat4 frameView{0.0f}, frameProjection{0.0f};
+  glm::mat4 inverseViewProjection{1.0f};
+  glm::vec3 frameViewPos{0.0f}, frameLightPos{0.0f}, frameLightColor{0.0f};
+};
+
+#endif
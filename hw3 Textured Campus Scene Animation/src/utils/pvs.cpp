@@ -0,0 +1,220 @@
+#include "pvs.h"
+#include "bvh.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+
+static const char PVS_MAGIC[4] = {'P', 'V', 'S', '1'};
+
+static bool is_transparent(const Mesh &mesh)
+{
+  return mesh.material && (mesh.material->d < 0.99f || !mesh.material->alphaTexPath.empty());
+}
+
+void PotentiallyVisibleSet::bake(const std::vector<Mesh> &meshes)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  Bvh bvh;
+  bvh.build(meshes);
+  cellRows.clear();
+  rows.clear();
+  if (bvh.nodes.empty())
+    return;
+
+  // ---------- 格子: 以水平最長邊決定格子大小 ----------
+  glm::vec3 extent = bvh.sceneMax - bvh.sceneMin;
+  cellSize = std::max(std::max(extent.x, extent.z), 1e-4f) / cellsPerAxis;
+  gridMin = bvh.sceneMin;
+  gridSize = glm::max(glm::ivec3(glm::ceil(extent / cellSize)), glm::ivec3(1));
+  meshCount = meshes.size();
+  meshChecksum = mesh_checksum(meshes);
+  wordsPerRow = (meshCount + 63) / 64;
+
+  size_t cellCount = (size_t)gridSize.x * gridSize.y * gridSize.z;
+  std::vector<std::vector<uint64_t>> cellBits(cellCount);
+
+  global_thread_pool().parallel_for(cellCount, 1, [&](size_t begin, size_t end)
+  {
+    for (size_t cell = begin; cell < end; ++cell)
+    {
+      std::vector<uint64_t> &bits = cellBits[cell];
+      bits.assign(wordsPerRow, 0);
+      auto mark = [&bits](unsigned int mesh)
+      { bits[mesh / 64] |= 1ull << (mesh % 64); };
+
+      glm::ivec3 c((int)(cell % gridSize.x), (int)(cell / gridSize.x % gridSize.y),
+                   (int)(cell / ((size_t)gridSize.x * gridSize.y)));
+      glm::vec3 cellMin = gridMin + glm::vec3(c) * cellSize;
+      glm::vec3 cellMax = cellMin + cellSize;
+
+      // 跟格子重疊的 mesh 一定算可見 (相機可能就站在它裡面)
+      for (unsigned int m = 0; m < meshCount; ++m)
+      {
+        if (glm::all(glm::lessThanEqual(meshes[m].boundsMin, cellMax)) &&
+            glm::all(glm::greaterThanEqual(meshes[m].boundsMax, cellMin)))
+          mark(m);
+      }
+
+      // 每格固定 seed, 重烘結果一樣
+      std::mt19937 rng((unsigned int)cell * 9781u + 6271u);
+      std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+      for (int s = 0; s < samplesPerCell; ++s)
+      {
+        glm::vec3 jitter(uniform(rng), uniform(rng), uniform(rng));
+        glm::vec3 origin = cellMin + jitter * cellSize;
+        float phase = uniform(rng);
+
+        // spherical Fibonacci 方向, 每個取樣點轉一個隨機相位
+        for (int r = 0; r < raysPerSample; ++r)
+        {
+          float z = 1.0f - 2.0f * (r + uniform(rng)) / raysPerSample;
+          float radius = std::sqrt(std::max(0.0f, 1.0f - z * z));
+          float phi = 6.28318531f * (r * 0.618033989f + phase);
+          Ray ray;
+          ray.origin = origin;
+          ray.direction = glm::vec3(radius * std::cos(phi), z, radius * std::sin(phi));
+
+          for (int layer = 0; layer <= maxTransparentHits; ++layer)
+          {
+            Hit hit;
+            if (!bvh.intersect(ray, hit))
+              break;
+            unsigned int mesh = bvh.triangles[hit.triangle].mesh;
+            mark(mesh);
+            if (!is_transparent(meshes[mesh]))
+              break;
+            ray.tMin = hit.t + 1e-5f;
+          }
+        }
+      }
+    }
+  });
+
+  // ---------- 相同的 bitset 只存一份 ----------
+  std::map<std::vector<uint64_t>, uint32_t> unique;
+  cellRows.resize(cellCount);
+  size_t visibleSum = 0;
+  for (size_t cell = 0; cell < cellCount; ++cell)
+  {
+    auto it = unique.find(cellBits[cell]);
+    if (it == unique.end())
+    {
+      it = unique.emplace(cellBits[cell], (uint32_t)unique.size()).first;
+      rows.insert(rows.end(), cellBits[cell].begin(), cellBits[cell].end());
+    }
+    cellRows[cell] = it->second;
+    for (uint64_t word : cellBits[cell])
+      visibleSum += std::popcount(word);
+  }
+
+  float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "PVS: " << gridSize.x << "x" << gridSize.y << "x" << gridSize.z << " cells, "
+            << unique.size() << " unique sets, avg " << (meshCount ? 100.0f * visibleSum / cellCount / meshCount : 0.0f)
+            << "% visible, " << seconds << " s on " << global_thread_pool().size() << " threads" << std::endl;
+}
+
+bool PotentiallyVisibleSet::save(const std::string &path) const
+{
+  std::ofstream file(path, std::ios::binary);
+  if (!file)
+  {
+    std::cerr << "Failed to write PVS: " << path << std::endl;
+    return false;
+  }
+  uint32_t cellCount = cellRows.size();
+  uint32_t rowCount = wordsPerRow ? rows.size() / wordsPerRow : 0;
+  file.write(PVS_MAGIC, sizeof(PVS_MAGIC));
+  file.write((const char *)&meshCount, sizeof(meshCount));
+  file.write((const char *)&meshChecksum, sizeof(meshChecksum));
+  file.write((const char *)&gridMin, sizeof(gridMin));
+  file.write((const char *)&cellSize, sizeof(cellSize));
+  file.write((const char *)&gridSize, sizeof(gridSize));
+  file.write((const char *)&wordsPerRow, sizeof(wordsPerRow));
+  file.write((const char *)&cellCount, sizeof(cellCount));
+  file.write((const char *)&rowCount, sizeof(rowCount));
+  file.write((const char *)cellRows.data(), cellRows.size() * sizeof(uint32_t));
+  file.write((const char *)rows.data(), rows.size() * sizeof(uint64_t));
+  std::cout << "PVS saved: " << path << std::endl;
+  return (bool)file;
+}
+
+bool PotentiallyVisibleSet::load(const std::string &path, const std::vector<Mesh> &meshes)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+
+  char magic[4];
+  uint32_t cellCount = 0, rowCount = 0;
+  file.read(magic, sizeof(magic));
+  file.read((char *)&meshCount, sizeof(meshCount));
+  file.read((char *)&meshChecksum, sizeof(meshChecksum));
+  file.read((char *)&gridMin, sizeof(gridMin));
+  file.read((char *)&cellSize, sizeof(cellSize));
+  file.read((char *)&gridSize, sizeof(gridSize));
+  file.read((char *)&wordsPerRow, sizeof(wordsPerRow));
+  file.read((char *)&cellCount, sizeof(cellCount));
+  file.read((char *)&rowCount, sizeof(rowCount));
+  if (!file || std::memcmp(magic, PVS_MAGIC, sizeof(magic)) != 0 ||
+      meshCount != meshes.size() || meshChecksum != mesh_checksum(meshes) ||
+      cellCount != (size_t)gridSize.x * gridSize.y * gridSize.z || wordsPerRow != (meshCount + 63) / 64)
+  {
+    std::cout << "PVS out of date, ignoring: " << path << std::endl;
+    cellRows.clear();
+    rows.clear();
+    return false;
+  }
+
+  cellRows.resize(cellCount);
+  rows.resize((size_t)rowCount * wordsPerRow);
+  file.read((char *)cellRows.data(), cellRows.size() * sizeof(uint32_t));
+  file.read((char *)rows.data(), rows.size() * sizeof(uint64_t));
+  if (!file || std::any_of(cellRows.begin(), cellRows.end(), [rowCount](uint32_t r)
+                           { return r >= rowCount; }))
+  {
+    std::cerr << "PVS file truncated: " << path << std::endl;
+    cellRows.clear();
+    rows.clear();
+    return false;
+  }
+  std::cout << "PVS loaded: " << cellCount << " cells, " << rowCount << " unique sets" << std::endl;
+  return true;
+}
+
+int PotentiallyVisibleSet::cell_index(const glm::vec3 &p) const
+{
+  glm::ivec3 c = glm::ivec3(glm::floor((p - gridMin) / cellSize));
+  if (glm::any(glm::lessThan(c, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(c, gridSize)))
+    return -1;
+  return (c.z * gridSize.y + c.y) * gridSize.x + c.x;
+}
+
+void PotentiallyVisibleSet::filter(const glm::vec3 &eye, const std::vector<unsigned int> &candidates,
+                                   std::vector<unsigned int> &visible)
+{
+  lastCell = empty() ? -1 : cell_index(eye);
+  if (lastCell < 0)
+  {
+    visible = candidates;
+    lastRejected = 0;
+    return;
+  }
+
+  int row = cellRows[lastCell];
+  visible.clear();
+  for (unsigned int mesh : candidates)
+  {
+    if (mesh >= meshCount || is_visible(row, mesh))
+      visible.push_back(mesh);
+  }
+  lastRejected = candidates.size() - visible.size();
+}
@@ -0,0 +1,59 @@
+#ifndef PVS_H
+#define PVS_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+// ========== 預先計算的可見集合 (Potentially Visible Set) ==========
+// 場景是靜態的, 所以離線把可走動的空間切成一格一格的 view cell,
+// 每格撒幾個取樣點往四面八方打 ray, 被打到的 mesh 就記成「這格看得到」.
+// 結果每格一個 bitset (相同的 bitset 只存一份), 存在 obj 旁邊的 .pvs 檔.
+// 執行時查相機所在的格子, 只送出那格的可見集合; 在烘焙範圍外就全部送出 (保守)
+class PotentiallyVisibleSet
+{
+public:
+  // 烘焙參數
+  int cellsPerAxis = 24;      // 水平最長邊切幾格 (格子是正立方體)
+  int samplesPerCell = 16;    // 每格的取樣點數
+  int raysPerSample = 1024;   // 每個取樣點打幾條 ray
+  int maxTransparentHits = 4; // 穿過半透明材質的次數上限
+
+  // 用全部 CPU 核心烘焙 (meshes 的 index 要跟執行時一致)
+  void bake(const std::vector<Mesh> &meshes);
+
+  bool save(const std::string &path) const;
+  // meshes 跟烘焙時不一致 (換了模型或切法) 就回傳 false
+  bool load(const std::string &path, const std::vector<Mesh> &meshes);
+
+  bool empty() const { return cellRows.empty(); }
+
+  // candidates 裡在相機那格可見的 mesh 寫進 visible; 不在範圍內就全部照抄
+  void filter(const glm::vec3 &eye, const std::vector<unsigned int> &candidates,
+              std::vector<unsigned int> &visible);
+
+  // 上一次 filter 的統計
+  int lastCell = -1; // -1: 在範圍外 (fallback)
+  int lastRejected = 0;
+
+private:
+  int cell_index(const glm::vec3 &p) const;
+  bool is_visible(int row, unsigned int mesh) const
+  {
+    return (rows[(size_t)row * wordsPerRow + mesh / 64] >> (mesh % 64)) & 1u;
+  }
+
+  glm::vec3 gridMin{0.0f};
+  float cellSize = 1.0f;
+  glm::ivec3 gridSize{0};
+  unsigned int meshCount = 0;
+  uint64_t meshChecksum = 0;
+  unsigned int wordsPerRow = 0;
+  std::vector<uint32_t> cellRows; // 每格對應到 rows 裡的第幾列
+  std::vector<uint64_t> rows;     // 去重後的 bitset, 每列 wordsPerRow 個 word
+};
+
+#endif
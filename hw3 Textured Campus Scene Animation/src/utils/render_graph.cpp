@@ -0,0 +1,477 @@
+#include "render_graph.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+// internal format -> glTexImage2D 要的 format / type 與每個 texel 的 bytes
+static bool format_info(unsigned int internalFormat, GLenum &format, GLenum &type, int &bytes)
+{
+  switch (internalFormat)
+  {
+  case GL_RGBA8:
+    format = GL_RGBA, type = GL_UNSIGNED_BYTE, bytes = 4;
+    return true;
+  case GL_RGB10_A2:
+    format = GL_RGBA, type = GL_UNSIGNED_INT_2_10_10_10_REV, bytes = 4;
+    return true;
+  case GL_R11F_G11F_B10F:
+    format = GL_RGB, type = GL_FLOAT, bytes = 4;
+    return true;
+  case GL_RGBA16F:
+    format = GL_RGBA, type = GL_FLOAT, bytes = 8;
+    return true;
+  case GL_RG16F:
+    format = GL_RG, type = GL_FLOAT, bytes = 4;
+    return true;
+  case GL_R32F:
+    format = GL_RED, type = GL_FLOAT, bytes = 4;
+    return true;
+  case GL_R32UI:
+    format = GL_RED_INTEGER, type = GL_UNSIGNED_INT, bytes = 4;
+    return true;
+  case GL_RG16UI:
+    format = GL_RG_INTEGER, type = GL_UNSIGNED_SHORT, bytes = 4;
+    return true;
+  case GL_DEPTH_COMPONENT24:
+    format = GL_DEPTH_COMPONENT, type = GL_UNSIGNED_INT, bytes = 4;
+    return true;
+  case GL_DEPTH_COMPONENT32F:
+    format = GL_DEPTH_COMPONENT, type = GL_FLOAT, bytes = 4;
+    return true;
+  case GL_DEPTH24_STENCIL8:
+    format = GL_DEPTH_STENCIL, type = GL_UNSIGNED_INT_24_8, bytes = 4;
+    return true;
+  }
+  return false;
+}
+
+static int texel_bytes(unsigned int internalFormat)
+{
+  GLenum format, type;
+  int bytes = 0;
+  format_info(internalFormat, format, type, bytes);
+  return bytes;
+}
+
+static bool is_depth_format(unsigned int internalFormat)
+{
+  return internalFormat == GL_DEPTH_COMPONENT24 || internalFormat == GL_DEPTH_COMPONENT32F ||
+         internalFormat == GL_DEPTH24_STENCIL8;
+}
+
+void RenderGraph::begin_frame(int width, int height)
+{
+  resources.clear();
+  passes.clear();
+  backbufferWidth = width;
+  backbufferHeight = height;
+
+  Resource backbuffer;
+  backbuffer.name = "backbuffer";
+  backbuffer.width = width;
+  backbuffer.height = height;
+  resources.push_back(backbuffer);
+}
+
+RenderGraph::Handle RenderGraph::create_texture(const std::string &name, const TextureDesc &desc)
+{
+  Resource resource;
+  resource.name = name;
+  resource.desc = desc;
+  resource.width = desc.width > 0 ? desc.width : std::max(1, (int)(backbufferWidth * desc.scale));
+  resource.height = desc.height > 0 ? desc.height : std::max(1, (int)(backbufferHeight * desc.scale));
+  resources.push_back(resource);
+  return (Handle)resources.size() - 1;
+}
+
+void RenderGraph::add_pass(const std::string &name, const PassDesc &desc, ExecuteFunc execute)
+{
+  Pass pass;
+  pass.name = name;
+  pass.desc = desc;
+  pass.execute = std::move(execute);
+  passes.push_back(std::move(pass));
+}
+
+void RenderGraph::add_blit_pass(const std::string &name, Handle source, Handle destination)
+{
+  PassDesc desc;
+  desc.reads = {source};
+  desc.colors = {destination};
+  add_pass(name, desc, [this, name, source, destination](const RenderGraph &)
+  {
+    // 只有 color 的 FBO (destination 是 backbuffer 時是 0); 第一次建立時會改到綁定, 所以兩個都取完再綁
+    unsigned int readFramebuffer = framebuffer_for({source}, -1, name);
+    unsigned int drawFramebuffer = framebuffer_for({destination}, -1, name);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+    glBlitFramebuffer(0, 0, width(source), height(source), 0, 0, width(destination), height(destination),
+                      GL_COLOR_BUFFER_BIT, width(source) == width(destination) && height(source) == height(destination) ? GL_NEAREST : GL_LINEAR);
+  });
+}
+
+// 從寫到 backbuffer 或有 sideEffect 的 pass 往回推, reference count 歸零的 pass 剔除
+void RenderGraph::cull()
+{
+  culledPasses = 0;
+  for (Resource &resource : resources)
+    resource.readers = 0, resource.writer = -1;
+
+  for (int p = 0; p < (int)passes.size(); ++p)
+  {
+    Pass &pass = passes[p];
+    pass.culled = false;
+    // 讀了還沒有人寫的 resource: 宣告順序錯了
+    for (Handle handle : pass.desc.reads)
+    {
+      if (handle != BACKBUFFER && resources[handle].writer < 0)
+      {
+        std::cerr << "Render graph: pass " << pass.name << " reads " << resources[handle].name
+                  << " before it is written, skipping" << std::endl;
+        pass.culled = true;
+      }
+    }
+    if (pass.culled)
+      continue;
+    for (Handle handle : pass.desc.reads)
+      resources[handle].readers++;
+    pass.references = pass.desc.sideEffect ? 1 : 0;
+    std::vector<Handle> writes = pass.desc.colors;
+    if (pass.desc.depth >= 0)
+      writes.push_back(pass.desc.depth);
+    for (Handle handle : writes)
+    {
+      resources[handle].writer = p;
+      if (handle == BACKBUFFER)
+        pass.references++;
+    }
+  }
+
+  // 每個 pass 的 reference = 寫出去、之後有人讀的 resource 數
+  for (int p = 0; p < (int)passes.size(); ++p)
+  {
+    Pass &pass = passes[p];
+    if (pass.culled)
+      continue;
+    std::vector<Handle> writes = pass.desc.colors;
+    if (pass.desc.depth >= 0)
+      writes.push_back(pass.desc.depth);
+    for (Handle handle : writes)
+    {
+      if (handle != BACKBUFFER && resources[handle].readers > 0)
+        pass.references++;
+    }
+  }
+
+  // 由後往前: 沒有 reference 的 pass 剔除, 並把它讀的 resource 的 reader 減掉
+  for (int p = (int)passes.size() - 1; p >= 0; --p)
+  {
+    Pass &pass = passes[p];
+    if (!pass.culled && pass.references == 0)
+    {
+      pass.culled = true;
+      for (Handle handle : pass.desc.reads)
+      {
+        if (handle == BACKBUFFER || --resources[handle].readers > 0)
+          continue;
+        // 最後一個 reader 也沒了, 寫它的 pass 少一個 reference
+        for (int q = p - 1; q >= 0; --q)
+        {
+          const PassDesc &desc = passes[q].desc;
+          if (std::find(desc.colors.begin(), desc.colors.end(), handle) != desc.colors.end() || desc.depth == handle)
+          {
+            passes[q].references--;
+            break;
+          }
+        }
+      }
+    }
+    if (pass.culled)
+      ++culledPasses;
+  }
+}
+
+int RenderGraph::acquire(const Resource &resource)
+{
+  for (int i = 0; i < (int)pool.size(); ++i)
+  {
+    PhysicalTexture &physical = pool[i];
+    if (!physical.busy && physical.format == resource.desc.format && physical.width == resource.width &&
+        physical.height == resource.height)
+    {
+      physical.busy = true;
+      physical.idleFrames = 0;
+      return i;
+    }
+  }
+
+  GLenum format, type;
+  int bytes;
+  if (!format_info(resource.desc.format, format, type, bytes))
+  {
+    std::cerr << "Render graph: unsupported format for " << resource.name << std::endl;
+    return -1;
+  }
+  PhysicalTexture physical;
+  physical.format = resource.desc.format;
+  physical.width = resource.width;
+  physical.height = resource.height;
+  physical.busy = true;
+  glGenTextures(1, &physical.texture);
+  glBindTexture(GL_TEXTURE_2D, physical.texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, physical.format, physical.width, physical.height, 0, format, type, NULL);
+  GLint filter = is_depth_format(physical.format) || format == GL_RED_INTEGER || format == GL_RG_INTEGER ? GL_NEAREST : GL_LINEAR;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  pool.push_back(physical);
+  return (int)pool.size() - 1;
+}
+
+unsigned int RenderGraph::framebuffer_for(const std::vector<Handle> &colors, Handle depth, const std::string &passName)
+{
+  if (std::find(colors.begin(), colors.end(), BACKBUFFER) != colors.end())
+    return 0;
+
+  std::vector<unsigned int> key;
+  for (Handle handle : colors)
+    key.push_back(texture(handle));
+  key.push_back(depth >= 0 ? texture(depth) : 0u);
+
+  auto it = framebuffers.find(key);
+  if (it != framebuffers.end())
+    return it->second;
+
+  unsigned int fbo = 0;
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  std::vector<GLenum> drawBuffers;
+  for (size_t i = 0; i < colors.size(); ++i)
+  {
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, key[i], 0);
+    drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + i);
+  }
+  if (depth >= 0)
+  {
+    GLenum attachment = resources[depth].desc.format == GL_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT
+                                                                                     : GL_DEPTH_ATTACHMENT;
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, key.back(), 0);
+  }
+  if (drawBuffers.empty())
+  {
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+  }
+  else
+    glDrawBuffers(drawBuffers.size(), drawBuffers.data());
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cerr << "Render graph: framebuffer for " << passName << " is incomplete" << std::endl;
+  framebuffers[key] = fbo;
+  return fbo;
+}
+
+void RenderGraph::execute()
+{
+  cull();
+
+  // ---------- 生命週期: 第一次寫到最後一次讀 (只看沒被剔除的 pass) ----------
+  for (Resource &resource : resources)
+    resource.firstUse = resource.lastUse = -1, resource.physical = -1;
+  for (int p = 0; p < (int)passes.size(); ++p)
+  {
+    const Pass &pass = passes[p];
+    if (pass.culled)
+      continue;
+    std::vector<Handle> used = pass.desc.reads;
+    used.insert(used.end(), pass.desc.colors.begin(), pass.desc.colors.end());
+    if (pass.desc.depth >= 0)
+      used.push_back(pass.desc.depth);
+    for (Handle handle : used)
+    {
+      Resource &resource = resources[handle];
+      if (resource.firstUse < 0)
+        resource.firstUse = p;
+      resource.lastUse = p;
+    }
+  }
+  requestedBytes = 0;
+  for (size_t r = 1; r < resources.size(); ++r)
+  {
+    if (resources[r].firstUse >= 0)
+      requestedBytes += (size_t)resources[r].width * resources[r].height * texel_bytes(resources[r].desc.format);
+  }
+
+  for (PhysicalTexture &physical : pool)
+    physical.busy = false;
+
+  // ---------- 依序執行; 用完的 texture 馬上還給 pool, 後面的 pass 就能共用 ----------
+  TimerSlot &slot = timers[frameIndex % TIMER_LATENCY];
+  collect_timers(slot);
+  stats.clear();
+  for (int p = 0; p < (int)passes.size(); ++p)
+  {
+    Pass &pass = passes[p];
+    if (pass.culled)
+      continue;
+
+    for (size_t r = 1; r < resources.size(); ++r)
+    {
+      if (resources[r].firstUse == p)
+        resources[r].physical = acquire(resources[r]);
+    }
+
+    bool hasTarget = !pass.desc.colors.empty() || pass.desc.depth >= 0;
+    if (hasTarget)
+    {
+      Handle target = pass.desc.colors.empty() ? pass.desc.depth : pass.desc.colors[0];
+      glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_for(pass.desc.colors, pass.desc.depth, pass.name));
+      glViewport(0, 0, width(target), height(target));
+    }
+
+    unsigned int query = 0;
+    if (!freeQueries.empty())
+    {
+      query = freeQueries.back();
+      freeQueries.pop_back();
+    }
+    else
+      glGenQueries(1, &query);
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    auto begin = std::chrono::high_resolution_clock::now();
+    pass.execute(*this);
+    auto end = std::chrono::high_resolution_clock::now();
+    glEndQuery(GL_TIME_ELAPSED);
+    slot.names.push_back(pass.name);
+    slot.queries.push_back(query);
+
+    PassStats passStats;
+    passStats.name = pass.name;
+    passStats.cpuMs = std::chrono::duration<double, std::milli>(end - begin).count();
+    auto gpu = lastGpuMs.find(pass.name);
+    passStats.gpuMs = gpu != lastGpuMs.end() ? gpu->second : 0.0;
+    stats.push_back(passStats);
+
+    for (size_t r = 1; r < resources.size(); ++r)
+    {
+      if (resources[r].lastUse == p && resources[r].physical >= 0)
+        pool[resources[r].physical].busy = false;
+    }
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(0, 0, backbufferWidth, backbufferHeight);
+
+  trim_pool();
+  ++frameIndex;
+}
+
+// 讀回 TIMER_LATENCY 幀前的 query; 還沒好就丟掉那幀的結果 (不等 GPU)
+void RenderGraph::collect_timers(TimerSlot &slot)
+{
+  for (size_t i = 0; i < slot.queries.size(); ++i)
+  {
+    GLint available = 0;
+    glGetQueryObjectiv(slot.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available)
+    {
+      GLuint64 ns = 0;
+      glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &ns);
+      lastGpuMs[slot.names[i]] = ns / 1.0e6;
+    }
+    freeQueries.push_back(slot.queries[i]);
+  }
+  slot.names.clear();
+  slot.queries.clear();
+}
+
+// 連續幾幀沒用到的 texture 釋放 (視窗改大小後舊尺寸的那批), 連帶刪掉用到它的 FBO
+void RenderGraph::trim_pool()
+{
+  const int maxIdleFrames = 3;
+  std::vector<bool> used(pool.size(), false);
+  for (const Resource &resource : resources)
+  {
+    if (resource.physical >= 0)
+      used[resource.physical] = true;
+  }
+
+  std::vector<PhysicalTexture> kept;
+  for (size_t i = 0; i < pool.size(); ++i)
+  {
+    PhysicalTexture &physical = pool[i];
+    physical.idleFrames = used[i] ? 0 : physical.idleFrames + 1;
+    if (physical.idleFrames <= maxIdleFrames)
+    {
+      kept.push_back(physical);
+      continue;
+    }
+    for (auto it = framebuffers.begin(); it != framebuffers.end();)
+    {
+      if (std::find(it->first.begin(), it->first.end(), physical.texture) != it->first.end())
+      {
+        glDeleteFramebuffers(1, &it->second);
+        it = framebuffers.erase(it);
+      }
+      else
+        ++it;
+    }
+    glDeleteTextures(1, &physical.texture);
+  }
+  pool = std::move(kept);
+}
+
+unsigned int RenderGraph::texture(Handle handle) const
+{
+  const Resource &resource = resources[handle];
+  return resource.physical >= 0 ? pool[resource.physical].texture : 0;
+}
+
+int RenderGraph::width(Handle handle) const
+{
+  return resources[handle].width;
+}
+
+int RenderGraph::height(Handle handle) const
+{
+  return resources[handle].height;
+}
+
+size_t RenderGraph::pool_bytes() const
+{
+  size_t bytes = 0;
+  for (const PhysicalTexture &physical : pool)
+    bytes += (size_t)physical.width * physical.height * texel_bytes(physical.format);
+  return bytes;
+}
+
+void RenderGraph::print_stats() const
+{
+  std::printf("\n=== Render graph: %zu passes (%d culled), %.2f MB pooled / %.2f MB requested ===\n",
+              passes.size(), culledPasses, pool_bytes() / (1024.0 * 1024.0), requestedBytes / (1024.0 * 1024.0));
+  std::printf("pass                  cpu ms   gpu ms\n");
+  for (const PassStats &pass : stats)
+    std::printf("%-20s %7.3f  %7.3f\n", pass.name.c_str(), pass.cpuMs, pass.gpuMs);
+}
+
+void RenderGraph::release()
+{
+  for (auto &entry : framebuffers)
+    glDeleteFramebuffers(1, &entry.second);
+  framebuffers.clear();
+  for (PhysicalTexture &physical : pool)
+    glDeleteTextures(1, &physical.texture);
+  pool.clear();
+  for (TimerSlot &slot : timers)
+  {
+    freeQueries.insert(freeQueries.end(), slot.queries.begin(), slot.queries.end());
+    slot.names.clear();
+    slot.queries.clear();
+  }
+  if (!freeQueries.empty())
+    glDeleteQueries(freeQueries.size(), freeQueries.data());
+  freeQueries.clear();
+}
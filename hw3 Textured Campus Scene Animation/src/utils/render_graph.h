@@ -0,0 +1,127 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// ========== render graph ==========
+// 每幀重新宣告一次: pass 依序加進來, 宣告讀哪些、寫哪些 texture, execute 時才真的配置資源:
+// - 輸出沒人讀 (也沒寫到 backbuffer、沒標 sideEffect) 的 pass 直接剔除
+// - 加入的順序就是執行順序, 讀還沒被寫過的 resource 視為錯誤 (那個 pass 會被剔除)
+// - transient texture 從跨幀的 pool 拿; 同尺寸同格式、生命週期 (第一次寫到最後一次讀) 不重疊的
+//   resource 共用同一個 GL texture (GL 沒有 placement 配置, aliasing 以整個 texture 物件為單位)
+// - 尺寸可以是 backbuffer 的比例, 視窗改大小時 pool 裡舊尺寸的 texture 閒置幾幀後釋放
+// - FBO 依 attachment 組合快取; 每個 pass 一組 GL_TIME_ELAPSED query, TIMER_LATENCY 幀後才讀結果, 不會卡 pipeline
+class RenderGraph
+{
+public:
+  using Handle = int;
+  static constexpr Handle BACKBUFFER = 0; // 預設 framebuffer (匯入的 resource, 永遠存活)
+
+  struct TextureDesc
+  {
+    unsigned int format = 0; // GL internal format, 例如 GL_RGBA8、GL_DEPTH_COMPONENT24
+    float scale = 1.0f;      // width / height 為 0 時用 backbuffer 尺寸 x scale
+    int width = 0, height = 0;
+  };
+
+  struct PassDesc
+  {
+    std::vector<Handle> reads;
+    std::vector<Handle> colors; // color attachment (依序對應 layout(location))
+    Handle depth = -1;
+    bool sideEffect = false; // 寫到 graph 以外的東西 (例如 shadow map 快取), 不能剔除
+  };
+  using ExecuteFunc = std::function<void(const RenderGraph &graph)>;
+
+  struct PassStats
+  {
+    std::string name;
+    double cpuMs = 0.0;
+    double gpuMs = 0.0; // TIMER_LATENCY 幀前的結果
+  };
+
+  // 每幀開頭清掉上一幀宣告的 pass 與 resource
+  void begin_frame(int backbufferWidth, int backbufferHeight);
+  Handle create_texture(const std::string &name, const TextureDesc &desc);
+  void add_pass(const std::string &name, const PassDesc &desc, ExecuteFunc execute);
+  // 用 glBlitFramebuffer 複製 color (尺寸不同時 linear 縮放)
+  void add_blit_pass(const std::string &name, Handle source, Handle destination);
+  // 剔除、排程、配置, 然後依序執行; 結束時綁回預設 framebuffer
+  void execute();
+  void release();
+
+  // execute 期間可用: resource 對應的 GL texture 與尺寸
+  unsigned int texture(Handle handle) const;
+  int width(Handle handle) const;
+  int height(Handle handle) const;
+
+  // ---------- 統計 ----------
+  const std::vector<PassStats> &pass_stats() const { return stats; }
+  size_t pool_bytes() const;            // pool 裡實際配置的 texture 記憶體
+  size_t requested_bytes() const { return requestedBytes; } // 這幀的 transient resource 不共用時要的量
+  int culled_passes() const { return culledPasses; }
+  void print_stats() const;
+
+private:
+  struct Resource
+  {
+    std::string name;
+    TextureDesc desc;
+    int width = 0, height = 0;
+    int writer = -1;      // 最後一個寫它的 pass
+    int readers = 0;      // 剔除用的 reference count
+    int firstUse = -1, lastUse = -1;
+    int physical = -1;    // pool index
+  };
+
+  struct Pass
+  {
+    std::string name;
+    PassDesc desc;
+    ExecuteFunc execute;
+    int references = 0;
+    bool culled = false;
+  };
+
+  struct PhysicalTexture
+  {
+    unsigned int texture = 0;
+    unsigned int format = 0;
+    int width = 0, height = 0;
+    bool busy = false;   // 這幀目前被某個 resource 占用
+    int idleFrames = 0;  // 連續幾幀沒被用到, 超過就釋放
+  };
+
+  struct TimerSlot
+  {
+    std::vector<std::string> names;
+    std::vector<unsigned int> queries;
+  };
+
+  void cull();
+  int acquire(const Resource &resource);
+  // 0 代表 backbuffer
+  unsigned int framebuffer_for(const std::vector<Handle> &colors, Handle depth, const std::string &passName);
+  void collect_timers(TimerSlot &slot);
+  void trim_pool();
+
+  std::vector<Resource> resources;
+  std::vector<Pass> passes;
+  std::vector<PhysicalTexture> pool;
+  std::map<std::vector<unsigned int>, unsigned int> framebuffers; // attachment 的 texture (depth 在最後) -> FBO
+  static constexpr int TIMER_LATENCY = 3;
+  TimerSlot timers[TIMER_LATENCY];
+  std::vector<unsigned int> freeQueries;
+  size_t frameIndex = 0;
+
+  int backbufferWidth = 0, backbufferHeight = 0;
+  std::vector<PassStats> stats;
+  std::map<std::string, double> lastGpuMs;
+  size_t requestedBytes = 0;
+  int culledPasses = 0;
+};
+
+#endif
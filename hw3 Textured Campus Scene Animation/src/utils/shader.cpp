@@ -0,0 +1,67 @@
+#include "shader.h"
+
+#include <glad/glad.h>
+#include <iostream>
+
+std::string shader_variant(const std::string &source, const std::string &version,
+                           const std::vector<std::string> &defines)
+{
+  std::string header = "#version " + version + "\n";
+  for (const auto &define : defines)
+    header += "#define " + define + "\n";
+
+  // 原本的 #version 必須是第一行, 直接把它換掉
+  size_t bodyStart = 0;
+  if (source.rfind("#version", 0) == 0)
+  {
+    bodyStart = source.find('\n');
+    bodyStart = bodyStart == std::string::npos ? source.size() : bodyStart + 1;
+  }
+  return header + source.substr(bodyStart);
+}
+
+static unsigned int compile_shader(GLenum type, const std::string &source)
+{
+  const char *src = source.c_str();
+  unsigned int shader = glCreateShader(type);
+  glShaderSource(shader, 1, &src, NULL);
+  glCompileShader(shader);
+
+  int success = 0;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (!success)
+  {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    std::cerr << (type == GL_VERTEX_SHADER ? "Vertex" : "Fragment")
+              << " shader compile fail:\n"
+              << log << std::endl;
+  }
+  return shader;
+}
+
+unsigned int compile_program(const std::string &vertexSource, const std::string &fragmentSource)
+{
+  unsigned int vertexShader = compile_shader(GL_VERTEX_SHADER, vertexSource);
+  unsigned int fragmentShader = compile_shader(GL_FRAGMENT_SHADER, fragmentSource);
+
+  unsigned int program = glCreateProgram();
+  glAttachShader(program, vertexShader);
+  glAttachShader(program, fragmentShader);
+  glLinkProgram(program);
+  glDeleteShader(vertexShader);
+  glDeleteShader(fragmentShader);
+
+  int success = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    char log[1024];
+    glGetProgramInfoLog(program, sizeof(log), NULL, log);
+    std::cerr << "Shader program link fail:\n"
+              << log << std::endl;
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
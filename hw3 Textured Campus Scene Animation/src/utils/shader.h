@@ -0,0 +1,15 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+#include <string>
+#include <vector>
+
+// 把 shader 原始碼第一行的 #version 換成指定版本, 並在後面插入 #define
+// 例如 shader_variant(src, "430 core", {"USE_MDI"})
+std::string shader_variant(const std::string &source, const std::string &version,
+                           const std::vector<std::string> &defines);
+
+// 編譯 + link, 失敗時印出 log 並回傳 0
+unsigned int compile_program(const std::string &vertexSource, const std::string &fragmentSource);
+
+#endif
@@ -0,0 +1,195 @@
+#include "shadow_cascades.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <cmath>
+
+static unsigned int create_depth_array(int resolution, int layers)
+{
+  unsigned int texture = 0;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, layers, 0,
+               GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+  // 硬體比較 + linear filter = 每次取樣就是 2x2 PCF
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  return texture;
+}
+
+void ShadowCascades::init(const glm::vec3 &sceneMin, const glm::vec3 &sceneMax)
+{
+  sceneCenter = (sceneMin + sceneMax) * 0.5f;
+  sceneRadius = glm::length(sceneMax - sceneMin) * 0.5f;
+
+  staticMap = create_depth_array(resolution, cascade_count());
+  glGenFramebuffers(1, &fbo);
+  glGenFramebuffers(1, &readFbo);
+
+  // 只有深度, 沒有 color attachment
+  GLint previousFramebuffer = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  glBindFramebuffer(GL_FRAMEBUFFER, readFbo);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+  invalidate();
+}
+
+void ShadowCascades::invalidate()
+{
+  for (Cascade &cascade : cascades)
+    cascade.valid = false;
+}
+
+void ShadowCascades::select_casters(const Cascade &cascade, float radius, const std::vector<Mesh> &meshes,
+                                    const std::vector<unsigned int> &candidates, std::vector<unsigned int> &out) const
+{
+  out.clear();
+  for (unsigned int meshIndex : candidates)
+  {
+    const Mesh &mesh = meshes[meshIndex];
+    glm::vec2 lo(1e30f), hi(-1e30f);
+    for (int corner = 0; corner < 8; ++corner)
+    {
+      glm::vec3 p((corner & 1) ? mesh.boundsMax.x : mesh.boundsMin.x,
+                  (corner & 2) ? mesh.boundsMax.y : mesh.boundsMin.y,
+                  (corner & 4) ? mesh.boundsMax.z : mesh.boundsMin.z);
+      glm::vec2 q = glm::vec2(cascade.view * glm::vec4(p, 1.0f));
+      lo = glm::min(lo, q);
+      hi = glm::max(hi, q);
+    }
+    // 深度方向不裁: 正方形外面、但擋在光源前面的東西也要投影子
+    if (hi.x >= -radius && lo.x <= radius && hi.y >= -radius && lo.y <= radius)
+      out.push_back(meshIndex);
+  }
+}
+
+void ShadowCascades::render_layer(unsigned int texture, int layer, const Cascade &cascade,
+                                  const std::vector<unsigned int> &casters, bool clear, const DrawFunc &draw)
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+  glViewport(0, 0, resolution, resolution);
+  if (clear)
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+  // slope-scaled bias 放在光柵化階段, shader 裡只剩 normal offset
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(2.0f, 4.0f);
+  draw(cascade.view, cascade.projection, casters);
+  glDisable(GL_POLYGON_OFFSET_FILL);
+}
+
+void ShadowCascades::update(const glm::vec3 &lightPos, const glm::vec3 &eye, const std::vector<Mesh> &meshes,
+                            const std::vector<unsigned int> &staticCasters,
+                            const std::vector<unsigned int> &dynamicCasters, const DrawFunc &draw)
+{
+  lastRendered = 0;
+  if (lightPos != cachedLightPos)
+  {
+    invalidate();
+    cachedLightPos = lightPos;
+  }
+
+  // lightPos 很遠, 當成從場景中心看過去的平行光
+  glm::vec3 dir = glm::normalize(lightPos - sceneCenter);
+  glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+  glm::mat4 basis = glm::lookAt(glm::vec3(0.0f), -dir, up);
+  glm::vec3 right(basis[0][0], basis[1][0], basis[2][0]);
+  glm::vec3 lightUp(basis[0][1], basis[1][1], basis[2][1]);
+
+  GLint previousFramebuffer = 0;
+  GLint previousViewport[4];
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+  for (int i = 0; i < cascade_count(); ++i)
+  {
+    Cascade &cascade = cascades[i];
+    float radius = radii[i];
+    // 涵蓋整個場景的那層不跟著相機走
+    glm::vec3 reference = radius >= sceneRadius ? sceneCenter : eye;
+    float snap = radius * snapFraction;
+    glm::vec2 snapped = glm::round(glm::vec2(glm::dot(reference, right), glm::dot(reference, lightUp)) / snap) * snap;
+    if (cascade.valid && snapped == cascade.snapped)
+      continue;
+
+    glm::vec3 center = right * snapped.x + lightUp * snapped.y + dir * glm::dot(sceneCenter, dir);
+    // 光源放在整個場景前面, 深度範圍涵蓋所有可能的 caster
+    float distance = sceneRadius + glm::length(center - sceneCenter) + 0.1f;
+    cascade.view = glm::lookAt(center + dir * distance, center, up);
+    cascade.projection = glm::ortho(-radius, radius, -radius, radius, 0.05f, 2.0f * distance);
+    cascade.snapped = snapped;
+    cascade.valid = true;
+
+    select_casters(cascade, radius, meshes, staticCasters, casterScratch);
+    render_layer(staticMap, i, cascade, casterScratch, true, draw);
+    ++lastRendered;
+    ++totalRendered;
+  }
+
+  // 會動的物件: static 快取複製到 liveMap 後疊上去, 快取本身保持乾淨
+  composited = !dynamicCasters.empty();
+  if (composited)
+  {
+    if (!liveMap)
+      liveMap = create_depth_array(resolution, cascade_count());
+    for (int i = 0; i < cascade_count(); ++i)
+    {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+      glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticMap, 0, i);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+      glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, liveMap, 0, i);
+      glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+      select_casters(cascades[i], radii[i], meshes, dynamicCasters, casterScratch);
+      render_layer(liveMap, i, cascades[i], casterScratch, false, draw);
+    }
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+  glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+}
+
+void ShadowCascades::bind(unsigned int program)
+{
+  glm::mat4 matrices[MAX_CASCADES];
+  float normalOffsets[MAX_CASCADES];
+  for (int i = 0; i < cascade_count(); ++i)
+  {
+    matrices[i] = cascades[i].projection * cascades[i].view;
+    // 沿法線推 1.5 個 texel, 避免斜面上的 shadow acne
+    normalOffsets[i] = 1.5f * 2.0f * radii[i] / resolution;
+  }
+
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "shadowMap"), 5);
+  glUniform1i(glGetUniformLocation(program, "shadowCascadeCount"), cascade_count());
+  glUniform1f(glGetUniformLocation(program, "shadowTexel"), 1.0f / resolution);
+  glUniformMatrix4fv(glGetUniformLocation(program, "shadowMatrices"), cascade_count(), GL_FALSE,
+                     glm::value_ptr(matrices[0]));
+  glUniform1fv(glGetUniformLocation(program, "shadowNormalOffset"), cascade_count(), normalOffsets);
+
+  glActiveTexture(GL_TEXTURE5);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, composited ? liveMap : staticMap);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void ShadowCascades::release()
+{
+  glDeleteTextures(1, &staticMap);
+  glDeleteTextures(1, &liveMap);
+  glDeleteFramebuffers(1, &fbo);
+  glDeleteFramebuffers(1, &readFbo);
+  staticMap = liveMap = fbo = readFbo = 0;
+}
@@ -0,0 +1,72 @@
+#ifndef SHADOW_CASCADES_H
+#define SHADOW_CASCADES_H
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "mesh.h"
+
+// ========== 快取的 cascaded shadow map ==========
+// 校園是靜態的, 太陽 (lightPos) 也不動, 所以 shadow map 不用每幀重畫:
+// - 每層 cascade 是 light space 裡以相機為中心、半邊長 radii[i] 的正方形,
+//   中心對齊到 radius * snapFraction 的格子; 相機沒跨過格子 (而且光源沒變) 就沿用上次畫好的深度
+// - 涵蓋整個場景的那層中心固定在場景中心, 只畫一次
+// - 會動的物件 (dynamicCasters) 每幀把 static 快取複製一份再疊上去, 沒有就直接取樣快取
+// fragment shader (USE_SHADOWS) 選包含這個 fragment 的最小一層, 3x3 PCF
+class ShadowCascades
+{
+public:
+  static constexpr int MAX_CASCADES = 4;
+  std::vector<float> radii = {0.15f, 0.5f, 2.0f};
+  int resolution = 1024;      // 每層的解析度 (要是 8 的倍數, 對齊格子才會剛好落在 texel 上)
+  float snapFraction = 0.25f; // 相機移動超過 radius * snapFraction 才重畫那一層
+
+  // 畫出 casters 的深度 (呼叫端負責 program)
+  using DrawFunc = std::function<void(const glm::mat4 &view, const glm::mat4 &projection,
+                                      const std::vector<unsigned int> &casters)>;
+
+  // 建立 depth texture array; scene bounds 決定 light space 的深度範圍
+  void init(const glm::vec3 &sceneMin, const glm::vec3 &sceneMax);
+  // 每幀: 重畫需要更新的 static cascade, 有 dynamicCasters 時再合成一份
+  void update(const glm::vec3 &lightPos, const glm::vec3 &eye, const std::vector<Mesh> &meshes,
+              const std::vector<unsigned int> &staticCasters, const std::vector<unsigned int> &dynamicCasters,
+              const DrawFunc &draw);
+  // 下次 update 全部重畫 (場景改了, 或 benchmark 比較不快取的成本)
+  void invalidate();
+  // 設定 shadow uniform, depth array bind 在 unit 5
+  void bind(unsigned int program);
+  void release();
+
+  int lastRendered = 0;     // 上一幀重畫的 static cascade 數
+  size_t totalRendered = 0; // 累計
+
+private:
+  struct Cascade
+  {
+    glm::mat4 view{1.0f};
+    glm::mat4 projection{1.0f};
+    glm::vec2 snapped{0.0f}; // 對齊後的中心 (light space x, y)
+    bool valid = false;
+  };
+
+  int cascade_count() const { return std::min((int)radii.size(), MAX_CASCADES); }
+  // 依 light space 的 x, y 範圍挑出會落在這層的 caster
+  void select_casters(const Cascade &cascade, float radius, const std::vector<Mesh> &meshes,
+                      const std::vector<unsigned int> &candidates, std::vector<unsigned int> &out) const;
+  void render_layer(unsigned int texture, int layer, const Cascade &cascade, const std::vector<unsigned int> &casters,
+                    bool clear, const DrawFunc &draw);
+
+  Cascade cascades[MAX_CASCADES];
+  glm::vec3 sceneCenter{0.0f};
+  float sceneRadius = 1.0f;
+  glm::vec3 cachedLightPos{0.0f};
+  bool composited = false; // 目前取樣的是合成了 dynamic caster 的那份
+
+  std::vector<unsigned int> casterScratch;
+  unsigned int staticMap = 0, liveMap = 0;
+  unsigned int fbo = 0, readFbo = 0;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// ========== 4-wide float SIMD ==========
+// x86 用 SSE2, Apple Silicon / ARM 用 NEON, 其他平台退回純 C++ (結果相同, 只是比較慢)
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+
+struct float4
+{
+#if defined(SIMD_SSE)
+  __m128 v;
+  float4() = default;
+  float4(__m128 x) : v(x) {}
+  explicit float4(float s) : v(_mm_set1_ps(s)) {}
+  float4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+  static float4 load(const float *p) { return _mm_loadu_ps(p); }
+  void store(float *p) const { _mm_storeu_ps(p, v); }
+#elif defined(SIMD_NEON)
+  float32x4_t v;
+  float4() = default;
+  float4(float32x4_t x) : v(x) {}
+  explicit float4(float s) : v(vdupq_n_f32(s)) {}
+  float4(float a, float b, float c, float d)
+  {
+    float tmp[4] = {a, b, c, d};
+    v = vld1q_f32(tmp);
+  }
+  static float4 load(const float *p) { return vld1q_f32(p); }
+  void store(float *p) const { vst1q_f32(p, v); }
+#else
+  float v[4];
+  float4() = default;
+  explicit float4(float s) : v{s, s, s, s} {}
+  float4(float a, float b, float c, float d) : v{a, b, c, d} {}
+  static float4 load(const float *p) { return float4(p[0], p[1], p[2], p[3]); }
+  void store(float *p) const { std::copy(v, v + 4, p); }
+#endif
+};
+
+#if defined(SIMD_SSE)
+inline float4 operator+(float4 a, float4 b) { return _mm_add_ps(a.v, b.v); }
+inline float4 operator-(float4 a, float4 b) { return _mm_sub_ps(a.v, b.v); }
+inline float4 operator*(float4 a, float4 b) { return _mm_mul_ps(a.v, b.v); }
+inline float4 operator/(float4 a, float4 b) { return _mm_div_ps(a.v, b.v); }
+inline float4 min(float4 a, float4 b) { return _mm_min_ps(a.v, b.v); }
+inline float4 max(float4 a, float4 b) { return _mm_max_ps(a.v, b.v); }
+// 比較結果是全 1 / 全 0 的 mask
+inline float4 cmp_lt(float4 a, float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+inline float4 cmp_le(float4 a, float4 b) { return _mm_cmple_ps(a.v, b.v); }
+inline float4 cmp_ge(float4 a, float4 b) { return _mm_cmpge_ps(a.v, b.v); }
+inline float4 cmp_gt(float4 a, float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline float4 mask_and(float4 a, float4 b) { return _mm_and_ps(a.v, b.v); }
+inline float4 mask_or(float4 a, float4 b) { return _mm_or_ps(a.v, b.v); }
+// mask ? a : b
+inline float4 select(float4 mask, float4 a, float4 b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+// 每個 lane 的 mask 壓成 4 個 bit
+inline int movemask(float4 mask) { return _mm_movemask_ps(mask.v); }
+#elif defined(SIMD_NEON)
+inline float4 operator+(float4 a, float4 b) { return vaddq_f32(a.v, b.v); }
+inline float4 operator-(float4 a, float4 b) { return vsubq_f32(a.v, b.v); }
+inline float4 operator*(float4 a, float4 b) { return vmulq_f32(a.v, b.v); }
+inline float4 operator/(float4 a, float4 b) { return vdivq_f32(a.v, b.v); }
+inline float4 min(float4 a, float4 b) { return vminq_f32(a.v, b.v); }
+inline float4 max(float4 a, float4 b) { return vmaxq_f32(a.v, b.v); }
+inline float4 cmp_lt(float4 a, float4 b) { return vreinterpretq_f32_u32(vcltq_f32(a.v, b.v)); }
+inline float4 cmp_le(float4 a, float4 b) { return vreinterpretq_f32_u32(vcleq_f32(a.v, b.v)); }
+inline float4 cmp_ge(float4 a, float4 b) { return vreinterpretq_f32_u32(vcgeq_f32(a.v, b.v)); }
+inline float4 cmp_gt(float4 a, float4 b) { return vreinterpretq_f32_u32(vcgtq_f32(a.v, b.v)); }
+inline float4 mask_and(float4 a, float4 b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))); }
+inline float4 mask_or(float4 a, float4 b) { return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))); }
+inline float4 select(float4 mask, float4 a, float4 b) { return vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v); }
+inline int movemask(float4 mask)
+{
+  uint32x4_t m = vshrq_n_u32(vreinterpretq_u32_f32(mask.v), 31);
+  return vgetq_lane_u32(m, 0) | (vgetq_lane_u32(m, 1) << 1) | (vgetq_lane_u32(m, 2) << 2) | (vgetq_lane_u32(m, 3) << 3);
+}
+#else
+#define SIMD_SCALAR_OP(name, expr)            \
+  inline float4 name(float4 a, float4 b)      \
+  {                                           \
+    float4 r;                                 \
+    for (int i = 0; i < 4; ++i)               \
+    {                                         \
+      float x = a.v[i], y = b.v[i];           \
+      r.v[i] = (expr);                        \
+    }                                         \
+    return r;                                 \
+  }
+SIMD_SCALAR_OP(operator+, x + y)
+SIMD_SCALAR_OP(operator-, x - y)
+SIMD_SCALAR_OP(operator*, x * y)
+SIMD_SCALAR_OP(operator/, x / y)
+SIMD_SCALAR_OP(min, std::min(x, y))
+SIMD_SCALAR_OP(max, std::max(x, y))
+#undef SIMD_SCALAR_OP
+
+// 純 C++ 版本的 mask 以 1.0 / 0.0 表示
+inline float4 simd_mask(bool a, bool b, bool c, bool d) { return float4(a, b, c, d); }
+inline float4 cmp_lt(float4 a, float4 b) { return simd_mask(a.v[0] < b.v[0], a.v[1] < b.v[1], a.v[2] < b.v[2], a.v[3] < b.v[3]); }
+inline float4 cmp_le(float4 a, float4 b) { return simd_mask(a.v[0] <= b.v[0], a.v[1] <= b.v[1], a.v[2] <= b.v[2], a.v[3] <= b.v[3]); }
+inline float4 cmp_ge(float4 a, float4 b) { return simd_mask(a.v[0] >= b.v[0], a.v[1] >= b.v[1], a.v[2] >= b.v[2], a.v[3] >= b.v[3]); }
+inline float4 cmp_gt(float4 a, float4 b) { return simd_mask(a.v[0] > b.v[0], a.v[1] > b.v[1], a.v[2] > b.v[2], a.v[3] > b.v[3]); }
+inline float4 mask_and(float4 a, float4 b) { return simd_mask(a.v[0] && b.v[0], a.v[1] && b.v[1], a.v[2] && b.v[2], a.v[3] && b.v[3]); }
+inline float4 mask_or(float4 a, float4 b) { return simd_mask(a.v[0] || b.v[0], a.v[1] || b.v[1], a.v[2] || b.v[2], a.v[3] || b.v[3]); }
+inline float4 select(float4 mask, float4 a, float4 b) { return float4(mask.v[0] ? a.v[0] : b.v[0], mask.v[1] ? a.v[1] : b.v[1], mask.v[2] ? a.v[2] : b.v[2], mask.v[3] ? a.v[3] : b.v[3]); }
+inline int movemask(float4 mask) { return (mask.v[0] != 0) | ((mask.v[1] != 0) << 1) | ((mask.v[2] != 0) << 2) | ((mask.v[3] != 0) << 3); }
+#endif
+
+#endif
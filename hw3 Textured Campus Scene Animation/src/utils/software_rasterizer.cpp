@@ -0,0 +1,517 @@
+#include "software_rasterizer.h"
+#include "simd.h"
+#include "thread_pool.h"
+#include "../stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+
+// 每段 setup 工作最多幾個三角形
+static const size_t CHUNK_TRIANGLES = 2048;
+
+int SoftwareRasterizer::load_texture(const std::string &path)
+{
+  int width, height, channels;
+  unsigned char *data = stbi_load(path.c_str(), &width, &height, &channels, 0);
+  if (!data)
+  {
+    std::cerr << "Software rasterizer: failed to load texture " << path << std::endl;
+    return -1;
+  }
+
+  // 跟 GL 一樣: 單通道是 (r, 0, 0, 1), 沒有 alpha 就補 1
+  Texture texture;
+  std::vector<unsigned char> level((size_t)width * height * 4);
+  for (size_t i = 0; i < (size_t)width * height; ++i)
+  {
+    const unsigned char *src = data + i * channels;
+    unsigned char *dst = &level[i * 4];
+    dst[0] = src[0];
+    dst[1] = channels >= 2 ? src[1] : 0;
+    dst[2] = channels >= 3 ? src[2] : 0;
+    dst[3] = channels == 4 ? src[3] : 255;
+  }
+  stbi_image_free(data);
+  texture.levels.push_back(std::move(level));
+  texture.sizes.push_back(glm::ivec2(width, height));
+
+  // mipmap: 縮到 1x1, 每個新 texel 在上一層對應的中心點做 bilinear (跟 driver 用 blit 做 glGenerateMipmap 一樣);
+  // 邊長剛好減半時就是 2x2 平均, 奇數邊長也不會丟掉最後一列/行
+  while (width > 1 || height > 1)
+  {
+    int w = std::max(1, width / 2), h = std::max(1, height / 2);
+    const std::vector<unsigned char> &src = texture.levels.back();
+    std::vector<unsigned char> dst((size_t)w * h * 4);
+    for (int y = 0; y < h; ++y)
+    {
+      float sy = std::clamp((y + 0.5f) * height / h - 0.5f, 0.0f, height - 1.0f);
+      int y0 = (int)sy, y1 = std::min(y0 + 1, height - 1);
+      float fy = sy - y0;
+      for (int x = 0; x < w; ++x)
+      {
+        float sx = std::clamp((x + 0.5f) * width / w - 0.5f, 0.0f, width - 1.0f);
+        int x0 = (int)sx, x1 = std::min(x0 + 1, width - 1);
+        float fx = sx - x0;
+        for (int c = 0; c < 4; ++c)
+        {
+          float top = src[((size_t)y0 * width + x0) * 4 + c] * (1 - fx) + src[((size_t)y0 * width + x1) * 4 + c] * fx;
+          float bottom = src[((size_t)y1 * width + x0) * 4 + c] * (1 - fx) + src[((size_t)y1 * width + x1) * 4 + c] * fx;
+          dst[((size_t)y * w + x) * 4 + c] = (unsigned char)(top * (1 - fy) + bottom * fy + 0.5f);
+        }
+      }
+    }
+    texture.levels.push_back(std::move(dst));
+    texture.sizes.push_back(glm::ivec2(w, h));
+    width = w;
+    height = h;
+  }
+
+  textures.push_back(std::move(texture));
+  return textures.size() - 1;
+}
+
+void SoftwareRasterizer::build(const std::vector<Mesh> &meshes)
+{
+  release();
+  std::map<std::string, int> loaded;
+  auto texture_index = [&](const std::string &path)
+  {
+    if (path.empty())
+      return -1;
+    auto it = loaded.find(path);
+    if (it == loaded.end())
+      it = loaded.emplace(path, load_texture(path)).first;
+    return it->second;
+  };
+
+  std::map<const Material *, int> materialIndex;
+  for (const Mesh &mesh : meshes)
+  {
+    MeshRange range{positions.size() / 3, 0, -1, mesh.boundsMin, mesh.boundsMax};
+    if (mesh.material)
+    {
+      auto it = materialIndex.find(mesh.material);
+      if (it == materialIndex.end())
+      {
+        const Material &source = *mesh.material;
+        MaterialData material;
+        material.Kd = source.Kd;
+        material.Ns = source.Ns;
+        material.d = source.d;
+        material.diffuse = texture_index(source.diffuseTexPath);
+        material.specular = texture_index(source.specularTexPath);
+        materials.push_back(material);
+        it = materialIndex.emplace(mesh.material, materials.size() - 1).first;
+      }
+      range.material = it->second;
+
+      // 跟 vertex.glsl 一樣: 位置乘 model, 法線乘 model 的 inverse transpose
+      glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(mesh.transform)));
+      for (size_t v = 0; v + VERTEX_STRIDE <= mesh.vertices.size(); v += VERTEX_STRIDE)
+      {
+        const float *p = &mesh.vertices[v];
+        positions.push_back(glm::vec3(mesh.transform * glm::vec4(p[0], p[1], p[2], 1.0f)));
+        uvs.push_back(glm::vec2(p[3], p[4]));
+        normals.push_back(normalMatrix * glm::vec3(p[5], p[6], p[7]));
+      }
+      range.triangleCount = positions.size() / 3 - range.firstTriangle;
+    }
+    ranges.push_back(range);
+  }
+  triangleCount = positions.size() / 3;
+
+  size_t textureBytes = 0;
+  for (const Texture &texture : textures)
+  {
+    for (const auto &level : texture.levels)
+      textureBytes += level.size();
+  }
+  std::cout << "Software rasterizer: " << triangleCount << " triangles, " << materials.size() << " materials, "
+            << textures.size() << " textures (" << textureBytes / (1024 * 1024) << " MB with mipmaps)" << std::endl;
+}
+
+// 所有點都在同一個 clip 平面外就看不到 (far plane 也算, near plane 另外裁切)
+static bool outside_clip(const glm::vec4 *points, int count)
+{
+  int outside[5] = {0, 0, 0, 0, 0};
+  for (int i = 0; i < count; ++i)
+  {
+    const glm::vec4 &p = points[i];
+    outside[0] += p.x < -p.w;
+    outside[1] += p.x > p.w;
+    outside[2] += p.y < -p.w;
+    outside[3] += p.y > p.w;
+    outside[4] += p.z > p.w;
+  }
+  for (int plane = 0; plane < 5; ++plane)
+  {
+    if (outside[plane] == count)
+      return true;
+  }
+  return false;
+}
+
+void SoftwareRasterizer::setup_chunk(Chunk &chunk, const glm::mat4 &viewProjection, float minInvW)
+{
+  chunk.triangles.clear();
+  chunk.bins.resize((size_t)tilesX * tilesY);
+  for (auto &bin : chunk.bins)
+    bin.clear();
+
+  for (size_t t = chunk.firstTriangle; t < chunk.firstTriangle + chunk.triangleCount; ++t)
+  {
+    glm::vec4 clip[3];
+    for (int k = 0; k < 3; ++k)
+      clip[k] = viewProjection * glm::vec4(positions[t * 3 + k], 1.0f);
+    if (outside_clip(clip, 3))
+      continue;
+
+    // 對 near plane (z + w >= 0) 裁切, 最多剩 4 個頂點; 新頂點記下它在原三角形裡的重心座標
+    static const glm::vec3 corners[3] = {glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1)};
+    glm::vec4 poly[4];
+    glm::vec3 polySource[4];
+    int n = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+      const glm::vec4 &a = clip[k];
+      const glm::vec4 &b = clip[(k + 1) % 3];
+      float da = a.z + a.w;
+      float db = b.z + b.w;
+      if (da >= 0.0f)
+      {
+        poly[n] = a;
+        polySource[n++] = corners[k];
+      }
+      if ((da >= 0.0f) != (db >= 0.0f))
+      {
+        float s = da / (da - db);
+        poly[n] = a + (b - a) * s;
+        polySource[n++] = corners[k] + (corners[(k + 1) % 3] - corners[k]) * s;
+      }
+    }
+    if (n < 3)
+      continue;
+
+    glm::vec3 screen[4]; // x, y, 1/w
+    for (int k = 0; k < n; ++k)
+    {
+      float invW = 1.0f / std::max(poly[k].w, 1e-9f);
+      screen[k] = glm::vec3((poly[k].x * invW * 0.5f + 0.5f) * width, (poly[k].y * invW * 0.5f + 0.5f) * height, invW);
+    }
+
+    for (int f = 0; f + 2 < n; ++f)
+    {
+      int index[3] = {0, f + 1, f + 2};
+      const glm::vec3 *v[3] = {&screen[0], &screen[f + 1], &screen[f + 2]};
+      float area = (v[1]->x - v[0]->x) * (v[2]->y - v[0]->y) - (v[2]->x - v[0]->x) * (v[1]->y - v[0]->y);
+      if (std::abs(area) < 1e-12f)
+        continue;
+      if (area < 0.0f)
+      {
+        // 兩面都畫 (GL 路徑沒開 face culling), 統一成逆時針
+        std::swap(v[1], v[2]);
+        std::swap(index[1], index[2]);
+        area = -area;
+      }
+
+      // 只算像素中心落在範圍內的像素
+      ScreenTriangle tri;
+      tri.minX = std::max(0, (int)std::ceil(std::min({v[0]->x, v[1]->x, v[2]->x}) - 0.5f));
+      tri.maxX = std::min(width - 1, (int)std::floor(std::max({v[0]->x, v[1]->x, v[2]->x}) - 0.5f));
+      tri.minY = std::max(0, (int)std::ceil(std::min({v[0]->y, v[1]->y, v[2]->y}) - 0.5f));
+      tri.maxY = std::min(height - 1, (int)std::floor(std::max({v[0]->y, v[1]->y, v[2]->y}) - 0.5f));
+      if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+        continue;
+
+      // 第 k 個頂點的權重 = 對邊與 p 圍成的面積 / 總面積
+      tri.depthA = tri.depthB = tri.depthC = 0.0f;
+      for (int k = 0; k < 3; ++k)
+      {
+        const glm::vec3 &a = *v[(k + 1) % 3];
+        const glm::vec3 &b = *v[(k + 2) % 3];
+        tri.edgeA[k] = (a.y - b.y) / area;
+        tri.edgeB[k] = (b.x - a.x) / area;
+        tri.edgeC[k] = (a.x * b.y - b.x * a.y) / area;
+        tri.invW[k] = v[k]->z;
+        tri.source[k] = polySource[index[k]];
+        tri.depthA += tri.edgeA[k] * tri.invW[k];
+        tri.depthB += tri.edgeB[k] * tri.invW[k];
+        tri.depthC += tri.edgeC[k] * tri.invW[k];
+      }
+      // 整個比 far plane 遠
+      if (std::max({tri.invW[0], tri.invW[1], tri.invW[2]}) < minInvW)
+        continue;
+      tri.triangle = (uint32_t)t;
+      tri.material = chunk.material;
+
+      uint32_t triangleIndex = chunk.triangles.size();
+      chunk.triangles.push_back(tri);
+      for (int ty = tri.minY / TILE; ty <= tri.maxY / TILE; ++ty)
+      {
+        for (int tx = tri.minX / TILE; tx <= tri.maxX / TILE; ++tx)
+          chunk.bins[(size_t)ty * tilesX + tx].push_back(triangleIndex);
+      }
+    }
+  }
+}
+
+void SoftwareRasterizer::rasterize_tile(int tile, float minInvW)
+{
+  int tileX = (tile % tilesX) * TILE, tileY = (tile / tilesX) * TILE;
+  int tileW = std::min(TILE, width - tileX), tileH = std::min(TILE, height - tileY);
+
+  // tile 內的深度 (1/w, 先填 far plane) 與每個像素最前面的三角形
+  alignas(16) float depth[TILE * TILE];
+  const ScreenTriangle *front[TILE * TILE];
+  std::fill(depth, depth + TILE * TILE, minInvW);
+  std::fill(front, front + TILE * TILE, nullptr);
+
+  const float4 laneOffset(0.5f, 1.5f, 2.5f, 3.5f);
+  const float4 zero(0.0f);
+  // 依 chunk 順序 (也就是三角形送出的順序) 畫, 深度相同時先畫的留下, 每次結果都一樣
+  for (size_t c = 0; c < activeChunks; ++c)
+  {
+    const Chunk &chunk = chunks[c];
+    for (uint32_t index : chunk.bins[tile])
+    {
+      const ScreenTriangle &tri = chunk.triangles[index];
+      int x0 = std::max(tri.minX, tileX), x1 = std::min(tri.maxX, tileX + tileW - 1);
+      int y0 = std::max(tri.minY, tileY), y1 = std::min(tri.maxY, tileY + tileH - 1);
+      if (x0 > x1 || y0 > y1)
+        continue;
+
+      // tile 的 buffer 固定 TILE 寬, 對齊 4 之後超出畫面右邊的 lane 只會寫到用不到的位置
+      int startX = x0 & ~3;
+      float4 A0(tri.edgeA[0]), A1(tri.edgeA[1]), A2(tri.edgeA[2]), dA(tri.depthA);
+      for (int y = y0; y <= y1; ++y)
+      {
+        float py = y + 0.5f;
+        float4 rowE0(tri.edgeB[0] * py + tri.edgeC[0]);
+        float4 rowE1(tri.edgeB[1] * py + tri.edgeC[1]);
+        float4 rowE2(tri.edgeB[2] * py + tri.edgeC[2]);
+        float4 rowZ(tri.depthB * py + tri.depthC);
+        float *depthRow = depth + (y - tileY) * TILE - tileX;
+        const ScreenTriangle **frontRow = front + (y - tileY) * TILE - tileX;
+
+        for (int x = startX; x <= x1; x += 4)
+        {
+          float4 px = float4((float)x) + laneOffset;
+          float4 inside = mask_and(mask_and(cmp_ge(A0 * px + rowE0, zero), cmp_ge(A1 * px + rowE1, zero)),
+                                   cmp_ge(A2 * px + rowE2, zero));
+          if (movemask(inside) == 0)
+            continue;
+          float4 z = dA * px + rowZ;
+          float4 stored = float4::load(depthRow + x);
+          float4 closer = mask_and(inside, cmp_gt(z, stored));
+          int mask = movemask(closer);
+          if (mask == 0)
+            continue;
+          select(closer, z, stored).store(depthRow + x);
+          for (int lane = 0; lane < 4; ++lane)
+          {
+            if (mask & (1 << lane))
+              frontRow[x + lane] = &tri;
+          }
+        }
+      }
+    }
+  }
+
+  // 每個像素只打光一次
+  for (int ly = 0; ly < tileH; ++ly)
+  {
+    unsigned char *out = &color[((size_t)(tileY + ly) * width + tileX) * 4];
+    for (int lx = 0; lx < tileW; ++lx, out += 4)
+    {
+      const ScreenTriangle *tri = front[ly * TILE + lx];
+      if (!tri)
+      {
+        // 跟 scene pass 的 glClearColor 一樣
+        out[0] = out[1] = out[2] = 102;
+        out[3] = 255;
+        continue;
+      }
+      glm::vec3 result = glm::clamp(shade(*tri, tileX + lx + 0.5f, tileY + ly + 0.5f), 0.0f, 1.0f);
+      out[0] = (unsigned char)(result.r * 255.0f + 0.5f);
+      out[1] = (unsigned char)(result.g * 255.0f + 0.5f);
+      out[2] = (unsigned char)(result.b * 255.0f + 0.5f);
+      out[3] = (unsigned char)(glm::clamp(materials[tri->material].d, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+  }
+}
+
+// 螢幕上 (x, y) 在原本三角形裡的重心座標 (透視校正: 螢幕空間的權重除以 w 再正規化)
+static glm::vec3 source_barycentric(const float *edgeA, const float *edgeB, const float *edgeC, const float *invW,
+                                    const glm::vec3 *source, float x, float y)
+{
+  float weight[3], sum = 0.0f;
+  for (int k = 0; k < 3; ++k)
+  {
+    weight[k] = (edgeA[k] * x + edgeB[k] * y + edgeC[k]) * invW[k];
+    sum += weight[k];
+  }
+  return (source[0] * weight[0] + source[1] * weight[1] + source[2] * weight[2]) / sum;
+}
+
+glm::vec4 SoftwareRasterizer::sample(int textureIndex, glm::vec2 uv, float lod) const
+{
+  const Texture &texture = textures[textureIndex];
+  // GL_LINEAR_MIPMAP_LINEAR: 相鄰兩層各做一次 bilinear 再依 lod 的小數部分混合; lod <= 0 是放大, 只取第 0 層
+  auto bilinear = [&](int level)
+  {
+    const std::vector<unsigned char> &texels = texture.levels[level];
+    glm::ivec2 size = texture.sizes[level];
+    float fx = uv.x * size.x - 0.5f, fy = uv.y * size.y - 0.5f;
+    float floorX = std::floor(fx), floorY = std::floor(fy);
+    float tx = fx - floorX, ty = fy - floorY;
+    // GL_REPEAT
+    int x0 = ((int)floorX % size.x + size.x) % size.x, y0 = ((int)floorY % size.y + size.y) % size.y;
+    int x1 = (x0 + 1) % size.x, y1 = (y0 + 1) % size.y;
+    auto texel = [&](int x, int y)
+    {
+      const unsigned char *p = &texels[((size_t)y * size.x + x) * 4];
+      return glm::vec4(p[0], p[1], p[2], p[3]);
+    };
+    glm::vec4 top = glm::mix(texel(x0, y0), texel(x1, y0), tx);
+    glm::vec4 bottom = glm::mix(texel(x0, y1), texel(x1, y1), tx);
+    return glm::mix(top, bottom, ty) * (1.0f / 255.0f);
+  };
+
+  int maxLevel = texture.levels.size() - 1;
+  if (lod <= 0.0f || maxLevel == 0)
+    return bilinear(0);
+  lod = std::min(lod, (float)maxLevel);
+  int level = (int)lod;
+  if (level == maxLevel)
+    return bilinear(level);
+  return glm::mix(bilinear(level), bilinear(level + 1), lod - level);
+}
+
+glm::vec3 SoftwareRasterizer::shade(const ScreenTriangle &tri, float x, float y) const
+{
+  glm::vec3 b = source_barycentric(tri.edgeA, tri.edgeB, tri.edgeC, tri.invW, tri.source, x, y);
+  size_t base = (size_t)tri.triangle * 3;
+  glm::vec3 fragPos = positions[base] * b.x + positions[base + 1] * b.y + positions[base + 2] * b.z;
+  glm::vec3 normal = normals[base] * b.x + normals[base + 1] * b.y + normals[base + 2] * b.z;
+  glm::mat3x2 uvMatrix(uvs[base], uvs[base + 1], uvs[base + 2]);
+  glm::vec2 uv = uvMatrix * b;
+  const MaterialData &material = materials[tri.material];
+
+  // mipmap 的 lod: 右邊與上面一個像素的 uv 差 (取代 GPU 的 2x2 quad 微分)
+  auto lod = [&](int textureIndex)
+  {
+    glm::vec2 size = textures[textureIndex].sizes[0];
+    glm::vec2 dx = (uvMatrix * source_barycentric(tri.edgeA, tri.edgeB, tri.edgeC, tri.invW, tri.source, x + 1.0f, y) - uv) * size;
+    glm::vec2 dy = (uvMatrix * source_barycentric(tri.edgeA, tri.edgeB, tri.edgeC, tri.invW, tri.source, x, y + 1.0f) - uv) * size;
+    return 0.5f * std::log2(std::max({glm::dot(dx, dx), glm::dot(dy, dy), 1e-20f}));
+  };
+
+  // 以下跟 fragment.glsl 的基本路徑一樣
+  glm::vec3 objectColor;
+  if (material.diffuse >= 0)
+    objectColor = glm::vec3(sample(material.diffuse, uv, lod(material.diffuse)));
+  else
+    objectColor = glm::length(material.Kd) > 0.01f ? material.Kd : glm::vec3(0.8f);
+
+  glm::vec3 norm = glm::normalize(normal);
+  glm::vec3 ambient = 0.3f * objectColor;
+
+  glm::vec3 lightDir = glm::normalize(frameLightPos - fragPos);
+  float diff = std::max(glm::dot(norm, lightDir), 0.0f);
+  glm::vec3 diffuse = diff * objectColor * frameLightColor;
+
+  glm::vec3 viewDir = glm::normalize(frameViewPos - fragPos);
+  glm::vec3 reflectDir = glm::reflect(-lightDir, norm);
+  float shininess = material.Ns > 1.0f ? material.Ns : 32.0f;
+  float spec = std::pow(std::max(glm::dot(viewDir, reflectDir), 0.0f), shininess);
+  glm::vec3 specularColor = material.specular >= 0 ? glm::vec3(sample(material.specular, uv, lod(material.specular)))
+                                                   : glm::vec3(0.2f);
+  glm::vec3 specular = spec * specularColor * frameLightColor;
+
+  return ambient + diffuse + specular;
+}
+
+void SoftwareRasterizer::render(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &viewPos,
+                                const glm::vec3 &lightPos, const glm::vec3 &lightColor,
+                                const std::vector<unsigned int> &visible, int targetWidth, int targetHeight)
+{
+  auto t0 = std::chrono::high_resolution_clock::now();
+  width = targetWidth;
+  height = targetHeight;
+  color.resize((size_t)width * height * 4);
+  tilesX = (width + TILE - 1) / TILE;
+  tilesY = (height + TILE - 1) / TILE;
+  frameViewPos = viewPos;
+  frameLightPos = lightPos;
+  frameLightColor = lightColor;
+
+  glm::mat4 viewProjection = projection * view;
+  // perspective 的 far plane: w = far 的地方 z = w
+  float farPlane = std::abs(projection[2][2] + 1.0f) > 1e-12f ? projection[3][2] / (projection[2][2] + 1.0f) : 0.0f;
+  float minInvW = farPlane > 0.0f ? 1.0f / farPlane : 0.0f;
+
+  // mesh 的 AABB 先做 frustum culling, 留下來的切成一段段 setup 工作
+  activeChunks = 0;
+  lastTriangles = 0;
+  for (unsigned int meshIndex : visible)
+  {
+    const MeshRange &range = ranges[meshIndex];
+    if (range.triangleCount == 0)
+      continue;
+    glm::vec4 corners[8];
+    for (int i = 0; i < 8; ++i)
+    {
+      glm::vec3 corner((i & 1) ? range.boundsMax.x : range.boundsMin.x, (i & 2) ? range.boundsMax.y : range.boundsMin.y,
+                       (i & 4) ? range.boundsMax.z : range.boundsMin.z);
+      corners[i] = viewProjection * glm::vec4(corner, 1.0f);
+    }
+    if (outside_clip(corners, 8))
+      continue;
+    lastTriangles += range.triangleCount;
+    for (size_t start = 0; start < range.triangleCount; start += CHUNK_TRIANGLES)
+    {
+      if (activeChunks == chunks.size())
+        chunks.emplace_back();
+      Chunk &chunk = chunks[activeChunks++];
+      chunk.firstTriangle = range.firstTriangle + start;
+      chunk.triangleCount = std::min(CHUNK_TRIANGLES, range.triangleCount - start);
+      chunk.material = range.material;
+    }
+  }
+
+  ThreadPool &pool = global_thread_pool();
+  pool.parallel_for(activeChunks, 1, [&](size_t begin, size_t end)
+                    {
+    for (size_t c = begin; c < end; ++c)
+      setup_chunk(chunks[c], viewProjection, minInvW); });
+  lastRasterized = 0;
+  for (size_t c = 0; c < activeChunks; ++c)
+    lastRasterized += chunks[c].triangles.size();
+  auto t1 = std::chrono::high_resolution_clock::now();
+
+  pool.parallel_for((size_t)tilesX * tilesY, 1, [&](size_t begin, size_t end)
+                    {
+    for (size_t tile = begin; tile < end; ++tile)
+      rasterize_tile(tile, minInvW); });
+  auto t2 = std::chrono::high_resolution_clock::now();
+
+  lastSetupMs = std::chrono::duration<float, std::milli>(t1 - t0).count();
+  lastRasterMs = std::chrono::duration<float, std::milli>(t2 - t1).count();
+}
+
+void SoftwareRasterizer::release()
+{
+  positions.clear();
+  normals.clear();
+  uvs.clear();
+  ranges.clear();
+  materials.clear();
+  textures.clear();
+  chunks.clear();
+  color.clear();
+  activeChunks = 0;
+  triangleCount = 0;
+}
@@ -0,0 +1,108 @@
+#ifndef SOFTWARE_RASTERIZER_H
+#define SOFTWARE_RASTERIZER_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+// ========== CPU 軟體光柵化 ==========
+// 不經過 GL driver 產生畫面 (CPU-only 的機器上做回歸測試), 光照與 fragment.glsl 的基本路徑相同
+// (ambient + diffuse + specular, 沒有 shadow / lightmap / probe / 點光源):
+// 1. setup: 可見 mesh 的三角形切成一段一段分給 worker, 轉到 clip space、對 near plane 裁切,
+//    算好邊方程式後依 bounding box 放進 64x64 的 tile bin (每段自己的 bin, 不用鎖, 順序固定)
+// 2. raster: 每個 worker 負責整塊 tile, SIMD 一次 4 個像素算邊方程式與 1/w 深度,
+//    只記下每個像素最前面的三角形 (tile 內的 visibility buffer)
+// 3. shade: 每個像素只打光一次; 透視校正的重心座標內插頂點屬性,
+//    貼圖是 stb_image 解出來的資料自己建 mipmap, trilinear + GL_REPEAT 取樣 (跟 load_texture 的設定一樣)
+// 輸出 RGBA8, 由下往上 (跟 glReadPixels 一樣), 可以直接交給 FrameCapture
+class SoftwareRasterizer
+{
+public:
+  static constexpr int TILE = 64;
+
+  // 複製 mesh 的頂點 (轉成 world space) 並讀取材質貼圖
+  void build(const std::vector<Mesh> &meshes);
+  // visible 是 mesh index; 會自己做 frustum culling
+  void render(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &viewPos, const glm::vec3 &lightPos,
+              const glm::vec3 &lightColor, const std::vector<unsigned int> &visible, int width, int height);
+  void release();
+
+  std::vector<unsigned char> color; // width * height * 4
+  int width = 0, height = 0;
+
+  // ---------- 上一幀的統計 ----------
+  size_t lastTriangles = 0;   // 通過 frustum culling 的 mesh 的三角形數
+  size_t lastRasterized = 0;  // 裁切後實際光柵化的三角形數 (畫面外、蓋不到像素中心的不算)
+  float lastSetupMs = 0.0f;   // setup + binning
+  float lastRasterMs = 0.0f;  // raster + shade
+  size_t triangleCount = 0;   // 全部的三角形數
+
+private:
+  struct Texture
+  {
+    std::vector<std::vector<unsigned char>> levels; // RGBA8, 第 0 列是圖片最上面 (uv 的 v = 0)
+    std::vector<glm::ivec2> sizes;
+  };
+
+  struct MaterialData
+  {
+    glm::vec3 Kd;
+    float Ns;
+    float d;
+    int diffuse = -1; // textures 的 index, -1: 沒有貼圖
+    int specular = -1;
+  };
+
+  struct MeshRange
+  {
+    size_t firstTriangle, triangleCount;
+    int material;
+    glm::vec3 boundsMin, boundsMax;
+  };
+
+  // 螢幕空間的三角形 (y 往上, 像素中心在 +0.5); 邊方程式已經除以面積, 值就是螢幕空間的重心座標
+  struct ScreenTriangle
+  {
+    float edgeA[3], edgeB[3], edgeC[3]; // 第 k 個值 = 第 k 個頂點的權重
+    float invW[3];                      // 各頂點的 1/w
+    float depthA, depthB, depthC;       // 1/w = A x + B y + C (越大越近)
+    glm::vec3 source[3];                // 各頂點在原本三角形裡的重心座標 (near plane 裁切會產生新頂點)
+    uint32_t triangle;                  // 原本的三角形 index
+    int material;
+    int minX, maxX, minY, maxY;
+  };
+
+  // setup 的一段工作: 一段連續的三角形, 結果與 bin 都屬於這一段
+  struct Chunk
+  {
+    size_t firstTriangle, triangleCount;
+    int material;
+    std::vector<ScreenTriangle> triangles;
+    std::vector<std::vector<uint32_t>> bins; // 每個 tile 一個
+  };
+
+  int load_texture(const std::string &path);
+  void setup_chunk(Chunk &chunk, const glm::mat4 &viewProjection, float minInvW);
+  void rasterize_tile(int tile, float minInvW);
+  glm::vec3 shade(const ScreenTriangle &tri, float x, float y) const;
+  glm::vec4 sample(int texture, glm::vec2 uv, float lod) const;
+
+  std::vector<glm::vec3> positions; // world space, 每 3 個一個三角形
+  std::vector<glm::vec3> normals;
+  std::vector<glm::vec2> uvs;
+  std::vector<MeshRange> ranges; // 每個 mesh 一個 (沒有材質的是空的)
+  std::vector<MaterialData> materials;
+  std::vector<Texture> textures;
+
+  std::vector<Chunk> chunks;
+  size_t activeChunks = 0;
+  int tilesX = 0, tilesY = 0;
+
+  // 這一幀的參數 (shade 用)
+  glm::vec3 frameViewPos, frameLightPos, frameLightColor;
+};
+
+#endif
@@ -0,0 +1,266 @@
+#include "texture_array.h"
+#include "../stb_image.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <tuple>
+
+std::vector<TextureArray> g_textureArrays;
+unsigned int g_whiteTextureArray = 0;
+
+bool load_image(const std::string &path, Image &image)
+{
+  int width, height, nrChannels;
+  unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrChannels, 0);
+  if (!data)
+  {
+    std::cerr << "Failed to load texture: " << path << std::endl;
+    std::cerr << "STB Error: " << stbi_failure_reason() << std::endl;
+    return false;
+  }
+
+  image.width = width;
+  image.height = height;
+  image.channels = nrChannels;
+  image.pixels.assign(data, data + (size_t)width * height * nrChannels);
+  stbi_image_free(data);
+  return true;
+}
+
+// 取一個 channel, 灰階 / 少 alpha 時補齊
+static float fetch(const Image &img, int x, int y, int c)
+{
+  x = ((x % img.width) + img.width) % img.width;
+  y = ((y % img.height) + img.height) % img.height;
+  const unsigned char *p = &img.pixels[((size_t)y * img.width + x) * img.channels];
+  if (img.channels >= 3)
+    return c < img.channels ? p[c] : 255.0f;
+  if (img.channels == 2)
+    return c < 3 ? p[0] : p[1];
+  return c < 3 ? p[0] : 255.0f;
+}
+
+static float bilinear(const Image &img, float u, float v, int c)
+{
+  float x = u * img.width - 0.5f;
+  float y = v * img.height - 0.5f;
+  int x0 = (int)std::floor(x);
+  int y0 = (int)std::floor(y);
+  float fx = x - x0;
+  float fy = y - y0;
+  float a = fetch(img, x0, y0, c) * (1 - fx) + fetch(img, x0 + 1, y0, c) * fx;
+  float b = fetch(img, x0, y0 + 1, c) * (1 - fx) + fetch(img, x0 + 1, y0 + 1, c) * fx;
+  return a * (1 - fy) + b * fy;
+}
+
+glm::vec4 sample_image(const Image &image, glm::vec2 uv)
+{
+  if (image.width == 0 || image.height == 0)
+    return glm::vec4(1.0f);
+  glm::vec4 color;
+  for (int c = 0; c < 4; ++c)
+    color[c] = bilinear(image, uv.x, uv.y, c) / 255.0f;
+  return color;
+}
+
+glm::vec3 average_albedo(const Material *mat)
+{
+  glm::vec3 color = glm::length(mat->Kd) > 0.01f ? mat->Kd : glm::vec3(0.8f);
+  Image image;
+  if (!mat->diffuseTexPath.empty() && load_image(mat->diffuseTexPath, image) && image.channels >= 3)
+  {
+    glm::dvec3 sum(0.0);
+    size_t pixels = (size_t)image.width * image.height;
+    for (size_t i = 0; i < pixels; ++i)
+      sum += glm::dvec3(image.pixels[i * image.channels], image.pixels[i * image.channels + 1],
+                        image.pixels[i * image.channels + 2]);
+    color = glm::vec3(sum / (255.0 * pixels));
+  }
+  return color;
+}
+
+Image resample_image(const Image &src, int width, int height, int channels)
+{
+  Image dst;
+  dst.width = width;
+  dst.height = height;
+  dst.channels = channels;
+  dst.pixels.resize((size_t)width * height * channels);
+
+  // 縮小倍率 > 1 時, 每個輸出像素取 n x n 個雙線性樣本平均
+  int nx = std::max(1, (int)std::ceil((float)src.width / width));
+  int ny = std::max(1, (int)std::ceil((float)src.height / height));
+
+  for (int y = 0; y < height; ++y)
+  {
+    for (int x = 0; x < width; ++x)
+    {
+      for (int c = 0; c < channels; ++c)
+      {
+        float sum = 0.0f;
+        for (int j = 0; j < ny; ++j)
+        {
+          for (int i = 0; i < nx; ++i)
+          {
+            float u = (x + (i + 0.5f) / nx) / width;
+            float v = (y + (j + 0.5f) / ny) / height;
+            sum += bilinear(src, u, v, c);
+          }
+        }
+        float value = sum / (nx * ny);
+        dst.pixels[((size_t)y * width + x) * channels + c] = (unsigned char)std::clamp(value + 0.5f, 0.0f, 255.0f);
+      }
+    }
+  }
+  return dst;
+}
+
+static int standard_size(int size, int minSize, int maxSize)
+{
+  // 最接近的 2 的次方 (以 log 距離計算)
+  int best = minSize;
+  for (int s = minSize; s <= maxSize; s *= 2)
+  {
+    if (std::abs(std::log2((float)s) - std::log2((float)size)) <
+        std::abs(std::log2((float)best) - std::log2((float)size)))
+      best = s;
+  }
+  return best;
+}
+
+void pack_texture_arrays(std::map<std::string, Material> &materials, int minSize, int maxSize)
+{
+  struct Entry
+  {
+    std::string path;
+    Image image;
+    int array = -1;
+    int layer = -1;
+  };
+
+  // 收集所有用到的貼圖 (同一個檔案只讀一次)
+  std::vector<Entry> entries;
+  std::map<std::string, int> entryIndex;
+  auto add = [&](const std::string &path)
+  {
+    if (path.empty() || entryIndex.count(path))
+      return;
+    Entry e;
+    e.path = path;
+    if (!load_image(path, e.image))
+      return;
+    entryIndex[path] = entries.size();
+    entries.push_back(std::move(e));
+  };
+  for (auto &[name, mat] : materials)
+  {
+    add(mat.diffuseTexPath);
+    add(mat.specularTexPath);
+  }
+
+  int maxLayers = 256;
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+  // 依 (寬, 高, 格式) 分組
+  std::map<std::tuple<int, int, int>, std::vector<int>> groups;
+  int resampled = 0;
+  for (size_t i = 0; i < entries.size(); ++i)
+  {
+    Image &img = entries[i].image;
+    int w = standard_size(img.width, minSize, maxSize);
+    int h = standard_size(img.height, minSize, maxSize);
+    int channels = (img.channels == 4 || img.channels == 2) ? 4 : 3;
+    if (w != img.width || h != img.height || channels != img.channels)
+    {
+      if (w != img.width || h != img.height)
+        resampled++;
+      img = resample_image(img, w, h, channels);
+    }
+    groups[{w, h, channels}].push_back(i);
+  }
+
+  for (auto &[key, members] : groups)
+  {
+    auto [w, h, channels] = key;
+    for (size_t start = 0; start < members.size(); start += maxLayers)
+    {
+      size_t count = std::min(members.size() - start, (size_t)maxLayers);
+
+      TextureArray array;
+      array.width = w;
+      array.height = h;
+      array.channels = channels;
+
+      GLenum format = channels == 4 ? GL_RGBA : GL_RGB;
+      GLenum internalFormat = channels == 4 ? GL_RGBA8 : GL_RGB8;
+
+      glGenTextures(1, &array.id);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, w, h, count, 0, format, GL_UNSIGNED_BYTE, NULL);
+      for (size_t l = 0; l < count; ++l)
+      {
+        Entry &e = entries[members[start + l]];
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, l, w, h, 1, format, GL_UNSIGNED_BYTE, e.image.pixels.data());
+        e.array = g_textureArrays.size();
+        e.layer = l;
+        array.layers.push_back(e.path);
+        e.image.pixels.clear();
+        e.image.pixels.shrink_to_fit();
+      }
+      glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+      g_textureArrays.push_back(array);
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  // 材質只記 (array, layer)
+  for (auto &[name, mat] : materials)
+  {
+    auto diffuse = entryIndex.find(mat.diffuseTexPath);
+    if (diffuse != entryIndex.end())
+    {
+      mat.diffuseArray = entries[diffuse->second].array;
+      mat.diffuseLayer = entries[diffuse->second].layer;
+    }
+    auto specular = entryIndex.find(mat.specularTexPath);
+    if (specular != entryIndex.end())
+    {
+      mat.specularArray = entries[specular->second].array;
+      mat.specularLayer = entries[specular->second].layer;
+    }
+  }
+
+  // 1x1 白色 array
+  unsigned char whitePixel[3] = {255, 255, 255};
+  glGenTextures(1, &g_whiteTextureArray);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, g_whiteTextureArray);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, 1, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, whitePixel);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  std::cout << "Texture arrays: " << entries.size() << " textures -> " << g_textureArrays.size()
+            << " arrays (" << resampled << " resampled)" << std::endl;
+  for (const auto &array : g_textureArrays)
+  {
+    std::cout << "  " << array.width << "x" << array.height << (array.channels == 4 ? " RGBA8" : " RGB8")
+              << " x " << array.layers.size() << " layers" << std::endl;
+  }
+}
+
+void release_texture_arrays()
+{
+  for (auto &array : g_textureArrays)
+    glDeleteTextures(1, &array.id);
+  g_textureArrays.clear();
+  glDeleteTextures(1, &g_whiteTextureArray);
+  g_whiteTextureArray = 0;
+}
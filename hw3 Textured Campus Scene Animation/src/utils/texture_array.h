@@ -0,0 +1,51 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glm/glm.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+// ========== CPU 端的圖片 ==========
+struct Image
+{
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  std::vector<unsigned char> pixels;
+};
+
+// 用 stb_image 讀檔, 失敗回傳 false
+bool load_image(const std::string &path, Image &image);
+
+// 雙線性 + box 平均重新取樣 (縮小時取 footprint 平均, 避免 aliasing), 貼圖是 REPEAT 所以邊界 wrap
+Image resample_image(const Image &src, int width, int height, int channels);
+
+// 雙線性取樣 (REPEAT), 回傳 0..1 的 RGBA; uv 與 GL 的貼圖座標相同
+glm::vec4 sample_image(const Image &image, glm::vec2 uv);
+
+// 烘焙反彈光用的 albedo: 有貼圖就取整張的平均 (跟 shader 一樣, 有貼圖時不看 Kd)
+glm::vec3 average_albedo(const Material *mat);
+
+// ========== 貼圖陣列 ==========
+// 同尺寸 + 同格式的貼圖合併成一個 GL_TEXTURE_2D_ARRAY, Material 只記 (array, layer)
+struct TextureArray
+{
+  unsigned int id = 0;
+  int width = 0;
+  int height = 0;
+  int channels = 0; // 3: RGB8, 4: RGBA8
+  std::vector<std::string> layers;
+};
+
+// 這些 extern 代表 texture_array.cpp 定義的全域變數
+extern std::vector<TextureArray> g_textureArrays;
+extern unsigned int g_whiteTextureArray; // 1x1 白色, 沒有任何貼圖時的預設
+
+// 尺寸對齊到 [minSize, maxSize] 內最接近的 2 的次方, 其餘 (outlier) 重新取樣
+void pack_texture_arrays(std::map<std::string, Material> &materials, int minSize = 64, int maxSize = 2048);
+void release_texture_arrays();
+
+#endif
@@ -0,0 +1,127 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+  if (threadCount == 0)
+    threadCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+  for (unsigned int i = 0; i < threadCount; ++i)
+    workers.emplace_back([this]
+                         { worker_loop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  taskReady.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+  if (workers.empty())
+  {
+    // 單核心機器: 直接在呼叫端做
+    task();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(std::move(task));
+    activeTasks++;
+  }
+  taskReady.notify_one();
+}
+
+void ThreadPool::wait_idle()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  taskDone.wait(lock, [this]
+                { return activeTasks == 0; });
+}
+
+void ThreadPool::worker_loop()
+{
+  while (true)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      taskReady.wait(lock, [this]
+                     { return stopping || !tasks.empty(); });
+      if (stopping && tasks.empty())
+        return;
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+
+    task();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      activeTasks--;
+    }
+    taskDone.notify_all();
+  }
+}
+
+void ThreadPool::parallel_for(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> &func)
+{
+  if (count == 0)
+    return;
+  grain = std::max<size_t>(grain, 1);
+  size_t chunks = (count + grain - 1) / grain;
+  if (chunks == 1 || workers.empty())
+  {
+    func(0, count);
+    return;
+  }
+
+  // 等的是「區段做完」而不是「task 做完」, 所以在 worker 裡巢狀呼叫也不會卡死:
+  // 呼叫端會自己把剩下的區段做完, 晚到的 task 拿不到區段就直接結束
+  struct State
+  {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+  };
+  auto state = std::make_shared<State>();
+
+  auto run = [state, count, grain, chunks, &func]
+  {
+    size_t chunk;
+    while ((chunk = state->next.fetch_add(1)) < chunks)
+    {
+      size_t begin = chunk * grain;
+      func(begin, std::min(count, begin + grain));
+      if (state->done.fetch_add(1) + 1 == chunks)
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->finished.notify_all();
+      }
+    }
+  };
+
+  size_t helpers = std::min<size_t>(workers.size(), chunks - 1);
+  for (size_t i = 0; i < helpers; ++i)
+    submit(run);
+  run();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->finished.wait(lock, [&]
+                       { return state->done.load() == chunks; });
+}
+
+ThreadPool &global_thread_pool()
+{
+  static ThreadPool pool;
+  return pool;
+}
@@ -0,0 +1,45 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ========== 簡單的 worker thread pool ==========
+class ThreadPool
+{
+public:
+  // threadCount = 0 時用 hardware_concurrency() - 1 (呼叫端本身也會幫忙做事)
+  explicit ThreadPool(unsigned int threadCount = 0);
+  ~ThreadPool();
+
+  // 丟一個非同步工作, 不等它完成
+  void submit(std::function<void()> task);
+
+  // 等所有 submit 的工作做完
+  void wait_idle();
+
+  // 把 [0, count) 切成大小 grain 的區段分給 worker, 呼叫端也一起做, 全部完成才回傳
+  void parallel_for(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> &func);
+
+  unsigned int size() const { return workers.size() + 1; }
+
+private:
+  void worker_loop();
+
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable taskReady;
+  std::condition_variable taskDone;
+  size_t activeTasks = 0;
+  bool stopping = false;
+};
+
+// 全程式共用一個 pool
+ThreadPool &global_thread_pool();
+
+#endif
@@ -0,0 +1,190 @@
+#include "tiled_poster.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+bool TiledPoster::parse_size(const std::string &text)
+{
+  int w = 0, h = 0;
+  if (std::sscanf(text.c_str(), "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+    return false;
+  width = w;
+  height = h;
+  return true;
+}
+
+bool TiledPoster::open(const std::string &outputPath, int maxTextureSize)
+{
+  path = outputPath;
+  supersample = std::max(1, supersample);
+  tileSize = std::max(16, std::min(tileSize, std::max(width, height)));
+  while (tileSize * supersample > maxTextureSize && tileSize > 16)
+    tileSize /= 2;
+  columns = (width + tileSize - 1) / tileSize;
+  rows = (height + tileSize - 1) / tileSize;
+
+  std::string extension = std::filesystem::path(path).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+  bool tiff = extension == ".tif" || extension == ".tiff";
+  if (!tiff && extension != ".ppm")
+  {
+    std::cerr << "Poster output must be .ppm, .tif or .tiff" << std::endl;
+    return false;
+  }
+  size_t pixelBytes = (size_t)width * height * 3;
+
+  file.open(path, std::ios::binary | std::ios::trunc);
+  if (!file)
+  {
+    std::cerr << "Cannot write " << path << std::endl;
+    return false;
+  }
+  if (tiff)
+  {
+    if (!write_tiff_header())
+      return false;
+  }
+  else
+    file << "P6\n" << width << " " << height << "\n255\n";
+  dataOffset = (size_t)file.tellp();
+
+  // 先把檔案撐到完整大小 (大部分檔案系統是 sparse 的, 不會真的寫這麼多)
+  file.seekp((std::streamoff)(dataOffset + pixelBytes - 1));
+  file.put(0);
+  return (bool)file;
+}
+
+// baseline TIFF, little endian, 未壓縮 RGB, 每列 tile 一個 strip
+bool TiledPoster::write_tiff_header()
+{
+  uint64_t pixelBytes = (uint64_t)width * height * 3;
+  int strips = rows;
+  const uint32_t ifdOffset = 8;
+  const uint16_t entries = 10;
+  uint32_t bitsOffset = ifdOffset + 2 + entries * 12 + 4;
+  uint32_t stripOffsetsOffset = bitsOffset + 6;
+  uint32_t stripCountsOffset = stripOffsetsOffset + 4 * strips;
+  uint32_t pixelOffset = (stripCountsOffset + 4 * strips + 15) & ~15u;
+  if (pixelOffset + pixelBytes > 0xffffffffull)
+  {
+    std::cerr << "Poster is larger than 4 GB, TIFF offsets do not fit; use .ppm" << std::endl;
+    return false;
+  }
+
+  std::vector<unsigned char> header(pixelOffset, 0);
+  auto put16 = [&](size_t at, uint32_t v) { header[at] = v & 0xff, header[at + 1] = (v >> 8) & 0xff; };
+  auto put32 = [&](size_t at, uint32_t v) { put16(at, v & 0xffff), put16(at + 2, v >> 16); };
+  header[0] = 'I', header[1] = 'I';
+  put16(2, 42);
+  put32(4, ifdOffset);
+  put16(ifdOffset, entries);
+  size_t at = ifdOffset + 2;
+  // type 3 = SHORT, 4 = LONG; count * size <= 4 時值直接放在 entry 裡
+  auto entry = [&](uint16_t tag, uint16_t type, uint32_t count, uint32_t value)
+  {
+    put16(at, tag), put16(at + 2, type), put32(at + 4, count);
+    if (type == 3 && count == 1)
+      put16(at + 8, value);
+    else
+      put32(at + 8, value);
+    at += 12;
+  };
+  uint32_t stripBytes = (uint32_t)width * tileSize * 3;
+  entry(256, 4, 1, width);                                                      // ImageWidth
+  entry(257, 4, 1, height);                                                     // ImageLength
+  entry(258, 3, 3, bitsOffset);                                                 // BitsPerSample 8, 8, 8
+  entry(259, 3, 1, 1);                                                          // Compression: none
+  entry(262, 3, 1, 2);                                                          // PhotometricInterpretation: RGB
+  entry(273, 4, strips, strips == 1 ? pixelOffset : stripOffsetsOffset);        // StripOffsets
+  entry(277, 3, 1, 3);                                                          // SamplesPerPixel
+  entry(278, 4, 1, tileSize);                                                   // RowsPerStrip
+  entry(279, 4, strips, strips == 1 ? (uint32_t)pixelBytes : stripCountsOffset); // StripByteCounts
+  entry(284, 3, 1, 1);                                                          // PlanarConfiguration: chunky
+  put32(at, 0);                                                                 // 沒有下一個 IFD
+  for (int i = 0; i < 3; ++i)
+    put16(bitsOffset + 2 * i, 8);
+  for (int s = 0; s < strips; ++s)
+  {
+    uint32_t rowsInStrip = std::min(tileSize, height - s * tileSize);
+    put32(stripOffsetsOffset + 4 * s, pixelOffset + s * stripBytes);
+    put32(stripCountsOffset + 4 * s, rowsInStrip * width * 3);
+  }
+  file.write((const char *)header.data(), header.size());
+  return (bool)file;
+}
+
+bool TiledPoster::close()
+{
+  file.close();
+  return !file.fail();
+}
+
+void TiledPoster::tile_rect(int tile, int &x, int &y, int &w, int &h) const
+{
+  x = (tile % columns) * tileSize;
+  y = (tile / columns) * tileSize;
+  w = std::min(tileSize, width - x);
+  h = std::min(tileSize, height - y);
+}
+
+void TiledPoster::render_size(int tile, int &w, int &h) const
+{
+  int x, y;
+  tile_rect(tile, x, y, w, h);
+  w *= supersample;
+  h *= supersample;
+}
+
+glm::mat4 TiledPoster::tile_projection(int tile, float fovy, float nearPlane, float farPlane) const
+{
+  // 整張海報的 near 平面: [-right, right] x [-top, top], 再依像素比例切出 tile 那一塊 (影像 y 往下)
+  float top = nearPlane * std::tan(fovy * 0.5f);
+  float right = top * (float)width / height;
+  int x, y, w, h;
+  tile_rect(tile, x, y, w, h);
+  float l = -right + 2.0f * right * x / width;
+  float r = -right + 2.0f * right * (x + w) / width;
+  float t = top - 2.0f * top * y / height;
+  float b = top - 2.0f * top * (y + h) / height;
+  return glm::frustum(l, r, b, t, nearPlane, farPlane);
+}
+
+void TiledPoster::write_tile(int tile, int renderWidth, int renderHeight, const std::vector<unsigned char> &rgba)
+{
+  int x, y, w, h;
+  tile_rect(tile, x, y, w, h);
+  int s = supersample;
+  if (renderWidth != w * s || renderHeight != h * s)
+  {
+    std::cerr << "Poster tile " << tile << " has the wrong size" << std::endl;
+    return;
+  }
+
+  // 一次一列: box filter 後寫到檔案裡 (y + row) 列的 x 處
+  std::vector<unsigned char> row((size_t)w * 3);
+  float scale = 1.0f / (s * s);
+  for (int r = 0; r < h; ++r)
+  {
+    int sourceRow = (h - 1 - r) * s; // GL 由下往上
+    for (int c = 0; c < w; ++c)
+    {
+      unsigned int sum[3] = {0, 0, 0};
+      for (int sy = 0; sy < s; ++sy)
+      {
+        const unsigned char *p = &rgba[((size_t)(sourceRow + sy) * renderWidth + c * s) * 4];
+        for (int sx = 0; sx < s; ++sx, p += 4)
+          sum[0] += p[0], sum[1] += p[1], sum[2] += p[2];
+      }
+      for (int k = 0; k < 3; ++k)
+        row[c * 3 + k] = (unsigned char)(sum[k] * scale + 0.5f);
+    }
+    std::lock_guard<std::mutex> lock(fileMutex);
+    file.seekp((std::streamoff)(dataOffset + ((size_t)(y + r) * width + x) * 3));
+    file.write((const char *)row.data(), row.size());
+  }
+}
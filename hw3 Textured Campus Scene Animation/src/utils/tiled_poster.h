@@ -0,0 +1,56 @@
+#ifndef TILED_POSTER_H
+#define TILED_POSTER_H
+
+#include <glm/glm.hpp>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// ========== 分塊渲染的大尺寸海報 ==========
+// 16K 以上的靜態圖超過 GL_MAX_TEXTURE_SIZE, 一張 render target 也要好幾 GB:
+// - 整張的透視投影切成 tileSize x tileSize 的 off-center 子 frustum, 每塊各畫一次 (glm::frustum)
+// - 每塊畫在 (tileSize * supersample)^2 的小 FBO, 經 FrameCapture 非同步讀回,
+//   encoder thread 做 supersample x supersample 的 box filter 後直接寫進檔案裡對應的位置
+// - 輸出是未壓縮的 PPM (P6) 或 strip 排列的 TIFF (每列 tile 一個 strip), 像素位置固定,
+//   檔案先整個配置好, 每塊 tile 寫自己那幾列的片段; 記憶體只跟 tile 大小有關, 跟海報尺寸無關
+class TiledPoster
+{
+public:
+  int width = 0, height = 0;
+  int tileSize = 1024;
+  int supersample = 1;
+
+  bool enabled() const { return width > 0; }
+  // "WxH"
+  bool parse_size(const std::string &text);
+
+  // 依副檔名 (.ppm / .tif / .tiff) 建立並預先配置檔案; tile 太大 (乘上 supersample 超過 maxTextureSize) 就縮小
+  bool open(const std::string &path, int maxTextureSize);
+  // 寫完所有 tile 後呼叫
+  bool close();
+
+  int tile_count() const { return columns * rows; }
+  // tile 在海報裡的範圍 (左上角為原點, 像素)
+  void tile_rect(int tile, int &x, int &y, int &w, int &h) const;
+  // 實際畫的大小 (乘上 supersample)
+  void render_size(int tile, int &w, int &h) const;
+  // 整張海報的 perspective (fovy 為垂直視角) 裡這塊 tile 的 off-center frustum
+  glm::mat4 tile_projection(int tile, float fovy, float nearPlane, float farPlane) const;
+
+  // encoder thread 呼叫: rgba 是 render_size 大小、由下往上
+  void write_tile(int tile, int renderWidth, int renderHeight, const std::vector<unsigned char> &rgba);
+
+  const std::string &output_path() const { return path; }
+
+private:
+  bool write_tiff_header();
+
+  std::string path;
+  int columns = 0, rows = 0;
+  std::ofstream file;
+  size_t dataOffset = 0; // 第 0 列像素在檔案裡的位置
+  std::mutex fileMutex;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// ========== lock-free triple buffer (一個寫入端、一個讀取端) ==========
+// 三個 slot: 寫入端一直擁有 back, 讀取端一直擁有 front, 中間那個用一次 atomic exchange 交換.
+// 寫入端永遠不會等 (讀取端來不及拿的舊資料直接被新的蓋掉), 讀取端拿到的永遠是最新發佈的那一份,
+// 而且在下一次 acquire 之前不會被改 (寫入端碰不到 front)
+template <typename T>
+class TripleBuffer
+{
+public:
+  // ---------- 寫入端 ----------
+  T &back() { return slots[backIndex]; }
+  // 把 back 發佈出去, 換回來的 slot 是讀取端沒拿走或已經用完的那個
+  void publish()
+  {
+    backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+    middle.notify_all();
+  }
+  // 上一次發佈的已經被讀取端拿走了
+  bool consumed() const { return !(middle.load(std::memory_order_acquire) & FRESH); }
+  // 等到上一次發佈的被拿走 (不忙等); 寫入端想跟讀取端同步時用
+  void wait_consumed() const
+  {
+    uint8_t state = middle.load(std::memory_order_acquire);
+    while (state & FRESH)
+    {
+      middle.wait(state, std::memory_order_acquire);
+      state = middle.load(std::memory_order_acquire);
+    }
+  }
+
+  // ---------- 讀取端 ----------
+  const T &front() const { return slots[frontIndex]; }
+  // 有新發佈的就換成 front, 回傳是否換了
+  bool acquire()
+  {
+    if (consumed())
+      return false;
+    frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+    middle.notify_all();
+    return true;
+  }
+  // 等到有新發佈的 (不忙等), 換成 front
+  void wait_acquire()
+  {
+    uint8_t state = middle.load(std::memory_order_acquire);
+    while (!(state & FRESH))
+    {
+      middle.wait(state, std::memory_order_acquire);
+      state = middle.load(std::memory_order_acquire);
+    }
+    acquire();
+  }
+
+private:
+  static constexpr uint8_t INDEX = 3;
+  static constexpr uint8_t FRESH = 4; // middle 是寫入端發佈後還沒被讀走的
+
+  T slots[3];
+  std::atomic<uint8_t> middle{1};
+  uint8_t backIndex = 0;  // 只有寫入端碰
+  uint8_t frontIndex = 2; // 只有讀取端碰
+};
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef UTILS_H
 #define UTILS_H
 #include <vector>
+#include <string>
 
 std::string load_shader_source(const std::string &filePath);
 std::vector<std::string> split(std::string line, std::string delimiter);
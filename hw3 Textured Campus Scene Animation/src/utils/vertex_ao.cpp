@@ -0,0 +1,241 @@
+#include "vertex_ao.h"
+#include "bvh.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <unordered_map>
+
+static const char AO_MAGIC[4] = {'A', 'O', 'V', '1'};
+
+namespace
+{
+// 位置 + 法線 (soup 裡同一個頂點會重複出現在每個相鄰三角形)
+struct AoKey
+{
+  float v[6];
+  bool operator==(const AoKey &other) const { return std::memcmp(v, other.v, sizeof(v)) == 0; }
+};
+
+struct AoKeyHash
+{
+  size_t operator()(const AoKey &key) const
+  {
+    // FNV-1a
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(key.v);
+    size_t hash = 1469598103934665603ull;
+    for (size_t i = 0; i < sizeof(key.v); ++i)
+    {
+      hash ^= bytes[i];
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+};
+}
+
+// 跟 n 垂直的兩個軸
+static void orthonormal_basis(const glm::vec3 &n, glm::vec3 &t, glm::vec3 &b)
+{
+  glm::vec3 up = std::abs(n.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+  t = glm::normalize(glm::cross(up, n));
+  b = glm::cross(n, t);
+}
+
+// 對 bvh 算 mesh 每個頂點的 AO
+static void bake_mesh(const Bvh &bvh, const Mesh &mesh, const std::vector<glm::vec3> &directions, float maxDistance,
+                      std::vector<float> &out)
+{
+  const float offset = 1e-4f;
+  size_t count = mesh.vertices.size() / VERTEX_STRIDE;
+  glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(mesh.transform)));
+
+  std::unordered_map<AoKey, unsigned int, AoKeyHash> unique;
+  std::vector<unsigned int> owner(count);
+  std::vector<size_t> firstVertex;
+  for (size_t i = 0; i < count; ++i)
+  {
+    const float *v = &mesh.vertices[i * VERTEX_STRIDE];
+    AoKey key{{v[0], v[1], v[2], v[5], v[6], v[7]}};
+    auto [it, inserted] = unique.emplace(key, (unsigned int)firstVertex.size());
+    if (inserted)
+      firstVertex.push_back(i);
+    owner[i] = it->second;
+  }
+
+  std::vector<float> values(firstVertex.size(), 1.0f);
+  global_thread_pool().parallel_for(firstVertex.size(), 256, [&](size_t begin, size_t end)
+  {
+    for (size_t k = begin; k < end; ++k)
+    {
+      const float *v = &mesh.vertices[firstVertex[k] * VERTEX_STRIDE];
+      glm::vec3 p = glm::vec3(mesh.transform * glm::vec4(v[0], v[1], v[2], 1.0f));
+      glm::vec3 n = normalMatrix * glm::vec3(v[5], v[6], v[7]);
+      if (glm::length(n) < 1e-12f)
+        continue;
+      n = glm::normalize(n);
+      glm::vec3 t, b;
+      orthonormal_basis(n, t, b);
+
+      // 同一組方向每個頂點轉一個隨機角度, 相鄰頂點的誤差才不會長成同一個圖樣
+      std::mt19937 rng(k * 2654435761u + 1);
+      float angle = std::uniform_real_distribution<float>(0.0f, 6.2831853f)(rng);
+      glm::vec3 rt = t * std::cos(angle) + b * std::sin(angle);
+      glm::vec3 rb = glm::cross(n, rt);
+
+      glm::vec3 origin = p + n * offset;
+      int hits = 0;
+      for (size_t r = 0; r < directions.size(); r += 4)
+      {
+        glm::vec3 world[4];
+        for (int lane = 0; lane < 4; ++lane)
+        {
+          const glm::vec3 &d = directions[r + lane];
+          world[lane] = rt * d.x + rb * d.y + n * d.z;
+        }
+        hits += std::popcount((unsigned int)bvh.occluded4(origin, world, 1e-5f, maxDistance));
+      }
+      values[k] = 1.0f - (float)hits / directions.size();
+    }
+  });
+
+  out.resize(count);
+  for (size_t i = 0; i < count; ++i)
+    out[i] = values[owner[i]];
+}
+
+void VertexAoBaker::bake(std::vector<Mesh> &meshes) const
+{
+  auto start = std::chrono::high_resolution_clock::now();
+
+  // tangent space 的 cosine 分布方向: 單位圓盤上的 Fibonacci 螺旋投影到半球, 分層比純亂數均勻
+  int rayCount = std::max(4, (raysPerVertex + 3) / 4 * 4);
+  std::vector<glm::vec3> directions(rayCount);
+  for (int i = 0; i < rayCount; ++i)
+  {
+    float u = (i + 0.5f) / rayCount;
+    float r = std::sqrt(u), phi = 2.3999632f * i;
+    directions[i] = glm::vec3(r * std::cos(phi), r * std::sin(phi), std::sqrt(1.0f - u));
+  }
+
+  std::vector<unsigned int> subset;
+  for (unsigned int m = 0; m < meshes.size(); ++m)
+  {
+    if (!meshes[m].proxy)
+      subset.push_back(m);
+  }
+  Bvh scene;
+  scene.build(meshes, subset);
+
+  // instancing 的 shape 只算第一個 instance, 其他 instance 直接複製
+  std::map<int, unsigned int> shapeOwner;
+  size_t vertexCount = 0;
+  for (unsigned int m : subset)
+  {
+    Mesh &mesh = meshes[m];
+    if (mesh.instanceShape < 0)
+    {
+      bake_mesh(scene, mesh, directions, maxDistance, mesh.ao);
+      vertexCount += mesh.ao.size();
+      continue;
+    }
+    auto [it, inserted] = shapeOwner.emplace(mesh.instanceShape, m);
+    if (!inserted)
+      continue;
+    Bvh shape;
+    shape.build(meshes, {m});
+    bake_mesh(shape, mesh, directions, maxDistance, mesh.ao);
+    vertexCount += mesh.ao.size();
+  }
+  for (unsigned int m : subset)
+  {
+    Mesh &mesh = meshes[m];
+    if (mesh.instanceShape >= 0 && shapeOwner[mesh.instanceShape] != m)
+      mesh.ao = meshes[shapeOwner[mesh.instanceShape]].ao;
+  }
+
+  float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+  std::cout << "Vertex AO baked: " << vertexCount << " vertices x " << rayCount << " rays, " << seconds << " s on "
+            << global_thread_pool().size() << " threads" << std::endl;
+}
+
+bool VertexAoBaker::save(const std::string &path, const std::vector<Mesh> &meshes) const
+{
+  std::ofstream file(path, std::ios::binary);
+  if (!file)
+  {
+    std::cerr << "Failed to write vertex AO: " << path << std::endl;
+    return false;
+  }
+  uint32_t meshCount = meshes.size();
+  uint64_t checksum = mesh_checksum(meshes);
+  file.write(AO_MAGIC, sizeof(AO_MAGIC));
+  file.write((const char *)&meshCount, sizeof(meshCount));
+  file.write((const char *)&checksum, sizeof(checksum));
+  file.write((const char *)&maxDistance, sizeof(maxDistance));
+  for (const Mesh &mesh : meshes)
+  {
+    uint32_t count = mesh.ao.size();
+    file.write((const char *)&count, sizeof(count));
+    file.write((const char *)mesh.ao.data(), count * sizeof(float));
+  }
+  std::cout << "Vertex AO saved: " << path << std::endl;
+  return (bool)file;
+}
+
+bool VertexAoBaker::load(const std::string &path, std::vector<Mesh> &meshes) const
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+
+  char magic[4];
+  uint32_t meshCount = 0;
+  uint64_t checksum = 0;
+  float distance = 0.0f;
+  file.read(magic, sizeof(magic));
+  file.read((char *)&meshCount, sizeof(meshCount));
+  file.read((char *)&checksum, sizeof(checksum));
+  file.read((char *)&distance, sizeof(distance));
+  if (!file || std::memcmp(magic, AO_MAGIC, sizeof(magic)) != 0 || meshCount != meshes.size() ||
+      checksum != mesh_checksum(meshes) || distance != maxDistance)
+  {
+    std::cout << "Vertex AO out of date, ignoring: " << path << std::endl;
+    return false;
+  }
+
+  std::vector<std::vector<float>> values(meshCount);
+  for (uint32_t m = 0; m < meshCount; ++m)
+  {
+    uint32_t count = 0;
+    file.read((char *)&count, sizeof(count));
+    if (!file || (count != 0 && count != meshes[m].vertices.size() / VERTEX_STRIDE))
+    {
+      std::cerr << "Vertex AO file truncated: " << path << std::endl;
+      return false;
+    }
+    values[m].resize(count);
+    file.read((char *)values[m].data(), count * sizeof(float));
+  }
+  if (!file)
+  {
+    std::cerr << "Vertex AO file truncated: " << path << std::endl;
+    return false;
+  }
+
+  size_t vertexCount = 0;
+  for (uint32_t m = 0; m < meshCount; ++m)
+  {
+    vertexCount += values[m].size();
+    meshes[m].ao = std::move(values[m]);
+  }
+  std::cout << "Vertex AO loaded: " << vertexCount << " vertices" << std::endl;
+  return true;
+}
@@ -0,0 +1,31 @@
+#ifndef VERTEX_AO_H
+#define VERTEX_AO_H
+
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+// ========== 逐頂點 ambient occlusion ==========
+// fragment.glsl 的 ambient 是常數, 牆角、屋簷下、樹底下都跟空地一樣亮; 螢幕空間 AO 又要每幀花 GPU 時間.
+// 場景不會動, 所以離線算好當成頂點屬性:
+// - 每個 (位置, 法線) 不同的頂點往法線半球射 raysPerVertex 條 cosine 分布的 ray,
+//   maxDistance 內被擋到的比例就是遮蔽量; BVH 用 Bvh::occluded4 一次走 4 條, thread pool 平行
+// - 結果寫進 Mesh::ao, 存成 models/<場景>/<場景>.ao
+// - instancing 的 shape 共用同一份頂點, 只算 shape 自己的遮蔽 (每個 instance 都一樣); HLOD 代理不算
+// 執行時 shader (USE_VERTEX_AO) 只是把 ambient 乘上內插的 AO
+class VertexAoBaker
+{
+public:
+  int raysPerVertex = 64;    // 會補到 4 的倍數 (一次一個 packet)
+  float maxDistance = 0.05f; // 場景正規化到 [-1, 1]; 更遠的遮擋不算, 不然室內整片都是黑的
+
+  // 多執行緒烘焙 (不需要 GL context), 填好每個 mesh 的 Mesh::ao
+  void bake(std::vector<Mesh> &meshes) const;
+
+  bool save(const std::string &path, const std::vector<Mesh> &meshes) const;
+  // 場景不同 (checksum / 頂點數對不上) 就回傳 false, Mesh::ao 保持不變
+  bool load(const std::string &path, std::vector<Mesh> &meshes) const;
+};
+
+#endif
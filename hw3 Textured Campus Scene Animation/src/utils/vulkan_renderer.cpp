@@ -0,0 +1,937 @@
+#include "vulkan_renderer.h"
+// glad 的 Vulkan loader 是 header-only, 實作放在這個檔案 (宣告已經由 vulkan_renderer.h 帶進來, 這裡只展開實作)
+#define GLAD_VULKAN_IMPLEMENTATION
+#include <glad/vulkan.h>
+#include "mdi_renderer.h"
+#include "../stb_image.h"
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+static bool check(VkResult result, const char *what)
+{
+  if (result == VK_SUCCESS)
+    return true;
+  std::cerr << "Vulkan: " << what << " failed (VkResult " << result << ")" << std::endl;
+  return false;
+}
+
+static GLADapiproc load_proc(void *instance, const char *name)
+{
+  return (GLADapiproc)glfwGetInstanceProcAddress((VkInstance)instance, name);
+}
+
+static bool read_spirv(const std::string &path, std::vector<uint32_t> &code)
+{
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file)
+    return false;
+  size_t bytes = (size_t)file.tellg();
+  if (bytes == 0 || bytes % 4 != 0)
+    return false;
+  code.resize(bytes / 4);
+  file.seekg(0);
+  file.read((char *)code.data(), bytes);
+  return (bool)file;
+}
+
+bool VulkanRenderer::init(const std::string &shaderDirectory)
+{
+  if (!glfwVulkanSupported())
+  {
+    std::cerr << "Vulkan: no loader / ICD found (install the Vulkan loader and a driver, e.g. Mesa lavapipe)"
+              << std::endl;
+    return false;
+  }
+  if (!gladLoadVulkanUserPtr(VK_NULL_HANDLE, load_proc, nullptr))
+  {
+    std::cerr << "Vulkan: failed to load the global functions" << std::endl;
+    return false;
+  }
+
+  VkApplicationInfo app{};
+
+  app.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app.pApplicationName = "Scene Animation";
+  app.apiVersion = VK_API_VERSION_1_2;
+  VkInstanceCreateInfo instanceInfo{};
+  instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  instanceInfo.pApplicationInfo = &app;
+  if (!check(vkCreateInstance(&instanceInfo, nullptr, &instance), "vkCreateInstance"))
+    return false;
+  gladLoadVulkanUserPtr(VK_NULL_HANDLE, load_proc, instance);
+
+  // 選 device: 要 1.2 + descriptor indexing + graphics queue; 獨立顯卡 > 內顯 > 其他 (lavapipe 是 CPU)
+  uint32_t count = 0;
+  vkEnumeratePhysicalDevices(instance, &count, nullptr);
+  std::vector<VkPhysicalDevice> candidates(count);
+  vkEnumeratePhysicalDevices(instance, &count, candidates.data());
+  int bestScore = -1;
+  for (VkPhysicalDevice candidate : candidates)
+  {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(candidate, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_2)
+      continue;
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features12;
+    vkGetPhysicalDeviceFeatures2(candidate, &features);
+    if (!features12.runtimeDescriptorArray || !features12.shaderSampledImageArrayNonUniformIndexing)
+      continue;
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(candidate, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(candidate, &familyCount, families.data());
+    int family = -1;
+    for (uint32_t f = 0; f < familyCount && family < 0; ++f)
+    {
+      if (families[f].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        family = f;
+    }
+    if (family < 0)
+      continue;
+
+    int score = properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU     ? 3
+                : properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ? 2
+                                                                                  : 1;
+    if (score > bestScore)
+    {
+      bestScore = score;
+      physicalDevice = candidate;
+      queueFamily = family;
+      deviceName = properties.deviceName;
+    }
+  }
+  if (physicalDevice == VK_NULL_HANDLE)
+  {
+    std::cerr << "Vulkan: no device with Vulkan 1.2 and descriptor indexing" << std::endl;
+    return false;
+  }
+  gladLoadVulkanUserPtr(physicalDevice, load_proc, instance);
+
+  float priority = 1.0f;
+  VkDeviceQueueCreateInfo queueInfo{};
+  queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  queueInfo.queueFamilyIndex = queueFamily;
+  queueInfo.queueCount = 1;
+  queueInfo.pQueuePriorities = &priority;
+  VkPhysicalDeviceVulkan12Features enabled12{};
+  enabled12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  enabled12.runtimeDescriptorArray = VK_TRUE;
+  enabled12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+  VkDeviceCreateInfo deviceInfo{};
+  deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  deviceInfo.pNext = &enabled12;
+  deviceInfo.queueCreateInfoCount = 1;
+  deviceInfo.pQueueCreateInfos = &queueInfo;
+  if (!check(vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &device), "vkCreateDevice"))
+    return false;
+  vkGetDeviceQueue(device, queueFamily, 0, &queue);
+
+  VkCommandPoolCreateInfo poolInfo{};
+
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = queueFamily;
+  if (!check(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool), "vkCreateCommandPool"))
+    return false;
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = commandPool;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+  if (!check(vkAllocateCommandBuffers(device, &allocInfo, &frameCommands), "vkAllocateCommandBuffers"))
+    return false;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+  if (!check(vkAllocateCommandBuffers(device, &allocInfo, &staticCommands), "vkAllocateCommandBuffers"))
+    return false;
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  if (!check(vkCreateFence(device, &fenceInfo, nullptr, &frameFence), "vkCreateFence"))
+    return false;
+
+  // 深度格式: 規格保證至少支援其中一個
+  for (VkFormat format : {VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D24_UNORM_S8_UINT})
+  {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+    if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+    {
+      depthFormat = format;
+      break;
+    }
+  }
+
+  // render pass: 清成背景色, 畫完直接轉成 transfer source 給讀回用
+  VkAttachmentDescription attachments[2] = {};
+  attachments[0].format = VK_FORMAT_R8G8B8A8_UNORM;
+  attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+  attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[0].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  attachments[1] = attachments[0];
+  attachments[1].format = depthFormat;
+  attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  VkAttachmentReference colorRef{0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference depthRef{1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+  VkSubpassDescription subpass{};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &colorRef;
+  subpass.pDepthStencilAttachment = &depthRef;
+  // 上一幀的讀回 (transfer) 要在這一幀寫 color 之前完成
+  VkSubpassDependency dependency{};
+  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependency.dstSubpass = 0;
+  dependency.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependency.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  VkRenderPassCreateInfo passInfo{};
+  passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  passInfo.attachmentCount = 2;
+  passInfo.pAttachments = attachments;
+  passInfo.subpassCount = 1;
+  passInfo.pSubpasses = &subpass;
+  passInfo.dependencyCount = 1;
+  passInfo.pDependencies = &dependency;
+  if (!check(vkCreateRenderPass(device, &passInfo, nullptr, &renderPass), "vkCreateRenderPass"))
+    return false;
+
+  // 建置時由 vertex.glsl / fragment.glsl 產生的 SPIR-V
+  const std::pair<const char *, VkShaderModule *> modules[] = {{"scene.vert.spv", &vertexShader},
+                                                               {"scene.frag.spv", &fragmentShader}};
+  for (const auto &[name, module] : modules)
+  {
+    std::vector<uint32_t> code;
+    std::string path = shaderDirectory + "/" + name;
+    if (!read_spirv(path, code))
+    {
+      std::cerr << "Vulkan: cannot read " << path << " (built by glslangValidator at build time)" << std::endl;
+      return false;
+    }
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = code.size() * 4;
+    moduleInfo.pCode = code.data();
+    if (!check(vkCreateShaderModule(device, &moduleInfo, nullptr, module), "vkCreateShaderModule"))
+      return false;
+  }
+
+  std::cout << "Vulkan: " << deviceName << std::endl;
+  return true;
+}
+
+uint32_t VulkanRenderer::memory_type(uint32_t typeBits, VkMemoryPropertyFlags properties) const
+{
+  VkPhysicalDeviceMemoryProperties memory;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memory);
+  for (uint32_t i = 0; i < memory.memoryTypeCount; ++i)
+  {
+    if ((typeBits & (1u << i)) && (memory.memoryTypes[i].propertyFlags & properties) == properties)
+      return i;
+  }
+  return ~0u;
+}
+
+bool VulkanRenderer::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, bool hostVisible, Buffer &buffer)
+{
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = std::max<VkDeviceSize>(size, 4);
+  bufferInfo.usage = usage;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if (!check(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer.buffer), "vkCreateBuffer"))
+    return false;
+  buffer.size = bufferInfo.size;
+
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(device, buffer.buffer, &requirements);
+  VkMemoryPropertyFlags properties = hostVisible
+                                         ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                                         : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = requirements.size;
+  allocInfo.memoryTypeIndex = memory_type(requirements.memoryTypeBits, properties);
+  if (allocInfo.memoryTypeIndex == ~0u)
+  {
+    std::cerr << "Vulkan: no memory type for buffer" << std::endl;
+    return false;
+  }
+  if (!check(vkAllocateMemory(device, &allocInfo, nullptr, &buffer.memory), "vkAllocateMemory") ||
+      !check(vkBindBufferMemory(device, buffer.buffer, buffer.memory, 0), "vkBindBufferMemory"))
+    return false;
+  if (hostVisible && !check(vkMapMemory(device, buffer.memory, 0, VK_WHOLE_SIZE, 0, &buffer.mapped), "vkMapMemory"))
+    return false;
+  return true;
+}
+
+void VulkanRenderer::destroy_buffer(Buffer &buffer)
+{
+  if (buffer.buffer)
+    vkDestroyBuffer(device, buffer.buffer, nullptr);
+  if (buffer.memory)
+    vkFreeMemory(device, buffer.memory, nullptr);
+  buffer = Buffer();
+}
+
+VkCommandBuffer VulkanRenderer::begin_one_shot()
+{
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = commandPool;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+  VkCommandBuffer commands = VK_NULL_HANDLE;
+  if (!check(vkAllocateCommandBuffers(device, &allocInfo, &commands), "vkAllocateCommandBuffers"))
+    return VK_NULL_HANDLE;
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkBeginCommandBuffer(commands, &beginInfo);
+  return commands;
+}
+
+bool VulkanRenderer::end_one_shot(VkCommandBuffer commands)
+{
+  vkEndCommandBuffer(commands);
+  VkSubmitInfo submit{};
+  submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit.commandBufferCount = 1;
+  submit.pCommandBuffers = &commands;
+  bool ok = check(vkQueueSubmit(queue, 1, &submit, VK_NULL_HANDLE), "vkQueueSubmit") &&
+            check(vkQueueWaitIdle(queue), "vkQueueWaitIdle");
+  vkFreeCommandBuffers(device, commandPool, 1, &commands);
+  return ok;
+}
+
+// 經過 staging buffer 複製到 device local
+bool VulkanRenderer::upload_buffer(const void *data, VkDeviceSize size, VkBufferUsageFlags usage, Buffer &buffer)
+{
+  Buffer staging;
+  if (!create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true, staging))
+    return false;
+  std::memcpy(staging.mapped, data, size);
+  bool ok = create_buffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, buffer);
+  if (ok)
+  {
+    VkCommandBuffer commands = begin_one_shot();
+    VkBufferCopy region{0, 0, size};
+    vkCmdCopyBuffer(commands, staging.buffer, buffer.buffer, 1, &region);
+    ok = end_one_shot(commands);
+  }
+  destroy_buffer(staging);
+  return ok;
+}
+
+bool VulkanRenderer::create_image(uint32_t w, uint32_t h, uint32_t levels, VkFormat format, VkImageUsageFlags usage,
+                                  VkImageAspectFlags aspect, Image &image)
+{
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = format;
+  imageInfo.extent = {w, h, 1};
+  imageInfo.mipLevels = levels;
+  imageInfo.arrayLayers = 1;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage = usage;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  if (!check(vkCreateImage(device, &imageInfo, nullptr, &image.image), "vkCreateImage"))
+    return false;
+
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(device, image.image, &requirements);
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = requirements.size;
+  allocInfo.memoryTypeIndex = memory_type(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  if (allocInfo.memoryTypeIndex == ~0u)
+  {
+    std::cerr << "Vulkan: no memory type for image" << std::endl;
+    return false;
+  }
+  if (!check(vkAllocateMemory(device, &allocInfo, nullptr, &image.memory), "vkAllocateMemory") ||
+      !check(vkBindImageMemory(device, image.image, image.memory, 0), "vkBindImageMemory"))
+    return false;
+
+  VkImageViewCreateInfo viewInfo{};
+
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = image.image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = format;
+  viewInfo.subresourceRange = {aspect, 0, levels, 0, 1};
+  return check(vkCreateImageView(device, &viewInfo, nullptr, &image.view), "vkCreateImageView");
+}
+
+void VulkanRenderer::destroy_image(Image &image)
+{
+  if (image.view)
+    vkDestroyImageView(device, image.view, nullptr);
+  if (image.image)
+    vkDestroyImage(device, image.image, nullptr);
+  if (image.memory)
+    vkFreeMemory(device, image.memory, nullptr);
+  image = Image();
+}
+
+// 上傳第 0 層後用 vkCmdBlitImage 逐層縮小 (跟 glGenerateMipmap 一樣一路縮到 1x1)
+bool VulkanRenderer::upload_texture(const unsigned char *rgba, int w, int h)
+{
+  uint32_t levels = 1;
+  while ((std::max(w, h) >> levels) > 0)
+    ++levels;
+  Image image;
+  if (!create_image(w, h, levels, VK_FORMAT_R8G8B8A8_UNORM,
+                    VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                    VK_IMAGE_ASPECT_COLOR_BIT, image))
+  {
+    destroy_image(image);
+    return false;
+  }
+  Buffer staging;
+  VkDeviceSize bytes = (VkDeviceSize)w * h * 4;
+  if (!create_buffer(bytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true, staging))
+  {
+    destroy_image(image);
+    return false;
+  }
+  std::memcpy(staging.mapped, rgba, bytes);
+
+  VkCommandBuffer commands = begin_one_shot();
+  auto barrier = [&](uint32_t level, uint32_t levelCount, VkImageLayout from, VkImageLayout to, VkAccessFlags srcAccess,
+                     VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage)
+  {
+    VkImageMemoryBarrier b{};
+    b.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    b.srcAccessMask = srcAccess;
+    b.dstAccessMask = dstAccess;
+    b.oldLayout = from;
+    b.newLayout = to;
+    b.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    b.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    b.image = image.image;
+    b.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, levelCount, 0, 1};
+    vkCmdPipelineBarrier(commands, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &b);
+  };
+  barrier(0, levels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+  VkBufferImageCopy copy{};
+  copy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  copy.imageExtent = {(uint32_t)w, (uint32_t)h, 1};
+  vkCmdCopyBufferToImage(commands, staging.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+
+  int32_t levelW = w, levelH = h;
+  for (uint32_t level = 1; level < levels; ++level)
+  {
+    barrier(level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT);
+    int32_t nextW = std::max(1, levelW / 2), nextH = std::max(1, levelH / 2);
+    VkImageBlit blit{};
+    blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1};
+    blit.srcOffsets[1] = {levelW, levelH, 1};
+    blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+    blit.dstOffsets[1] = {nextW, nextH, 1};
+    vkCmdBlitImage(commands, image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image.image,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+    levelW = nextW;
+    levelH = nextH;
+  }
+  // 最後一層還是 transfer dst, 其他層是 transfer src
+  if (levels > 1)
+    barrier(0, levels - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+  barrier(levels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+          VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+  bool ok = end_one_shot(commands);
+  destroy_buffer(staging);
+  if (!ok)
+  {
+    destroy_image(image);
+    return false;
+  }
+  textures.push_back(image);
+  return true;
+}
+
+int VulkanRenderer::load_texture(const std::string &path)
+{
+  int w, h, channels;
+  unsigned char *data = stbi_load(path.c_str(), &w, &h, &channels, 0);
+  if (!data)
+  {
+    std::cerr << "Vulkan: failed to load texture " << path << std::endl;
+    return -1;
+  }
+  // 跟 GL 一樣: 單通道是 (r, 0, 0), 沒有 alpha 就補 1
+  std::vector<unsigned char> rgba((size_t)w * h * 4);
+  for (size_t i = 0; i < (size_t)w * h; ++i)
+  {
+    const unsigned char *src = data + i * channels;
+    rgba[i * 4] = src[0];
+    rgba[i * 4 + 1] = channels >= 2 ? src[1] : 0;
+    rgba[i * 4 + 2] = channels >= 3 ? src[2] : 0;
+    rgba[i * 4 + 3] = channels == 4 ? src[3] : 255;
+  }
+  stbi_image_free(data);
+  return upload_texture(rgba.data(), w, h) ? (int)textures.size() - 1 : -1;
+}
+
+bool VulkanRenderer::build(const std::vector<Mesh> &meshes, const std::vector<unsigned int> &visible)
+{
+  // ---------- 幾何: 跟 MdiRenderer 一樣每個 mesh 去重成 indexed geometry, 同一個 instancing shape 共用 ----------
+  std::vector<float> allVertices;
+  std::vector<unsigned int> allIndices;
+  std::vector<DrawRange> meshRanges(meshes.size());
+  std::map<int, DrawRange> shapeRanges;
+  for (uint32_t m = 0; m < meshes.size(); ++m)
+  {
+    const Mesh &mesh = meshes[m];
+    auto shared = mesh.instanceShape >= 0 ? shapeRanges.find(mesh.instanceShape) : shapeRanges.end();
+    DrawRange range;
+    if (shared != shapeRanges.end())
+      range = shared->second;
+    else
+    {
+      range.firstIndex = allIndices.size();
+      range.vertexOffset = allVertices.size() / VERTEX_STRIDE;
+      index_vertices(mesh.vertices, allVertices, allIndices);
+      range.indexCount = allIndices.size() - range.firstIndex;
+      if (mesh.instanceShape >= 0)
+        shapeRanges.emplace(mesh.instanceShape, range);
+    }
+    range.mesh = m;
+    meshRanges[m] = range;
+  }
+  ranges.clear();
+  for (unsigned int m : visible)
+  {
+    if (meshes[m].material && meshRanges[m].indexCount > 0)
+      ranges.push_back(meshRanges[m]);
+  }
+  drawCount = ranges.size();
+
+  // ---------- 材質與貼圖: 第 0 張是白色 ----------
+  const unsigned char white[4] = {255, 255, 255, 255};
+  if (!upload_texture(white, 1, 1))
+    return false;
+  std::map<std::string, int> loaded;
+  auto texture_index = [&](const std::string &path)
+  {
+    if (path.empty())
+      return -1;
+    auto it = loaded.find(path);
+    if (it == loaded.end())
+      it = loaded.emplace(path, load_texture(path)).first;
+    return it->second;
+  };
+  std::vector<GpuMaterial> gpuMaterials;
+  std::vector<GpuDrawData> drawData(meshes.size());
+  std::map<const Material *, std::pair<uint32_t, glm::uvec2>> materialIndex;
+  for (uint32_t m = 0; m < meshes.size(); ++m)
+  {
+    const Material *mat = meshes[m].material;
+    glm::uvec4 info(0u);
+    if (mat)
+    {
+      auto it = materialIndex.find(mat);
+      if (it == materialIndex.end())
+      {
+        int diffuse = texture_index(mat->diffuseTexPath);
+        int specular = texture_index(mat->specularTexPath);
+        GpuMaterial gm;
+        gm.Ka = glm::vec4(mat->Ka, 0.0f);
+        gm.Kd = glm::vec4(mat->Kd, 0.0f);
+        gm.Ks = glm::vec4(mat->Ks, 0.0f);
+        gm.Ke = glm::vec4(mat->Ke, 0.0f);
+        gm.params = glm::vec4(mat->Ns, mat->d, diffuse >= 0 ? 1.0f : 0.0f, specular >= 0 ? 1.0f : 0.0f);
+        gpuMaterials.push_back(gm);
+        glm::uvec2 slots(std::max(diffuse, 0), std::max(specular, 0));
+        it = materialIndex.emplace(mat, std::make_pair((uint32_t)gpuMaterials.size() - 1, slots)).first;
+      }
+      info = glm::uvec4(it->second.first, it->second.second.x, it->second.second.y, 0u);
+    }
+    drawData[m] = {meshes[m].transform, info};
+  }
+  if (gpuMaterials.empty())
+    gpuMaterials.push_back(GpuMaterial{});
+  std::vector<uint32_t> drawIdData(meshes.size());
+  for (uint32_t m = 0; m < meshes.size(); ++m)
+    drawIdData[m] = m;
+
+  if (!upload_buffer(allVertices.data(), allVertices.size() * sizeof(float), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                     vertices) ||
+      !upload_buffer(allIndices.data(), allIndices.size() * sizeof(unsigned int), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                     indices) ||
+      !upload_buffer(drawIdData.data(), drawIdData.size() * sizeof(uint32_t), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                     drawIds) ||
+      !upload_buffer(drawData.data(), drawData.size() * sizeof(GpuDrawData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                     draws) ||
+      !upload_buffer(gpuMaterials.data(), gpuMaterials.size() * sizeof(GpuMaterial),
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, materials) ||
+      !create_buffer(sizeof(FrameUniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, true, uniforms))
+    return false;
+
+  // ---------- descriptor set: draws, materials, frame uniforms, textures[] ----------
+  VkSamplerCreateInfo samplerInfo{};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_LINEAR;
+  samplerInfo.minFilter = VK_FILTER_LINEAR;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+  if (!check(vkCreateSampler(device, &samplerInfo, nullptr, &sampler), "vkCreateSampler"))
+    return false;
+
+  uint32_t textureCount = textures.size();
+  VkDescriptorSetLayoutBinding bindings[4] = {
+      {0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr},
+      {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
+      {2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
+      {3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textureCount, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}};
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 4;
+  layoutInfo.pBindings = bindings;
+  if (!check(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout), "vkCreateDescriptorSetLayout"))
+    return false;
+
+  VkDescriptorPoolSize poolSizes[3] = {{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2},
+                                       {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+                                       {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textureCount}};
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = 3;
+  poolInfo.pPoolSizes = poolSizes;
+  if (!check(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool), "vkCreateDescriptorPool"))
+    return false;
+  VkDescriptorSetAllocateInfo setInfo{};
+  setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  setInfo.descriptorPool = descriptorPool;
+  setInfo.descriptorSetCount = 1;
+  setInfo.pSetLayouts = &setLayout;
+  if (!check(vkAllocateDescriptorSets(device, &setInfo, &descriptorSet), "vkAllocateDescriptorSets"))
+    return false;
+
+  VkDescriptorBufferInfo bufferInfos[3] = {{draws.buffer, 0, VK_WHOLE_SIZE},
+                                           {materials.buffer, 0, VK_WHOLE_SIZE},
+                                           {uniforms.buffer, 0, VK_WHOLE_SIZE}};
+  std::vector<VkDescriptorImageInfo> imageInfos;
+  for (const Image &texture : textures)
+    imageInfos.push_back({sampler, texture.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL});
+  VkWriteDescriptorSet writes[4] = {};
+  for (uint32_t b = 0; b < 4; ++b)
+  {
+    writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[b].dstSet = descriptorSet;
+    writes[b].dstBinding = b;
+    writes[b].descriptorType = bindings[b].descriptorType;
+    writes[b].descriptorCount = bindings[b].descriptorCount;
+    if (b < 3)
+      writes[b].pBufferInfo = &bufferInfos[b];
+    else
+      writes[b].pImageInfo = imageInfos.data();
+  }
+  vkUpdateDescriptorSets(device, 4, writes, 0, nullptr);
+
+  if (!create_pipeline())
+    return false;
+  std::cout << "Vulkan: " << drawCount << " static draws, " << allIndices.size() / 3 << " triangles, "
+            << gpuMaterials.size() << " materials, " << textures.size() << " textures in one descriptor array"
+            << std::endl;
+  return true;
+}
+
+// 唯一的一條 pipeline (VULKAN + USE_MDI 這個 shader variant); viewport / scissor 是 dynamic state
+bool VulkanRenderer::create_pipeline()
+{
+  VkPipelineLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layoutInfo.setLayoutCount = 1;
+  layoutInfo.pSetLayouts = &setLayout;
+  if (!check(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &pipelineLayout), "vkCreatePipelineLayout"))
+    return false;
+
+  VkPipelineShaderStageCreateInfo stages[2] = {};
+  stages[0].sType = stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  stages[0].module = vertexShader;
+  stages[0].pName = "main";
+  stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  stages[1].module = fragmentShader;
+  stages[1].pName = "main";
+
+  // 跟 MDI 的 VAO 一樣: x y z | u v | nx ny nz, 加上 divisor = 1 的 draw ID
+  VkVertexInputBindingDescription vertexBindings[2] = {
+      {0, VERTEX_STRIDE * sizeof(float), VK_VERTEX_INPUT_RATE_VERTEX},
+      {1, sizeof(uint32_t), VK_VERTEX_INPUT_RATE_INSTANCE}};
+  VkVertexInputAttributeDescription attributes[4] = {{0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0},
+                                                     {1, 0, VK_FORMAT_R32G32_SFLOAT, 3 * sizeof(float)},
+                                                     {2, 0, VK_FORMAT_R32G32B32_SFLOAT, 5 * sizeof(float)},
+                                                     {3, 1, VK_FORMAT_R32_UINT, 0}};
+  VkPipelineVertexInputStateCreateInfo vertexInput{};
+  vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInput.vertexBindingDescriptionCount = 2;
+  vertexInput.pVertexBindingDescriptions = vertexBindings;
+  vertexInput.vertexAttributeDescriptionCount = 4;
+  vertexInput.pVertexAttributeDescriptions = attributes;
+
+  VkPipelineInputAssemblyStateCreateInfo assembly{};
+
+  assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  VkPipelineViewportStateCreateInfo viewport{};
+  viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewport.viewportCount = 1;
+  viewport.scissorCount = 1;
+  // GL 路徑沒有開 face culling
+  VkPipelineRasterizationStateCreateInfo raster{};
+  raster.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  raster.polygonMode = VK_POLYGON_MODE_FILL;
+  raster.cullMode = VK_CULL_MODE_NONE;
+  raster.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  raster.lineWidth = 1.0f;
+  VkPipelineMultisampleStateCreateInfo multisample{};
+  multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+  VkPipelineDepthStencilStateCreateInfo depth{};
+  depth.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depth.depthTestEnable = VK_TRUE;
+  depth.depthWriteEnable = VK_TRUE;
+  depth.depthCompareOp = VK_COMPARE_OP_LESS;
+  VkPipelineColorBlendAttachmentState blendAttachment{};
+  blendAttachment.colorWriteMask =
+      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  VkPipelineColorBlendStateCreateInfo blend{};
+  blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  blend.attachmentCount = 1;
+  blend.pAttachments = &blendAttachment;
+  VkDynamicState dynamicStates[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamic{};
+  dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamic.dynamicStateCount = 2;
+  dynamic.pDynamicStates = dynamicStates;
+
+  VkGraphicsPipelineCreateInfo pipelineInfo{};
+
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.stageCount = 2;
+  pipelineInfo.pStages = stages;
+  pipelineInfo.pVertexInputState = &vertexInput;
+  pipelineInfo.pInputAssemblyState = &assembly;
+  pipelineInfo.pViewportState = &viewport;
+  pipelineInfo.pRasterizationState = &raster;
+  pipelineInfo.pMultisampleState = &multisample;
+  pipelineInfo.pDepthStencilState = &depth;
+  pipelineInfo.pColorBlendState = &blend;
+  pipelineInfo.pDynamicState = &dynamic;
+  pipelineInfo.layout = pipelineLayout;
+  pipelineInfo.renderPass = renderPass;
+  pipelineInfo.subpass = 0;
+  return check(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline),
+               "vkCreateGraphicsPipelines");
+}
+
+bool VulkanRenderer::create_targets(int w, int h)
+{
+  destroy_targets();
+  if (!create_image(w, h, 1, VK_FORMAT_R8G8B8A8_UNORM,
+                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+                    colorTarget) ||
+      !create_image(w, h, 1, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+                    depthTarget) ||
+      !create_buffer((VkDeviceSize)w * h * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT, true, readback))
+    return false;
+
+  VkImageView views[2] = {colorTarget.view, depthTarget.view};
+  VkFramebufferCreateInfo framebufferInfo{};
+  framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  framebufferInfo.renderPass = renderPass;
+  framebufferInfo.attachmentCount = 2;
+  framebufferInfo.pAttachments = views;
+  framebufferInfo.width = w;
+  framebufferInfo.height = h;
+  framebufferInfo.layers = 1;
+  if (!check(vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffer), "vkCreateFramebuffer"))
+    return false;
+  width = w;
+  height = h;
+  color.resize((size_t)w * h * 4);
+  return record_static_draws();
+}
+
+void VulkanRenderer::destroy_targets()
+{
+  if (!device)
+    return;
+  if (framebuffer)
+    vkDestroyFramebuffer(device, framebuffer, nullptr);
+  framebuffer = VK_NULL_HANDLE;
+  destroy_image(colorTarget);
+  destroy_image(depthTarget);
+  destroy_buffer(readback);
+  width = height = 0;
+}
+
+// 全部靜態幾何的 draw 錄一次; 每個 mesh 一個 vkCmdDrawIndexed, firstInstance 是 mesh index (-> aDrawID)
+bool VulkanRenderer::record_static_draws()
+{
+  VkCommandBufferInheritanceInfo inheritance{};
+  inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inheritance.renderPass = renderPass;
+  inheritance.subpass = 0;
+  inheritance.framebuffer = framebuffer;
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  beginInfo.pInheritanceInfo = &inheritance;
+  if (!check(vkBeginCommandBuffer(staticCommands, &beginInfo), "vkBeginCommandBuffer"))
+    return false;
+
+  // 正的 viewport 高度: 第 0 列是 NDC y = -1, 讀回來就是由下往上 (跟 glReadPixels 一樣)
+  VkViewport viewport{0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f};
+  VkRect2D scissor{{0, 0}, {(uint32_t)width, (uint32_t)height}};
+  vkCmdSetViewport(staticCommands, 0, 1, &viewport);
+  vkCmdSetScissor(staticCommands, 0, 1, &scissor);
+  vkCmdBindPipeline(staticCommands, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  vkCmdBindDescriptorSets(staticCommands, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0,
+                          nullptr);
+  VkBuffer vertexBuffers[2] = {vertices.buffer, drawIds.buffer};
+  VkDeviceSize offsets[2] = {0, 0};
+  vkCmdBindVertexBuffers(staticCommands, 0, 2, vertexBuffers, offsets);
+  vkCmdBindIndexBuffer(staticCommands, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+  for (const DrawRange &range : ranges)
+    vkCmdDrawIndexed(staticCommands, range.indexCount, 1, range.firstIndex, range.vertexOffset, range.mesh);
+  return check(vkEndCommandBuffer(staticCommands), "vkEndCommandBuffer");
+}
+
+bool VulkanRenderer::render(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &viewPos,
+                            const glm::vec3 &lightPos, const glm::vec3 &lightColor, int w, int h)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  if ((w != width || h != height) && !create_targets(w, h))
+    return false;
+
+  // GL 的 projection 把深度映到 [-1, 1], Vulkan 要 [0, 1]
+  glm::mat4 depthRemap(1.0f);
+  depthRemap[2][2] = 0.5f;
+  depthRemap[3][2] = 0.5f;
+  FrameUniforms frame{view, depthRemap * projection, glm::vec4(lightPos, 0.0f), glm::vec4(viewPos, 0.0f),
+                      glm::vec4(lightColor, 0.0f)};
+  std::memcpy(uniforms.mapped, &frame, sizeof(frame));
+
+  VkCommandBufferBeginInfo beginInfo{};
+
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkBeginCommandBuffer(frameCommands, &beginInfo);
+  VkClearValue clears[2];
+  clears[0].color = {{0.4f, 0.4f, 0.4f, 1.0f}};
+  clears[1].depthStencil = {1.0f, 0};
+  VkRenderPassBeginInfo passBegin{};
+  passBegin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  passBegin.renderPass = renderPass;
+  passBegin.framebuffer = framebuffer;
+  passBegin.renderArea = {{0, 0}, {(uint32_t)width, (uint32_t)height}};
+  passBegin.clearValueCount = 2;
+  passBegin.pClearValues = clears;
+  vkCmdBeginRenderPass(frameCommands, &passBegin, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  vkCmdExecuteCommands(frameCommands, 1, &staticCommands);
+  vkCmdEndRenderPass(frameCommands);
+
+  // render pass 結束時 color 已經是 transfer src
+  VkBufferImageCopy copy{};
+  copy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  copy.imageExtent = {(uint32_t)width, (uint32_t)height, 1};
+  vkCmdCopyImageToBuffer(frameCommands, colorTarget.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, 1,
+                         &copy);
+  VkBufferMemoryBarrier toHost{};
+  toHost.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  toHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  toHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  toHost.buffer = readback.buffer;
+  toHost.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(frameCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+                       &toHost, 0, nullptr);
+  if (!check(vkEndCommandBuffer(frameCommands), "vkEndCommandBuffer"))
+    return false;
+
+  VkSubmitInfo submit{};
+
+  submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit.commandBufferCount = 1;
+  submit.pCommandBuffers = &frameCommands;
+  if (!check(vkQueueSubmit(queue, 1, &submit, frameFence), "vkQueueSubmit"))
+    return false;
+  lastRecordMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+  if (!check(vkWaitForFences(device, 1, &frameFence, VK_TRUE, UINT64_MAX), "vkWaitForFences"))
+    return false;
+  vkResetFences(device, 1, &frameFence);
+  std::memcpy(color.data(), readback.mapped, color.size());
+  lastFrameMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+  return true;
+}
+
+void VulkanRenderer::release()
+{
+  if (device)
+  {
+    vkDeviceWaitIdle(device);
+    destroy_targets();
+    for (Image &texture : textures)
+      destroy_image(texture);
+    textures.clear();
+    for (Buffer *buffer : {&vertices, &indices, &drawIds, &draws, &materials, &uniforms})
+      destroy_buffer(*buffer);
+    if (pipeline)
+      vkDestroyPipeline(device, pipeline, nullptr);
+    if (pipelineLayout)
+      vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    if (descriptorPool)
+      vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    if (setLayout)
+      vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+    if (sampler)
+      vkDestroySampler(device, sampler, nullptr);
+    if (vertexShader)
+      vkDestroyShaderModule(device, vertexShader, nullptr);
+    if (fragmentShader)
+      vkDestroyShaderModule(device, fragmentShader, nullptr);
+    if (renderPass)
+      vkDestroyRenderPass(device, renderPass, nullptr);
+    if (frameFence)
+      vkDestroyFence(device, frameFence, nullptr);
+    if (commandPool)
+      vkDestroyCommandPool(device, commandPool, nullptr);
+    vkDestroyDevice(device, nullptr);
+  }
+  if (instance)
+    vkDestroyInstance(instance, nullptr);
+  *this = VulkanRenderer();
+}
@@ -0,0 +1,121 @@
+#ifndef VULKAN_RENDERER_H
+#define VULKAN_RENDERER_H
+
+#include <glad/vulkan.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+// ========== Vulkan 繪製路徑 (--vulkan, 要用 -DHW3_VULKAN=ON 建置) ==========
+// 同一份 meshes 與材質, 資料排列跟 GL 的 MDI 路徑一樣 (GpuDrawData / GpuMaterial, aDrawID 由 firstInstance 帶入),
+// shader 是同一份 vertex.glsl / fragment.glsl 加上 VULKAN 在建置時編成的 SPIR-V:
+// - 靜態幾何的 draw 預先錄在 secondary command buffer; 每幀只更新 uniform、錄一個很短的 primary
+//   (execute secondary + 讀回), 畫面大小變了才重錄
+// - 材質貼圖用 descriptor indexing 放在同一個 sampler2D 陣列, 整個場景一個 descriptor set、一條 pipeline
+// - 不建 surface / swapchain: 畫在離屏 image 再讀回來, 跟 --software 一樣交給 GL 顯示與 FrameCapture 存檔,
+//   所以只有 CPU 的機器也能用 lavapipe 跑
+// 光照是 fragment.glsl 的基本路徑 (沒有 shadow / lightmap / probe / 點光源)
+class VulkanRenderer
+{
+public:
+  // 建 instance / device / render pass, 讀 shaderDirectory 裡的 scene.vert.spv 與 scene.frag.spv
+  bool init(const std::string &shaderDirectory);
+  // 上傳頂點、材質與貼圖, 建 descriptor set 與 pipeline; visible 是要畫的 mesh index
+  bool build(const std::vector<Mesh> &meshes, const std::vector<unsigned int> &visible);
+  bool render(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &viewPos, const glm::vec3 &lightPos,
+              const glm::vec3 &lightColor, int width, int height);
+  void release();
+
+  std::vector<unsigned char> color; // width * height * 4, 由下往上 (跟 glReadPixels 一樣)
+  int width = 0, height = 0;
+  std::string deviceName;
+
+  // ---------- 統計 ----------
+  size_t drawCount = 0;     // secondary command buffer 裡的 draw 數
+  float lastRecordMs = 0.0f; // 上一幀錄 primary + submit 的 CPU 時間
+  float lastFrameMs = 0.0f;  // 上一幀含等 GPU 與讀回的時間
+
+private:
+  struct Buffer
+  {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    void *mapped = nullptr; // host visible 的 buffer 一直 map 著
+    VkDeviceSize size = 0;
+  };
+
+  struct Image
+  {
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+  };
+
+  // std140: 對應 shader 裡的 FrameUniforms (vec3 各佔 16 bytes)
+  struct FrameUniforms
+  {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 lightPos;
+    glm::vec4 viewPos;
+    glm::vec4 lightColor;
+  };
+
+  struct DrawRange
+  {
+    uint32_t indexCount, firstIndex;
+    int32_t vertexOffset;
+    uint32_t mesh; // firstInstance -> aDrawID
+  };
+
+  bool create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, bool hostVisible, Buffer &buffer);
+  bool upload_buffer(const void *data, VkDeviceSize size, VkBufferUsageFlags usage, Buffer &buffer);
+  void destroy_buffer(Buffer &buffer);
+  bool create_image(uint32_t w, uint32_t h, uint32_t levels, VkFormat format, VkImageUsageFlags usage,
+                    VkImageAspectFlags aspect, Image &image);
+  void destroy_image(Image &image);
+  uint32_t memory_type(uint32_t typeBits, VkMemoryPropertyFlags properties) const;
+  VkCommandBuffer begin_one_shot();
+  bool end_one_shot(VkCommandBuffer commands);
+
+  int load_texture(const std::string &path);
+  bool upload_texture(const unsigned char *rgba, int w, int h);
+  bool create_pipeline();
+  bool create_targets(int w, int h);
+  void destroy_targets();
+  bool record_static_draws();
+
+  VkInstance instance = VK_NULL_HANDLE;
+  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  VkQueue queue = VK_NULL_HANDLE;
+  uint32_t queueFamily = 0;
+  VkCommandPool commandPool = VK_NULL_HANDLE;
+  VkCommandBuffer frameCommands = VK_NULL_HANDLE;
+  VkCommandBuffer staticCommands = VK_NULL_HANDLE; // secondary, 只在大小改變時重錄
+  VkFence frameFence = VK_NULL_HANDLE;
+  VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  VkShaderModule vertexShader = VK_NULL_HANDLE, fragmentShader = VK_NULL_HANDLE;
+
+  VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+  VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+  VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkSampler sampler = VK_NULL_HANDLE;
+
+  Buffer vertices, indices, drawIds, draws, materials, uniforms;
+  std::vector<Image> textures; // 第 0 張是白色, 沒有貼圖的材質指到它
+  std::vector<DrawRange> ranges;
+
+  // 畫面大小相關
+  Image colorTarget, depthTarget;
+  VkFramebuffer framebuffer = VK_NULL_HANDLE;
+  Buffer readback;
+};
+
+#endif